@@ -0,0 +1,304 @@
+#include "AdpcmSample.h"
+#include <cmath>
+#include <cstring>
+
+#if defined(_M_X64) || defined(__x86_64__) || defined(__SSE2__) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#define ADPCM_SSE2
+#include <emmintrin.h>
+#endif
+
+//The four prediction filters, the ones of CD-ROM XA: none, first order and two second order ones
+static const float FILTERS[4][2] = { { 0.0f, 0.0f }, { 0.9375f, 0.0f }, { 1.796875f, -0.8125f }, { 1.53125f, -0.859375f } };
+static const int MAX_SHIFT = 12; // 2^12 / 32768 times a residual of 8 is a full scale step
+static const float MAX_SAMPLE = 32767.0f / 32768.0f;
+static const unsigned char SILENT_BLOCK[CAdpcmSample::BLOCK_BYTES] = { 0 };
+
+//Little endian 16 bit history samples of the header
+static float ReadHistory(const unsigned char *p) { return (short)(p[0] | (p[1] << 8)) / 32768.0f; }
+static short QuantiseHistory(float x)
+{
+	int v = (int)floorf(x * 32768.0f + 0.5f);
+	return (short)(v > 32767 ? 32767 : (v < -32768 ? -32768 : v));
+}
+
+//The sample a residual decodes to. The SSE2 decoder does the same operations in the same order, so both match the encoder exactly
+static inline float Reconstruct(float c1, float c2, float s1, float s2, int residual, float scale)
+{
+	float s = (c1 * s1 + c2 * s2) + residual * scale;
+	return s < -1.0f ? -1.0f : (s > MAX_SAMPLE ? MAX_SAMPLE : s);
+}
+
+CAdpcmSample::CAdpcmSample()
+{
+	m_channels = 0;
+	m_sampleRate = 0;
+	m_frames = 0;
+	m_blocks = 0;
+}
+
+CAdpcmSample::~CAdpcmSample()
+{}
+
+//Encodes every block of every channel
+void CAdpcmSample::Encode(const float *in, int channels, int sampleRate, unsigned int frames)
+{
+	m_channels = channels;
+	m_sampleRate = sampleRate;
+	m_frames = frames;
+	m_blocks = (frames + BLOCK_FRAMES - 1) / BLOCK_FRAMES;
+	m_data.assign((size_t)m_blocks * channels * BLOCK_BYTES, 0);
+	for (unsigned int b = 0; b < m_blocks; b++)
+	{
+		unsigned int count = frames - b * BLOCK_FRAMES < (unsigned int)BLOCK_FRAMES ? frames - b * BLOCK_FRAMES : BLOCK_FRAMES;
+		for (int c = 0; c < channels; c++)
+			EncodeBlock(in + (size_t)b * BLOCK_FRAMES * channels + c, channels, count, &m_data[((size_t)b * channels + c) * BLOCK_BYTES]);
+	}
+}
+
+/*
+	For every filter, the shift is first estimated from the largest open loop prediction error, and the shifts around it
+	are tried by encoding the block through the decoder. The filter and shift with the smallest squared error are kept
+*/
+void CAdpcmSample::EncodeBlock(const float *in, int stride, unsigned int count, unsigned char *block)
+{
+	float x[BLOCK_FRAMES];
+	for (int n = 0; n < BLOCK_FRAMES; n++)
+	{
+		float v = (unsigned int)n < count ? in[(size_t)n * stride] : 0.0f;
+		x[n] = v < -1.0f ? -1.0f : (v > 1.0f ? 1.0f : v);
+	}
+
+	short h0 = QuantiseHistory(x[0]), h1 = QuantiseHistory(x[1]);
+	block[1] = h0 & 0xFF;
+	block[2] = (h0 >> 8) & 0xFF;
+	block[3] = h1 & 0xFF;
+	block[4] = (h1 >> 8) & 0xFF;
+
+	unsigned char nibbles[BLOCK_FRAMES - 2];
+	double best = -1.0;
+	for (int f = 0; f < 4; f++)
+	{
+		float c1 = FILTERS[f][0], c2 = FILTERS[f][1];
+		float peak = 0.0f;
+		for (int n = 2; n < BLOCK_FRAMES; n++)
+			peak = fmaxf(peak, fabsf(x[n] - (c1 * x[n - 1] + c2 * x[n - 2])));
+		int estimate = 0;
+		while (estimate < MAX_SHIFT && peak * 32768.0f > 8.0f * (1 << estimate))
+			estimate++;
+
+		for (int shift = estimate - 1; shift <= estimate + 1; shift++)
+		{
+			if (shift < 0 || shift > MAX_SHIFT)
+				continue;
+			float scale = (1 << shift) / 32768.0f;
+			float s2 = h0 / 32768.0f, s1 = h1 / 32768.0f;
+			double error = 0.0;
+			for (int n = 2; n < BLOCK_FRAMES; n++)
+			{
+				float prediction = c1 * s1 + c2 * s2;
+				int r = (int)floorf((x[n] - prediction) / scale + 0.5f);
+				r = r < -8 ? -8 : (r > 7 ? 7 : r);
+				float s = Reconstruct(c1, c2, s1, s2, r, scale);
+				error += (double)(x[n] - s) * (x[n] - s);
+				nibbles[n - 2] = (unsigned char)(r & 0xF);
+				s2 = s1;
+				s1 = s;
+			}
+			if (best < 0.0 || error < best)
+			{
+				best = error;
+				block[0] = (unsigned char)((f << 4) | shift);
+				for (int i = 0; i < BLOCK_FRAMES - 2; i += 2)
+					block[HEADER_BYTES + i / 2] = nibbles[i] | (nibbles[i + 1] << 4);
+			}
+		}
+	}
+}
+
+//Decodes a block, sample by sample
+void CAdpcmSample::DecodeBlock(const unsigned char *block, float *out)
+{
+	float c1 = FILTERS[(block[0] >> 4) & 3][0], c2 = FILTERS[(block[0] >> 4) & 3][1];
+	float scale = (1 << (block[0] & 15)) / 32768.0f;
+	float s2 = ReadHistory(block + 1), s1 = ReadHistory(block + 3);
+	out[0] = s2;
+	out[1] = s1;
+	for (int n = 2; n < BLOCK_FRAMES; n++)
+	{
+		int nibble = (block[HEADER_BYTES + (n - 2) / 2] >> (((n - 2) & 1) * 4)) & 15;
+		float s = Reconstruct(c1, c2, s1, s2, (nibble ^ 8) - 8, scale);
+		out[n] = s;
+		s2 = s1;
+		s1 = s;
+	}
+}
+
+/*
+	Each block is a lane. Eight residuals of every block are loaded at once, as 32 bits, and shifted out nibble by
+	nibble. The samples are kept four lanes side by side and transposed into the blocks four at a time
+*/
+void CAdpcmSample::DecodeBlocks(const unsigned char *const *blocks, float *const *out)
+{
+#ifdef ADPCM_SSE2
+	float c1v[LANES], c2v[LANES], scalev[LANES], s2v[LANES], s1v[LANES];
+	for (int i = 0; i < LANES; i++)
+	{
+		int f = (blocks[i][0] >> 4) & 3;
+		c1v[i] = FILTERS[f][0];
+		c2v[i] = FILTERS[f][1];
+		scalev[i] = (1 << (blocks[i][0] & 15)) / 32768.0f;
+		s2v[i] = ReadHistory(blocks[i] + 1);
+		s1v[i] = ReadHistory(blocks[i] + 3);
+	}
+	__m128 c1 = _mm_loadu_ps(c1v), c2 = _mm_loadu_ps(c2v), scale = _mm_loadu_ps(scalev);
+	__m128 s2 = _mm_loadu_ps(s2v), s1 = _mm_loadu_ps(s1v);
+	const __m128 low = _mm_set1_ps(-1.0f), high = _mm_set1_ps(MAX_SAMPLE);
+	const __m128i mask = _mm_set1_epi32(15), sign = _mm_set1_epi32(8);
+
+	__m128 lanes[BLOCK_FRAMES];
+	lanes[0] = s2;
+	lanes[1] = s1;
+	for (int n = 2; n < BLOCK_FRAMES; n += 8)
+	{
+		int count = BLOCK_FRAMES - n < 8 ? BLOCK_FRAMES - n : 8;
+		unsigned int words[LANES] = { 0, 0, 0, 0 };
+		for (int i = 0; i < LANES; i++)
+			memcpy(&words[i], blocks[i] + HEADER_BYTES + (n - 2) / 2, (count + 1) / 2);
+		__m128i residuals = _mm_loadu_si128((const __m128i *)words);
+
+		for (int k = 0; k < count; k++)
+		{
+			__m128i nibble = _mm_and_si128(residuals, mask);
+			residuals = _mm_srli_epi32(residuals, 4);
+			__m128 r = _mm_cvtepi32_ps(_mm_sub_epi32(_mm_xor_si128(nibble, sign), sign));
+			__m128 prediction = _mm_add_ps(_mm_mul_ps(c1, s1), _mm_mul_ps(c2, s2));
+			__m128 s = _mm_min_ps(_mm_max_ps(_mm_add_ps(prediction, _mm_mul_ps(r, scale)), low), high);
+			lanes[n + k] = s;
+			s2 = s1;
+			s1 = s;
+		}
+	}
+
+	for (int n = 0; n < BLOCK_FRAMES; n += 4)
+	{
+		__m128 a = lanes[n], b = lanes[n + 1], c = lanes[n + 2], d = lanes[n + 3];
+		_MM_TRANSPOSE4_PS(a, b, c, d);
+		_mm_storeu_ps(out[0] + n, a);
+		_mm_storeu_ps(out[1] + n, b);
+		_mm_storeu_ps(out[2] + n, c);
+		_mm_storeu_ps(out[3] + n, d);
+	}
+#else
+	for (int i = 0; i < LANES; i++)
+		DecodeBlock(blocks[i], out[i]);
+#endif
+}
+
+//Getters of the class attributes
+const unsigned char *CAdpcmSample::getBlock(unsigned int block, int channel) const { return &m_data[((size_t)block * m_channels + channel) * BLOCK_BYTES]; }
+int CAdpcmSample::getChannels() const { return m_channels; }
+int CAdpcmSample::getSampleRate() const { return m_sampleRate; }
+unsigned int CAdpcmSample::getFrames() const { return m_frames; }
+unsigned int CAdpcmSample::getBlocks() const { return m_blocks; }
+size_t CAdpcmSample::getBytes() const { return m_data.size(); }
+
+CAdpcmVoice::CAdpcmVoice()
+{
+	m_sample = NULL;
+	m_position = 0;
+	m_cacheStart = 0;
+	m_cacheFrames = 0;
+	m_cache.resize((size_t)CACHE_BLOCKS * CAdpcmSample::BLOCK_FRAMES * CAdpcmSample::MAX_CHANNELS);
+	m_planar.resize(m_cache.size());
+}
+
+CAdpcmVoice::~CAdpcmVoice()
+{}
+
+//Empties the cache, so the first read decodes from the new cursor. It runs in the per-frame update, so it doesn't allocate
+void CAdpcmVoice::Start(const CAdpcmSample *sample, unsigned int frame)
+{
+	std::lock_guard<std::mutex> lock(m_mutex);
+	m_sample = sample && sample->getChannels() <= CAdpcmSample::MAX_CHANNELS ? sample : NULL;
+	m_position = m_sample && m_sample->getFrames() > 0 ? frame % m_sample->getFrames() : 0;
+	m_cacheStart = 0;
+	m_cacheFrames = 0;
+}
+
+/*
+	Copies out of the cache, decoding the next blocks whenever the cursor leaves it. The lock is only tried, so the audio
+	thread plays a block of silence rather than wait for the game thread to switch samples
+*/
+void CAdpcmVoice::Read(float *out, unsigned int frames, int channels)
+{
+	std::unique_lock<std::mutex> lock(m_mutex, std::try_to_lock);
+	if (!lock.owns_lock() || !m_sample || m_sample->getFrames() == 0)
+	{
+		memset(out, 0, (size_t)frames * channels * sizeof(float));
+		return;
+	}
+
+	int sampleChannels = m_sample->getChannels();
+	while (frames > 0)
+	{
+		if (m_position < m_cacheStart || m_position >= m_cacheStart + m_cacheFrames)
+			Decode(m_position / CAdpcmSample::BLOCK_FRAMES);
+
+		unsigned int count = m_cacheStart + m_cacheFrames - m_position;
+		if (count > frames)
+			count = frames;
+		const float *in = &m_cache[(size_t)(m_position - m_cacheStart) * sampleChannels];
+		if (sampleChannels == channels)
+			memcpy(out, in, (size_t)count * channels * sizeof(float));
+		else
+		{
+			for (unsigned int n = 0; n < count; n++)
+				for (int c = 0; c < channels; c++)
+					out[(size_t)n * channels + c] = sampleChannels == 1 ? in[n] : (c < sampleChannels ? in[(size_t)n * sampleChannels + c] : 0.0f);
+		}
+		out += (size_t)count * channels;
+		frames -= count;
+		m_position += count;
+		if (m_position >= m_sample->getFrames())
+			m_position = 0;
+	}
+}
+
+/*
+	The blocks of every channel are decoded LANES at a time, padded with silent blocks, then interleaved into the cache.
+	The cache is cut at the end of the sample
+*/
+void CAdpcmVoice::Decode(unsigned int block)
+{
+	int channels = m_sample->getChannels();
+	unsigned int blocks = m_sample->getBlocks() - block < (unsigned int)CACHE_BLOCKS ? m_sample->getBlocks() - block : CACHE_BLOCKS;
+	int count = (int)blocks * channels;
+
+	float discard[CAdpcmSample::BLOCK_FRAMES];
+	for (int first = 0; first < count; first += CAdpcmSample::LANES)
+	{
+		const unsigned char *in[CAdpcmSample::LANES];
+		float *out[CAdpcmSample::LANES];
+		for (int i = 0; i < CAdpcmSample::LANES; i++)
+		{
+			int lane = first + i;
+			in[i] = lane < count ? m_sample->getBlock(block + lane / channels, lane % channels) : SILENT_BLOCK;
+			out[i] = lane < count ? &m_planar[(size_t)lane * CAdpcmSample::BLOCK_FRAMES] : discard;
+		}
+		CAdpcmSample::DecodeBlocks(in, out);
+	}
+
+	for (int lane = 0; lane < count; lane++)
+	{
+		const float *planar = &m_planar[(size_t)lane * CAdpcmSample::BLOCK_FRAMES];
+		float *cache = &m_cache[(size_t)(lane / channels) * CAdpcmSample::BLOCK_FRAMES * channels + lane % channels];
+		for (int n = 0; n < CAdpcmSample::BLOCK_FRAMES; n++)
+			cache[(size_t)n * channels] = planar[n];
+	}
+
+	m_cacheStart = block * CAdpcmSample::BLOCK_FRAMES;
+	m_cacheFrames = m_sample->getFrames() - m_cacheStart < blocks * CAdpcmSample::BLOCK_FRAMES ? m_sample->getFrames() - m_cacheStart : blocks * CAdpcmSample::BLOCK_FRAMES;
+}
+
+//Getters of the class attributes
+const CAdpcmSample *CAdpcmVoice::getSample() const { return m_sample; }
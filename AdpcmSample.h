@@ -0,0 +1,87 @@
+#pragma once
+#include <vector>
+#include <cstddef>
+#include <mutex>
+
+// A sample held in memory as block ADPCM, about 3.8 times smaller than 16 bit PCM.
+// Each channel is cut into blocks of BLOCK_FRAMES frames. A block starts with its filter and shift and its first two
+// samples as 16 bit PCM, followed by a 4 bit residual for every other sample: the sample is the prediction of one of
+// four second order filters from the two before it, plus the residual scaled by 2^shift. As a block carries its own
+// history, any block can be decoded on its own, and four of them are decoded at once in the lanes of an SSE2 register.
+class CAdpcmSample
+{
+public:
+	static const int BLOCK_FRAMES = 128;
+	static const int HEADER_BYTES = 5; // Filter and shift, then the first two samples
+	static const int BLOCK_BYTES = HEADER_BYTES + (BLOCK_FRAMES - 2) / 2;
+	static const int LANES = 4; // Blocks decoded at once
+	static const int MAX_CHANNELS = 8; // Most channels a voice plays, 7.1. The loaders reject samples with more
+
+	CAdpcmSample(); //Constructor
+	~CAdpcmSample(); //Destructor
+
+	//Encodes frames frames of interleaved samples. The encoder decodes every block the way the decoder will, so the
+	//errors don't add up from one sample to the next
+	void Encode(const float *in, int channels, int sampleRate, unsigned int frames);
+
+	//Decodes a block into BLOCK_FRAMES samples
+	static void DecodeBlock(const unsigned char *block, float *out);
+	//Decodes LANES blocks at once, block i into out[i]
+	static void DecodeBlocks(const unsigned char *const *blocks, float *const *out);
+
+	//Returns block block of channel channel
+	const unsigned char *getBlock(unsigned int block, int channel) const;
+	//Getters of the class attributes
+	int getChannels() const;
+	int getSampleRate() const;
+	unsigned int getFrames() const;
+	unsigned int getBlocks() const;
+	size_t getBytes() const;
+
+private:
+	//Encodes count samples, stride apart in in, into a block. The rest of the block is silence
+	static void EncodeBlock(const float *in, int stride, unsigned int count, unsigned char *block);
+
+	std::vector<unsigned char> m_data; // The blocks of every channel for the first frames, then for the next ones...
+	int m_channels;
+	int m_sampleRate;
+	unsigned int m_frames;
+	unsigned int m_blocks; // Blocks of each channel
+};
+
+// Plays a CAdpcmSample in a loop, decoding only the few blocks just ahead of its cursor: a voice decodes the next
+// CACHE_BLOCKS blocks of every channel when its cursor leaves the ones it has, and copies frames out of them.
+// The same voice plays one sample after another for the stream of a channel, which is created once: the game thread
+// points it at a new sample while the audio thread may be reading it, and the audio thread never waits for that.
+// The buffers are sized for samples of MAX_CHANNELS channels when the voice is created, so starting a sample never
+// allocates.
+class CAdpcmVoice
+{
+public:
+	static const int CACHE_BLOCKS = CAdpcmSample::LANES; // Blocks of each channel decoded ahead of the cursor
+
+	CAdpcmVoice(); //Constructor: sizes the buffers for samples of up to CAdpcmSample::MAX_CHANNELS channels
+	~CAdpcmVoice(); //Destructor
+
+	//Game thread: plays a sample from a frame, or silence for NULL or a sample of more than MAX_CHANNELS channels. It
+	//waits for a read in progress, so the previous sample isn't used any more once it returns
+	void Start(const CAdpcmSample *sample, unsigned int frame);
+	//Audio thread: copies the next frames of the sample into out, interleaved in channels channels, starting it again at
+	//its end. A mono sample is copied to every channel, otherwise the channels the sample lacks are silent. A read
+	//while Start runs plays silence
+	void Read(float *out, unsigned int frames, int channels);
+
+	//Getters of the class attributes
+	const CAdpcmSample *getSample() const;
+
+private:
+	//Decodes CACHE_BLOCKS blocks of every channel from block block into the cache
+	void Decode(unsigned int block);
+
+	const CAdpcmSample *m_sample;
+	unsigned int m_position; // Frame of the cursor
+	unsigned int m_cacheStart, m_cacheFrames; // Frames in the cache
+	std::vector<float> m_cache; // The decoded frames, interleaved
+	std::vector<float> m_planar; // The decoded blocks, one after the other
+	std::mutex m_mutex; // Held by Start, and by Read unless Start has it
+};
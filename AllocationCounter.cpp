@@ -0,0 +1,36 @@
+#include "AllocationCounter.h"
+#include <cstdlib>
+#include <new>
+
+#ifdef _DEBUG
+// Per thread, so the allocations of the mixer and loader threads don't show up in the game thread's count
+static thread_local unsigned long long allocations = 0;
+
+/*
+	The replaceable global operator new. The array and nothrow forms call it by default, and the default deletes
+	end up in operator delete(void *), so these two cover every allocation that doesn't ask for an extended alignment
+*/
+void *operator new(size_t size)
+{
+	allocations++;
+	void *p = malloc(size ? size : 1);
+	if (p == NULL)
+		throw std::bad_alloc();
+	return p;
+}
+
+void operator delete(void *p) noexcept
+{
+	free(p);
+}
+#endif
+
+//Allocations made by the calling thread since it started
+unsigned long long CAllocationCounter::getAllocations()
+{
+#ifdef _DEBUG
+	return allocations;
+#else
+	return 0;
+#endif
+}
@@ -0,0 +1,21 @@
+#pragma once
+
+// Counts the heap allocations made through operator new by the calling thread, so a code path that must not allocate
+// (the per-frame audio update) can check it. The count is only kept in debug builds, where operator new is replaced;
+// in release builds it stays at zero and the checks compile away.
+class CAllocationCounter
+{
+public:
+	//Allocations made by the calling thread since it started
+	static unsigned long long getAllocations();
+};
+
+#ifdef _DEBUG
+#include <assert.h>
+//Asserts that the code between the two macros doesn't allocate on this thread
+#define BEGIN_NO_ALLOCATIONS() unsigned long long allocationsBefore = CAllocationCounter::getAllocations()
+#define END_NO_ALLOCATIONS() assert(CAllocationCounter::getAllocations() == allocationsBefore)
+#else
+#define BEGIN_NO_ALLOCATIONS()
+#define END_NO_ALLOCATIONS()
+#endif
@@ -0,0 +1,398 @@
+#include "AmbisonicDecoder.h"
+#include <cstring>
+#include <algorithm>
+#include <math.h>
+
+static const float DEGREES = 3.14159265f / 180.0f;
+// Above this frequency, in Hz, the responses are aligned before they are projected onto the harmonics
+static const float ALIGN_FREQUENCY = 2000.0f;
+static const float ALIGN_WIDTH = 1000.0f; // Width of the crossover
+// Marks the LFE channel of a speaker layout, which gets nothing from the bus
+static const float LFE = 1000.0f;
+
+//Azimuths of the speakers of each speaker mode of the mixer, in its channel order, clockwise from the front
+static const float QUAD[4] = { -45.0f, 45.0f, -135.0f, 135.0f };
+static const float SURROUND[5] = { -30.0f, 30.0f, 0.0f, -110.0f, 110.0f };
+static const float SURROUND51[6] = { -30.0f, 30.0f, 0.0f, LFE, -110.0f, 110.0f };
+static const float SURROUND71[8] = { -30.0f, 30.0f, 0.0f, LFE, -90.0f, 90.0f, -150.0f, 150.0f };
+
+//The direction of an azimuth and an elevation of the listener in the frame of the bus: x to the front, y to the left
+//and z up
+static void Direction(float azimuth, float elevation, float *direction)
+{
+	direction[0] = cosf(elevation * DEGREES) * cosf(azimuth * DEGREES);
+	direction[1] = -cosf(elevation * DEGREES) * sinf(azimuth * DEGREES);
+	direction[2] = sinf(elevation * DEGREES);
+}
+
+/*
+	A sound encoded from direction s and decoded with harmonic responses H is heard through the sum over the grid of
+	K(s, d) h(d), where K is the sum of (2l + 1) times the Legendre polynomial of order l of the angle between s and d.
+	That is the third order approximation of a spike at s, so the responses are the HRIRs of the grid weighted by the
+	harmonics times (2l + 1) and by the area around each point. Every point of the grid is used once: the azimuth 360
+	repeats 0.
+	Third order can't follow how the delay of an ear changes with the direction above about 2 kHz, and the delayed
+	copies would blur into each other, so above ALIGN_FREQUENCY every response is moved to start with the earliest one.
+	The high frequencies keep the level differences between the ears, which is what the ear uses up there
+*/
+CAmbisonicDecoder::CAmbisonicDecoder(const CHrirSet &set)
+	: m_fft(2 * set.getBlockSize())
+{
+	m_kernel = CHrtfFilter::SelectKernel();
+	m_block = set.getBlockSize();
+	m_bins = set.getBins();
+	m_partitions = set.getPartitions();
+	int spectrum = m_partitions * m_bins;
+
+	const CMorphBank &responses = set.getResponses();
+	int taps = set.getTaps();
+	int size = 2;
+	while (size < 2 * taps)
+		size *= 2;
+	CFft fft(size);
+	int bins = fft.getBins();
+
+	//The onset of each response is its first sample at half its peak
+	std::vector<int> onsets(2 * responses.getCount());
+	int earliest = taps;
+	for (int i = 0; i < responses.getCount(); i++)
+	{
+		for (int ear = 0; ear < 2; ear++)
+		{
+			const float *h = responses.getEntry(i) + ear * taps;
+			float peak = 0.0f;
+			for (int n = 0; n < taps; n++)
+				peak = std::max(peak, fabsf(h[n]));
+			int onset = 0;
+			while (onset < taps - 1 && fabsf(h[onset]) < 0.5f * peak)
+				onset++;
+			onsets[2 * i + ear] = onset;
+			earliest = std::min(earliest, onset);
+		}
+	}
+
+	//Share of the aligned response in each bin, rising over ALIGN_WIDTH around ALIGN_FREQUENCY
+	std::vector<float> aligned(bins);
+	for (int k = 0; k < bins; k++)
+	{
+		float f = (float)k * set.getSampleRate() / size;
+		float x = (f - ALIGN_FREQUENCY) / ALIGN_WIDTH + 0.5f;
+		aligned[k] = x <= 0.0f ? 0.0f : (x >= 1.0f ? 1.0f : 0.5f - 0.5f * cosf(3.14159265f * x));
+	}
+
+	std::vector<float> segment(size), re(bins), im(bins);
+	std::vector<double> projected((size_t)2 * CHANNELS * 2 * bins, 0.0);
+	int azimuths = CHrirSet::AZIMUTHS - 1;
+	double total = 0.0;
+	for (int e = 0; e < CHrirSet::ELEVATIONS; e++)
+	{
+		float elevation = -90.0f + e * 180.0f / (CHrirSet::ELEVATIONS - 1);
+		float area = cosf(elevation * DEGREES);
+		if (area <= 1e-6f)
+			continue;
+		for (int a = 0; a < azimuths; a++)
+		{
+			float direction[3], gains[CHANNELS];
+			Direction(a * 360.0f / azimuths, elevation, direction);
+			CAmbisonicEncoder::Encode(direction[0], direction[1], direction[2], gains);
+			int index = a + e * CHrirSet::AZIMUTHS;
+			for (int ear = 0; ear < 2; ear++)
+			{
+				std::fill(segment.begin(), segment.end(), 0.0f);
+				memcpy(segment.data(), responses.getEntry(index) + ear * taps, taps * sizeof(float));
+				fft.Forward(segment.data(), re.data(), im.data());
+
+				//Moving the response earlier by shift samples turns each bin forward by 2 pi k shift / size
+				int shift = onsets[2 * index + ear] - earliest;
+				for (int k = 0; k < bins; k++)
+				{
+					float phase = 2.0f * 3.14159265f * k * shift / size;
+					float turnedRe = re[k] * cosf(phase) - im[k] * sinf(phase);
+					float turnedIm = re[k] * sinf(phase) + im[k] * cosf(phase);
+					re[k] += aligned[k] * (turnedRe - re[k]);
+					im[k] += aligned[k] * (turnedIm - im[k]);
+				}
+
+				for (int c = 0; c < CHANNELS; c++)
+				{
+					int order = (int)sqrtf((float)c);
+					double weight = area * (2 * order + 1) * gains[c];
+					double *p = &projected[(size_t)(ear * CHANNELS + c) * 2 * bins];
+					for (int k = 0; k < bins; k++)
+					{
+						p[k] += weight * re[k];
+						p[bins + k] += weight * im[k];
+					}
+				}
+			}
+			total += area;
+		}
+	}
+
+	//Back to taps long responses, then into partition spectra as in CHrirSet::Transform
+	m_filters.assign((size_t)2 * CHANNELS * 2 * spectrum, 0.0f);
+	std::vector<float> response(size), block(2 * m_block);
+	for (int f = 0; f < 2 * CHANNELS; f++)
+	{
+		const double *p = &projected[(size_t)f * 2 * bins];
+		for (int k = 0; k < bins; k++)
+		{
+			re[k] = (float)(p[k] / total);
+			im[k] = (float)(p[bins + k] / total);
+		}
+		fft.Inverse(re.data(), im.data(), response.data());
+
+		float *filterRe = &m_filters[(size_t)f * 2 * spectrum];
+		float *filterIm = filterRe + spectrum;
+		for (int p = 0; p < m_partitions; p++)
+		{
+			std::fill(block.begin(), block.end(), 0.0f);
+			for (int n = 0; n < m_block && p * m_block + n < taps; n++)
+				block[n] = response[p * m_block + n];
+			m_fft.Forward(block.data(), &filterRe[p * m_bins], &filterIm[p * m_bins]);
+		}
+	}
+
+	m_input.assign((size_t)CHANNELS * 2 * m_block, 0.0f);
+	m_fdlRe.assign((size_t)CHANNELS * spectrum, 0.0f);
+	m_fdlIm.assign((size_t)CHANNELS * spectrum, 0.0f);
+	m_left.assign(m_block, 0.0f);
+	m_right.assign(m_block, 0.0f);
+	m_accRe.resize(m_bins);
+	m_accIm.resize(m_bins);
+	m_time.resize(2 * m_block);
+	m_fill = 0;
+	m_fdlPos = 0;
+
+	//Starts facing the frame of the bus
+	memset(m_rotation, 0, sizeof(m_rotation));
+	for (int c = 0; c < CHANNELS; c++)
+		m_rotation[c * CHANNELS + c] = 1.0f;
+	m_layout = 0;
+}
+
+CAmbisonicDecoder::~CAmbisonicDecoder()
+{}
+
+/*
+	The bus is rotated for the whole block first. The binaural decode then collects it like CHrtfFilter, a block of the
+	set at a time, and the speaker decode mixes it straight into the output
+*/
+void CAmbisonicDecoder::Process(const float *in, int inChannels, float *out, int outChannels, unsigned int frames, const float *rotation, bool binaural)
+{
+	if (m_rotated.size() < (size_t)CHANNELS * frames)
+		Prepare(frames);
+	Rotate(in, inChannels, frames, rotation);
+
+	if (!binaural)
+	{
+		if (outChannels != m_layout)
+			SetLayout(outChannels);
+		int speakers = std::min(outChannels, (int)MAX_SPEAKERS);
+		memset(out, 0, (size_t)frames * outChannels * sizeof(float));
+		for (int s = 0; s < speakers; s++)
+		{
+			const float *beam = &m_decode[s * CHANNELS];
+			for (int c = 0; c < CHANNELS; c++)
+			{
+				if (beam[c] == 0.0f)
+					continue;
+				const float *r = &m_rotated[(size_t)c * frames];
+				for (unsigned int n = 0; n < frames; n++)
+					out[n * outChannels + s] += beam[c] * r[n];
+			}
+		}
+		return;
+	}
+
+	unsigned int done = 0;
+	while (done < frames)
+	{
+		unsigned int n = m_block - m_fill;
+		if (n > frames - done)
+			n = frames - done;
+
+		for (int c = 0; c < CHANNELS; c++)
+			memcpy(&m_input[(size_t)(2 * c + 1) * m_block + m_fill], &m_rotated[(size_t)c * frames + done], n * sizeof(float));
+		if (outChannels == 1)
+		{
+			for (unsigned int i = 0; i < n; i++)
+				out[done + i] = 0.5f * (m_left[m_fill + i] + m_right[m_fill + i]);
+		}
+		else
+		{
+			memset(out + (size_t)done * outChannels, 0, (size_t)n * outChannels * sizeof(float));
+			for (unsigned int i = 0; i < n; i++)
+			{
+				out[(done + i) * outChannels] = m_left[m_fill + i];
+				out[(done + i) * outChannels + 1] = m_right[m_fill + i];
+			}
+		}
+
+		m_fill += n;
+		done += n;
+
+		if (m_fill == m_block)
+		{
+			ProcessBlock();
+			m_fill = 0;
+		}
+	}
+}
+
+/*
+	A channel of order l only takes from the 2l + 1 channels of the same order. The matrix of each sample is the one of
+	the last block plus a growing share of the difference, so the sound turns smoothly however fast the camera does
+*/
+void CAmbisonicDecoder::Rotate(const float *in, int inChannels, unsigned int frames, const float *rotation)
+{
+	int channels = std::min(inChannels, (int)CHANNELS);
+	bool moved = memcmp(rotation, m_rotation, sizeof(m_rotation)) != 0;
+	for (int k = 0; k < CHANNELS * CHANNELS; k++)
+		m_delta[k] = rotation[k] - m_rotation[k];
+
+	float step = 1.0f / frames;
+	for (unsigned int n = 0; n < frames; n++)
+	{
+		const float *b = in + (size_t)n * inChannels;
+		float mix = (n + 1) * step;
+		for (int l = 0; l <= CAmbisonicEncoder::ORDER; l++)
+		{
+			int first = l * l, last = std::min((l + 1) * (l + 1), channels);
+			for (int i = l * l; i < (l + 1) * (l + 1); i++)
+			{
+				const float *row = &m_rotation[i * CHANNELS];
+				float sum = 0.0f;
+				for (int j = first; j < last; j++)
+					sum += row[j] * b[j];
+				if (moved)
+				{
+					const float *delta = &m_delta[i * CHANNELS];
+					float change = 0.0f;
+					for (int j = first; j < last; j++)
+						change += delta[j] * b[j];
+					sum += mix * change;
+				}
+				m_rotated[(size_t)i * frames + n] = sum;
+			}
+		}
+	}
+	memcpy(m_rotation, rotation, sizeof(m_rotation));
+}
+
+//Overlap-save as in CHrtfFilter, with the FFT of every channel into its own delay line and all of them summed per ear
+void CAmbisonicDecoder::ProcessBlock()
+{
+	int spectrum = m_partitions * m_bins;
+	for (int c = 0; c < CHANNELS; c++)
+	{
+		float *re = &m_fdlRe[(size_t)c * spectrum + m_fdlPos * m_bins];
+		float *im = &m_fdlIm[(size_t)c * spectrum + m_fdlPos * m_bins];
+		m_fft.Forward(&m_input[(size_t)c * 2 * m_block], re, im);
+	}
+
+	float *outputs[2] = { m_left.data(), m_right.data() };
+	for (int ear = 0; ear < 2; ear++)
+	{
+		memset(m_accRe.data(), 0, m_bins * sizeof(float));
+		memset(m_accIm.data(), 0, m_bins * sizeof(float));
+		for (int c = 0; c < CHANNELS; c++)
+		{
+			const float *hRe = &m_filters[(size_t)(ear * CHANNELS + c) * 2 * spectrum];
+			const float *hIm = hRe + spectrum;
+			for (int p = 0; p < m_partitions; p++)
+			{
+				int slot = m_fdlPos - p;
+				if (slot < 0)
+					slot += m_partitions;
+				size_t x = (size_t)c * spectrum + slot * m_bins;
+				m_kernel(&m_fdlRe[x], &m_fdlIm[x], hRe + p * m_bins, hIm + p * m_bins, m_accRe.data(), m_accIm.data(), m_bins);
+			}
+		}
+		m_fft.Inverse(m_accRe.data(), m_accIm.data(), m_time.data());
+		memcpy(outputs[ear], &m_time[m_block], m_block * sizeof(float));
+	}
+
+	//The block just filled becomes the previous block of every channel
+	for (int c = 0; c < CHANNELS; c++)
+		memmove(&m_input[(size_t)c * 2 * m_block], &m_input[(size_t)(2 * c + 1) * m_block], m_block * sizeof(float));
+	m_fdlPos = (m_fdlPos + 1) % m_partitions;
+}
+
+/*
+	Each speaker gets a beam pointing at it: the harmonics of its direction weighted per order. Rings of four or more
+	speakers use the max rE weights of the highest order the ring can show, about half its speakers, normalised to 1
+	towards the speaker. Stereo gets two cardioids pointing to the sides, so the sounds behind the listener are still
+	heard, and mono the omnidirectional channel
+*/
+void CAmbisonicDecoder::SetLayout(int outChannels)
+{
+	memset(m_decode, 0, sizeof(m_decode));
+	m_layout = outChannels;
+
+	const float *azimuths = NULL;
+	int speakers = 0, order = 0;
+	float weights[CAmbisonicEncoder::ORDER + 1] = { 1.0f, 0.0f, 0.0f, 0.0f };
+	static const float STEREO[2] = { -90.0f, 90.0f };
+	switch (outChannels)
+	{
+	case 1:
+		m_decode[0] = 1.0f;
+		return;
+	case 2: azimuths = STEREO; speakers = 2; break;
+	case 4: azimuths = QUAD; speakers = 4; order = 1; break;
+	case 5: azimuths = SURROUND; speakers = 5; order = 2; break;
+	case 6: azimuths = SURROUND51; speakers = 6; order = 2; break;
+	case 8: azimuths = SURROUND71; speakers = 8; order = 3; break;
+	default: azimuths = STEREO; speakers = std::min(outChannels, 2); break;
+	}
+
+	if (order == 0)
+	{
+		weights[0] = 0.5f;
+		weights[1] = 0.5f;
+	}
+	else
+	{
+		float c = cosf(137.9f / (order + 1.51f) * DEGREES);
+		float legendre[CAmbisonicEncoder::ORDER + 1] = { 1.0f, c, 0.5f * (3.0f * c * c - 1.0f), 0.5f * c * (5.0f * c * c - 3.0f) };
+		float total = 0.0f;
+		for (int l = 0; l <= order; l++)
+			total += (2 * l + 1) * legendre[l];
+		for (int l = 0; l <= order; l++)
+			weights[l] = (2 * l + 1) * legendre[l] / total;
+	}
+
+	for (int s = 0; s < speakers; s++)
+	{
+		if (azimuths[s] == LFE)
+			continue;
+		float direction[3], gains[CHANNELS];
+		Direction(azimuths[s], 0.0f, direction);
+		CAmbisonicEncoder::Encode(direction[0], direction[1], direction[2], gains);
+		for (int c = 0; c < CHANNELS; c++)
+			m_decode[s * CHANNELS + c] = weights[(int)sqrtf((float)c)] * gains[c];
+	}
+}
+
+//Clears the history. The rotation carries on from where it was
+void CAmbisonicDecoder::Reset()
+{
+	std::fill(m_input.begin(), m_input.end(), 0.0f);
+	std::fill(m_fdlRe.begin(), m_fdlRe.end(), 0.0f);
+	std::fill(m_fdlIm.begin(), m_fdlIm.end(), 0.0f);
+	std::fill(m_left.begin(), m_left.end(), 0.0f);
+	std::fill(m_right.begin(), m_right.end(), 0.0f);
+	m_fill = 0;
+	m_fdlPos = 0;
+}
+
+//Grows the buffers for blocks of up to frames frames
+void CAmbisonicDecoder::Prepare(unsigned int frames)
+{
+	if (m_rotated.size() < (size_t)CHANNELS * frames)
+		m_rotated.resize((size_t)CHANNELS * frames);
+}
+
+//Getters of the class attributes
+int CAmbisonicDecoder::getLatency() { return m_block; }
@@ -0,0 +1,56 @@
+#pragma once
+#include <vector>
+#include "AmbisonicEncoder.h"
+#include "Fft.h"
+#include "HrtfFilter.h"
+
+// Turns a third order ambisonic bus towards the listener and decodes it, either to a pair of ears or to the speakers of
+// the mixer. The bus is rotated sample by sample, the matrix moving linearly from the previous block's to the new one.
+// The binaural decode convolves each of the 16 channels with the response of its harmonic, the HRIRs of a CHrirSet
+// projected onto it, in partitions like CHrtfFilter, so the cost doesn't depend on how many sounds the bus carries. Its
+// output is delayed by one block of the set. The speaker decode is a matrix of beams, one per speaker, and has no delay.
+class CAmbisonicDecoder
+{
+public:
+	static const int CHANNELS = CAmbisonicEncoder::CHANNELS;
+	static const int MAX_SPEAKERS = 8; // 7.1, the largest speaker mode of the mixer
+
+	CAmbisonicDecoder(const CHrirSet &set); //Projects the spectra of a transformed set onto the harmonics
+	~CAmbisonicDecoder(); //Destructor
+
+	//Decodes frames frames of interleaved bus channels into interleaved output channels, rotated by rotation (a matrix
+	//from CAmbisonicEncoder::Rotation). Missing bus channels are taken as silent. The binaural pair goes to the first two
+	//output channels, or their average to a single one
+	void Process(const float *in, int inChannels, float *out, int outChannels, unsigned int frames, const float *rotation, bool binaural);
+	//Clears the history
+	void Reset();
+	//Grows the buffers for blocks of up to frames frames, so Process doesn't allocate later
+	void Prepare(unsigned int frames);
+	//Getters of the class attributes
+	int getLatency();
+
+private:
+	//Rotates frames frames of the bus into m_rotated, one channel after the other
+	void Rotate(const float *in, int inChannels, unsigned int frames, const float *rotation);
+	//Filters the block of every channel that has just been filled into both ears
+	void ProcessBlock();
+	//Builds the beams of the speakers of a mixer with outChannels channels
+	void SetLayout(int outChannels);
+
+	CFft m_fft; // FFT of twice the block size
+	SpectrumKernelFunc m_kernel; // Multiply-accumulate for the instruction set of the CPU
+	int m_block, m_bins, m_partitions;
+	std::vector<float> m_filters; // Partition spectra of each harmonic for each ear: real parts, then imaginary parts
+	std::vector<float> m_input; // The previous block followed by the block being filled, for each channel
+	std::vector<float> m_fdlRe, m_fdlIm; // Spectra of the last partitions input blocks of each channel
+	std::vector<float> m_left, m_right; // The last filtered block, read while the next one is filled
+	std::vector<float> m_accRe, m_accIm; // Spectrum of the block being filtered
+	std::vector<float> m_time; // Time domain result of the block being filtered
+	std::vector<float> m_rotated; // The rotated bus of the block being processed
+	int m_fill; // Samples in the block being filled
+	int m_fdlPos; // Position of the newest spectra in the delay line
+	float m_rotation[CHANNELS * CHANNELS]; // The matrix the last block ended with
+	float m_delta[CHANNELS * CHANNELS]; // From that matrix to the one of the block being rotated
+	float m_decode[MAX_SPEAKERS * CHANNELS]; // Beam of each speaker
+	int m_layout; // Output channels m_decode was built for
+};
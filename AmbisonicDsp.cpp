@@ -0,0 +1,126 @@
+#include "AmbisonicDsp.h"
+#include <cstring>
+
+#if defined(_M_X64) || defined(__x86_64__) || defined(__SSE2__) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#define AMBISONIC_SSE2
+#include <emmintrin.h>
+#endif
+
+static const int CHANNELS = CAmbisonicEncoder::CHANNELS;
+
+//Starts with the voice in front of the listener, in the frame of the bus
+CAmbisonicEncoderDsp::CAmbisonicEncoderDsp()
+{
+	ambisonic_gains_t &gains = m_gains.Write();
+	CAmbisonicEncoder::Encode(1.0f, 0.0f, 0.0f, gains.gains);
+	memcpy(m_current, gains.gains, sizeof(m_current));
+	m_gains.Publish();
+	m_gains.Update();
+	m_reset.store(false, std::memory_order_relaxed);
+}
+
+CAmbisonicEncoderDsp::~CAmbisonicEncoderDsp()
+{}
+
+/*
+	Every frame is the mono sample times the 16 gains, which are four SSE2 vectors. The gains move linearly from the ones
+	the last block ended with to the newest ones over the block, so a moving voice doesn't click
+*/
+void CAmbisonicEncoderDsp::Read(const float *in, float *out, unsigned int length, int inChannels)
+{
+	m_gains.Update();
+	const float *target = m_gains.Read().gains;
+	if (m_reset.load(std::memory_order_relaxed) && m_reset.exchange(false, std::memory_order_acquire))
+		memcpy(m_current, target, sizeof(m_current));
+
+	float step[CHANNELS], gains[CHANNELS];
+	for (int c = 0; c < CHANNELS; c++)
+	{
+		step[c] = (target[c] - m_current[c]) / length;
+		gains[c] = m_current[c];
+	}
+
+	float scale = 1.0f / inChannels;
+	for (unsigned int n = 0; n < length; n++)
+	{
+		float mono = in[n * inChannels];
+		for (int c = 1; c < inChannels; c++)
+			mono += in[n * inChannels + c];
+		mono *= scale;
+
+		float *o = out + (size_t)n * CHANNELS;
+#ifdef AMBISONIC_SSE2
+		__m128 s = _mm_set1_ps(mono);
+		for (int c = 0; c < CHANNELS; c += 4)
+		{
+			__m128 g = _mm_add_ps(_mm_loadu_ps(gains + c), _mm_loadu_ps(step + c));
+			_mm_storeu_ps(gains + c, g);
+			_mm_storeu_ps(o + c, _mm_mul_ps(s, g));
+		}
+#else
+		for (int c = 0; c < CHANNELS; c++)
+		{
+			gains[c] += step[c];
+			o[c] = mono * gains[c];
+		}
+#endif
+	}
+	memcpy(m_current, target, sizeof(m_current));
+}
+
+//The next block starts at the newest gains
+void CAmbisonicEncoderDsp::Reset()
+{
+	m_reset.store(true, std::memory_order_release);
+}
+
+//Hands new gains to the mixer thread
+void CAmbisonicEncoderDsp::SetGains(const ambisonic_gains_t &gains)
+{
+	m_gains.Write() = gains;
+	m_gains.Publish();
+}
+
+//Creates the decoder with the spectra of a transformed set. The listener starts facing the frame of the bus
+CAmbisonicDecoderDsp::CAmbisonicDecoderDsp(const CHrirSet &set)
+	: m_decoder(set)
+{
+	ambisonic_rotation_t &rotation = m_rotation.Write();
+	memset(rotation.matrix, 0, sizeof(rotation.matrix));
+	for (int c = 0; c < CHANNELS; c++)
+		rotation.matrix[c * CHANNELS + c] = 1.0f;
+	m_rotation.Publish();
+	m_rotation.Update();
+	m_binaural.store(true, std::memory_order_relaxed);
+}
+
+CAmbisonicDecoderDsp::~CAmbisonicDecoderDsp()
+{}
+
+//Takes the newest orientation once for the whole block. The decoder turns to it over the block
+void CAmbisonicDecoderDsp::Read(const float *in, float *out, unsigned int length, int inChannels, int outChannels)
+{
+	m_rotation.Update();
+	m_decoder.Process(in, inChannels, out, outChannels, length, m_rotation.Read().matrix, m_binaural.load(std::memory_order_relaxed));
+}
+
+//Grows the buffers for blocks of up to frames frames
+void CAmbisonicDecoderDsp::Prepare(unsigned int frames)
+{
+	m_decoder.Prepare(frames);
+}
+
+//Hands a new orientation to the mixer thread
+void CAmbisonicDecoderDsp::SetRotation(const ambisonic_rotation_t &rotation)
+{
+	m_rotation.Write() = rotation;
+	m_rotation.Publish();
+}
+
+//Decodes to the pair of ears, or to the speakers of the mixer
+void CAmbisonicDecoderDsp::SetBinaural(bool binaural)
+{
+	m_binaural.store(binaural, std::memory_order_relaxed);
+}
+
+bool CAmbisonicDecoderDsp::getBinaural() const { return m_binaural.load(std::memory_order_relaxed); }
@@ -0,0 +1,66 @@
+#pragma once
+#include <atomic>
+#include <vector>
+#include "AmbisonicDecoder.h"
+#include "TripleBuffer.h"
+
+// Gains of a voice into the channels of the ambisonic bus, from CAmbisonicEncoder
+typedef struct
+{
+	float gains[CAmbisonicEncoder::CHANNELS];
+} ambisonic_gains_t;
+
+// Orientation of the listener in the frame of the ambisonic bus, from CAmbisonicEncoder::Rotation
+typedef struct
+{
+	float matrix[CAmbisonicEncoder::CHANNELS * CAmbisonicEncoder::CHANNELS];
+} ambisonic_rotation_t;
+
+// The state of an ambisonic encoder DSP, one per voice. Like CHrtfDsp it doesn't depend on FMOD: the game thread sets
+// the gains of the voice and the mixer thread picks them up through a triple buffer. The input is mixed down to mono and
+// spread over the CHANNELS channels of the bus, the gains moving linearly over the block from the previous ones.
+class CAmbisonicEncoderDsp
+{
+public:
+	CAmbisonicEncoderDsp(); //Starts with the voice in front of the listener
+	~CAmbisonicEncoderDsp(); //Destructor
+
+	//Mixer thread: encodes one block of interleaved samples into CHANNELS interleaved channels
+	void Read(const float *in, float *out, unsigned int length, int inChannels);
+	//Any thread: the next block starts at the newest gains instead of moving to them, e.g. when the DSP moves to
+	//another channel
+	void Reset();
+
+	//Game thread: hands new gains to the mixer thread
+	void SetGains(const ambisonic_gains_t &gains);
+
+private:
+	CTripleBuffer<ambisonic_gains_t> m_gains; // Gains handed from the game thread to the mixer thread
+	float m_current[CAmbisonicEncoder::CHANNELS]; // Gains the last block ended with
+	std::atomic<bool> m_reset; // Set by Reset, cleared by the mixer thread
+};
+
+// The state of the ambisonic decoder DSP at the head of the bus. The game thread sets the orientation of the listener
+// once per frame and chooses between the binaural and the speaker decode.
+class CAmbisonicDecoderDsp
+{
+public:
+	CAmbisonicDecoderDsp(const CHrirSet &set); //Creates the decoder with the spectra of a transformed set
+	~CAmbisonicDecoderDsp(); //Destructor
+
+	//Mixer thread: rotates and decodes one block of the bus into outChannels interleaved channels
+	void Read(const float *in, float *out, unsigned int length, int inChannels, int outChannels);
+	//Grows the buffers for blocks of up to frames frames, so Read doesn't allocate later. Called before the DSP is used
+	void Prepare(unsigned int frames);
+
+	//Game thread: hands a new orientation of the listener to the mixer thread
+	void SetRotation(const ambisonic_rotation_t &rotation);
+	//Any thread: decodes to the pair of ears, or to the speakers of the mixer
+	void SetBinaural(bool binaural);
+	bool getBinaural() const;
+
+private:
+	CAmbisonicDecoder m_decoder; // Only touched by the mixer thread
+	CTripleBuffer<ambisonic_rotation_t> m_rotation; // Orientation handed from the game thread to the mixer thread
+	std::atomic<bool> m_binaural;
+};
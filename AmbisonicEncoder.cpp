@@ -0,0 +1,248 @@
+#include "AmbisonicEncoder.h"
+#include <math.h>
+
+#if defined(_M_X64) || defined(__x86_64__) || defined(__SSE2__) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#define AMBISONIC_SSE2
+#include <emmintrin.h>
+#endif
+
+// SN3D factors of the second and third order harmonics
+static const float SQRT3 = 1.7320508f;
+static const float SQRT3_2 = 0.8660254f; // sqrt(3) / 2
+static const float SQRT5_8 = 0.7905694f; // sqrt(5 / 8)
+static const float SQRT15 = 3.8729833f;
+static const float SQRT3_8 = 0.6123724f; // sqrt(3 / 8)
+static const float SQRT15_2 = 1.9364917f; // sqrt(15) / 2
+// Closer than this to the listener an emitter is heard from the direction it has at this distance
+static const float MIN_DISTANCE = 1e-3f;
+// Directions the rotation matrices are fitted on, more than the channels so the fit is well conditioned
+static const int FIT_POINTS = 32;
+
+//Constructor
+CAmbisonicEncoder::CAmbisonicEncoder()
+{
+	m_capacity = 0;
+}
+
+CAmbisonicEncoder::~CAmbisonicEncoder()
+{}
+
+//The harmonics are polynomials of the coordinates of the unit direction
+void CAmbisonicEncoder::Encode(float x, float y, float z, float *gains)
+{
+	float x2 = x * x, y2 = y * y, z2 = z * z;
+	gains[0] = 1.0f;
+	gains[1] = y;
+	gains[2] = z;
+	gains[3] = x;
+	gains[4] = SQRT3 * x * y;
+	gains[5] = SQRT3 * y * z;
+	gains[6] = 0.5f * (3.0f * z2 - 1.0f);
+	gains[7] = SQRT3 * x * z;
+	gains[8] = SQRT3_2 * (x2 - y2);
+	gains[9] = SQRT5_8 * y * (3.0f * x2 - y2);
+	gains[10] = SQRT15 * x * y * z;
+	gains[11] = SQRT3_8 * y * (5.0f * z2 - 1.0f);
+	gains[12] = 0.5f * z * (5.0f * z2 - 3.0f);
+	gains[13] = SQRT3_8 * x * (5.0f * z2 - 1.0f);
+	gains[14] = SQRT15_2 * z * (x2 - y2);
+	gains[15] = SQRT5_8 * x * (x2 - 3.0f * y2);
+}
+
+//The least squares fit of the harmonics on FIT_POINTS directions, Y^T (Y Y^T)^-1, which only depends on the directions
+typedef struct
+{
+	float directions[FIT_POINTS][3];
+	double fit[FIT_POINTS][CAmbisonicEncoder::CHANNELS];
+} rotation_fit_t;
+
+//Spreads the directions over the sphere on a Fibonacci spiral and inverts Y Y^T by Gauss-Jordan elimination
+static rotation_fit_t MakeRotationFit()
+{
+	const int n = CAmbisonicEncoder::CHANNELS;
+	rotation_fit_t result;
+	double y[FIT_POINTS][CAmbisonicEncoder::CHANNELS];
+	for (int k = 0; k < FIT_POINTS; k++)
+	{
+		float z = 1.0f - (2.0f * k + 1.0f) / FIT_POINTS;
+		float r = sqrtf(1.0f - z * z);
+		float phi = 2.3999632f * k; // The golden angle
+		result.directions[k][0] = r * cosf(phi);
+		result.directions[k][1] = r * sinf(phi);
+		result.directions[k][2] = z;
+		float gains[CAmbisonicEncoder::CHANNELS];
+		CAmbisonicEncoder::Encode(result.directions[k][0], result.directions[k][1], z, gains);
+		for (int i = 0; i < n; i++)
+			y[k][i] = gains[i];
+	}
+
+	//Y Y^T next to the identity, reduced until the identity holds the inverse
+	double a[CAmbisonicEncoder::CHANNELS][2 * CAmbisonicEncoder::CHANNELS];
+	for (int i = 0; i < n; i++)
+	{
+		for (int j = 0; j < n; j++)
+		{
+			double sum = 0.0;
+			for (int k = 0; k < FIT_POINTS; k++)
+				sum += y[k][i] * y[k][j];
+			a[i][j] = sum;
+			a[i][n + j] = i == j ? 1.0 : 0.0;
+		}
+	}
+	for (int c = 0; c < n; c++)
+	{
+		int pivot = c;
+		for (int i = c + 1; i < n; i++)
+			if (fabs(a[i][c]) > fabs(a[pivot][c]))
+				pivot = i;
+		for (int j = 0; j < 2 * n; j++)
+		{
+			double t = a[c][j];
+			a[c][j] = a[pivot][j];
+			a[pivot][j] = t;
+		}
+		double scale = 1.0 / a[c][c];
+		for (int j = 0; j < 2 * n; j++)
+			a[c][j] *= scale;
+		for (int i = 0; i < n; i++)
+		{
+			if (i == c)
+				continue;
+			double f = a[i][c];
+			for (int j = 0; j < 2 * n; j++)
+				a[i][j] -= f * a[c][j];
+		}
+	}
+
+	for (int k = 0; k < FIT_POINTS; k++)
+	{
+		for (int j = 0; j < n; j++)
+		{
+			double sum = 0.0;
+			for (int i = 0; i < n; i++)
+				sum += y[k][i] * a[i][n + j];
+			result.fit[k][j] = sum;
+		}
+	}
+	return result;
+}
+
+/*
+	The harmonics of a rotated direction are a linear mix of the harmonics of the direction, so the matrix is found by
+	encoding the fit directions turned into the new frame and fitting them to the harmonics of the directions themselves.
+	Mixing only happens within an order, and the entries between orders, which the fit leaves at rounding noise, are zeroed
+*/
+void CAmbisonicEncoder::Rotation(const float *axes, float *matrix)
+{
+	static const rotation_fit_t FIT = MakeRotationFit();
+
+	double sums[CHANNELS][CHANNELS] = {};
+	for (int k = 0; k < FIT_POINTS; k++)
+	{
+		const float *d = FIT.directions[k];
+		float turned[CHANNELS];
+		Encode(axes[0] * d[0] + axes[1] * d[1] + axes[2] * d[2],
+			axes[3] * d[0] + axes[4] * d[1] + axes[5] * d[2],
+			axes[6] * d[0] + axes[7] * d[1] + axes[8] * d[2], turned);
+		for (int i = 0; i < CHANNELS; i++)
+			for (int j = 0; j < CHANNELS; j++)
+				sums[i][j] += turned[i] * FIT.fit[k][j];
+	}
+
+	for (int i = 0; i < CHANNELS; i++)
+	{
+		int order = (int)sqrtf((float)i);
+		for (int j = 0; j < CHANNELS; j++)
+			matrix[i * CHANNELS + j] = j >= order * order && j < (order + 1) * (order + 1) ? (float)sums[i][j] : 0.0f;
+	}
+}
+
+//Allocates the gains for capacity emitters
+void CAmbisonicEncoder::Reserve(int capacity)
+{
+	if (capacity <= m_capacity)
+		return;
+	m_capacity = capacity;
+	m_gains.assign((size_t)CHANNELS * capacity, 0.0f);
+}
+
+/*
+	Four emitters go through Encode at once, a lane each. Every channel of the four is stored with one write, as the
+	gains are laid out channel by channel
+*/
+void CAmbisonicEncoder::Update(const CEmitterTable &emitters, const float *listener)
+{
+	int count = emitters.getRange();
+	if (count > m_capacity)
+		Reserve(count);
+
+	int first = 0;
+#ifdef AMBISONIC_SSE2
+	const float *px = emitters.getX(), *py = emitters.getY(), *pz = emitters.getZ();
+	float *gains = m_gains.data();
+	size_t stride = m_capacity;
+
+	__m128 lx = _mm_set1_ps(listener[0]), ly = _mm_set1_ps(listener[1]), lz = _mm_set1_ps(listener[2]);
+	__m128 minDistance2 = _mm_set1_ps(MIN_DISTANCE * MIN_DISTANCE);
+	__m128 one = _mm_set1_ps(1.0f), half = _mm_set1_ps(0.5f), three = _mm_set1_ps(3.0f), five = _mm_set1_ps(5.0f);
+	__m128 sqrt3 = _mm_set1_ps(SQRT3), sqrt3_2 = _mm_set1_ps(SQRT3_2), sqrt5_8 = _mm_set1_ps(SQRT5_8);
+	__m128 sqrt15 = _mm_set1_ps(SQRT15), sqrt3_8 = _mm_set1_ps(SQRT3_8), sqrt15_2 = _mm_set1_ps(SQRT15_2);
+	for (; first + 4 <= count; first += 4)
+	{
+		__m128 x = _mm_sub_ps(_mm_loadu_ps(px + first), lx);
+		__m128 y = _mm_sub_ps(_mm_loadu_ps(py + first), ly);
+		__m128 z = _mm_sub_ps(_mm_loadu_ps(pz + first), lz);
+		__m128 d2 = _mm_add_ps(_mm_add_ps(_mm_mul_ps(x, x), _mm_mul_ps(y, y)), _mm_mul_ps(z, z));
+		__m128 inverse = _mm_div_ps(one, _mm_sqrt_ps(_mm_max_ps(d2, minDistance2)));
+		x = _mm_mul_ps(x, inverse);
+		y = _mm_mul_ps(y, inverse);
+		z = _mm_mul_ps(z, inverse);
+
+		__m128 x2 = _mm_mul_ps(x, x), y2 = _mm_mul_ps(y, y), z2 = _mm_mul_ps(z, z);
+		__m128 xy = _mm_mul_ps(x, y);
+		__m128 x2y2 = _mm_sub_ps(x2, y2);
+		__m128 z5 = _mm_sub_ps(_mm_mul_ps(five, z2), one); // 5z^2 - 1
+		float *g = gains + first;
+		_mm_storeu_ps(g, one);
+		_mm_storeu_ps(g + stride, y);
+		_mm_storeu_ps(g + 2 * stride, z);
+		_mm_storeu_ps(g + 3 * stride, x);
+		_mm_storeu_ps(g + 4 * stride, _mm_mul_ps(sqrt3, xy));
+		_mm_storeu_ps(g + 5 * stride, _mm_mul_ps(sqrt3, _mm_mul_ps(y, z)));
+		_mm_storeu_ps(g + 6 * stride, _mm_mul_ps(half, _mm_sub_ps(_mm_mul_ps(three, z2), one)));
+		_mm_storeu_ps(g + 7 * stride, _mm_mul_ps(sqrt3, _mm_mul_ps(x, z)));
+		_mm_storeu_ps(g + 8 * stride, _mm_mul_ps(sqrt3_2, x2y2));
+		_mm_storeu_ps(g + 9 * stride, _mm_mul_ps(sqrt5_8, _mm_mul_ps(y, _mm_sub_ps(_mm_mul_ps(three, x2), y2))));
+		_mm_storeu_ps(g + 10 * stride, _mm_mul_ps(sqrt15, _mm_mul_ps(xy, z)));
+		_mm_storeu_ps(g + 11 * stride, _mm_mul_ps(sqrt3_8, _mm_mul_ps(y, z5)));
+		_mm_storeu_ps(g + 12 * stride, _mm_mul_ps(half, _mm_mul_ps(z, _mm_sub_ps(_mm_mul_ps(five, z2), three))));
+		_mm_storeu_ps(g + 13 * stride, _mm_mul_ps(sqrt3_8, _mm_mul_ps(x, z5)));
+		_mm_storeu_ps(g + 14 * stride, _mm_mul_ps(sqrt15_2, _mm_mul_ps(z, x2y2)));
+		_mm_storeu_ps(g + 15 * stride, _mm_mul_ps(sqrt5_8, _mm_mul_ps(x, _mm_sub_ps(x2, _mm_mul_ps(three, y2)))));
+	}
+#endif
+	UpdateScalar(emitters, listener, first, count);
+}
+
+//The same calculation one emitter at a time, for the emitters left over and for CPUs without SSE2
+void CAmbisonicEncoder::UpdateScalar(const CEmitterTable &emitters, const float *listener, int first, int last)
+{
+	const float *px = emitters.getX(), *py = emitters.getY(), *pz = emitters.getZ();
+	for (int i = first; i < last; i++)
+	{
+		float x = px[i] - listener[0], y = py[i] - listener[1], z = pz[i] - listener[2];
+		float d2 = x * x + y * y + z * z;
+		float inverse = 1.0f / sqrtf(d2 > MIN_DISTANCE * MIN_DISTANCE ? d2 : MIN_DISTANCE * MIN_DISTANCE);
+		float gains[CHANNELS];
+		Encode(x * inverse, y * inverse, z * inverse, gains);
+		for (int c = 0; c < CHANNELS; c++)
+			m_gains[(size_t)c * m_capacity + i] = gains[c];
+	}
+}
+
+//Copies the gains of an emitter
+void CAmbisonicEncoder::getGains(int emitter, float *gains) const
+{
+	for (int c = 0; c < CHANNELS; c++)
+		gains[c] = m_gains[(size_t)c * m_capacity + emitter];
+}
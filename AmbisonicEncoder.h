@@ -0,0 +1,39 @@
+#pragma once
+#include <vector>
+#include "EmitterTable.h"
+
+// Third order ambisonics in the AmbiX convention: the 16 real spherical harmonics in ACN order with SN3D normalisation.
+// The encoder gives every emitter of the table the 16 gains of its direction from the listener in one pass over the
+// position arrays, four emitters at a time with SSE2. The directions are taken in world coordinates, so the gains don't
+// depend on where the listener looks: the whole field is turned to the listener once, by a matrix from Rotation.
+class CAmbisonicEncoder
+{
+public:
+	static const int ORDER = 3;
+	static const int CHANNELS = (ORDER + 1) * (ORDER + 1);
+
+	CAmbisonicEncoder(); //Constructor
+	~CAmbisonicEncoder(); //Destructor
+
+	//Gains of the unit direction x, y, z into the CHANNELS channels of gains. The channels of order l are l * l to
+	//(l + 1) * (l + 1) - 1, and the first order ones are y, z and x
+	static void Encode(float x, float y, float z, float *gains);
+	//Matrix that turns a field encoded in one frame into another, row major: out[i] is the sum of matrix[i * CHANNELS + j]
+	//times in[j]. axes holds the three axes of the new frame one after the other, in coordinates of the old frame, and
+	//must be a rotation. Only the entries between channels of the same order are non zero
+	static void Rotation(const float *axes, float *matrix);
+
+	//Allocates the gains for capacity emitters, so Update doesn't allocate
+	void Reserve(int capacity);
+	//Calculates the gains of every emitter of the table for the listener position (x, y and z)
+	void Update(const CEmitterTable &emitters, const float *listener);
+	//Copies the CHANNELS gains of an emitter, valid until the next Update
+	void getGains(int emitter, float *gains) const;
+
+private:
+	//Calculates the gains of emitters first to last - 1 one at a time
+	void UpdateScalar(const CEmitterTable &emitters, const float *listener, int first, int last);
+
+	std::vector<float> m_gains; // Channel c of emitter e at c * m_capacity + e
+	int m_capacity;
+};
@@ -1,17 +1,86 @@
 ﻿#include "Audio.h"
+#include "FirKernels.h"
+#include "FmodStreamSource.h"
+#include "AllocationCounter.h"
 
 #pragma comment(lib, "lib/fmod_vc.lib")
 #pragma warning(disable:4996)
 
-//Static FIR filters 
+//Static FIR filters, the same specifications that were passed to signal.firls
+band_spec_t CAudio::FIR1_SPEC{ { 0, 2000, 2600, 2900, 3500, 22050 }, { 0, 0, 1, 1, 0, 0 }, {} };
+band_spec_t CAudio::FIR2_SPEC{ { 0, 100, 700, 1000, 1600, 22050 }, { 1, 0, 1, 0, 1, 0 }, {} };
+band_spec_t CAudio::FIR1_DEEP_SPEC{ { 0, 1000, 1300, 1450, 1750, 22050 }, { 0, 0, 1, 1, 0, 0 }, {} };
+band_spec_t CAudio::FIR2_DEEP_SPEC{ { 0, 50, 350, 500, 800, 22050 }, { 1, 0, 1, 0, 1, 0 }, {} };
+const float CAudio::DEPTH_DISTANCE = 100.0f;
 vector<float> CAudio::FIR1{ 0.01473892f, 0.01595279f, 0.01473892f };
 vector<float> CAudio::FIR2{ 0.2025804f,  0.52309322f, 0.2025804f };
+CFilterBank CAudio::FILTER_BANK;
+CFilterDspPool CAudio::FILTER_DSP_POOL;
+
+//Underwater reverb
+const float CAudio::REVERB_SECONDS = 3.0f;
+
+//Binaural placement
+CHrirSet CAudio::HRIR_SET;
+const char *CAudio::HRIR_FILE = "resources\\Audio\\hrir.wav";
+const char *CAudio::HRIR_DIRECTIONS_FILE = "resources\\Audio\\hrir.txt";
+const float CAudio::MIN_DISTANCE = 1.0f;
+
+//Streams decoded on the prefetch thread
+const float CAudio::STREAM_BUFFER_SECONDS = 2.0f;
+const float CAudio::STREAM_PREFILL_SECONDS = 0.25f;
 
 CAudio::CAudio()
-{}
+	: m_soundBank(m_soundLoader, SOUND_BANK_BUDGET), m_voiceManager(m_emitters, REAL_VOICES)
+{
+	m_music = NULL;
+	m_musicStream = NULL;
+	m_sound1 = -1;
+	m_sound2 = -1;
+	m_musicProfiler = NULL;
+	m_submarineProfiler = NULL;
+	for (int v = 0; v < REAL_VOICES; v++)
+	{
+		m_3dChannels[v] = NULL;
+		m_voiceEmitters[v] = -1;
+		m_voiceSounds[v] = -1;
+		m_voiceStreams[v] = NULL;
+		m_hrtfDsps[v] = NULL;
+		m_lowpassDsps[v] = NULL;
+		m_encoderDsps[v] = NULL;
+	}
+	m_propagation.Reserve(MAX_EMITTERS);
+	m_propagation.SetMinDistance(MIN_DISTANCE);
+	m_binaural = true;
+	m_ambisonic = false;
+	m_ambisonicEncoder.Reserve(MAX_EMITTERS);
+	m_ambisonicGroup = NULL;
+	m_decoderDsp = NULL;
+	m_listenerPosition = glm::vec3(0, 0, 0);
+	m_listenerFront = glm::vec3(0, 0, -1);
+	m_listenerRight = glm::vec3(1, 0, 0);
+	m_listenerUp = glm::vec3(0, 1, 0);
+	m_listenerVelocity = glm::vec3(0, 0, 0);
+	m_emitters.Reserve(MAX_EMITTERS);
+	m_voiceManager.Reserve(MAX_EMITTERS);
+	m_emitterSounds.assign(MAX_EMITTERS, -1);
+	m_emitterDsps.assign(MAX_EMITTERS, NULL);
+}
 
+//The music and the voices read their streams, so they are released first. The sound bank releases its own sounds
 CAudio::~CAudio()
-{}
+{
+	if (m_music)
+		m_music->release();
+	if (m_musicStream)
+	{
+		m_prefetcher.Remove(m_musicStream);
+		delete m_musicStream;
+	}
+	for (int v = 0; v < REAL_VOICES; v++)
+		if (m_voiceStreams[v])
+			m_voiceStreams[v]->release();
+}
 
 // Check for error
 void CAudio::FmodErrorCheck(FMOD_RESULT result)
@@ -29,61 +98,54 @@ void CAudio::FmodErrorCheck(FMOD_RESULT result)
 */
 FMOD_RESULT F_CALLBACK CAudio::DSPCallback(FMOD_DSP_STATE *dsp_state, float *inbuffer, float *outbuffer, unsigned int length, int inchannels, int *outchannels)
 {
-	mydsp_data_t *thisdsp = (mydsp_data_t *)dsp_state->plugindata;
-
-	for (int samp = 0; samp < length; samp++)
-	{
-		for (int chan = 0; chan < *outchannels; chan++)
-		{		
-
-			//Apply the final filter to the music, by convolution
-			//Definition taken from the lecture 4 slides: f(x[n]) = ∑i=0 x[n−i]b[i]
-			float conv = 0.0f;
-			for (int i = 0; i < thisdsp->buffer->getLength(); ++i) {
-
-				if ((samp - i)*inchannels + chan >= 0){
-
-					float ec = thisdsp->external_control;
-					//Interpolate the two filters based on the signal
-					//Definition taken from lab 7: b_filt_mix = (1-mix_ratio) * b_filt1 + mix_ratio * b_filt2
-					for (unsigned int i = 0; i < (thisdsp->buffer->getLength()); i++) {
-						thisdsp->buffer->Put((1 - ec) * FIR1[i] + ec * FIR2[i]);
-					}
-					//The index is applied to the sample so the channels dont get mixed 
-					conv = conv + inbuffer[(samp-i)*inchannels + chan] * thisdsp->buffer->ItemAt(i *inchannels + chan);
-				}
-				else {
-					break;
-				}
-			}
+	CFilterDsp *thisdsp = (CFilterDsp *)dsp_state->plugindata;
+	unsigned long long start = CDspProfiler::Now();
 
-			//The convolution result is saved in the outbuffer
-			outbuffer[samp**outchannels + chan] = conv;
+	//Filters the block with the newest controls, into the channel count the mixer asks for. See CFilterDsp::Read
+	thisdsp->Read(inbuffer, outbuffer, length, inchannels, *outchannels);
 
-		}
-	}
+	//Accounts the time the callback took against the time the block lasts
+	thisdsp->getProfiler().Record(start, length);
 
 	return FMOD_OK;
 }
 
 /*
-	Callback called when DSP is created. This implementation creates a structure which is attached to the dsp state's 'plugindata' member.
+	Callback called when DSP is created. This implementation takes the state of the filter from the pool, which is attached to the dsp state's 'plugindata' member.
+	Every dynamic filter starts with the music bank and the FILTER_MODE engine, and its buffers are already allocated
 */
 FMOD_RESULT F_CALLBACK CAudio::myDSPCreateCallback(FMOD_DSP_STATE *dsp_state)
 {
-
-	//Allocates space for the dsp structure 
-	mydsp_data_t *data = (mydsp_data_t *)calloc(sizeof(mydsp_data_t), 1);
+	CFilterDsp *data = FILTER_DSP_POOL.Acquire();
 	if (!data)
 	{
 		return FMOD_ERR_MEMORY;
 	}
 
-	//Plugindata pointer of the DSP state to the DSP structure
+	//The deadline of a block is its length at the mixer sample rate
+	int rate = 44100;
+	dsp_state->functions->getsamplerate(dsp_state, &rate);
+	data->getProfiler().SetSampleRate(rate);
+
+	//Plugindata pointer of the DSP state to the DSP state
 	dsp_state->plugindata = data;
-	//Initialise the elements of the structure 
-	data->external_control = 0.0f; 
-	data->buffer = new CBuffer(CAudio::FIR1.size()); 
+
+	return FMOD_OK;
+}
+
+//Callback called when DSP is released. The state goes back to the pool
+FMOD_RESULT F_CALLBACK CAudio::myDSPReleaseCallback(FMOD_DSP_STATE *dsp_state)
+{
+	FILTER_DSP_POOL.Release((CFilterDsp *)dsp_state->plugindata);
+	dsp_state->plugindata = NULL;
+
+	return FMOD_OK;
+}
+
+//Callback called when DSP is reset, e.g. when the sound it filters starts again. The history is cleared before the next block
+FMOD_RESULT F_CALLBACK CAudio::myDSPResetCallback(FMOD_DSP_STATE *dsp_state)
+{
+	((CFilterDsp *)dsp_state->plugindata)->Reset();
 
 	return FMOD_OK;
 }
@@ -93,13 +155,36 @@ FMOD_RESULT F_CALLBACK CAudio::myDSPCreateCallback(FMOD_DSP_STATE *dsp_state)
 */
 FMOD_RESULT F_CALLBACK CAudio::myDSPSetParameterFloatCallback(FMOD_DSP_STATE *dsp_state, int index, float value)
 {
+	//Index 1 is the external control parameter and index 2 the depth control. They are handed to the mixer thread
+	CFilterDsp *mydata = (CFilterDsp *)dsp_state->plugindata;
+	if (mydata->SetControl(index - 1, value))
+		return FMOD_OK;
 
-	//If the index is the one asigned to the external control parameter 
-	if (index == 1)
+	return FMOD_ERR_INVALID_PARAM;
+}
+
+/*
+	Callback called when DSP::setParameterInt is called. The int parameter is the filter mode
+*/
+FMOD_RESULT F_CALLBACK CAudio::myDSPSetParameterIntCallback(FMOD_DSP_STATE *dsp_state, int index, int value)
+{
+	CFilterDsp *mydata = (CFilterDsp *)dsp_state->plugindata;
+	if (index == 3 && mydata->SetMode(value))
+		return FMOD_OK;
+
+	return FMOD_ERR_INVALID_PARAM;
+}
+
+/*
+	Callback called when DSP::setParameterData is called. The data parameter carries a new filter bank
+*/
+FMOD_RESULT F_CALLBACK CAudio::myDSPSetParameterDataCallback(FMOD_DSP_STATE *dsp_state, int index, void *data, unsigned int length)
+{
+	if (index == 0 && length == sizeof(filter_coefficients_t))
 	{
-		//Changes the value of the parameter
-		mydsp_data_t *mydata = (mydsp_data_t *)dsp_state->plugindata;
-		mydata->external_control = value;
+		filter_coefficients_t *coefficients = (filter_coefficients_t *)data;
+		CFilterDsp *mydata = (CFilterDsp *)dsp_state->plugindata;
+		mydata->SetBank(*coefficients->bank);
 
 		return FMOD_OK;
 	}
@@ -112,13 +197,29 @@ FMOD_RESULT F_CALLBACK CAudio::myDSPSetParameterFloatCallback(FMOD_DSP_STATE *ds
 */
 FMOD_RESULT F_CALLBACK CAudio::myDSPGetParameterFloatCallback(FMOD_DSP_STATE *dsp_state, int index, float *value, char *valstr)
 {
-	//If the index is the one asigned to the external control parameter 
-	if (index == 1)
+	//If the index is the one asigned to the external control parameter or to the depth control
+	if (index == 1 || index == 2)
 	{
+		//Makes the value pointer points to the control parameter of the structure
+		CFilterDsp *mydata = (CFilterDsp *)dsp_state->plugindata;
+		*value = mydata->getControl(index - 1);
+
+		return FMOD_OK;
+	}
+
+	return FMOD_ERR_INVALID_PARAM;
+}
 
-		//Makes the value pointer points to the external control parameter of the structure
-		mydsp_data_t *mydata = (mydsp_data_t *)dsp_state->plugindata;
-		*value = mydata->external_control;
+/*
+	Callback called when DSP::getParameterData is called. The read-only data parameter is the profiler of the DSP
+*/
+FMOD_RESULT F_CALLBACK CAudio::myDSPGetParameterDataCallback(FMOD_DSP_STATE *dsp_state, int index, void **data, unsigned int *length, char *valstr)
+{
+	if (index == 4)
+	{
+		CFilterDsp *mydata = (CFilterDsp *)dsp_state->plugindata;
+		*data = &mydata->getProfiler();
+		*length = sizeof(CDspProfiler);
 
 		return FMOD_OK;
 	}
@@ -126,209 +227,1227 @@ FMOD_RESULT F_CALLBACK CAudio::myDSPGetParameterFloatCallback(FMOD_DSP_STATE *ds
 	return FMOD_ERR_INVALID_PARAM;
 }
 
-//Initialise the FMOD system and creates the DSP effect
-bool CAudio::Initialise()
+/*
+	Reverb DSP callback:
+	adds the underwater reverb to the mix of every channel
+*/
+FMOD_RESULT F_CALLBACK CAudio::ReverbDSPCallback(FMOD_DSP_STATE *dsp_state, float *inbuffer, float *outbuffer, unsigned int length, int inchannels, int *outchannels)
 {
-	// Create an FMOD system
-	result = FMOD::System_Create(&m_FmodSystem);
-	FmodErrorCheck(result);
-	if (result != FMOD_OK)
-		return false;
+	reverb_data_t *thisdsp = (reverb_data_t *)dsp_state->plugindata;
 
-	// Initialise the system
-	result = m_FmodSystem->init(32, FMOD_INIT_NORMAL, 0);
-	FmodErrorCheck(result);
-	if (result != FMOD_OK)
-		return false;
+	thisdsp->reverb->Process(inbuffer, outbuffer, length, inchannels, thisdsp->wet, thisdsp->dry);
 
-	// Set 3D settings
-	result = m_FmodSystem->set3DSettings(1.0f, 1.0f, 1.0f); //doppler scale, distance factor, distance roll-off
-	FmodErrorCheck(result);
-	if (result != FMOD_OK)
-		return false;
+	return FMOD_OK;
+}
 
-	// Create the DSP effect 
+/*
+	Callback called when the reverb DSP is created. The impulse response is generated for the sample rate and the speaker mode of the mixer,
+	and the buffers are allocated for the block size of the mixer here, so the process callback doesn't allocate
+*/
+FMOD_RESULT F_CALLBACK CAudio::myReverbCreateCallback(FMOD_DSP_STATE *dsp_state)
+{
+	int rate = 44100;
+	unsigned int blockSize = 1024;
+	FMOD_SPEAKERMODE mixer = FMOD_SPEAKERMODE_STEREO, output;
+	dsp_state->functions->getsamplerate(dsp_state, &rate);
+	dsp_state->functions->getblocksize(dsp_state, &blockSize);
+	dsp_state->functions->getspeakermode(dsp_state, &mixer, &output);
+
+	int channels = SpeakerModeChannels(mixer);
+
+	reverb_data_t *data = (reverb_data_t *)calloc(sizeof(reverb_data_t), 1);
+	if (!data)
 	{
-		//Creates the DSP descriptor
-		FMOD_DSP_DESCRIPTION dspdesc;
-		memset(&dspdesc, 0, sizeof(dspdesc));
+		return FMOD_ERR_MEMORY;
+	}
 
-		//Creates the DSP parameters
-		FMOD_DSP_PARAMETER_DESC data_desc;
-		FMOD_DSP_PARAMETER_DESC  external_control_desc;
-		FMOD_DSP_PARAMETER_DESC *paramdesc[2] =
-		{
-			&data_desc,
-			&external_control_desc
-		};
-		FMOD_DSP_INIT_PARAMDESC_DATA(data_desc, "data", "", "data", FMOD_DSP_PARAMETER_DATA_TYPE_USER);
-		FMOD_DSP_INIT_PARAMDESC_FLOAT(external_control_desc, "external control", "%", "external control in percent", 0, 1, 1);
+	dsp_state->plugindata = data;
+	data->wet = 0.3f;
+	data->dry = 1.0f;
+	data->reverb = new CConvolutionReverb(CConvolutionReverb::GenerateUnderwaterIR(rate, REVERB_SECONDS, channels));
+	data->reverb->Prepare(blockSize);
 
-		//Intialise some variables of the DSP descriptor 
-		strncpy_s(dspdesc.name, "Control FIR filter", sizeof(dspdesc.name));
-		dspdesc.version = 0x00010000;
-		dspdesc.numinputbuffers = 2;
-		dspdesc.numoutputbuffers = 2;
-		dspdesc.read = DSPCallback;
-		dspdesc.create = myDSPCreateCallback;
-		dspdesc.setparameterfloat = myDSPSetParameterFloatCallback;
-		dspdesc.numparameters = 2;
-		dspdesc.paramdesc = paramdesc;
+	return FMOD_OK;
+}
 
-		//Creates the DSP for the music stream 
-		result = m_FmodSystem->createDSP(&dspdesc, &m_dsp);
-		FmodErrorCheck(result);
+/*
+	Callback called when the reverb DSP is released. Stops the background thread of the reverb
+*/
+FMOD_RESULT F_CALLBACK CAudio::myReverbReleaseCallback(FMOD_DSP_STATE *dsp_state)
+{
+	reverb_data_t *data = (reverb_data_t *)dsp_state->plugindata;
+	delete data->reverb;
+	free(data);
 
-		if (result != FMOD_OK)
-			return false;
+	return FMOD_OK;
+}
 
-		//Creates the DSP for the submarine sound
-		result = m_FmodSystem->createDSP(&dspdesc, &submarine_dsp);
-		FmodErrorCheck(result);
+/*
+	Callback called when DSP::setParameterFloat is called on the reverb DSP.
+*/
+FMOD_RESULT F_CALLBACK CAudio::myReverbSetParameterFloatCallback(FMOD_DSP_STATE *dsp_state, int index, float value)
+{
+	reverb_data_t *mydata = (reverb_data_t *)dsp_state->plugindata;
 
-		if (result != FMOD_OK)
-			return false;
+	if (index == 0)
+	{
+		mydata->wet = value;
+		return FMOD_OK;
+	}
+	if (index == 1)
+	{
+		mydata->dry = value;
+		return FMOD_OK;
 	}
 
-	return true;
+	return FMOD_ERR_INVALID_PARAM;
 }
 
-// Load a music stream
-bool CAudio::LoadMusicStream(const char *filename)
+/*
+	HRTF DSP callback:
+	filters the voice for the direction of its emitter into the left and right ears
+*/
+FMOD_RESULT F_CALLBACK CAudio::HrtfDSPCallback(FMOD_DSP_STATE *dsp_state, float *inbuffer, float *outbuffer, unsigned int length, int inchannels, int *outchannels)
 {
-	result = m_FmodSystem->createStream(filename, NULL | FMOD_LOOP_NORMAL, 0, &m_music);
-	FmodErrorCheck(result);
+	CHrtfDsp *thisdsp = (CHrtfDsp *)dsp_state->plugindata;
 
-	if (result != FMOD_OK) 
-		return false;
+	thisdsp->Read(inbuffer, outbuffer, length, inchannels, *outchannels);
 
-	return true;
+	return FMOD_OK;
 }
 
-// Play a music stream
-bool CAudio::PlayMusicStream()
+/*
+	Callback called when the HRTF DSP is created. Its buffers are allocated for the block size of the mixer here, so
+	the read callback doesn't allocate
+*/
+FMOD_RESULT F_CALLBACK CAudio::myHrtfCreateCallback(FMOD_DSP_STATE *dsp_state)
 {
-	result = m_FmodSystem->playSound(m_music, NULL, false, &m_musicChannel);
-	FmodErrorCheck(result);
+	unsigned int blockSize = 1024;
+	dsp_state->functions->getblocksize(dsp_state, &blockSize);
 
-	if (result != FMOD_OK)
-		return false;
+	CHrtfDsp *data = new CHrtfDsp(HRIR_SET);
+	data->Prepare(blockSize);
+	dsp_state->plugindata = data;
 
-	//Sets the 2D mode
-	result = m_musicChannel->setMode(FMOD_2D);
-	FmodErrorCheck(result);
+	return FMOD_OK;
+}
 
-	//Adds the DSP effect 
-	result = m_musicChannel->addDSP(0, m_dsp);
-	FmodErrorCheck(result);
+//Callback called when the HRTF DSP is released
+FMOD_RESULT F_CALLBACK CAudio::myHrtfReleaseCallback(FMOD_DSP_STATE *dsp_state)
+{
+	delete (CHrtfDsp *)dsp_state->plugindata;
+	dsp_state->plugindata = NULL;
 
-	return true;
+	return FMOD_OK;
 }
 
+//Callback called when the HRTF DSP is reset. The history of the last channel it filtered is cleared before the next block
+FMOD_RESULT F_CALLBACK CAudio::myHrtfResetCallback(FMOD_DSP_STATE *dsp_state)
+{
+	((CHrtfDsp *)dsp_state->plugindata)->Reset();
 
-// Load a sound source
-bool CAudio::LoadSoundSource(const char *filename)
+	return FMOD_OK;
+}
+
+/*
+	Callback called when DSP::setParameterData is called on the HRTF DSP. The data parameter is the direction of the voice
+*/
+FMOD_RESULT F_CALLBACK CAudio::myHrtfSetParameterDataCallback(FMOD_DSP_STATE *dsp_state, int index, void *data, unsigned int length)
 {
-	result = m_FmodSystem->createSound(filename, NULL | FMOD_LOOP_NORMAL, 0, &m_sound1);
-	FmodErrorCheck(result);
+	if (index == 0 && length == sizeof(hrtf_direction_t))
+	{
+		((CHrtfDsp *)dsp_state->plugindata)->SetDirection(*(hrtf_direction_t *)data);
 
-	if (result != FMOD_OK)
-		return false;
+		return FMOD_OK;
+	}
 
-	return true;
+	return FMOD_ERR_INVALID_PARAM;
 }
 
-// Play the sound source
-bool CAudio::PlaySoundSource()
+/*
+	Ambisonic encoder DSP callback:
+	spreads the voice over the channels of the bus. The query tells the mixer the output is CHANNELS raw channels, and a
+	channel that is silent isn't encoded at all
+*/
+FMOD_RESULT F_CALLBACK CAudio::AmbisonicEncoderDSPCallback(FMOD_DSP_STATE *dsp_state, unsigned int length, const FMOD_DSP_BUFFER_ARRAY *inbufferarray, FMOD_DSP_BUFFER_ARRAY *outbufferarray, FMOD_BOOL inputsidle, FMOD_DSP_PROCESS_OPERATION op)
 {
-	result = m_FmodSystem->playSound(m_sound1, NULL, false, &m_3dChannel1);
-	FmodErrorCheck(result);
+	if (op == FMOD_DSP_PROCESS_QUERY)
+	{
+		if (outbufferarray)
+		{
+			outbufferarray->buffernumchannels[0] = CAmbisonicEncoder::CHANNELS;
+			outbufferarray->bufferchannelmask[0] = 0;
+			outbufferarray->speakermode = FMOD_SPEAKERMODE_RAW;
+		}
 
-	if (result != FMOD_OK)
-		return false;
+		return inputsidle ? FMOD_ERR_DSP_DONTPROCESS : FMOD_OK;
+	}
 
-	//Sets the 3D mode
-	result = m_3dChannel1->setMode(FMOD_3D);
-	FmodErrorCheck(result);
+	CAmbisonicEncoderDsp *thisdsp = (CAmbisonicEncoderDsp *)dsp_state->plugindata;
+	thisdsp->Read(inbufferarray->buffers[0], outbufferarray->buffers[0], length, inbufferarray->buffernumchannels[0]);
 
-	return true;
+	return FMOD_OK;
 }
 
-// Load the object sound
-bool CAudio::LoadObjectSound(const char *filename)
+//Callback called when the ambisonic encoder DSP is created
+FMOD_RESULT F_CALLBACK CAudio::myAmbisonicEncoderCreateCallback(FMOD_DSP_STATE *dsp_state)
 {
-	result = m_FmodSystem->createSound(filename, NULL | FMOD_LOOP_NORMAL, 0, &m_sound2);
-	FmodErrorCheck(result);
+	dsp_state->plugindata = new CAmbisonicEncoderDsp();
 
-	if (result != FMOD_OK)
-		return false;
+	return FMOD_OK;
+}
 
-	return true;
+//Callback called when the ambisonic encoder DSP is released
+FMOD_RESULT F_CALLBACK CAudio::myAmbisonicEncoderReleaseCallback(FMOD_DSP_STATE *dsp_state)
+{
+	delete (CAmbisonicEncoderDsp *)dsp_state->plugindata;
+	dsp_state->plugindata = NULL;
 
+	return FMOD_OK;
 }
 
-// Play the object sound
-bool CAudio::PlayObjectSound()
+//Callback called when the ambisonic encoder DSP is reset. The next block starts at the gains of the new channel
+FMOD_RESULT F_CALLBACK CAudio::myAmbisonicEncoderResetCallback(FMOD_DSP_STATE *dsp_state)
 {
-	result = m_FmodSystem->playSound(m_sound2, NULL, false, &m_3dChannel2);
-	m_3dChannel2->setVolume(10.0);
-	FmodErrorCheck(result);
+	((CAmbisonicEncoderDsp *)dsp_state->plugindata)->Reset();
 
-	if (result != FMOD_OK)
-		return false;
+	return FMOD_OK;
+}
 
-	//Sets the 3D mode
-	result = m_3dChannel2->setMode(FMOD_3D);
-	FmodErrorCheck(result);
+/*
+	Callback called when DSP::setParameterData is called on the ambisonic encoder DSP. The data parameter is the gains of the voice
+*/
+FMOD_RESULT F_CALLBACK CAudio::myAmbisonicEncoderSetParameterDataCallback(FMOD_DSP_STATE *dsp_state, int index, void *data, unsigned int length)
+{
+	if (index == 0 && length == sizeof(ambisonic_gains_t))
+	{
+		((CAmbisonicEncoderDsp *)dsp_state->plugindata)->SetGains(*(ambisonic_gains_t *)data);
 
-	//Adds the DSP effect 
-	result = m_3dChannel2->addDSP(0, submarine_dsp);
-	FmodErrorCheck(result);
+		return FMOD_OK;
+	}
 
-	return true;
+	return FMOD_ERR_INVALID_PARAM;
 }
 
-void CAudio::Update(float external_control, const CSoundSource *soundSource, const CSoundSource *submarineSoundSource, float submarine_vel, const CCamera *cam)
+/*
+	Ambisonic decoder DSP callback:
+	rotates and decodes the bus into the speakers of the mixer. Its input is held at CHANNELS raw channels by the
+	channel format of the DSP, and the query gives the output the speaker mode of the mixer back
+*/
+FMOD_RESULT F_CALLBACK CAudio::AmbisonicDecoderDSPCallback(FMOD_DSP_STATE *dsp_state, unsigned int length, const FMOD_DSP_BUFFER_ARRAY *inbufferarray, FMOD_DSP_BUFFER_ARRAY *outbufferarray, FMOD_BOOL inputsidle, FMOD_DSP_PROCESS_OPERATION op)
 {
+	ambisonic_decoder_data_t *data = (ambisonic_decoder_data_t *)dsp_state->plugindata;
+	if (op == FMOD_DSP_PROCESS_QUERY)
+	{
+		if (outbufferarray)
+		{
+			outbufferarray->buffernumchannels[0] = data->channels;
+			outbufferarray->bufferchannelmask[0] = 0;
+			outbufferarray->speakermode = data->speakerMode;
+		}
 
-	//Sets the external control of the music filtering (changed by F1/F2 buttons) 
-	float ec = external_control;
-	result = m_dsp->setParameterFloat(1, ec);
-	FmodErrorCheck(result);
+		return FMOD_OK;
+	}
 
-	//Sets the 3D attributes, given by the position and velocity of the sound source, to the module sound 
-	FMOD_VECTOR *srcPos = ToFmodVector(soundSource->GetPosition());
-	FMOD_VECTOR *srcVel = ToFmodVector(soundSource->GetVelocity());
-	result = m_3dChannel1->set3DAttributes(srcPos, srcVel);
-	FmodErrorCheck(result);
+	data->decoder->Read(inbufferarray->buffers[0], outbufferarray->buffers[0], length, inbufferarray->buffernumchannels[0], data->channels);
 
-	//Sets the external control of submarine sound filtering (the speed of the submarine, changed by F3/F4) 
-	float vel = submarine_vel*1000; //Changes the speed to 0-1 range
-	result = submarine_dsp->setParameterFloat(1, vel);
-	FmodErrorCheck(result);
+	return FMOD_OK;
+}
 
-	//Sets the 3D attributes, given by the position and velocity of the sound source, to the submarine sound
-	FMOD_VECTOR *srcPosSub = ToFmodVector(submarineSoundSource->GetPosition());
-	FMOD_VECTOR *srcVelSub = ToFmodVector(submarineSoundSource->GetVelocity());
-	result = m_3dChannel2->set3DAttributes(srcPosSub, srcVelSub);
-	FmodErrorCheck(result);
+/*
+	Callback called when the ambisonic decoder DSP is created. It decodes to the speaker mode of the mixer, and its
+	buffers are allocated for the block size of the mixer here, so the process callback doesn't allocate
+*/
+FMOD_RESULT F_CALLBACK CAudio::myAmbisonicDecoderCreateCallback(FMOD_DSP_STATE *dsp_state)
+{
+	unsigned int blockSize = 1024;
+	FMOD_SPEAKERMODE mixer = FMOD_SPEAKERMODE_STEREO, output;
+	dsp_state->functions->getblocksize(dsp_state, &blockSize);
+	dsp_state->functions->getspeakermode(dsp_state, &mixer, &output);
 
-	//Set the attributes of the 3D listener with the camera data 
-	FMOD_VECTOR *camPos = ToFmodVector(cam->GetPosition());
-	FMOD_VECTOR *camStrafe = ToFmodVector(cam->GetStrafeVector());
-	FMOD_VECTOR *camUp = ToFmodVector(cam->GetUpVector());
-	result = m_FmodSystem->set3DListenerAttributes(0, camPos, 0, camStrafe, camUp);
-	FmodErrorCheck(result);
+	ambisonic_decoder_data_t *data = (ambisonic_decoder_data_t *)calloc(sizeof(ambisonic_decoder_data_t), 1);
+	if (!data)
+	{
+		return FMOD_ERR_MEMORY;
+	}
 
-	//Updates the system
-	m_FmodSystem->update();
+	dsp_state->plugindata = data;
+	data->channels = SpeakerModeChannels(mixer);
+	data->speakerMode = mixer;
+	data->decoder = new CAmbisonicDecoderDsp(HRIR_SET);
+	data->decoder->Prepare(blockSize);
+
+	return FMOD_OK;
+}
+
+//Callback called when the ambisonic decoder DSP is released
+FMOD_RESULT F_CALLBACK CAudio::myAmbisonicDecoderReleaseCallback(FMOD_DSP_STATE *dsp_state)
+{
+	ambisonic_decoder_data_t *data = (ambisonic_decoder_data_t *)dsp_state->plugindata;
+	delete data->decoder;
+	free(data);
 
+	return FMOD_OK;
 }
 
+/*
+	Callback called when DSP::setParameterData is called on the ambisonic decoder DSP. The data parameter is the
+	orientation of the listener
+*/
+FMOD_RESULT F_CALLBACK CAudio::myAmbisonicDecoderSetParameterDataCallback(FMOD_DSP_STATE *dsp_state, int index, void *data, unsigned int length)
+{
+	if (index == 0 && length == sizeof(ambisonic_rotation_t))
+	{
+		((ambisonic_decoder_data_t *)dsp_state->plugindata)->decoder->SetRotation(*(ambisonic_rotation_t *)data);
+
+		return FMOD_OK;
+	}
+
+	return FMOD_ERR_INVALID_PARAM;
+}
+
+//Callback called when DSP::setParameterBool is called on the ambisonic decoder DSP. The bool parameter is the binaural decode
+FMOD_RESULT F_CALLBACK CAudio::myAmbisonicDecoderSetParameterBoolCallback(FMOD_DSP_STATE *dsp_state, int index, FMOD_BOOL value)
+{
+	if (index == 1)
+	{
+		((ambisonic_decoder_data_t *)dsp_state->plugindata)->decoder->SetBinaural(value != 0);
+
+		return FMOD_OK;
+	}
+
+	return FMOD_ERR_INVALID_PARAM;
+}
+
+//Returns the number of channels of a speaker mode
+int CAudio::SpeakerModeChannels(FMOD_SPEAKERMODE mode)
+{
+	switch (mode)
+	{
+	case FMOD_SPEAKERMODE_MONO: return 1;
+	case FMOD_SPEAKERMODE_QUAD: return 4;
+	case FMOD_SPEAKERMODE_SURROUND: return 5;
+	case FMOD_SPEAKERMODE_5POINT1: return 6;
+	case FMOD_SPEAKERMODE_7POINT1: return 8;
+	default: return 2;
+	}
+}
+
+/*
+	Read callback of a stream created with FMOD_OPENUSER. It never decodes: it copies what the prefetch thread has put in
+	the ring, and plays silence for anything missing rather than waiting for it
+*/
+FMOD_RESULT F_CALLBACK CAudio::StreamReadCallback(FMOD_SOUND *sound, void *data, unsigned int datalen)
+{
+	void *userdata;
+	((FMOD::Sound *)sound)->getUserData(&userdata);
+	CAudioStream *stream = (CAudioStream *)userdata;
+	stream->Read((float *)data, datalen / (stream->getChannels() * sizeof(float)));
+
+	return FMOD_OK;
+}
+
+//Read callback of the stream of a 3D voice: decodes the next frames of its ADPCM sample, a CAdpcmVoice
+FMOD_RESULT F_CALLBACK CAudio::AdpcmReadCallback(FMOD_SOUND *sound, void *data, unsigned int datalen)
+{
+	void *userdata;
+	((FMOD::Sound *)sound)->getUserData(&userdata);
+	CAdpcmVoice *voice = (CAdpcmVoice *)userdata;
+	voice->Read((float *)data, datalen / (VOICE_CHANNELS * sizeof(float)), VOICE_CHANNELS);
+
+	return FMOD_OK;
+}
+
+//Initialise the FMOD system and creates the DSP effect
+bool CAudio::Initialise()
+{
+	// Create an FMOD system
+	result = FMOD::System_Create(&m_FmodSystem);
+	FmodErrorCheck(result);
+	if (result != FMOD_OK)
+		return false;
+
+	// Initialise the system
+	result = m_FmodSystem->init(32, FMOD_INIT_NORMAL, 0);
+	FmodErrorCheck(result);
+	if (result != FMOD_OK)
+		return false;
+	m_soundLoader.SetSystem(m_FmodSystem);
+
+	// Set 3D settings. The Doppler shift and the roll-off are calculated by m_propagation, so FMOD only pans
+	result = m_FmodSystem->set3DSettings(0.0f, 1.0f, 0.0f); //doppler scale, distance factor, distance roll-off
+	FmodErrorCheck(result);
+	if (result != FMOD_OK)
+		return false;
+
+	// Pick the FIR kernel for the CPU the game runs on, before any DSP can call it
+	CFirKernels::Select();
+
+	// Design the filter bank at the mixer sample rate, before any DSP is created with it
+	int sampleRate = 44100;
+	m_FmodSystem->getSoftwareFormat(&sampleRate, NULL, NULL);
+	if (!FILTER_BANK.Build(FILTER_TAPS, FIR1_SPEC, FIR2_SPEC, (float)sampleRate, BANK_SIZE))
+		FILTER_BANK.Build(FIR1, FIR2, (float)sampleRate);
+
+	// Create the user stream of every voice once, so starting and stopping a voice never creates or releases one. The
+	// stream reads whatever sample its ADPCM voice is given, and the channel plays it at the rate of the sample
+	for (int v = 0; v < REAL_VOICES; v++)
+	{
+		FMOD_CREATESOUNDEXINFO exinfo;
+		memset(&exinfo, 0, sizeof(exinfo));
+		exinfo.cbsize = sizeof(exinfo);
+		exinfo.numchannels = VOICE_CHANNELS;
+		exinfo.defaultfrequency = sampleRate;
+		exinfo.format = FMOD_SOUND_FORMAT_PCMFLOAT;
+		exinfo.length = sampleRate * VOICE_CHANNELS * sizeof(float);
+		exinfo.decodebuffersize = ADPCM_DECODE_FRAMES;
+		exinfo.pcmreadcallback = AdpcmReadCallback;
+		exinfo.userdata = &m_adpcmVoices[v];
+		result = m_FmodSystem->createStream(NULL, FMOD_OPENUSER | FMOD_LOOP_NORMAL, &exinfo, &m_voiceStreams[v]);
+		FmodErrorCheck(result);
+		if (result != FMOD_OK)
+			return false;
+	}
+
+	// Create the states of the dynamic filter DSPs, sized for the largest blocks and layouts the mixer can ask for
+	unsigned int blockLength = 1024;
+	int blockCount = 4;
+	m_FmodSystem->getDSPBufferSize(&blockLength, &blockCount);
+	FILTER_DSP_POOL.Init(FILTER_BANK, FILTER_MODE, blockLength, CChannelMixer::MAX_CHANNELS);
+
+	// The submarine morphs with its speed along the first control and the depth of water to the listener along the second
+	vector<band_spec_t> corners{ FIR1_SPEC, FIR2_SPEC, FIR1_DEEP_SPEC, FIR2_DEEP_SPEC };
+	vector<int> sizes{ BANK_SIZE, DEPTH_SIZE };
+	if (!m_submarineBank.Build(FILTER_TAPS, corners, (float)sampleRate, sizes))
+		m_submarineBank = FILTER_BANK;
+
+	// Create the DSP effect 
+	{
+		//Creates the DSP descriptor
+		FMOD_DSP_DESCRIPTION dspdesc;
+		memset(&dspdesc, 0, sizeof(dspdesc));
+
+		//Creates the DSP parameters
+		FMOD_DSP_PARAMETER_DESC data_desc;
+		FMOD_DSP_PARAMETER_DESC  external_control_desc;
+		FMOD_DSP_PARAMETER_DESC  depth_control_desc;
+		FMOD_DSP_PARAMETER_DESC  mode_desc;
+		FMOD_DSP_PARAMETER_DESC  profiler_desc;
+		FMOD_DSP_PARAMETER_DESC *paramdesc[5] =
+		{
+			&data_desc,
+			&external_control_desc,
+			&depth_control_desc,
+			&mode_desc,
+			&profiler_desc
+		};
+		static const char *modeNames[3] = { "FIR", "IIR", "Multirate" };
+		FMOD_DSP_INIT_PARAMDESC_DATA(data_desc, "data", "", "data", FMOD_DSP_PARAMETER_DATA_TYPE_USER);
+		FMOD_DSP_INIT_PARAMDESC_FLOAT(external_control_desc, "external control", "%", "external control in percent", 0, 1, 1);
+		FMOD_DSP_INIT_PARAMDESC_FLOAT(depth_control_desc, "depth control", "%", "second control of 2D filter banks in percent", 0, 1, 0);
+		FMOD_DSP_INIT_PARAMDESC_INT(mode_desc, "mode", "", "exact FIR filters, cheaper fitted IIR sections or FIR filters at a lower rate", FILTER_MODE_FIR, FILTER_MODE_MULTIRATE, FILTER_MODE, false, modeNames);
+		FMOD_DSP_INIT_PARAMDESC_DATA(profiler_desc, "profiler", "", "CPU time accounting of the read callback, read only", FMOD_DSP_PARAMETER_DATA_TYPE_USER);
+
+		//Intialise some variables of the DSP descriptor 
+		strncpy_s(dspdesc.name, "Control FIR filter", sizeof(dspdesc.name));
+		dspdesc.version = 0x00010000;
+		dspdesc.numinputbuffers = 2;
+		dspdesc.numoutputbuffers = 2;
+		dspdesc.read = DSPCallback;
+		dspdesc.create = myDSPCreateCallback;
+		dspdesc.release = myDSPReleaseCallback;
+		dspdesc.reset = myDSPResetCallback;
+		dspdesc.setparameterfloat = myDSPSetParameterFloatCallback;
+		dspdesc.setparameterint = myDSPSetParameterIntCallback;
+		dspdesc.setparameterdata = myDSPSetParameterDataCallback;
+		dspdesc.getparameterdata = myDSPGetParameterDataCallback;
+		dspdesc.numparameters = 5;
+		dspdesc.paramdesc = paramdesc;
+
+		//Creates the DSP for the music stream 
+		result = m_FmodSystem->createDSP(&dspdesc, &m_dsp);
+		FmodErrorCheck(result);
+
+		if (result != FMOD_OK)
+			return false;
+
+		//Creates the DSP for the submarine sound
+		result = m_FmodSystem->createDSP(&dspdesc, &submarine_dsp);
+		FmodErrorCheck(result);
+
+		if (result != FMOD_OK)
+			return false;
+
+		//The profilers of both DSPs are read by the game thread for the HUD
+		m_musicProfiler = GetDSPProfiler(m_dsp);
+		m_submarineProfiler = GetDSPProfiler(submarine_dsp);
+
+		//Gives it the speed x depth bank. The passband of the bank reaches too high for decimating to pay off, so it runs
+		//the engine the pool prepared, like the music. The engine of the new bank is built and prepared here
+		if (!SetSubmarineFilters(m_submarineBank) || !SetSubmarineFilterMode(FILTER_MODE))
+			return false;
+	}
+
+	// Create the underwater reverb and add it to the master channel group, so a single reverb is applied to every channel
+	{
+		FMOD_DSP_DESCRIPTION dspdesc;
+		memset(&dspdesc, 0, sizeof(dspdesc));
+
+		FMOD_DSP_PARAMETER_DESC wet_desc;
+		FMOD_DSP_PARAMETER_DESC dry_desc;
+		FMOD_DSP_PARAMETER_DESC *paramdesc[2] =
+		{
+			&wet_desc,
+			&dry_desc
+		};
+		FMOD_DSP_INIT_PARAMDESC_FLOAT(wet_desc, "wet", "", "level of the reverb", 0, 1, 0.3f);
+		FMOD_DSP_INIT_PARAMDESC_FLOAT(dry_desc, "dry", "", "level of the original signal", 0, 1, 1);
+
+		strncpy_s(dspdesc.name, "Convolution reverb", sizeof(dspdesc.name));
+		dspdesc.version = 0x00010000;
+		dspdesc.numinputbuffers = 1;
+		dspdesc.numoutputbuffers = 1;
+		dspdesc.read = ReverbDSPCallback;
+		dspdesc.create = myReverbCreateCallback;
+		dspdesc.release = myReverbReleaseCallback;
+		dspdesc.setparameterfloat = myReverbSetParameterFloatCallback;
+		dspdesc.numparameters = 2;
+		dspdesc.paramdesc = paramdesc;
+
+		result = m_FmodSystem->createDSP(&dspdesc, &m_reverbDsp);
+		FmodErrorCheck(result);
+
+		if (result != FMOD_OK)
+			return false;
+
+		FMOD::ChannelGroup *master;
+		result = m_FmodSystem->getMasterChannelGroup(&master);
+		FmodErrorCheck(result);
+
+		if (result != FMOD_OK)
+			return false;
+
+		result = master->addDSP(0, m_reverbDsp);
+		FmodErrorCheck(result);
+	}
+
+	// Create an HRTF DSP for every channel of the 3D sounds. The measured set is used if the game ships one, the spherical
+	// head model otherwise
+	{
+		if (!HRIR_SET.Load(HRIR_FILE, HRIR_DIRECTIONS_FILE, sampleRate))
+			HRIR_SET.Generate(sampleRate);
+		HRIR_SET.Transform(HRTF_BLOCK);
+
+		FMOD_DSP_DESCRIPTION dspdesc;
+		memset(&dspdesc, 0, sizeof(dspdesc));
+
+		FMOD_DSP_PARAMETER_DESC direction_desc;
+		FMOD_DSP_PARAMETER_DESC *paramdesc[1] =
+		{
+			&direction_desc
+		};
+		FMOD_DSP_INIT_PARAMDESC_DATA(direction_desc, "direction", "", "azimuth, elevation and distance gain of the voice", FMOD_DSP_PARAMETER_DATA_TYPE_USER);
+
+		strncpy_s(dspdesc.name, "HRTF", sizeof(dspdesc.name));
+		dspdesc.version = 0x00010000;
+		dspdesc.numinputbuffers = 1;
+		dspdesc.numoutputbuffers = 1;
+		dspdesc.read = HrtfDSPCallback;
+		dspdesc.create = myHrtfCreateCallback;
+		dspdesc.release = myHrtfReleaseCallback;
+		dspdesc.reset = myHrtfResetCallback;
+		dspdesc.setparameterdata = myHrtfSetParameterDataCallback;
+		dspdesc.numparameters = 1;
+		dspdesc.paramdesc = paramdesc;
+
+		for (int v = 0; v < REAL_VOICES; v++)
+		{
+			result = m_FmodSystem->createDSP(&dspdesc, &m_hrtfDsps[v]);
+			FmodErrorCheck(result);
+
+			if (result != FMOD_OK)
+				return false;
+
+			//The output is the pair of ears whatever the speaker mode of the mixer
+			result = m_hrtfDsps[v]->setChannelFormat(FMOD_CHANNELMASK_STEREO, 2, FMOD_SPEAKERMODE_STEREO);
+			FmodErrorCheck(result);
+		}
+	}
+
+	// Create the ambisonic bus: an encoder DSP for every channel of the 3D sounds, and a channel group they are mixed into
+	// with the decoder DSP at its head. The decoder uses HRIR_SET for the binaural decode
+	{
+		FMOD_DSP_DESCRIPTION dspdesc;
+		memset(&dspdesc, 0, sizeof(dspdesc));
+
+		FMOD_DSP_PARAMETER_DESC gains_desc;
+		FMOD_DSP_PARAMETER_DESC *paramdesc[1] =
+		{
+			&gains_desc
+		};
+		FMOD_DSP_INIT_PARAMDESC_DATA(gains_desc, "gains", "", "gains of the voice into the channels of the bus", FMOD_DSP_PARAMETER_DATA_TYPE_USER);
+
+		strncpy_s(dspdesc.name, "Ambisonic encoder", sizeof(dspdesc.name));
+		dspdesc.version = 0x00010000;
+		dspdesc.numinputbuffers = 1;
+		dspdesc.numoutputbuffers = 1;
+		dspdesc.process = AmbisonicEncoderDSPCallback;
+		dspdesc.create = myAmbisonicEncoderCreateCallback;
+		dspdesc.release = myAmbisonicEncoderReleaseCallback;
+		dspdesc.reset = myAmbisonicEncoderResetCallback;
+		dspdesc.setparameterdata = myAmbisonicEncoderSetParameterDataCallback;
+		dspdesc.numparameters = 1;
+		dspdesc.paramdesc = paramdesc;
+
+		for (int v = 0; v < REAL_VOICES; v++)
+		{
+			result = m_FmodSystem->createDSP(&dspdesc, &m_encoderDsps[v]);
+			FmodErrorCheck(result);
+
+			if (result != FMOD_OK)
+				return false;
+		}
+	}
+	{
+		FMOD_DSP_DESCRIPTION dspdesc;
+		memset(&dspdesc, 0, sizeof(dspdesc));
+
+		FMOD_DSP_PARAMETER_DESC rotation_desc;
+		FMOD_DSP_PARAMETER_DESC binaural_desc;
+		FMOD_DSP_PARAMETER_DESC *paramdesc[2] =
+		{
+			&rotation_desc,
+			&binaural_desc
+		};
+		FMOD_DSP_INIT_PARAMDESC_DATA(rotation_desc, "rotation", "", "orientation of the listener in the frame of the bus", FMOD_DSP_PARAMETER_DATA_TYPE_USER);
+		FMOD_DSP_INIT_PARAMDESC_BOOL(binaural_desc, "binaural", "", "decode to the ears rather than to the speakers", true, 0);
+
+		strncpy_s(dspdesc.name, "Ambisonic decoder", sizeof(dspdesc.name));
+		dspdesc.version = 0x00010000;
+		dspdesc.numinputbuffers = 1;
+		dspdesc.numoutputbuffers = 1;
+		dspdesc.process = AmbisonicDecoderDSPCallback;
+		dspdesc.create = myAmbisonicDecoderCreateCallback;
+		dspdesc.release = myAmbisonicDecoderReleaseCallback;
+		dspdesc.setparameterdata = myAmbisonicDecoderSetParameterDataCallback;
+		dspdesc.setparameterbool = myAmbisonicDecoderSetParameterBoolCallback;
+		dspdesc.numparameters = 2;
+		dspdesc.paramdesc = paramdesc;
+
+		result = m_FmodSystem->createDSP(&dspdesc, &m_decoderDsp);
+		FmodErrorCheck(result);
+
+		if (result != FMOD_OK)
+			return false;
+
+		//The channels of the bus are mixed as they are, not as speakers
+		result = m_decoderDsp->setChannelFormat(0, CAmbisonicEncoder::CHANNELS, FMOD_SPEAKERMODE_RAW);
+		FmodErrorCheck(result);
+		result = m_decoderDsp->setParameterBool(1, m_binaural);
+		FmodErrorCheck(result);
+
+		result = m_FmodSystem->createChannelGroup("Ambisonic bus", &m_ambisonicGroup);
+		FmodErrorCheck(result);
+
+		if (result != FMOD_OK)
+			return false;
+
+		result = m_ambisonicGroup->addDSP(FMOD_CHANNELCONTROL_DSP_HEAD, m_decoderDsp);
+		FmodErrorCheck(result);
+	}
+
+	// Create the absorption low pass of every channel of the 3D sounds
+	for (int v = 0; v < REAL_VOICES; v++)
+	{
+		result = m_FmodSystem->createDSPByType(FMOD_DSP_TYPE_LOWPASS_SIMPLE, &m_lowpassDsps[v]);
+		FmodErrorCheck(result);
+
+		if (result != FMOD_OK)
+			return false;
+	}
+
+	return true;
+}
+
+/*
+	Load a music stream. The music is decoded ahead into a ring on the prefetch thread, and the sound FMOD plays is a
+	user stream that only copies the ready samples out of it. The source loops, so the sound just keeps reading
+*/
+bool CAudio::LoadMusicStream(const char *filename)
+{
+	CStreamSource *source = OpenStreamSource(filename);
+	if (!source)
+		return false;
+
+	int sampleRate = source->getSampleRate();
+	m_musicStream = new CAudioStream(source, true, (unsigned int)(STREAM_BUFFER_SECONDS * sampleRate));
+	m_prefetcher.Add(m_musicStream, (unsigned int)(STREAM_PREFILL_SECONDS * sampleRate));
+
+	FMOD_CREATESOUNDEXINFO exinfo;
+	memset(&exinfo, 0, sizeof(exinfo));
+	exinfo.cbsize = sizeof(exinfo);
+	exinfo.numchannels = m_musicStream->getChannels();
+	exinfo.defaultfrequency = sampleRate;
+	exinfo.format = FMOD_SOUND_FORMAT_PCMFLOAT;
+	exinfo.decodebuffersize = STREAM_DECODE_FRAMES;
+	exinfo.pcmreadcallback = StreamReadCallback;
+	exinfo.userdata = m_musicStream;
+	//Length in bytes; a source of unknown length is played as the longest sound FMOD takes
+	unsigned long long bytes = (unsigned long long)m_musicStream->getFrames() * exinfo.numchannels * sizeof(float);
+	exinfo.length = bytes > 0 && bytes < 0xFFFFFFFF ? (unsigned int)bytes : 0xFFFFFFFF;
+
+	result = m_FmodSystem->createStream(NULL, FMOD_OPENUSER | FMOD_LOOP_NORMAL, &exinfo, &m_music);
+	FmodErrorCheck(result);
+
+	if (result != FMOD_OK)
+		return false;
+
+	return true;
+}
+
+// Play a music stream
+bool CAudio::PlayMusicStream()
+{
+	result = m_FmodSystem->playSound(m_music, NULL, false, &m_musicChannel);
+	FmodErrorCheck(result);
+
+	if (result != FMOD_OK)
+		return false;
+
+	//Sets the 2D mode
+	result = m_musicChannel->setMode(FMOD_2D);
+	FmodErrorCheck(result);
+
+	//Adds the DSP effect 
+	result = m_musicChannel->addDSP(0, m_dsp);
+	FmodErrorCheck(result);
+
+	return true;
+}
+
+
+// Load a sound source
+bool CAudio::LoadSoundSource(const char *filename)
+{
+	return LoadBankSound(filename, m_sound1);
+}
+
+// Play the sound source
+bool CAudio::PlaySoundSource(const CSoundSource *source)
+{
+	return PlayEmitter(source->GetEmitter(), m_sound1, NULL, 1.0f, 1.0f);
+}
+
+// Load the object sound
+bool CAudio::LoadObjectSound(const char *filename)
+{
+	return LoadBankSound(filename, m_sound2);
+}
+
+// Play the object sound
+bool CAudio::PlayObjectSound(const CSoundSource *source)
+{
+	//Played louder, with the submarine DSP effect
+	return PlayEmitter(source->GetEmitter(), m_sound2, submarine_dsp, 10.0f, 1.0f);
+}
+
+/*
+	The new sound is taken before the old one is given back, so loading the same file again keeps it resident. A file
+	the bank already has, under any path, isn't loaded twice
+*/
+bool CAudio::LoadBankSound(const char *filename, int &sound)
+{
+	int loaded = m_soundBank.Load(filename);
+	if (loaded < 0)
+		return false;
+
+	m_soundBank.Release(sound);
+	sound = loaded;
+	return true;
+}
+
+//Memory the resident sounds are kept within
+void CAudio::SetSoundBankBudget(size_t bytes)
+{
+	m_soundBank.SetBudget(bytes);
+}
+
+//Counters of the sound bank
+sound_bank_stats_t CAudio::GetSoundBankStats()
+{
+	return m_soundBank.getStats();
+}
+
+//Opens a WAVE file through a mapping, or any other file with FMOD's codecs
+CStreamSource *CAudio::OpenStreamSource(const char *filename)
+{
+	CWavStreamSource *wav = new CWavStreamSource();
+	if (wav->Open(filename))
+		return wav;
+	delete wav;
+
+	CFmodStreamSource *fmod = new CFmodStreamSource();
+	if (fmod->Open(m_FmodSystem, filename))
+		return fmod;
+	delete fmod;
+	return NULL;
+}
+
+// Play a looping sound from an emitter, which gets a channel on the next update if it is audible enough
+bool CAudio::PlayEmitter(int emitter, int sound, FMOD::DSP *dsp, float volume, float priority)
+{
+	if (sound < 0 || emitter < 0 || emitter >= MAX_EMITTERS)
+		return false;
+
+	m_emitterSounds[emitter] = sound;
+	m_emitterDsps[emitter] = dsp;
+	m_voiceManager.Play(emitter, volume, priority);
+
+	//An emitter that is already heard starts its sound again on the same channel
+	int voice = m_emitters.getVoice(emitter);
+	if (voice != CEmitterTable::NO_VOICE)
+	{
+		StopVoice(voice, emitter);
+		StartVoice(emitter);
+	}
+
+	return true;
+}
+
+/*
+	The channel is stopped now rather than on the next update, as the index can be given to a new emitter before then
+	and the DSP effect of the old one must come off the channel. The voice manager hands the voice back and lists it as
+	stopped on the next update, which finds its channel already stopped
+*/
+bool CAudio::RemoveEmitter(int emitter)
+{
+	if (!m_emitters.isLive(emitter))
+		return false;
+
+	int voice = m_emitters.getVoice(emitter);
+	if (voice != CEmitterTable::NO_VOICE)
+		StopVoice(voice, emitter);
+	m_emitterSounds[emitter] = -1;
+	m_emitterDsps[emitter] = NULL;
+	return m_voiceManager.Remove(emitter);
+}
+
+/*
+	The channel starts paused, so its 3D attributes can be set before the mixer hears it. A virtual emitter went on
+	playing silently, so its sound starts where it would be now: the ADPCM voice starts there before its stream reads it
+*/
+void CAudio::StartVoice(int emitter)
+{
+	int voice = m_emitters.getVoice(emitter);
+	m_voiceEmitters[voice] = emitter;
+	//The bank keeps the sound until the voice stops. An evicted sound is read again by the loader of the bank, and the
+	//voice waits without a channel until Update starts it
+	const CAdpcmSample *sample = (const CAdpcmSample *)m_soundBank.Play(m_emitterSounds[emitter]);
+	if (sample == NULL)
+	{
+		m_3dChannels[voice] = NULL;
+		return;
+	}
+	double frame = sample->getFrames() > 0 ? fmod(m_voiceManager.getPlayTime(emitter) / 1000.0 * sample->getSampleRate(), (double)sample->getFrames()) : 0.0;
+	m_adpcmVoices[voice].Start(sample, (unsigned int)frame);
+
+	//The stream of the voice, created with the system, decodes the sample in its read callback a few blocks ahead of
+	//the channel. The channel plays at the rate of the sample
+	result = m_FmodSystem->playSound(m_voiceStreams[voice], m_ambisonic ? m_ambisonicGroup : NULL, true, &m_3dChannels[voice]);
+	FmodErrorCheck(result);
+	if (result != FMOD_OK)
+	{
+		m_adpcmVoices[voice].Start(NULL, 0);
+		m_soundBank.Stop(m_emitterSounds[emitter]);
+		m_3dChannels[voice] = NULL;
+		return;
+	}
+	m_voiceSounds[voice] = m_emitterSounds[emitter];
+	result = m_3dChannels[voice]->setFrequency((float)sample->getSampleRate());
+	FmodErrorCheck(result);
+
+	//Sets the 3D mode, or the 2D mode when the HRTF DSP or the ambisonic bus places the sound
+	FMOD::Channel *channel = m_3dChannels[voice];
+	result = channel->setMode(m_binaural || m_ambisonic ? FMOD_2D : FMOD_3D);
+	FmodErrorCheck(result);
+
+	//Adds the DSP effect
+	if (m_emitterDsps[emitter])
+	{
+		result = channel->addDSP(0, m_emitterDsps[emitter]);
+		FmodErrorCheck(result);
+	}
+
+	//Adds the absorption of the water after the effect, and the encoder or the HRTF DSP of the voice after them, with no
+	//history of the channel they placed before
+	result = channel->addDSP(0, m_lowpassDsps[voice]);
+	FmodErrorCheck(result);
+	ApplyPropagation(voice, true);
+	if (m_ambisonic)
+	{
+		SetVoiceGains(voice);
+		result = m_encoderDsps[voice]->reset();
+		FmodErrorCheck(result);
+		result = channel->addDSP(0, m_encoderDsps[voice]);
+		FmodErrorCheck(result);
+	}
+	else if (m_binaural)
+	{
+		SetVoiceDirection(voice);
+		result = m_hrtfDsps[voice]->reset();
+		FmodErrorCheck(result);
+		result = channel->addDSP(0, m_hrtfDsps[voice]);
+		FmodErrorCheck(result);
+	}
+
+	FMOD_VECTOR srcPos, srcVel;
+	m_emitters.getPosition(emitter, &srcPos.x);
+	m_emitters.getVelocity(emitter, &srcVel.x);
+	result = channel->set3DAttributes(&srcPos, &srcVel);
+	FmodErrorCheck(result);
+	result = channel->setPaused(false);
+	FmodErrorCheck(result);
+}
+
+//Stops the channel of a voice taken from its emitter. Its DSP effect is taken off so the next channel can have it
+void CAudio::StopVoice(int voice, int emitter)
+{
+	FMOD::Channel *channel = m_3dChannels[voice];
+	if (channel == NULL)
+	{
+		//The voice was waiting for its sound
+		m_voiceEmitters[voice] = -1;
+		return;
+	}
+
+	if (m_emitterDsps[emitter])
+	{
+		result = channel->removeDSP(m_emitterDsps[emitter]);
+		FmodErrorCheck(result);
+	}
+	if (m_ambisonic)
+	{
+		result = channel->removeDSP(m_encoderDsps[voice]);
+		FmodErrorCheck(result);
+	}
+	else if (m_binaural)
+	{
+		result = channel->removeDSP(m_hrtfDsps[voice]);
+		FmodErrorCheck(result);
+	}
+	result = channel->removeDSP(m_lowpassDsps[voice]);
+	FmodErrorCheck(result);
+	result = channel->stop();
+	FmodErrorCheck(result);
+	//The ADPCM voice waits for a read callback in progress, so the sample can be evicted after it. The stream stays
+	//for the next sample of the voice
+	m_adpcmVoices[voice].Start(NULL, 0);
+	m_soundBank.Stop(m_voiceSounds[voice]);
+	m_3dChannels[voice] = NULL;
+	m_voiceEmitters[voice] = -1;
+	m_voiceSounds[voice] = -1;
+}
+
+/*
+	The emitter is projected on the axes of the listener: the azimuth turns clockwise from the front towards the right
+	and the elevation rises towards the up vector
+*/
+void CAudio::SetVoiceDirection(int voice)
+{
+	float position[3];
+	m_emitters.getPosition(m_voiceEmitters[voice], position);
+	glm::vec3 offset = glm::vec3(position[0], position[1], position[2]) - m_listenerPosition;
+	float x = glm::dot(offset, m_listenerRight);
+	float y = glm::dot(offset, m_listenerUp);
+	float z = glm::dot(offset, m_listenerFront);
+	float horizontal = sqrtf(x * x + z * z);
+
+	hrtf_direction_t direction;
+	direction.azimuth = atan2f(x, z) * 180.0f / 3.14159265f;
+	direction.elevation = atan2f(y, horizontal) * 180.0f / 3.14159265f;
+	result = m_hrtfDsps[voice]->setParameterData(0, &direction, sizeof(direction));
+	FmodErrorCheck(result);
+}
+
+/*
+	The results of m_propagation change a little every frame, so they are only sent when the change can be heard: 1% of
+	the volume, 2% of the cutoff and a tenth of a percent of the pitch, below the smallest step the ear tells apart
+*/
+void CAudio::ApplyPropagation(int voice, bool force)
+{
+	FMOD::Channel *channel = m_3dChannels[voice];
+	int emitter = m_voiceEmitters[voice];
+	float gain = m_voiceManager.getVolume(emitter) * m_propagation.getGains()[emitter];
+	float cutoff = m_propagation.getCutoffs()[emitter];
+	float pitch = m_propagation.getPitches()[emitter];
+
+	if (force || fabsf(gain - m_voiceGains[voice]) > 0.01f * m_voiceGains[voice])
+	{
+		result = channel->setVolume(gain);
+		FmodErrorCheck(result);
+		m_voiceGains[voice] = gain;
+	}
+	if (force || fabsf(cutoff - m_voiceCutoffs[voice]) > 0.02f * m_voiceCutoffs[voice])
+	{
+		result = m_lowpassDsps[voice]->setParameterFloat(FMOD_DSP_LOWPASS_SIMPLE_CUTOFF, cutoff);
+		FmodErrorCheck(result);
+		m_voiceCutoffs[voice] = cutoff;
+	}
+	if (force || fabsf(pitch - m_voicePitches[voice]) > 0.001f * m_voicePitches[voice])
+	{
+		result = channel->setPitch(pitch);
+		FmodErrorCheck(result);
+		m_voicePitches[voice] = pitch;
+	}
+}
+
+//Sends the ambisonic gains of the emitter of a voice to its encoder DSP
+void CAudio::SetVoiceGains(int voice)
+{
+	ambisonic_gains_t gains;
+	m_ambisonicEncoder.getGains(m_voiceEmitters[voice], gains.gains);
+	result = m_encoderDsps[voice]->setParameterData(0, &gains, sizeof(gains));
+	FmodErrorCheck(result);
+}
+
+/*
+	The bus is encoded in world coordinates, so the decoder turns it into the frame of the listener: x to the front,
+	y to the left and z up
+*/
+void CAudio::SetListenerRotation()
+{
+	glm::vec3 left = -m_listenerRight;
+	float axes[9] = {
+		m_listenerFront.x, m_listenerFront.y, m_listenerFront.z,
+		left.x, left.y, left.z,
+		m_listenerUp.x, m_listenerUp.y, m_listenerUp.z
+	};
+	ambisonic_rotation_t rotation;
+	CAmbisonicEncoder::Rotation(axes, rotation.matrix);
+	result = m_decoderDsp->setParameterData(0, &rotation, sizeof(rotation));
+	FmodErrorCheck(result);
+}
+
+// Stop the channels that play, change how they are placed and start them again the new way
+void CAudio::SetPlacement(bool binaural, bool ambisonic)
+{
+	//The channels are stopped the way they were started
+	int emitters[REAL_VOICES];
+	for (int v = 0; v < REAL_VOICES; v++)
+	{
+		emitters[v] = m_3dChannels[v] != NULL ? m_voiceEmitters[v] : -1;
+		if (emitters[v] >= 0)
+			StopVoice(v, emitters[v]);
+	}
+	m_binaural = binaural;
+	m_ambisonic = ambisonic;
+	result = m_decoderDsp->setParameterBool(1, m_binaural);
+	FmodErrorCheck(result);
+	//The gains of the bus are only kept up to date while it is used
+	if (m_ambisonic)
+	{
+		m_ambisonicEncoder.Update(m_emitters, glm::value_ptr(m_listenerPosition));
+		SetListenerRotation();
+	}
+	for (int v = 0; v < REAL_VOICES; v++)
+	{
+		if (emitters[v] >= 0)
+			StartVoice(emitters[v]);
+	}
+}
+
+// Switch between the HRTF DSPs and FMOD's panner, or between the binaural and the speaker decode of the ambisonic bus
+void CAudio::SetBinaural(bool binaural)
+{
+	if (binaural == m_binaural)
+		return;
+
+	//The bus only changes its decoder, the voices play on
+	if (m_ambisonic)
+	{
+		m_binaural = binaural;
+		result = m_decoderDsp->setParameterBool(1, m_binaural);
+		FmodErrorCheck(result);
+		return;
+	}
+	SetPlacement(binaural, m_ambisonic);
+}
+
+// Switch between the ambisonic bus and placing every channel on its own
+void CAudio::SetAmbisonic(bool ambisonic)
+{
+	if (ambisonic == m_ambisonic)
+		return;
+
+	SetPlacement(m_binaural, ambisonic);
+}
+
+// Replace the filter bank of the music DSP
+bool CAudio::SetMusicFilters(const CFilterBank &bank)
+{
+	return SetDSPFilters(m_dsp, bank);
+}
+
+// Replace the filter bank of the submarine DSP
+bool CAudio::SetSubmarineFilters(const CFilterBank &bank)
+{
+	return SetDSPFilters(submarine_dsp, bank);
+}
+
+// Choose the engine of the music DSP
+bool CAudio::SetMusicFilterMode(FilterMode mode)
+{
+	result = m_dsp->setParameterInt(3, mode);
+	FmodErrorCheck(result);
+
+	return result == FMOD_OK;
+}
+
+// Choose the engine of the submarine DSP
+bool CAudio::SetSubmarineFilterMode(FilterMode mode)
+{
+	result = submarine_dsp->setParameterInt(3, mode);
+	FmodErrorCheck(result);
+
+	return result == FMOD_OK;
+}
+
+// Send a new filter bank through the data parameter of a dynamic filter DSP
+bool CAudio::SetDSPFilters(FMOD::DSP *dsp, const CFilterBank &bank)
+{
+	filter_coefficients_t coefficients;
+	coefficients.bank = &bank;
+	result = dsp->setParameterData(0, &coefficients, sizeof(coefficients));
+	FmodErrorCheck(result);
+
+	return result == FMOD_OK;
+}
+
+// Read the profiler of a dynamic filter DSP through its read-only data parameter
+CDspProfiler *CAudio::GetDSPProfiler(FMOD::DSP *dsp)
+{
+	void *data = NULL;
+	unsigned int length = 0;
+	result = dsp->getParameterData(4, &data, &length, NULL, 0);
+	FmodErrorCheck(result);
+
+	return result == FMOD_OK && length == sizeof(CDspProfiler) ? (CDspProfiler *)data : NULL;
+}
+
+// CPU load of the music and the submarine DSPs since the last call
+void CAudio::GetDspLoads(dsp_load_t &music, dsp_load_t &submarine)
+{
+	dsp_load_t none = { 0.0f, 0.0f, 0, 0 };
+	music = m_musicProfiler ? m_musicProfiler->Snapshot() : none;
+	submarine = m_submarineProfiler ? m_submarineProfiler->Snapshot() : none;
+}
+
+/*
+	Called every frame, so it must not allocate: the FMOD vectors live on the stack, the controls are copied into
+	buffers the DSPs allocated when they were created and the emitter table was allocated for MAX_EMITTERS. Debug builds
+	assert it
+*/
+void CAudio::Update(float dt, float external_control, const CSoundSource *submarineSoundSource, float submarine_vel, const CCamera *cam)
+{
+	BEGIN_NO_ALLOCATIONS();
+
+	//Sets the external control of the music filtering (changed by F1/F2 buttons) 
+	float ec = external_control;
+	result = m_dsp->setParameterFloat(1, ec);
+	FmodErrorCheck(result);
+
+	//Sets the external control of submarine sound filtering (the speed of the submarine, changed by F3/F4) 
+	float vel = submarine_vel*1000; //Changes the speed to 0-1 range
+	result = submarine_dsp->setParameterFloat(1, vel);
+	FmodErrorCheck(result);
+
+	//Sets the depth control of submarine sound filtering (the water between the submarine and the listener)
+	float depth = glm::length(submarineSoundSource->GetPosition() - cam->GetPosition()) / DEPTH_DISTANCE;
+	result = submarine_dsp->setParameterFloat(2, depth);
+	FmodErrorCheck(result);
+
+	//Moves every emitter with its velocity, then gives the channels to the emitters the listener hears best
+	m_emitters.Integrate(dt);
+	if (dt > 0.0f)
+		m_listenerVelocity = (cam->GetPosition() - m_listenerPosition) / dt;
+	m_listenerPosition = cam->GetPosition();
+	m_listenerFront = glm::normalize(cam->GetView() - m_listenerPosition);
+	m_listenerRight = glm::normalize(glm::cross(m_listenerFront, cam->GetUpVector()));
+	m_listenerUp = glm::cross(m_listenerRight, m_listenerFront);
+	m_propagation.Update(m_emitters, glm::value_ptr(m_listenerPosition), glm::value_ptr(m_listenerVelocity));
+	if (m_ambisonic)
+		m_ambisonicEncoder.Update(m_emitters, glm::value_ptr(m_listenerPosition));
+	m_voiceManager.Update(dt, glm::value_ptr(m_listenerPosition));
+	const vector<int> &stopped = m_voiceManager.getStopped();
+	const vector<int> &stoppedVoices = m_voiceManager.getStoppedVoices();
+	for (size_t i = 0; i < stopped.size(); i++)
+		StopVoice(stoppedVoices[i], stopped[i]);
+	const vector<int> &started = m_voiceManager.getStarted();
+	for (size_t i = 0; i < started.size(); i++)
+		StartVoice(started[i]);
+
+	//The voices waiting for a sound the loader of the bank has read again start now
+	const vector<int> &reloaded = m_soundBank.Update();
+	for (size_t i = 0; i < reloaded.size(); i++)
+	{
+		for (int v = 0; v < REAL_VOICES; v++)
+		{
+			int emitter = m_voiceEmitters[v];
+			if (m_3dChannels[v] == NULL && emitter >= 0 && m_emitters.getVoice(emitter) == v && m_emitterSounds[emitter] == reloaded[i])
+				StartVoice(emitter);
+		}
+	}
+
+	//Sets the 3D attributes of the channels whose emitter moved enough to be heard. The HRTF DSPs and the ambisonic
+	//encoders follow every emitter instead
+	const vector<int> &changed = m_emitters.Collect();
+	for (size_t i = 0; i < changed.size() && !m_binaural && !m_ambisonic; i++)
+	{
+		int emitter = changed[i];
+		FMOD::Channel *channel = m_3dChannels[m_emitters.getVoice(emitter)];
+		if (channel == NULL)
+			continue;
+		FMOD_VECTOR srcPos, srcVel;
+		m_emitters.getPosition(emitter, &srcPos.x);
+		m_emitters.getVelocity(emitter, &srcVel.x);
+		result = channel->set3DAttributes(&srcPos, &srcVel);
+		FmodErrorCheck(result);
+	}
+	//Applies the propagation of every channel, and their directions to the ambisonic encoders or the HRTF DSPs. The bus
+	//is turned to the listener once for all of them
+	for (int v = 0; v < REAL_VOICES; v++)
+	{
+		if (m_3dChannels[v] == NULL)
+			continue;
+		ApplyPropagation(v, false);
+		if (m_ambisonic)
+			SetVoiceGains(v);
+		else if (m_binaural)
+			SetVoiceDirection(v);
+	}
+	if (m_ambisonic)
+		SetListenerRotation();
+
+	//Set the attributes of the 3D listener with the camera data 
+	FMOD_VECTOR camPos = ToFmodVector(cam->GetPosition());
+	FMOD_VECTOR camStrafe = ToFmodVector(cam->GetStrafeVector());
+	FMOD_VECTOR camUp = ToFmodVector(cam->GetUpVector());
+	result = m_FmodSystem->set3DListenerAttributes(0, &camPos, 0, &camStrafe, &camUp);
+	FmodErrorCheck(result);
+
+	//Updates the system
+	m_FmodSystem->update();
+
+	END_NO_ALLOCATIONS();
+}
+
+//The emitters of the 3D sounds
+CEmitterTable &CAudio::GetEmitters() { return m_emitters; }
+
 //Takes a glm vector and returns it as a FMOD vector 
-FMOD_VECTOR *CAudio::ToFmodVector(const glm::vec3 &v)
+FMOD_VECTOR CAudio::ToFmodVector(const glm::vec3 &v)
 {
-	FMOD_VECTOR *fv = new FMOD_VECTOR();
-	fv->x = v.x; fv->y = v.y; fv->z = v.z;
+	FMOD_VECTOR fv;
+	fv.x = v.x; fv.y = v.y; fv.z = v.z;
 	return fv;
 }
\ No newline at end of file
@@ -3,7 +3,18 @@
 #include "./include/fmod_studio/fmod.hpp"
 #include "./include/fmod_studio/fmod_errors.h"
 #include "Common.h"
-#include "CircBuffer.h"
+#include "FilterDsp.h"
+#include "FilterDspPool.h"
+#include "ConvolutionReverb.h"
+#include "HrtfDsp.h"
+#include "AmbisonicDsp.h"
+#include "AudioStream.h"
+#include "SoundBank.h"
+#include "FmodSoundLoader.h"
+#include "PropagationModel.h"
+#include "TripleBuffer.h"
+#include "EmitterTable.h"
+#include "VoiceManager.h"
 #include "SoundSource.h"
 #include "Camera.h"
 
@@ -20,41 +31,163 @@ public:
 	//Initialise function
 	bool Initialise();
 
-	//Functions for loading and playing the music stream - task 1
+	//Functions for loading and playing the music stream - task 1. It is decoded ahead on the prefetch thread
 	bool LoadMusicStream(const char *filename);
 	bool PlayMusicStream();
 
-	//Functions for loading and playing the sound of the sound source - task 2 part 1
+	//Functions for loading and playing the sound of the sound source - task 2 part 1. It is heard from source
 	bool LoadSoundSource(const char *filename);
-	bool PlaySoundSource();
+	bool PlaySoundSource(const CSoundSource *source);
 
-	//Functions for loading and playing the sound of the sound source - task 2 part 1
+	//Functions for loading and playing the sound of the sound source - task 2 part 1. It is heard from source
 	bool LoadObjectSound(const char *filename);
-	bool PlayObjectSound();
+	bool PlayObjectSound(const CSoundSource *source);
+
+	//Plays a looping sound of the sound bank from an emitter, with a DSP effect if dsp isn't NULL. The emitter only gets
+	//a channel while it is among the REAL_VOICES most audible ones, scored by distance to the listener, volume and priority
+	bool PlayEmitter(int emitter, int sound, FMOD::DSP *dsp, float volume, float priority);
+	//Stops the sound of an emitter, hands its channel back and removes it from the emitter table. Returns false if the
+	//emitter isn't in the table
+	bool RemoveEmitter(int emitter);
+
+	//Memory the resident sounds of the sound bank are kept within, in bytes
+	void SetSoundBankBudget(size_t bytes);
+	//Hits, misses, evictions and resident bytes of the sound bank
+	sound_bank_stats_t GetSoundBankStats();
+
+	//The emitters of the 3D sounds, which the sound sources of the game are added to
+	CEmitterTable &GetEmitters();
+
+	//Places the 3D sounds with the HRTF DSPs for headphones, or with FMOD's panner for speakers. The voices that are
+	//playing are started again the new way. On the ambisonic bus it chooses what the bus is decoded to
+	void SetBinaural(bool binaural);
+	//Mixes the 3D sounds into a third order ambisonic bus, decoded once for the listener, instead of placing every voice
+	//on its own. The voices that are playing are started again the new way
+	void SetAmbisonic(bool ambisonic);
+
+	//Replace the filter bank the music and the submarine DSPs look up. Can be called while they play
+	bool SetMusicFilters(const CFilterBank &bank);
+	bool SetSubmarineFilters(const CFilterBank &bank);
+	//Choose between the exact FIR filters, the cheaper IIR sections fitted to them and the multirate FIR filters, for each DSP
+	bool SetMusicFilterMode(FilterMode mode);
+	bool SetSubmarineFilterMode(FilterMode mode);
+	//CPU load of the music and the submarine DSPs since the last call, in percent of their real-time budget
+	void GetDspLoads(dsp_load_t &music, dsp_load_t &submarine);
 
 	//Update function
-	void Update(float external_control, const CSoundSource *soundSource, const CSoundSource *submarineSoundSource, float submarine_vel, const CCamera *cam);
+	void Update(float dt, float external_control, const CSoundSource *submarineSoundSource, float submarine_vel, const CCamera *cam);
 
 private:
+	//Starts the sound of an emitter on the voice it was given, at the place it would have reached
+	void StartVoice(int emitter);
+	//Stops the channel of a voice taken from its emitter
+	void StopVoice(int voice, int emitter);
+	//Sends the direction of the emitter of a voice from the listener to the HRTF DSP of the voice
+	void SetVoiceDirection(int voice);
+	//Applies the propagation of the emitter of a voice to its channel: volume, low pass cutoff and pitch. Unless force is
+	//true, only the ones that changed audibly since they were last applied are sent to FMOD
+	void ApplyPropagation(int voice, bool force);
+	//Sends the ambisonic gains of the emitter of a voice to the encoder DSP of the voice
+	void SetVoiceGains(int voice);
+	//Sends the orientation of the listener to the ambisonic decoder DSP
+	void SetListenerRotation();
+	//Stops the voices that are playing, changes how they are placed and starts them again
+	void SetPlacement(bool binaural, bool ambisonic);
 		
-	//FMOD_DSP_STATE struct 
+	//Data parameter of the DSP: a new filter bank
 	typedef struct
 	{
-		CBuffer *buffer;
-		float external_control;
-	} mydsp_data_t;
+		const CFilterBank *bank;
+	} filter_coefficients_t;
 
 	//Custom DSP
 	static FMOD_RESULT F_CALLBACK DSPCallback(FMOD_DSP_STATE *dsp_state, float *inbuffer, float *outbuffer, unsigned int length, int inchannels, int *outchannels);
 	//Callback to set float parameter of the DSP
 	static FMOD_RESULT F_CALLBACK myDSPSetParameterFloatCallback(FMOD_DSP_STATE *dsp_state, int index, float value);
-	//Function to create DSP 
+	//Callback to set the int parameter of the DSP, the filter mode
+	static FMOD_RESULT F_CALLBACK myDSPSetParameterIntCallback(FMOD_DSP_STATE *dsp_state, int index, int value);
+	//Callback to set the data parameter of the DSP
+	static FMOD_RESULT F_CALLBACK myDSPSetParameterDataCallback(FMOD_DSP_STATE *dsp_state, int index, void *data, unsigned int length);
+	//Functions to create, release and reset the DSP. Its state is a CFilterDsp taken from FILTER_DSP_POOL
 	static FMOD_RESULT F_CALLBACK myDSPCreateCallback(FMOD_DSP_STATE *dsp_state);
+	static FMOD_RESULT F_CALLBACK myDSPReleaseCallback(FMOD_DSP_STATE *dsp_state);
+	static FMOD_RESULT F_CALLBACK myDSPResetCallback(FMOD_DSP_STATE *dsp_state);
 	//Function to get the float parameter of the DSP - not used in the program, has been used to test the code
 	static FMOD_RESULT F_CALLBACK myDSPGetParameterFloatCallback(FMOD_DSP_STATE *dsp_state, int index, float *value, char *valstr);
+	//Function to get the data parameter of the DSP: its profiler
+	static FMOD_RESULT F_CALLBACK myDSPGetParameterDataCallback(FMOD_DSP_STATE *dsp_state, int index, void **data, unsigned int *length, char *valstr);
+
+	//Reverb DSP struct
+	typedef struct
+	{
+		CConvolutionReverb *reverb;
+		float wet;
+		float dry;
+	} reverb_data_t;
+
+	//Convolution reverb DSP
+	static FMOD_RESULT F_CALLBACK ReverbDSPCallback(FMOD_DSP_STATE *dsp_state, float *inbuffer, float *outbuffer, unsigned int length, int inchannels, int *outchannels);
+	//Functions to create and release the reverb DSP
+	static FMOD_RESULT F_CALLBACK myReverbCreateCallback(FMOD_DSP_STATE *dsp_state);
+	static FMOD_RESULT F_CALLBACK myReverbReleaseCallback(FMOD_DSP_STATE *dsp_state);
+	//Callback to set the wet and dry levels of the reverb DSP
+	static FMOD_RESULT F_CALLBACK myReverbSetParameterFloatCallback(FMOD_DSP_STATE *dsp_state, int index, float value);
+
+	//HRTF DSP, one per voice: binaural filter of the voice for the direction of its emitter
+	static FMOD_RESULT F_CALLBACK HrtfDSPCallback(FMOD_DSP_STATE *dsp_state, float *inbuffer, float *outbuffer, unsigned int length, int inchannels, int *outchannels);
+	//Functions to create, release and reset the HRTF DSP. Its state is a CHrtfDsp of HRIR_SET
+	static FMOD_RESULT F_CALLBACK myHrtfCreateCallback(FMOD_DSP_STATE *dsp_state);
+	static FMOD_RESULT F_CALLBACK myHrtfReleaseCallback(FMOD_DSP_STATE *dsp_state);
+	static FMOD_RESULT F_CALLBACK myHrtfResetCallback(FMOD_DSP_STATE *dsp_state);
+	//Callback to set the data parameter of the HRTF DSP, an hrtf_direction_t
+	static FMOD_RESULT F_CALLBACK myHrtfSetParameterDataCallback(FMOD_DSP_STATE *dsp_state, int index, void *data, unsigned int length);
+
+	//Ambisonic decoder DSP struct
+	typedef struct
+	{
+		CAmbisonicDecoderDsp *decoder;
+		int channels; // Output channels, the speakers of the mixer
+		FMOD_SPEAKERMODE speakerMode;
+	} ambisonic_decoder_data_t;
+
+	//Ambisonic encoder DSP, one per voice: spreads the voice over the channels of the bus for the direction of its emitter.
+	//It uses the process callback, as its output has more channels than its input
+	static FMOD_RESULT F_CALLBACK AmbisonicEncoderDSPCallback(FMOD_DSP_STATE *dsp_state, unsigned int length, const FMOD_DSP_BUFFER_ARRAY *inbufferarray, FMOD_DSP_BUFFER_ARRAY *outbufferarray, FMOD_BOOL inputsidle, FMOD_DSP_PROCESS_OPERATION op);
+	//Functions to create, release and reset the ambisonic encoder DSP. Its state is a CAmbisonicEncoderDsp
+	static FMOD_RESULT F_CALLBACK myAmbisonicEncoderCreateCallback(FMOD_DSP_STATE *dsp_state);
+	static FMOD_RESULT F_CALLBACK myAmbisonicEncoderReleaseCallback(FMOD_DSP_STATE *dsp_state);
+	static FMOD_RESULT F_CALLBACK myAmbisonicEncoderResetCallback(FMOD_DSP_STATE *dsp_state);
+	//Callback to set the data parameter of the ambisonic encoder DSP, an ambisonic_gains_t
+	static FMOD_RESULT F_CALLBACK myAmbisonicEncoderSetParameterDataCallback(FMOD_DSP_STATE *dsp_state, int index, void *data, unsigned int length);
+	//Ambisonic decoder DSP, at the head of the bus: turns the bus to the listener and decodes it to the speakers or the ears
+	static FMOD_RESULT F_CALLBACK AmbisonicDecoderDSPCallback(FMOD_DSP_STATE *dsp_state, unsigned int length, const FMOD_DSP_BUFFER_ARRAY *inbufferarray, FMOD_DSP_BUFFER_ARRAY *outbufferarray, FMOD_BOOL inputsidle, FMOD_DSP_PROCESS_OPERATION op);
+	//Functions to create and release the ambisonic decoder DSP. Its state is a CAmbisonicDecoderDsp of HRIR_SET
+	static FMOD_RESULT F_CALLBACK myAmbisonicDecoderCreateCallback(FMOD_DSP_STATE *dsp_state);
+	static FMOD_RESULT F_CALLBACK myAmbisonicDecoderReleaseCallback(FMOD_DSP_STATE *dsp_state);
+	//Callbacks to set the parameters of the ambisonic decoder DSP: the orientation of the listener, an
+	//ambisonic_rotation_t, and the binaural decode
+	static FMOD_RESULT F_CALLBACK myAmbisonicDecoderSetParameterDataCallback(FMOD_DSP_STATE *dsp_state, int index, void *data, unsigned int length);
+	static FMOD_RESULT F_CALLBACK myAmbisonicDecoderSetParameterBoolCallback(FMOD_DSP_STATE *dsp_state, int index, FMOD_BOOL value);
+	//Returns the number of channels of a speaker mode
+	static int SpeakerModeChannels(FMOD_SPEAKERMODE mode);
 
-	//Takes a glm vector and returns it as a FMOD vector 
-	FMOD_VECTOR *ToFmodVector(const glm::vec3 &v);
+	//Read callback of the music stream: copies the samples the prefetch thread has decoded, a CAudioStream
+	static FMOD_RESULT F_CALLBACK StreamReadCallback(FMOD_SOUND *sound, void *data, unsigned int datalen);
+	//Read callback of the stream of a 3D voice: decodes its ADPCM sample just ahead of the channel, a CAdpcmVoice
+	static FMOD_RESULT F_CALLBACK AdpcmReadCallback(FMOD_SOUND *sound, void *data, unsigned int datalen);
+	//Opens the decoder of a stream: a WAVE file is read through a mapping, anything else is decoded by FMOD. NULL if
+	//the file can't be opened
+	CStreamSource *OpenStreamSource(const char *filename);
+	//Takes a handle to a sound of the sound bank in place of the one in sound, which is given back. False if it can't be loaded
+	bool LoadBankSound(const char *filename, int &sound);
+
+	//Sends a new filter bank to a dynamic filter DSP
+	bool SetDSPFilters(FMOD::DSP *dsp, const CFilterBank &bank);
+	//Returns the profiler of a dynamic filter DSP, NULL if it can't be read
+	CDspProfiler *GetDSPProfiler(FMOD::DSP *dsp);
+
+	//Takes a glm vector and returns it as a FMOD vector, by value so the per-frame update doesn't allocate
+	static FMOD_VECTOR ToFmodVector(const glm::vec3 &v);
 	// Function to check for error
 	void FmodErrorCheck(FMOD_RESULT result);
 
@@ -64,20 +197,91 @@ private:
 	//Music sound and channel
 	FMOD::Sound *m_music;
 	FMOD::Channel* m_musicChannel;
+	CStreamPrefetcher m_prefetcher; // Background thread decoding the streams ahead of playback
+	CAudioStream *m_musicStream; // Samples of the music, read by the music sound
+	static const float STREAM_BUFFER_SECONDS; // Length of the ring of a stream, the longest disk stall it hides
+	static const float STREAM_PREFILL_SECONDS; // Decoded when a stream is loaded, before the prefetch thread takes over
+	static const unsigned int STREAM_DECODE_FRAMES = 2048; // Frames FMOD asks a stream for at a time
+
+	//The looping sounds of the emitters, loaded once each as ADPCM samples and kept within a memory budget
+	CFmodSoundLoader m_soundLoader;
+	CSoundBank m_soundBank;
+	static const size_t SOUND_BANK_BUDGET = 64 << 20; // Default budget of the resident sounds, in bytes
 
-	//Module source sound and channel
-	FMOD::Sound *m_sound1;
-	FMOD::Channel *m_3dChannel1; // The channel containing the 3d sound effects
+	//Module source and submarine sounds, handles in m_soundBank
+	int m_sound1;
+	int m_sound2;
 
-	//Submarine sound and channel
-	FMOD::Sound *m_sound2;
-	FMOD::Channel *m_3dChannel2; // The channel containing the 3d sound effects
+	//The channels containing the 3d sound effects, each one following the emitter bound to it
+	static const int REAL_VOICES = 31; // The channels FMOD is initialised with, less the music stream
+	FMOD::Channel *m_3dChannels[REAL_VOICES];
+	CEmitterTable m_emitters; // Positions and velocities of every sound emitter
+	static const int MAX_EMITTERS = 16384; // Emitters the table is allocated for, above the 10000 a level may hold
+	CVoiceManager m_voiceManager; // Hands the channels to the most audible emitters
+	vector<int> m_emitterSounds; // Sound of the bank played by each emitter, -1 for none
+	vector<FMOD::DSP *> m_emitterDsps; // DSP effect of each emitter, NULL for none
+	int m_voiceEmitters[REAL_VOICES]; // Emitter each channel plays
+	int m_voiceSounds[REAL_VOICES]; // Sound of the bank each channel plays, given back to the bank when it stops
+	CAdpcmVoice m_adpcmVoices[REAL_VOICES]; // Decoder of the ADPCM sample of each channel
+	FMOD::Sound *m_voiceStreams[REAL_VOICES]; // User stream each channel plays, reading its ADPCM voice. Created once
+	static const int VOICE_CHANNELS = 2; // Channels of the streams, a mono sample plays on both
+	static const unsigned int ADPCM_DECODE_FRAMES = 512; // Frames the stream of a voice asks its decoder for at a time
+
+	//Distance attenuation, absorption and Doppler shift of every emitter, calculated in one pass every frame
+	CPropagationModel m_propagation;
+	FMOD::DSP *m_lowpassDsps[REAL_VOICES]; // Absorption low pass of each channel
+	float m_voiceGains[REAL_VOICES], m_voiceCutoffs[REAL_VOICES], m_voicePitches[REAL_VOICES]; // Last applied to each channel
+
+	//Binaural placement of the 3D sounds
+	bool m_binaural; // The channels are 2D and filtered by the HRTF DSPs instead of FMOD's panner
+	FMOD::DSP *m_hrtfDsps[REAL_VOICES]; // HRTF DSP of each channel
+	glm::vec3 m_listenerPosition, m_listenerFront, m_listenerRight, m_listenerUp; // The camera at the last update
+	glm::vec3 m_listenerVelocity; // Units per millisecond, from the last two positions
+
+	//Ambisonic bus of the 3D sounds
+	bool m_ambisonic; // The channels are 2D, encoded into the bus and decoded once, instead of placed one by one
+	CAmbisonicEncoder m_ambisonicEncoder; // Gains of every emitter into the bus, calculated in one pass every frame
+	FMOD::DSP *m_encoderDsps[REAL_VOICES]; // Ambisonic encoder DSP of each channel
+	FMOD::ChannelGroup *m_ambisonicGroup; // The bus: the channels of the 3D sounds are mixed into it
+	FMOD::DSP *m_decoderDsp; // Ambisonic decoder DSP at the head of the bus
 
 	FMOD::DSP *m_dsp; //Music DSP
 	FMOD::DSP *submarine_dsp; //Submarine DSP
+	FMOD::DSP *m_reverbDsp; //Underwater reverb DSP, shared by every channel
+	CDspProfiler *m_musicProfiler; //CPU time accounting of the music DSP, owned by the DSP
+	CDspProfiler *m_submarineProfiler; //CPU time accounting of the submarine DSP, owned by the DSP
 
-	//Coefficients of the static FIR filters
+	//Band specifications of the two static FIR filters, designed at startup
+	static band_spec_t FIR1_SPEC;
+	static band_spec_t FIR2_SPEC;
+	//Length of the designed filters. The deep specifications have 300 Hz transition bands, which take 511 taps to reach
+	//50 dB of stopband attenuation at 44.1 kHz; 3 taps left every design a flat attenuator
+	static const int FILTER_TAPS = 511;
+	static const int BANK_SIZE = 16; // Number of filters spanning the external control
+	static const FilterMode FILTER_MODE = FILTER_MODE_FIR; // Engine the music and submarine DSPs run, prepared by the pool
+	//The same specifications with the band edges halved, heard through deep water
+	static band_spec_t FIR1_DEEP_SPEC;
+	static band_spec_t FIR2_DEEP_SPEC;
+	static const int DEPTH_SIZE = 8; // Number of filters spanning the depth control of the submarine
+	static const float DEPTH_DISTANCE; // Distance from the listener at which the submarine sounds deepest
+	//Coefficients of the static FIR filters designed offline, used if the design fails
 	static vector<float> FIR1;
 	static vector<float> FIR2;
+	//Filter bank every dynamic filter DSP is created with
+	static CFilterBank FILTER_BANK;
+	//The states of the dynamic filter DSPs, created with FILTER_BANK when the system is initialised
+	static CFilterDspPool FILTER_DSP_POOL;
+	//Speed x depth filter bank of the submarine DSP
+	CFilterBank m_submarineBank;
+
+	//Length of the underwater reverb impulse response in seconds
+	static const float REVERB_SECONDS;
+
+	//Head related impulse responses of the HRTF DSPs, read from HRIR_FILE and HRIR_DIRECTIONS_FILE or modelled
+	static CHrirSet HRIR_SET;
+	static const char *HRIR_FILE;
+	static const char *HRIR_DIRECTIONS_FILE;
+	static const int HRTF_BLOCK = 128; // Partition size of the HRTF convolution, also its latency in frames
+	static const float MIN_DISTANCE; // Distance up to which the emitters aren't attenuated, as FMOD's 3D min distance
 
 };
@@ -0,0 +1,140 @@
+#include "AudioStream.h"
+#include <algorithm>
+#include <chrono>
+#include <cstring>
+
+//Takes the source, with a ring of bufferFrames frames
+CAudioStream::CAudioStream(CStreamSource *source, bool loop, unsigned int bufferFrames)
+	: m_source(source)
+{
+	m_channels = source->getChannels();
+	m_sampleRate = source->getSampleRate();
+	m_frames = source->getFrames();
+	m_loop = loop;
+	m_ring.Init(bufferFrames * m_channels);
+	m_chunk.resize(CHUNK_FRAMES * m_channels);
+	m_ended.store(false, std::memory_order_relaxed);
+	m_underruns.store(0, std::memory_order_relaxed);
+}
+
+CAudioStream::~CAudioStream()
+{
+	delete m_source;
+}
+
+/*
+	Decodes chunk by chunk into the ring. The ring only takes whole frames, so the audio callback always finds whole
+	frames in it. A looping source that ends is rewound and decoding carries on in the same chunk, unless it has nothing
+	to decode even from its start
+*/
+unsigned int CAudioStream::Fill(unsigned int maxFrames)
+{
+	const unsigned int chunk = CHUNK_FRAMES;
+	unsigned int done = 0;
+	bool rewound = false;
+	while (done < maxFrames && !m_ended.load(std::memory_order_relaxed))
+	{
+		unsigned int frames = m_ring.getWritable() / m_channels;
+		frames = std::min(frames, std::min(chunk, maxFrames - done));
+		if (frames == 0)
+			break;
+
+		unsigned int decoded = m_source->Decode(m_chunk.data(), frames);
+		m_ring.Write(m_chunk.data(), decoded * m_channels);
+		done += decoded;
+		if (decoded > 0)
+			rewound = false;
+
+		if (decoded < frames)
+		{
+			if (m_loop && !rewound && m_source->Rewind())
+				rewound = true;
+			else
+				m_ended.store(true, std::memory_order_release);
+		}
+	}
+	return done;
+}
+
+//Copies the ready frames. A short read before the end of the source is an underrun
+unsigned int CAudioStream::Read(float *out, unsigned int frames)
+{
+	unsigned int copied = m_ring.Read(out, frames * m_channels) / m_channels;
+	if (copied < frames)
+	{
+		memset(out + copied * m_channels, 0, (frames - copied) * m_channels * sizeof(float));
+		if (!m_ended.load(std::memory_order_acquire))
+			m_underruns.fetch_add(1, std::memory_order_relaxed);
+	}
+	return copied;
+}
+
+//Getters of the class attributes
+int CAudioStream::getChannels() const { return m_channels; }
+int CAudioStream::getSampleRate() const { return m_sampleRate; }
+unsigned int CAudioStream::getFrames() const { return m_frames; }
+unsigned int CAudioStream::getBuffered() const { return m_ring.getReadable() / m_channels; }
+unsigned int CAudioStream::getUnderruns() const { return m_underruns.load(std::memory_order_relaxed); }
+bool CAudioStream::isFinished() const { return m_ended.load(std::memory_order_acquire) && m_ring.getReadable() == 0; }
+
+//Starts the prefetch thread
+CStreamPrefetcher::CStreamPrefetcher()
+{
+	m_quit = false;
+	m_filling = NULL;
+	m_worker = std::thread(&CStreamPrefetcher::Worker, this);
+}
+
+//Stops the prefetch thread
+CStreamPrefetcher::~CStreamPrefetcher()
+{
+	{
+		std::lock_guard<std::mutex> lock(m_mutex);
+		m_quit = true;
+	}
+	m_wake.notify_one();
+	m_worker.join();
+}
+
+//The stream isn't in the list yet, so the prefill can't race the prefetch thread
+void CStreamPrefetcher::Add(CAudioStream *stream, unsigned int prefill)
+{
+	stream->Fill(prefill);
+	std::lock_guard<std::mutex> lock(m_mutex);
+	m_streams.push_back(stream);
+}
+
+//Once out of the list the stream can't be picked for another fill, so only a fill already running on it is waited for
+void CStreamPrefetcher::Remove(CAudioStream *stream)
+{
+	std::unique_lock<std::mutex> lock(m_mutex);
+	m_streams.erase(std::remove(m_streams.begin(), m_streams.end(), stream), m_streams.end());
+	m_filled.wait(lock, [this, stream] { return m_filling != stream; });
+}
+
+/*
+	Tops the streams up every PERIOD_MS milliseconds until it is told to finish. The list is copied under the lock and
+	the streams are decoded without it, so Add and Remove never wait for a decode of another stream. A stream removed
+	after the copy is skipped
+*/
+void CStreamPrefetcher::Worker()
+{
+	const int period = PERIOD_MS;
+	std::unique_lock<std::mutex> lock(m_mutex);
+	while (!m_quit)
+	{
+		m_pass = m_streams;
+		for (unsigned int s = 0; s < m_pass.size() && !m_quit; s++)
+		{
+			if (std::find(m_streams.begin(), m_streams.end(), m_pass[s]) == m_streams.end())
+				continue;
+			m_filling = m_pass[s];
+			lock.unlock();
+			m_pass[s]->Fill(~0u);
+			lock.lock();
+			m_filling = NULL;
+			m_filled.notify_all();
+		}
+		m_wake.wait_for(lock, std::chrono::milliseconds(period), [this] { return m_quit; });
+	}
+}
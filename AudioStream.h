@@ -0,0 +1,74 @@
+#pragma once
+#include <vector>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <atomic>
+#include "LockFreeRing.h"
+#include "StreamSource.h"
+
+// A stream of interleaved float samples decoded ahead of playback. The prefetch thread decodes the source into a
+// lock-free ring whenever there is room, and the audio callback only copies the samples that are ready out of it, so a
+// slow disk or decoder can't make the callback wait: if the ring runs dry it plays silence and counts an underrun.
+class CAudioStream
+{
+public:
+	static const unsigned int CHUNK_FRAMES = 4096; // Frames decoded at a time
+
+	CAudioStream(CStreamSource *source, bool loop, unsigned int bufferFrames); //Takes the source, with a ring of bufferFrames frames
+	~CAudioStream(); //Deletes the source
+
+	//Prefetch thread: decodes until the ring is full, the source ends or maxFrames frames have been decoded. A looping
+	//stream starts the source again at its end. Returns the frames decoded
+	unsigned int Fill(unsigned int maxFrames);
+	//Audio callback: copies up to frames ready frames into out and fills the rest with silence. Returns the frames copied
+	unsigned int Read(float *out, unsigned int frames);
+
+	//Getters of the class attributes. A stream is finished when its source has ended and everything has been read
+	int getChannels() const;
+	int getSampleRate() const;
+	unsigned int getFrames() const;
+	unsigned int getBuffered() const;
+	unsigned int getUnderruns() const;
+	bool isFinished() const;
+
+private:
+	CStreamSource *m_source; // Only touched by the prefetch thread once the stream plays
+	CLockFreeRing<float> m_ring; // Decoded samples, from the prefetch thread to the audio callback
+	std::vector<float> m_chunk; // One chunk decoded by the prefetch thread
+	int m_channels, m_sampleRate;
+	unsigned int m_frames; // Length of the source, 0 if unknown
+	bool m_loop;
+	std::atomic<bool> m_ended; // The source has ended and won't be started again
+	std::atomic<unsigned int> m_underruns; // Reads the ring couldn't fill while the source hadn't ended
+};
+
+// The background thread that keeps the rings of the streams full. It tops every stream up every PERIOD_MS
+// milliseconds, which the rings have to outlast, so a stall of the disk shorter than a ring is never heard.
+class CStreamPrefetcher
+{
+public:
+	static const int PERIOD_MS = 5;
+
+	CStreamPrefetcher(); //Starts the prefetch thread
+	~CStreamPrefetcher(); //Stops the prefetch thread
+
+	//Decodes the first prefill frames of a stream on the calling thread, so it can start playing at once, and hands the
+	//rest to the prefetch thread
+	void Add(CAudioStream *stream, unsigned int prefill);
+	//Stops filling a stream. It can be deleted once this returns, which only waits for a fill of that stream
+	void Remove(CAudioStream *stream);
+
+private:
+	//Tops the streams up until it is told to finish
+	void Worker();
+
+	std::vector<CAudioStream *> m_streams;
+	std::vector<CAudioStream *> m_pass; // Copy of m_streams the prefetch thread fills, only touched by it
+	CAudioStream *m_filling; // Stream being filled, NULL between fills
+	std::thread m_worker; // The prefetch thread
+	std::mutex m_mutex; // Protects m_streams, m_filling and m_quit. It isn't held while a stream is filled
+	std::condition_variable m_wake; // Wakes the prefetch thread to finish
+	std::condition_variable m_filled; // Signalled at the end of every fill, for Remove
+	bool m_quit; // Tells the prefetch thread to finish
+};
@@ -0,0 +1,228 @@
+#include "ChannelMixer.h"
+#include <cstring>
+
+// The speakers of the named layouts
+enum Speaker
+{
+	SPEAKER_L, SPEAKER_R, SPEAKER_C, SPEAKER_LFE, SPEAKER_SL, SPEAKER_SR, SPEAKER_BL, SPEAKER_BR
+};
+
+static const int MONO[] = { SPEAKER_C };
+static const int STEREO[] = { SPEAKER_L, SPEAKER_R };
+static const int QUAD[] = { SPEAKER_L, SPEAKER_R, SPEAKER_SL, SPEAKER_SR };
+static const int SURROUND[] = { SPEAKER_L, SPEAKER_R, SPEAKER_C, SPEAKER_SL, SPEAKER_SR };
+static const int SURROUND_5POINT1[] = { SPEAKER_L, SPEAKER_R, SPEAKER_C, SPEAKER_LFE, SPEAKER_SL, SPEAKER_SR };
+static const int SURROUND_7POINT1[] = { SPEAKER_L, SPEAKER_R, SPEAKER_C, SPEAKER_LFE, SPEAKER_SL, SPEAKER_SR, SPEAKER_BL, SPEAKER_BR };
+
+// Where a speaker is heard when the other layout doesn't have it, at -3 dB per side for a split. The LFE is dropped
+typedef struct
+{
+	int speaker;
+	float gain;
+} fallback_t;
+
+static const float HALF_POWER = 0.70710678f;
+static const fallback_t FALLBACKS[8][2] =
+{
+	{ { SPEAKER_C, HALF_POWER }, { -1, 0.0f } }, // L
+	{ { SPEAKER_C, HALF_POWER }, { -1, 0.0f } }, // R
+	{ { SPEAKER_L, HALF_POWER }, { SPEAKER_R, HALF_POWER } }, // C
+	{ { -1, 0.0f }, { -1, 0.0f } }, // LFE
+	{ { SPEAKER_L, HALF_POWER }, { -1, 0.0f } }, // SL
+	{ { SPEAKER_R, HALF_POWER }, { -1, 0.0f } }, // SR
+	{ { SPEAKER_SL, 1.0f }, { -1, 0.0f } }, // BL
+	{ { SPEAKER_SR, 1.0f }, { -1, 0.0f } } // BR
+};
+
+// The longest chain of fallbacks a speaker needs to reach a layout: a 7.1 back channel goes BL, SL, L, C to mono
+static const int FALLBACK_DEPTH = 3;
+
+//Starts with a stereo to stereo layout
+CChannelMixer::CChannelMixer()
+{
+	m_inChannels = 0;
+	m_outChannels = 0;
+	m_capacity = 0;
+	SetLayout(2, 2);
+}
+
+CChannelMixer::~CChannelMixer()
+{}
+
+//Returns the speakers of a layout, or NULL when the channel count has no named layout
+const int *CChannelMixer::Layout(int channels)
+{
+	switch (channels)
+	{
+	case 1: return MONO;
+	case 2: return STEREO;
+	case 4: return QUAD;
+	case 5: return SURROUND;
+	case 6: return SURROUND_5POINT1;
+	case 8: return SURROUND_7POINT1;
+	default: return NULL;
+	}
+}
+
+/*
+	A speaker the layout has is heard on it at full gain. Otherwise it follows its fallbacks, so a 7.1 back channel
+	goes to the side channel of 5.1 and quad, to the front channel of stereo at -3 dB and to mono at -6 dB
+*/
+void CChannelMixer::Route(int speaker, const int *layout, int channels, float gain, float *row, int depth)
+{
+	for (int c = 0; c < channels; c++)
+	{
+		if (layout[c] == speaker)
+		{
+			row[c] += gain;
+			return;
+		}
+	}
+	if (depth == 0)
+		return;
+	for (int f = 0; f < 2; f++)
+	{
+		const fallback_t &fallback = FALLBACKS[speaker][f];
+		if (fallback.speaker >= 0)
+			Route(fallback.speaker, layout, channels, gain * fallback.gain, row, depth - 1);
+	}
+}
+
+//Sets the channel counts of the input and output blocks
+void CChannelMixer::SetLayout(int inChannels, int outChannels)
+{
+	if (inChannels == m_inChannels && outChannels == m_outChannels)
+		return;
+	m_inChannels = inChannels;
+	m_outChannels = outChannels;
+
+	//Row c of the matrix holds the gains between narrow channel c and every wide channel
+	int narrow = getChannels();
+	int wide = inChannels > outChannels ? inChannels : outChannels;
+	m_matrix.assign(narrow * wide, 0.0f);
+	const int *narrowLayout = Layout(narrow);
+	const int *wideLayout = Layout(wide);
+	if (inChannels != outChannels && narrowLayout && wideLayout)
+	{
+		if (inChannels > outChannels)
+		{
+			//Downmix: where each wide input speaker is heard in the narrow layout
+			for (int w = 0; w < wide; w++)
+			{
+				float column[MAX_CHANNELS] = {};
+				Route(wideLayout[w], narrowLayout, narrow, 1.0f, column, FALLBACK_DEPTH);
+				for (int c = 0; c < narrow; c++)
+					m_matrix[c * wide + w] = column[c];
+			}
+		}
+		else
+		{
+			//Upmix: where each narrow input speaker is heard in the wide layout
+			for (int c = 0; c < narrow; c++)
+				Route(narrowLayout[c], wideLayout, wide, 1.0f, &m_matrix[c * wide], FALLBACK_DEPTH);
+		}
+	}
+	else
+	{
+		//Channel to channel: extra input channels are dropped and extra output channels are silent
+		for (int c = 0; c < narrow; c++)
+			m_matrix[c * wide + c] = 1.0f;
+	}
+
+	m_capacity = 0; //The planar channels are laid out again on the next block
+}
+
+//Copies an interleaved input block into the planar channels, downmixing it if the output has fewer channels
+void CChannelMixer::Deinterleave(const float *in, unsigned int frames)
+{
+	int channels = getChannels();
+	if (frames > m_capacity)
+	{
+		m_capacity = frames;
+		m_samples.resize((size_t)channels * frames);
+		m_planar.resize(channels);
+		for (int c = 0; c < channels; c++)
+			m_planar[c] = &m_samples[(size_t)c * frames];
+	}
+
+	int stride = m_inChannels;
+	if (m_inChannels <= m_outChannels)
+	{
+		//Each input channel goes to its own planar channel
+		if (stride == 1)
+		{
+			memcpy(m_planar[0], in, frames * sizeof(float));
+			return;
+		}
+		for (int c = 0; c < channels; c++)
+		{
+			float *dst = m_planar[c];
+			const float *src = in + c;
+			for (unsigned int n = 0; n < frames; n++)
+				dst[n] = src[n * stride];
+		}
+		return;
+	}
+
+	//Downmix: each planar channel sums the input channels heard on it
+	for (int c = 0; c < channels; c++)
+	{
+		float *dst = m_planar[c];
+		const float *row = &m_matrix[c * m_inChannels];
+		memset(dst, 0, frames * sizeof(float));
+		for (int i = 0; i < m_inChannels; i++)
+		{
+			float gain = row[i];
+			if (gain == 0.0f)
+				continue;
+			const float *src = in + i;
+			for (unsigned int n = 0; n < frames; n++)
+				dst[n] += gain * src[n * stride];
+		}
+	}
+}
+
+//Copies the planar channels into an interleaved output block, upmixing them if the output has more channels
+void CChannelMixer::Interleave(float *out, unsigned int frames)
+{
+	int channels = getChannels();
+	int stride = m_outChannels;
+	if (m_outChannels <= m_inChannels)
+	{
+		//Each planar channel goes to its own output channel
+		if (stride == 1)
+		{
+			memcpy(out, m_planar[0], frames * sizeof(float));
+			return;
+		}
+		for (int c = 0; c < channels; c++)
+		{
+			const float *src = m_planar[c];
+			float *dst = out + c;
+			for (unsigned int n = 0; n < frames; n++)
+				dst[n * stride] = src[n];
+		}
+		return;
+	}
+
+	//Upmix: each output channel sums the planar channels heard on it
+	for (int o = 0; o < m_outChannels; o++)
+	{
+		float *dst = out + o;
+		for (unsigned int n = 0; n < frames; n++)
+			dst[n * stride] = 0.0f;
+		for (int c = 0; c < channels; c++)
+		{
+			float gain = m_matrix[c * m_outChannels + o];
+			if (gain == 0.0f)
+				continue;
+			const float *src = m_planar[c];
+			for (unsigned int n = 0; n < frames; n++)
+				dst[n * stride] += gain * src[n];
+		}
+	}
+}
+
+//Getters of the class attributes
+float *const *CChannelMixer::getPlanar() { return m_planar.data(); }
+int CChannelMixer::getChannels() { return m_inChannels < m_outChannels ? m_inChannels : m_outChannels; }
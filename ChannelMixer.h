@@ -0,0 +1,38 @@
+#pragma once
+#include <vector>
+
+// Converts the interleaved blocks of a DSP to planar channels and back, between the input and the output speaker
+// layouts. The layouts follow FMOD's channel order: mono, stereo (L R), quad (L R SL SR), surround (L R C SL SR),
+// 5.1 (L R C LFE SL SR) and 7.1 (L R C LFE SL SR BL BR). Other channel counts map channel to channel.
+// A filter that treats every channel the same commutes with the mix, so only the smaller of the two layouts is planar:
+// a downmix happens while de-interleaving, before the filter, and an upmix while re-interleaving, after it.
+class CChannelMixer
+{
+public:
+	static const int MAX_CHANNELS = 8; // Largest layout with named speakers
+
+	CChannelMixer(); //Starts with a stereo to stereo layout
+	~CChannelMixer(); //Destructor
+
+	//Sets the channel counts of the input and output blocks. The mixing matrix is only rebuilt when they change
+	void SetLayout(int inChannels, int outChannels);
+	//Copies an interleaved input block into the planar channels, downmixing it if the output has fewer channels
+	void Deinterleave(const float *in, unsigned int frames);
+	//Copies the planar channels into an interleaved output block, upmixing them if the output has more channels
+	void Interleave(float *out, unsigned int frames);
+	//Getters of the class attributes
+	float *const *getPlanar(); //The planar channels, at least as long as the last block
+	int getChannels(); //The number of planar channels, the smaller of the input and output counts
+
+private:
+	//Adds the gains a speaker of one layout is heard with on the speakers of another to a row of the matrix
+	static void Route(int speaker, const int *layout, int channels, float gain, float *row, int depth);
+	//Returns the speakers of a layout, or NULL when the channel count has no named layout
+	static const int *Layout(int channels);
+
+	int m_inChannels, m_outChannels;
+	std::vector<float> m_matrix; // Gain between every narrower layout channel and every wider layout channel
+	std::vector<float> m_samples; // The planar channels, one after the other
+	std::vector<float *> m_planar; // Start of every planar channel
+	unsigned int m_capacity; // Frames each planar channel holds
+};
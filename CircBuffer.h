@@ -1,20 +1,87 @@
 #pragma once
-#include "Common.h"
+#include <vector>
 
-// A circular buffer
-class CBuffer
+// A circular buffer with a power of two capacity, indexed with a mask instead of a modulo.
+// In the mirrored mode every item is also stored one capacity further on, so the last N items (N up to the capacity)
+// are always one contiguous span in chronological order and a FIR kernel can read its history without wrapping.
+template <typename T>
+class CRingBuffer
 {
 public:
-	CBuffer(int l); //Initialises the class attributes with the lengt passes as a parameter
-	~CBuffer(); //Destructor
-	void Put(float n); //Adds an item 
-	float ItemAt(int i); //Returns the item at the position i
+	CRingBuffer(int capacity = 1, bool mirrored = true) { Init(capacity, mirrored); }
+
+	//Allocates the buffer for at least capacity items and clears it
+	void Init(int capacity, bool mirrored)
+	{
+		int size = 1;
+		while (size < capacity)
+			size <<= 1;
+		m_mirrored = mirrored;
+		m_mask = size - 1;
+		m_mirror = mirrored ? size : 0;
+		m_data.assign(mirrored ? 2 * size : size, T());
+		m_tail = 0;
+	}
+
+	//Grows the buffer to at least capacity items, keeping the newest ones
+	void Reserve(int capacity)
+	{
+		if (capacity <= getCapacity())
+			return;
+		CRingBuffer grown(capacity, m_mirrored);
+		for (int age = getCapacity() - 1; age >= 0; age--)
+			grown.Put(Recent(age));
+		*this = grown;
+	}
+
+	//Adds an item
+	void Put(const T &item)
+	{
+		unsigned int i = m_tail & m_mask;
+		m_data[i] = item;
+		m_data[i + m_mirror] = item; //Same slot twice when not mirrored, so there's no branch
+		m_tail++;
+	}
+
+	//Adds count items, each stride items after the previous one in the source, e.g. one channel of an interleaved block
+	void Write(const T *items, unsigned int count, int stride = 1)
+	{
+		//Two runs without masking: up to the end of the buffer, then from its start
+		unsigned int start = m_tail & m_mask;
+		unsigned int first = count < m_mask + 1 - start ? count : m_mask + 1 - start;
+		T *data = m_data.data() + start;
+		T *copy = data + m_mirror;
+		for (unsigned int n = 0; n < first; n++)
+			data[n] = copy[n] = items[n * stride];
+		data = m_data.data();
+		copy = data + m_mirror;
+		items += first * stride;
+		for (unsigned int n = 0; n < count - first; n++)
+			data[n] = copy[n] = items[n * stride];
+		m_tail += count;
+	}
+
+	//Returns the item put age items before the newest one. Items older than the capacity have been overwritten
+	const T &Recent(int age) const { return m_data[(m_tail - 1 - age) & m_mask]; }
+
+	//Returns the item at the absolute position i, counted from the first item put
+	const T &ItemAt(unsigned int i) const { return m_data[i & m_mask]; }
+
+	//Mirrored mode only: the newest count items, oldest first, as one contiguous span. count can't exceed the capacity
+	const T *Window(int count) const { return &m_data[(m_tail - count) & m_mask]; }
+
+	//Fills the buffer with default items (silence) without moving the tail
+	void Clear() { m_data.assign(m_data.size(), T()); }
+
 	//Getters of the class attributes
-	int getTail();
-	int getLength();
+	unsigned int getTail() const { return m_tail; }
+	int getCapacity() const { return m_mask + 1; }
+	bool isMirrored() const { return m_mirrored; }
 
 private:
-	float* buffer;  // The data 
-	int length;	// The length of the buffer
-	int tail;	// The next element's index
-};
\ No newline at end of file
+	std::vector<T> m_data; // The items, followed by their copy in the mirrored mode
+	unsigned int m_mask; // Capacity - 1
+	unsigned int m_mirror; // Offset of the copy of an item, 0 when not mirrored
+	unsigned int m_tail; // The number of items put so far, wrapping at 2^32 which the capacity divides
+	bool m_mirrored;
+};
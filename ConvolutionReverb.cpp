@@ -0,0 +1,248 @@
+#include "ConvolutionReverb.h"
+#include <random>
+#include <cmath>
+#include <algorithm>
+
+//Returns the part of the impulse response between two taps
+static std::vector<float> Segment(const std::vector<float> &ir, int start, int end)
+{
+	if (end > (int)ir.size())
+		end = (int)ir.size();
+	if (start >= end)
+		return std::vector<float>();
+	return std::vector<float>(ir.begin() + start, ir.begin() + end);
+}
+
+//Splits the impulse response of each channel into the segments and starts the background thread
+CConvolutionReverb::CConvolutionReverb(const std::vector< std::vector<float> > &ir)
+{
+	m_length = 0;
+	m_channels.resize(ir.size());
+	for (unsigned int c = 0; c < ir.size(); c++)
+	{
+		channel_t &chan = m_channels[c];
+		const std::vector<float> &h = ir[c];
+		if ((int)h.size() > m_length)
+			m_length = (int)h.size();
+
+		std::vector<float> head = Segment(h, 0, HEAD_SIZE);
+		std::vector<float> early = Segment(h, HEAD_SIZE, 2 * LATE_BLOCK);
+		std::vector<float> late = Segment(h, 2 * LATE_BLOCK, 2 * TAIL_BLOCK);
+		std::vector<float> tail = Segment(h, 2 * TAIL_BLOCK, (int)h.size());
+
+		chan.head = new CFirFilter(HEAD_SIZE);
+		chan.head->SetCoefficients(head);
+		chan.early = early.empty() ? NULL : new CFftConvolver(early, EARLY_BLOCK, 0);
+		chan.late = late.empty() ? NULL : new CFftConvolver(late, LATE_BLOCK, 1);
+		chan.tail = tail.empty() ? NULL : new CFftConvolver(tail, TAIL_BLOCK, 0);
+		//Every segment filters a single channel
+		if (chan.early)
+			chan.early->Prepare(1);
+		if (chan.late)
+			chan.late->Prepare(1);
+		if (chan.tail)
+			chan.tail->Prepare(1);
+		chan.tailIn.assign(TAIL_BLOCK, 0.0f);
+		chan.tailOut.assign(TAIL_BLOCK, 0.0f);
+		chan.jobIn.assign(TAIL_BLOCK, 0.0f);
+		chan.jobOut.assign(TAIL_BLOCK, 0.0f);
+	}
+	m_tailFill = 0;
+
+	m_quit = false;
+	m_jobDone = true;
+	m_misses = 0;
+	m_worker = std::thread(&CConvolutionReverb::Worker, this);
+}
+
+//Stops the background thread
+CConvolutionReverb::~CConvolutionReverb()
+{
+	m_quit.store(true, std::memory_order_release);
+	m_wake.Post();
+	m_worker.join();
+
+	for (unsigned int c = 0; c < m_channels.size(); c++)
+	{
+		delete m_channels[c].head;
+		delete m_channels[c].early;
+		delete m_channels[c].late;
+		delete m_channels[c].tail;
+	}
+}
+
+//Waits for jobs and calculates the tail of every channel
+void CConvolutionReverb::Worker()
+{
+	while (true)
+	{
+		m_wake.Wait();
+		if (m_quit.load(std::memory_order_acquire))
+			return;
+
+		for (unsigned int c = 0; c < m_channels.size(); c++)
+		{
+			channel_t &chan = m_channels[c];
+			if (chan.tail)
+			{
+				const float *in = chan.jobIn.data();
+				float *out = chan.jobOut.data();
+				chan.tail->ProcessAligned(&in, &out, 1);
+			}
+		}
+
+		m_jobDone.store(true, std::memory_order_release);
+	}
+}
+
+/*
+	Called on the mixer thread when a tail block is full. The previous job had a whole block of time to finish, so it
+	normally has. If it hasn't, nothing is handed over: the collected block is dropped and the next block plays no tail,
+	rather than the mixer thread waiting. Posting the semaphore doesn't take a lock the background thread could hold
+*/
+void CConvolutionReverb::SwapTail()
+{
+	if (!m_jobDone.load(std::memory_order_acquire))
+	{
+		for (unsigned int c = 0; c < m_channels.size(); c++)
+			std::fill(m_channels[c].tailOut.begin(), m_channels[c].tailOut.end(), 0.0f);
+		m_misses.fetch_add(1, std::memory_order_relaxed);
+		return;
+	}
+
+	for (unsigned int c = 0; c < m_channels.size(); c++)
+	{
+		m_channels[c].tailIn.swap(m_channels[c].jobIn);
+		m_channels[c].tailOut.swap(m_channels[c].jobOut);
+	}
+
+	m_jobDone.store(false, std::memory_order_relaxed);
+	m_wake.Post();
+}
+
+//Grows the buffers for blocks of up to frames frames. A block is never cut into longer pieces than a tail block
+void CConvolutionReverb::Prepare(unsigned int frames)
+{
+	unsigned int n = frames < (unsigned int)TAIL_BLOCK ? frames : (unsigned int)TAIL_BLOCK;
+	if (m_dry.size() < n)
+	{
+		m_dry.resize(n);
+		m_wet.resize(n);
+		m_segment.resize(n);
+	}
+	for (unsigned int c = 0; c < m_channels.size(); c++)
+		m_channels[c].head->Prepare(n, 1);
+}
+
+/*
+	Adds the reverb to a block of interleaved samples. The block is cut where tail blocks are completed, so every
+	completed tail block is handed over before the next one is collected
+*/
+void CConvolutionReverb::Process(const float *in, float *out, unsigned int frames, int channels, float wet, float dry)
+{
+	int reverbChannels = channels < (int)m_channels.size() ? channels : (int)m_channels.size();
+
+	unsigned int done = 0;
+	while (done < frames)
+	{
+		unsigned int n = TAIL_BLOCK - m_tailFill;
+		if (n > frames - done)
+			n = frames - done;
+		if (m_dry.size() < n)
+			Prepare(n);
+		const float *chunkIn = in + done*channels;
+		float *chunkOut = out + done*channels;
+
+		for (int c = 0; c < reverbChannels; c++)
+		{
+			channel_t &chan = m_channels[c];
+			float *x = m_dry.data();
+			float *y = m_wet.data();
+			float *s = m_segment.data();
+			for (unsigned int i = 0; i < n; i++)
+				x[i] = chunkIn[i*channels + c];
+
+			chan.head->Process(&x, &y, n, 1);
+			if (chan.early)
+			{
+				chan.early->Process(&x, &s, n, 1);
+				for (unsigned int i = 0; i < n; i++)
+					y[i] += s[i];
+			}
+			if (chan.late)
+			{
+				chan.late->Process(&x, &s, n, 1);
+				for (unsigned int i = 0; i < n; i++)
+					y[i] += s[i];
+			}
+
+			//The tail block is collected and the result of the previous one is played
+			float *tailIn = &chan.tailIn[m_tailFill];
+			const float *tailOut = &chan.tailOut[m_tailFill];
+			for (unsigned int i = 0; i < n; i++)
+			{
+				tailIn[i] = x[i];
+				y[i] += tailOut[i];
+			}
+
+			for (unsigned int i = 0; i < n; i++)
+				chunkOut[i*channels + c] = dry * x[i] + wet * y[i];
+		}
+
+		for (int c = reverbChannels; c < channels; c++)
+			for (unsigned int i = 0; i < n; i++)
+				chunkOut[i*channels + c] = dry * chunkIn[i*channels + c];
+
+		m_tailFill += n;
+		done += n;
+		if (m_tailFill == TAIL_BLOCK)
+		{
+			m_tailFill = 0;
+			SwapTail();
+		}
+	}
+}
+
+//Getters of the class attributes
+int CConvolutionReverb::getChannels() { return (int)m_channels.size(); }
+int CConvolutionReverb::getLength() { return m_length; }
+unsigned int CConvolutionReverb::getMisses() const { return m_misses.load(std::memory_order_relaxed); }
+
+/*
+	Exponentially decaying noise (-60 dB after the given time), low pass filtered with a cutoff that falls as the
+	response decays, since water absorbs the high frequencies first. Each channel uses a different seed so the
+	reverb is decorrelated between the speakers
+*/
+std::vector< std::vector<float> > CConvolutionReverb::GenerateUnderwaterIR(int sampleRate, float seconds, int channels)
+{
+	std::vector< std::vector<float> > ir(channels);
+	int length = (int)(seconds * sampleRate);
+
+	for (int c = 0; c < channels; c++)
+	{
+		std::minstd_rand random(1234 + c);
+		std::uniform_real_distribution<float> noise(-1.0f, 1.0f);
+		std::vector<float> &h = ir[c];
+		h.resize(length);
+
+		float state = 0.0f;
+		double energy = 0.0;
+		for (int n = 0; n < length; n++)
+		{
+			float t = (float)n / sampleRate;
+			float decay = expf(-6.9078f * t / seconds);
+			float cutoff = 4000.0f * expf(-2.0f * t / seconds);
+			float alpha = 1.0f - expf(-2.0f * 3.14159265f * cutoff / sampleRate);
+			state += alpha * (noise(random) - state);
+			h[n] = state * decay;
+			energy += h[n] * h[n];
+		}
+
+		//Normalises the energy so the wet signal is about as loud as the dry one
+		float scale = energy > 0.0 ? (float)(0.5 / sqrt(energy)) : 0.0f;
+		for (int n = 0; n < length; n++)
+			h[n] *= scale;
+	}
+
+	return ir;
+}
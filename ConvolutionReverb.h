@@ -0,0 +1,68 @@
+#pragma once
+#include <vector>
+#include <thread>
+#include <atomic>
+#include "FirFilter.h"
+#include "FftConvolver.h"
+#include "Semaphore.h"
+
+// Convolution reverb with zero added latency for impulse responses of several seconds.
+// The impulse response of each channel is cut into segments of growing partition size:
+//  - head:  taps 0..127, direct form, so the first output sample already has reverb
+//  - early: taps 128..2047, FFT partitions of 128 (its one block delay lines up with the start of the segment)
+//  - late:  taps 2048..16383, FFT partitions of 1024, delayed by one extra block
+//  - tail:  taps 16384.., FFT partitions of 8192, calculated on a background thread. A block is handed over
+//           when it is full and its result is played one block later, which lines up with the start of the segment.
+//           The mixer thread never waits for the background thread: if it hasn't finished the last block, the new
+//           one is dropped, the tail is silent for a block and a miss is counted
+class CConvolutionReverb
+{
+public:
+	static const int HEAD_SIZE = 128;
+	static const int EARLY_BLOCK = 128;
+	static const int LATE_BLOCK = 1024;
+	static const int TAIL_BLOCK = 8192;
+
+	CConvolutionReverb(const std::vector< std::vector<float> > &ir); //Splits the impulse response of each channel into the segments and starts the background thread
+	~CConvolutionReverb(); //Stops the background thread
+
+	//Grows the buffers for blocks of up to frames frames
+	void Prepare(unsigned int frames);
+	//Adds the reverb to a block of interleaved samples: out = dry * in + wet * reverb. Extra channels are passed through dry
+	void Process(const float *in, float *out, unsigned int frames, int channels, float wet, float dry);
+	//Getters of the class attributes
+	int getChannels();
+	int getLength();
+	unsigned int getMisses() const;
+
+	//Creates a dense, dark impulse response with a long decay, different for each channel
+	static std::vector< std::vector<float> > GenerateUnderwaterIR(int sampleRate, float seconds, int channels);
+
+private:
+	// The segments of the impulse response of one channel. Segments the impulse response doesn't reach are NULL
+	typedef struct
+	{
+		CFirFilter *head;
+		CFftConvolver *early;
+		CFftConvolver *late;
+		CFftConvolver *tail;
+		std::vector<float> tailIn, tailOut; // Block being collected for the tail, and tail result being played
+		std::vector<float> jobIn, jobOut; // Block and result of the background thread
+	} channel_t;
+
+	//Waits for jobs and calculates the tail of every channel
+	void Worker();
+	//Hands the collected tail blocks to the background thread and takes its last results
+	void SwapTail();
+
+	std::vector<channel_t> m_channels;
+	std::vector<float> m_dry, m_wet, m_segment; // One channel of the block being processed
+	int m_length; // The length of the impulse response
+	int m_tailFill; // Samples collected for the tail block
+
+	std::thread m_worker; // Background thread for the tail
+	CSemaphore m_wake; // Posted once for every job handed over, and to finish
+	std::atomic<bool> m_quit; // Tells the background thread to finish
+	std::atomic<bool> m_jobDone; // The background thread has finished the last job
+	std::atomic<unsigned int> m_misses; // Tail blocks dropped because the background thread was late
+};
@@ -0,0 +1,137 @@
+#include "DspProfiler.h"
+#include <chrono>
+#include <cmath>
+
+#if defined(_MSC_VER) && (defined(_M_X64) || defined(_M_IX86))
+#include <intrin.h>
+#define PROFILER_RDTSC
+#elif defined(__x86_64__) || defined(__i386__)
+#include <x86intrin.h>
+#define PROFILER_RDTSC
+#endif
+
+const float CDspProfiler::MIN_LOAD = 0.01f;
+
+//Starts with empty counters
+CDspProfiler::CDspProfiler()
+{
+	for (int b = 0; b < BINS; b++)
+	{
+		m_bins[b].store(0, std::memory_order_relaxed);
+		m_lastBins[b] = 0;
+	}
+	m_busy.store(0, std::memory_order_relaxed);
+	m_budget.store(0, std::memory_order_relaxed);
+	m_overruns.store(0, std::memory_order_relaxed);
+	m_ticksPerFrame.store(TicksPerSecond() / 44100.0, std::memory_order_relaxed);
+	m_lastBusy = 0;
+	m_lastBudget = 0;
+	m_lastOverruns = 0;
+}
+
+CDspProfiler::~CDspProfiler()
+{}
+
+//Time stamp to pass to Record
+unsigned long long CDspProfiler::Now()
+{
+#ifdef PROFILER_RDTSC
+	return __rdtsc();
+#else
+	return (unsigned long long)std::chrono::duration_cast<std::chrono::nanoseconds>(
+		std::chrono::steady_clock::now().time_since_epoch()).count();
+#endif
+}
+
+/*
+	The time stamp counter of current CPUs runs at a constant rate whatever the clock of the core, so it is measured
+	once over a few milliseconds of the steady clock. Without it the ticks are already nanoseconds
+*/
+double CDspProfiler::TicksPerSecond()
+{
+#ifdef PROFILER_RDTSC
+	static const double ticksPerSecond = []()
+	{
+		std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+		unsigned long long ticks = Now();
+		double seconds;
+		do
+			seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+		while (seconds < 0.01);
+		return (Now() - ticks) / seconds;
+	}();
+	return ticksPerSecond;
+#else
+	return 1e9;
+#endif
+}
+
+//Sets the sample rate the deadlines are calculated with
+void CDspProfiler::SetSampleRate(int sampleRate)
+{
+	if (sampleRate > 0)
+		m_ticksPerFrame.store(TicksPerSecond() / sampleRate, std::memory_order_relaxed);
+}
+
+//Adds a block whose callback started at start
+void CDspProfiler::Record(unsigned long long start, unsigned int frames)
+{
+	unsigned long long busy = Now() - start;
+	unsigned long long budget = (unsigned long long)(frames * m_ticksPerFrame.load(std::memory_order_relaxed));
+
+	double load = budget > 0 ? 100.0 * busy / budget : 0.0;
+	int bin = load > MIN_LOAD ? 1 + (int)(BINS_PER_DECADE * log10(load / MIN_LOAD)) : 0;
+	if (bin >= BINS)
+		bin = BINS - 1;
+
+	//Single writer: a load and a store are enough, the game thread only ever reads
+	m_bins[bin].store(m_bins[bin].load(std::memory_order_relaxed) + 1, std::memory_order_relaxed);
+	m_busy.store(m_busy.load(std::memory_order_relaxed) + busy, std::memory_order_relaxed);
+	m_budget.store(m_budget.load(std::memory_order_relaxed) + budget, std::memory_order_relaxed);
+	if (busy > budget)
+		m_overruns.store(m_overruns.load(std::memory_order_relaxed) + 1, std::memory_order_relaxed);
+}
+
+/*
+	The counters only grow, so the blocks of the period are the differences with the last snapshot. A block recorded
+	while the snapshot is taken may be counted in one counter and not yet in another; it is caught up by the next one
+*/
+dsp_load_t CDspProfiler::Snapshot()
+{
+	dsp_load_t result;
+	unsigned int counts[BINS];
+	unsigned int blocks = 0;
+	for (int b = 0; b < BINS; b++)
+	{
+		unsigned int total = m_bins[b].load(std::memory_order_relaxed);
+		counts[b] = total - m_lastBins[b];
+		m_lastBins[b] = total;
+		blocks += counts[b];
+	}
+	unsigned long long busy = m_busy.load(std::memory_order_relaxed);
+	unsigned long long budget = m_budget.load(std::memory_order_relaxed);
+	unsigned int overruns = m_overruns.load(std::memory_order_relaxed);
+
+	result.blocks = blocks;
+	result.load = budget > m_lastBudget ? 100.0f * (float)(busy - m_lastBusy) / (float)(budget - m_lastBudget) : 0.0f;
+	result.overruns = overruns - m_lastOverruns;
+	m_lastBusy = busy;
+	m_lastBudget = budget;
+	m_lastOverruns = overruns;
+
+	//The 99th percentile is the top of the bin the slowest 1% of the blocks start in. Bin b > 0 ends at
+	//MIN_LOAD * 10^(b / BINS_PER_DECADE)
+	result.p99 = 0.0f;
+	unsigned int below = 0;
+	for (int b = 0; b < BINS && blocks > 0; b++)
+	{
+		below += counts[b];
+		if (below * 100ull >= blocks * 99ull)
+		{
+			result.p99 = MIN_LOAD * powf(10.0f, (float)b / BINS_PER_DECADE);
+			break;
+		}
+	}
+
+	return result;
+}
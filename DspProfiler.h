@@ -0,0 +1,52 @@
+#pragma once
+#include <atomic>
+
+// The CPU load of a DSP over a reporting period, in percent of its real-time budget
+typedef struct
+{
+	float load; // Time spent in the read callback over the time the blocks last
+	float p99; // Load the slowest 1% of the blocks reach
+	unsigned int overruns; // Blocks that took longer than they last, and would have made the mixer miss its deadline
+	unsigned int blocks; // Blocks read in the period
+} dsp_load_t;
+
+// CPU time accounting of a DSP read callback against its deadline: the length of the block over the sample rate.
+// The mixer thread times every block with the time stamp counter and adds it to a histogram of loads; the game thread
+// takes a snapshot of the blocks recorded since its last one. The mixer thread is the only writer, so the counters are
+// updated with relaxed loads and stores and the callback never waits on the game thread or a locked instruction.
+class CDspProfiler
+{
+public:
+	// The histogram has logarithmic bins, so light and heavy DSPs get the same relative resolution:
+	// 16 bins per decade from 0.01% load, the first one collecting everything below and the last everything above
+	static const int BINS = 96;
+	static const int BINS_PER_DECADE = 16;
+	static const float MIN_LOAD; // Load in percent at the top of the first bin
+
+	CDspProfiler(); //Starts with empty counters
+	~CDspProfiler(); //Destructor
+
+	//Time stamp to pass to Record, in ticks of the time stamp counter (or of the steady clock without one)
+	static unsigned long long Now();
+	//Sets the sample rate the deadlines are calculated with. Called from the create callback of the DSP
+	void SetSampleRate(int sampleRate);
+	//Mixer thread: adds a block of frames frames whose callback started at start
+	void Record(unsigned long long start, unsigned int frames);
+	//Game thread: the load since the last snapshot
+	dsp_load_t Snapshot();
+
+private:
+	//Ticks of Now per second, measured once against the steady clock
+	static double TicksPerSecond();
+
+	std::atomic<unsigned int> m_bins[BINS]; // Blocks per logarithmic bin of load
+	std::atomic<unsigned long long> m_busy; // Ticks spent in the callback
+	std::atomic<unsigned long long> m_budget; // Ticks the blocks last
+	std::atomic<unsigned int> m_overruns;
+	std::atomic<double> m_ticksPerFrame; // Deadline of one frame, set by SetSampleRate
+
+	// The counters at the last snapshot, only touched by the game thread
+	unsigned int m_lastBins[BINS];
+	unsigned long long m_lastBusy, m_lastBudget;
+	unsigned int m_lastOverruns;
+};
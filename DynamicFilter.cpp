@@ -0,0 +1,153 @@
+#include "DynamicFilter.h"
+#include <cstring>
+
+//Picks the engine for the mode and the length of the filters
+CDynamicFilter::CDynamicFilter(const CFilterBank &bank, FilterMode mode)
+{
+	m_direct = NULL;
+	m_fft = NULL;
+	m_iir = NULL;
+	m_multirate = NULL;
+	m_mode = mode;
+	SetFilters(bank);
+}
+
+//Replaces the filter bank
+void CDynamicFilter::SetFilters(const CFilterBank &bank)
+{
+	bool sameLength = (m_direct || m_fft || m_iir || m_multirate) && bank.getTaps() == m_bank.getLength();
+
+	m_bank = bank.getBank();
+	if (m_bank.getCount() == 0 || m_bank.getLength() == 0)
+	{
+		//An empty bank passes the signal through
+		m_bank.Init(std::vector<int>(1, 1), 1);
+		m_bank.getEntry(0)[0] = 1.0f;
+	}
+	m_sections = bank.getSections();
+	m_sampleRate = bank.getSampleRate();
+	m_blend = bank.getBlend();
+	m_coefficients.assign(m_bank.getLength(), 0.0f);
+	m_valid = false; //Forces the filter to be blended on the next block
+
+	//In the multirate mode the passband of the new filters may need another decimation factor
+	int factor = m_multirate ? m_multirate->getFactor() : 1;
+	if (m_mode == FILTER_MODE_MULTIRATE && sameLength)
+		sameLength = CMultirateFilter::ChooseFactor(m_bank, m_sampleRate) == factor;
+
+	//The IIR mode only runs on sections that fit the filters
+	bool iir = m_mode == FILTER_MODE_IIR && m_sections.getCount() == m_bank.getCount();
+	if (!sameLength || iir != (m_iir != NULL))
+		CreateEngine();
+	else if (m_multirate)
+		m_multirate->SetFilters(m_bank);
+	else if (m_fft)
+		m_fft->SetFilters(m_bank);
+	else if (m_iir)
+		m_iir->SetSections(m_sections);
+}
+
+//Switches between the FIR and the IIR engines
+void CDynamicFilter::SetMode(FilterMode mode)
+{
+	if (mode == m_mode)
+		return;
+	m_mode = mode;
+	m_valid = false;
+	CreateEngine();
+}
+
+//Creates the engine for the mode and the length of the filters
+void CDynamicFilter::CreateEngine()
+{
+	delete m_direct;
+	delete m_fft;
+	delete m_iir;
+	delete m_multirate;
+	m_direct = NULL;
+	m_fft = NULL;
+	m_iir = NULL;
+	m_multirate = NULL;
+
+	int taps = m_bank.getLength();
+	int factor = m_mode == FILTER_MODE_MULTIRATE ? CMultirateFilter::ChooseFactor(m_bank, m_sampleRate) : 1;
+	if (m_mode == FILTER_MODE_IIR && m_sections.getCount() == m_bank.getCount())
+		m_iir = new CIirFilter(m_sections, m_sampleRate);
+	else if (factor > 1)
+		m_multirate = new CMultirateFilter(m_bank, m_sampleRate, factor);
+	else if (taps >= FFT_CROSSOVER_TAPS)
+		m_fft = new CFftConvolver(m_bank, FFT_BLOCK_SIZE);
+	else
+		m_direct = new CFirFilter(taps);
+}
+
+CDynamicFilter::~CDynamicFilter()
+{
+	delete m_direct;
+	delete m_fft;
+	delete m_iir;
+	delete m_multirate;
+}
+
+//Filters a block of interleaved samples with the filter blended from the bank entries around the controls
+void CDynamicFilter::Process(const float *const *in, float *const *out, unsigned int frames, int channels, const float *controls)
+{
+	if (m_iir)
+	{
+		m_iir->Process(in, out, frames, channels, controls, m_blend);
+	}
+	else if (m_multirate)
+	{
+		m_multirate->Process(in, out, frames, channels, controls, m_blend);
+	}
+	else if (m_fft)
+	{
+		m_fft->Mix(controls, m_blend);
+		m_fft->Process(in, out, frames, channels);
+	}
+	else
+	{
+		//The bank entries are blended once for the whole block, and only when the controls change
+		int dimensions = m_bank.getDimensions();
+		if (!m_valid || memcmp(controls, m_controls, dimensions * sizeof(float)) != 0)
+		{
+			m_bank.Blend(controls, m_blend, m_coefficients.data());
+			m_direct->SetCoefficients(m_coefficients);
+			memcpy(m_controls, controls, dimensions * sizeof(float));
+			m_valid = true;
+		}
+		m_direct->Process(in, out, frames, channels);
+	}
+}
+
+//Clears the history of every channel
+void CDynamicFilter::Reset()
+{
+	if (m_iir)
+		m_iir->Reset();
+	else if (m_multirate)
+		m_multirate->Reset();
+	else if (m_fft)
+		m_fft->Reset();
+	else
+		m_direct->Reset();
+}
+
+//Filters a block of silence so every buffer of the engine is allocated
+void CDynamicFilter::Prepare(unsigned int frames, int channels)
+{
+	std::vector<float> silence((size_t)frames * channels, 0.0f);
+	std::vector<float *> planar(channels);
+	for (int c = 0; c < channels; c++)
+		planar[c] = &silence[(size_t)c * frames];
+	float controls[CMorphBank::MAX_DIMENSIONS] = {};
+	Process(planar.data(), planar.data(), frames, channels, controls);
+	Reset();
+}
+
+//Getters of the class attributes
+int CDynamicFilter::getTaps() { return m_bank.getLength(); }
+int CDynamicFilter::getDimensions() { return m_bank.getDimensions(); }
+FilterMode CDynamicFilter::getMode() { return m_mode; }
+bool CDynamicFilter::usesFft() { return m_fft != NULL; }
+const char *CDynamicFilter::getEngineName() { return m_iir ? "IIR" : (m_multirate ? "multirate" : (m_fft ? "FFT" : "direct")); }
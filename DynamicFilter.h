@@ -0,0 +1,75 @@
+#pragma once
+#include <vector>
+#include "FirFilter.h"
+#include "FftConvolver.h"
+#include "IirFilter.h"
+#include "MultirateFilter.h"
+#include "FilterBank.h"
+
+// Quality/performance choice of a dynamic filter
+enum FilterMode
+{
+	FILTER_MODE_FIR, // The exact FIR filters, convolved directly or with the FFT
+	FILTER_MODE_IIR, // The IIR sections fitted to them, much cheaper for long filters
+	FILTER_MODE_MULTIRATE // The FIR filters run at a lower rate when they only keep low frequencies
+};
+
+class CDynamicFilter;
+
+// The controls of a dynamic filter, handed from the game thread to the mixer thread in one piece.
+// A new bank or mode travels as a whole engine, built and prepared by the game thread
+typedef struct
+{
+	float controls[CMorphBank::MAX_DIMENSIONS]; // The external control followed by the other dimensions of the bank
+	unsigned int version; // Version of the engine, 0 for the one the DSP was created with
+	CDynamicFilter *filter; // The engine of that version
+} filter_params_t;
+
+// The dynamic filter of the custom DSP: morphs across a bank of static FIR filters with one or more controls.
+// Short filters are convolved directly, long ones with the partitioned FFT convolver, unless the IIR mode is chosen.
+// The multirate mode falls back to these when the passband of the filters is too wide to decimate.
+class CDynamicFilter
+{
+public:
+	static const int FFT_CROSSOVER_TAPS = 128; // Filters of this length or longer use the FFT convolver
+	static const int FFT_BLOCK_SIZE = 128; // Partition size of the FFT convolver
+
+	CDynamicFilter(const CFilterBank &bank, FilterMode mode); //Picks the engine for the mode and the length of the filters
+	~CDynamicFilter(); //Destructor
+
+	//Filters a block of planar samples with the filter blended from the bank entries around the controls, one per
+	//dimension of the bank. in[c] and out[c] hold the frames of channel c. They can be the same buffers
+	void Process(const float *const *in, float *const *out, unsigned int frames, int channels, const float *controls);
+	//Replaces the filter bank. The history is kept unless the length of the filters changes
+	void SetFilters(const CFilterBank &bank);
+	//Switches between the FIR, IIR and multirate engines. The history is cleared
+	void SetMode(FilterMode mode);
+	//Clears the history of every channel
+	void Reset();
+	//Filters a block of silence of frames frames of channels channels, so every buffer of the engine is allocated
+	//before the mixer thread uses it. The history is cleared afterwards
+	void Prepare(unsigned int frames, int channels);
+	//Getters of the class attributes
+	int getTaps();
+	int getDimensions();
+	FilterMode getMode();
+	bool usesFft();
+	const char *getEngineName(); //The engine in use: "direct", "FFT", "IIR" or "multirate"
+
+private:
+	//Creates the engine for the mode and the length of the filters
+	void CreateEngine();
+
+	CMorphBank m_bank; // The filter bank
+	CMorphBank m_sections; // The IIR section gains of the filter bank
+	float m_sampleRate; // The sample rate the filter bank was designed for
+	FilterMode m_mode;
+	bool m_blend; // Whether the nearest entries are blended or the nearest one is used
+	std::vector<float> m_coefficients; // The blended filter of the direct form engine
+	float m_controls[CMorphBank::MAX_DIMENSIONS]; // The controls the blended filter was calculated with
+	bool m_valid; // False until the blended filter has been calculated from the current bank
+	CFirFilter *m_direct; // Direct form engine, NULL when another engine is used
+	CFftConvolver *m_fft; // FFT engine, NULL when another engine is used
+	CIirFilter *m_iir; // IIR engine, NULL unless in the IIR mode
+	CMultirateFilter *m_multirate; // Multirate engine, NULL unless in the multirate mode and the filters can be decimated
+};
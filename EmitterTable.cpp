@@ -0,0 +1,208 @@
+#include "EmitterTable.h"
+#include <assert.h>
+
+const float CEmitterTable::DISTANCE_THRESHOLD = 0.01f;
+const float CEmitterTable::SPEED_THRESHOLD = 0.01f;
+
+//Creates an empty table
+CEmitterTable::CEmitterTable()
+{
+	m_count = 0;
+}
+
+CEmitterTable::~CEmitterTable()
+{}
+
+//Grows the arrays to capacity emitters
+void CEmitterTable::Grow(int capacity)
+{
+	m_x.resize(capacity);
+	m_y.resize(capacity);
+	m_z.resize(capacity);
+	m_vx.resize(capacity);
+	m_vy.resize(capacity);
+	m_vz.resize(capacity);
+	m_voice.resize(capacity, (int)NO_VOICE);
+	m_slot.resize(capacity, -1);
+	m_live.resize(capacity, 0);
+}
+
+//Allocates room for emitters emitters
+void CEmitterTable::Reserve(int emitters)
+{
+	if (emitters > (int)m_x.size())
+		Grow(emitters);
+	m_free.reserve(emitters);
+	m_active.reserve(emitters);
+	m_pushed.reserve(6 * emitters);
+	m_stale.reserve(emitters);
+	m_changed.reserve(emitters);
+}
+
+//Adds an emitter at rest and returns its index
+int CEmitterTable::Add(float x, float y, float z)
+{
+	int emitter;
+	if (!m_free.empty())
+	{
+		emitter = m_free.back();
+		m_free.pop_back();
+	}
+	else
+	{
+		emitter = m_count++;
+		if (m_count > (int)m_x.size())
+			Reserve(m_count * 2);
+	}
+
+	m_x[emitter] = x;
+	m_y[emitter] = y;
+	m_z[emitter] = z;
+	m_vx[emitter] = m_vy[emitter] = m_vz[emitter] = 0.0f;
+	m_voice[emitter] = NO_VOICE;
+	m_live[emitter] = 1;
+	return emitter;
+}
+
+/*
+	Removes an emitter. It stays in the arrays at rest, so Integrate doesn't need to skip it. Removing it twice would put
+	its index twice on the free list, and two emitters added later would share it
+*/
+bool CEmitterTable::Remove(int emitter)
+{
+	bool live = isLive(emitter);
+	assert(live);
+	if (!live)
+		return false;
+
+	SetVoice(emitter, NO_VOICE);
+	m_vx[emitter] = m_vy[emitter] = m_vz[emitter] = 0.0f;
+	m_live[emitter] = 0;
+	m_free.push_back(emitter);
+	return true;
+}
+
+/*
+	Each component is a separate loop over contiguous floats with no dependencies between emitters, which the compiler
+	turns into packed multiply-adds
+*/
+void CEmitterTable::Integrate(float dt)
+{
+	int count = m_count;
+	float *x = m_x.data(), *y = m_y.data(), *z = m_z.data();
+	const float *vx = m_vx.data(), *vy = m_vy.data(), *vz = m_vz.data();
+	for (int i = 0; i < count; i++)
+		x[i] += vx[i] * dt;
+	for (int i = 0; i < count; i++)
+		y[i] += vy[i] * dt;
+	for (int i = 0; i < count; i++)
+		z[i] += vz[i] * dt;
+}
+
+/*
+	The active emitters are kept packed, so unbinding one moves the last active emitter into its slot
+*/
+void CEmitterTable::SetVoice(int emitter, int voice)
+{
+	int slot = m_slot[emitter];
+	m_voice[emitter] = voice;
+	if (voice != NO_VOICE)
+	{
+		if (slot < 0)
+		{
+			slot = (int)m_active.size();
+			m_slot[emitter] = slot;
+			m_active.push_back(emitter);
+			m_pushed.resize(m_pushed.size() + 6);
+			m_stale.push_back(0);
+		}
+		m_stale[slot] = 1;
+	}
+	else if (slot >= 0)
+	{
+		int last = (int)m_active.size() - 1;
+		int moved = m_active[last];
+		m_active[slot] = moved;
+		m_slot[moved] = slot;
+		for (int i = 0; i < 6; i++)
+			m_pushed[6 * slot + i] = m_pushed[6 * last + i];
+		m_stale[slot] = m_stale[last];
+		m_active.pop_back();
+		m_pushed.resize(m_pushed.size() - 6);
+		m_stale.pop_back();
+		m_slot[emitter] = -1;
+	}
+}
+
+//The active emitters that moved or changed velocity past the thresholds since their attributes were last pushed
+const std::vector<int> &CEmitterTable::Collect()
+{
+	const float distance2 = DISTANCE_THRESHOLD * DISTANCE_THRESHOLD;
+	const float speed2 = SPEED_THRESHOLD * SPEED_THRESHOLD;
+
+	m_changed.clear();
+	for (int slot = 0; slot < (int)m_active.size(); slot++)
+	{
+		int e = m_active[slot];
+		float *pushed = &m_pushed[6 * slot];
+		float dx = m_x[e] - pushed[0], dy = m_y[e] - pushed[1], dz = m_z[e] - pushed[2];
+		float dvx = m_vx[e] - pushed[3], dvy = m_vy[e] - pushed[4], dvz = m_vz[e] - pushed[5];
+		if (m_stale[slot] || dx * dx + dy * dy + dz * dz > distance2 || dvx * dvx + dvy * dvy + dvz * dvz > speed2)
+		{
+			pushed[0] = m_x[e];
+			pushed[1] = m_y[e];
+			pushed[2] = m_z[e];
+			pushed[3] = m_vx[e];
+			pushed[4] = m_vy[e];
+			pushed[5] = m_vz[e];
+			m_stale[slot] = 0;
+			m_changed.push_back(e);
+		}
+	}
+
+	return m_changed;
+}
+
+//Setters and getters of the emitter attributes
+void CEmitterTable::SetPosition(int emitter, float x, float y, float z)
+{
+	m_x[emitter] = x;
+	m_y[emitter] = y;
+	m_z[emitter] = z;
+}
+
+void CEmitterTable::SetVelocity(int emitter, float x, float y, float z)
+{
+	m_vx[emitter] = x;
+	m_vy[emitter] = y;
+	m_vz[emitter] = z;
+}
+
+void CEmitterTable::getPosition(int emitter, float *position) const
+{
+	position[0] = m_x[emitter];
+	position[1] = m_y[emitter];
+	position[2] = m_z[emitter];
+}
+
+void CEmitterTable::getVelocity(int emitter, float *velocity) const
+{
+	velocity[0] = m_vx[emitter];
+	velocity[1] = m_vy[emitter];
+	velocity[2] = m_vz[emitter];
+}
+
+int CEmitterTable::getVoice(int emitter) const { return m_voice[emitter]; }
+const float *CEmitterTable::getX() const { return m_x.data(); }
+const float *CEmitterTable::getY() const { return m_y.data(); }
+const float *CEmitterTable::getZ() const { return m_z.data(); }
+const float *CEmitterTable::getVX() const { return m_vx.data(); }
+const float *CEmitterTable::getVY() const { return m_vy.data(); }
+const float *CEmitterTable::getVZ() const { return m_vz.data(); }
+const int *CEmitterTable::getVoices() const { return m_voice.data(); }
+
+//Getters of the class attributes
+int CEmitterTable::getCount() const { return m_count - (int)m_free.size(); }
+int CEmitterTable::getActive() const { return (int)m_active.size(); }
+int CEmitterTable::getRange() const { return m_count; }
+bool CEmitterTable::isLive(int emitter) const { return emitter >= 0 && emitter < m_count && m_live[emitter]; }
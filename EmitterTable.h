@@ -0,0 +1,73 @@
+#pragma once
+#include <vector>
+
+// The positions and velocities of every sound emitter in the world, stored as a structure of arrays so moving them is
+// one pass over contiguous floats the compiler vectorises. Only a few emitters are heard at a time: an emitter bound to
+// a voice (an FMOD channel) is active, and only the active emitters are checked for changes, so the cost of pushing 3D
+// attributes to FMOD grows with the voices playing, not with the emitters in the world.
+// Emitters are identified by their index, which stays the same until they are removed.
+class CEmitterTable
+{
+public:
+	static const int NO_VOICE = -1;
+	static const float DISTANCE_THRESHOLD; // Movement in world units before the position is pushed again
+	static const float SPEED_THRESHOLD; // Change of velocity before it is pushed again
+
+	CEmitterTable(); //Creates an empty table
+	~CEmitterTable(); //Destructor
+
+	//Allocates room for emitters emitters, so adding them and collecting their changes doesn't allocate
+	void Reserve(int emitters);
+	//Adds an emitter at rest and returns its index
+	int Add(float x, float y, float z);
+	//Removes an emitter. Its index is reused by the next one added. Returns false, and asserts in debug builds, if the
+	//emitter isn't in the table, e.g. when it was already removed
+	bool Remove(int emitter);
+
+	//Moves every emitter by its velocity over dt
+	void Integrate(float dt);
+	//Binds an emitter to a voice, or unbinds it with NO_VOICE. The attributes of a newly bound emitter are always pushed
+	void SetVoice(int emitter, int voice);
+	//The active emitters that moved or changed velocity past the thresholds since their attributes were last pushed.
+	//They count as pushed once returned. The list is valid until the next call
+	const std::vector<int> &Collect();
+
+	//Setters and getters of the emitter attributes
+	void SetPosition(int emitter, float x, float y, float z);
+	void SetVelocity(int emitter, float x, float y, float z);
+	void getPosition(int emitter, float *position) const; //x, y and z
+	void getVelocity(int emitter, float *velocity) const;
+	int getVoice(int emitter) const;
+	//The position and velocity arrays themselves, for passes over many emitters
+	const float *getX() const;
+	const float *getY() const;
+	const float *getZ() const;
+	const float *getVX() const;
+	const float *getVY() const;
+	const float *getVZ() const;
+	const int *getVoices() const;
+	//Getters of the class attributes
+	int getCount() const; //Emitters in use
+	int getActive() const; //Emitters bound to a voice
+	int getRange() const; //Length of the attribute arrays in use, removed emitters included
+	bool isLive(int emitter) const; //Added and not removed yet
+
+private:
+	//Grows the arrays to capacity emitters
+	void Grow(int capacity);
+
+	//Emitter attributes, one array per component
+	std::vector<float> m_x, m_y, m_z;
+	std::vector<float> m_vx, m_vy, m_vz;
+	std::vector<int> m_voice; // Voice of each emitter, NO_VOICE when inactive
+	std::vector<int> m_slot; // Position of each active emitter in m_active
+	std::vector<unsigned char> m_live; // Set from Add to Remove
+	std::vector<int> m_free; // Removed emitters, reused first
+
+	//Active emitters, with the attributes last pushed to their voices in the same order
+	std::vector<int> m_active;
+	std::vector<float> m_pushed; // Position and velocity, 6 floats per active emitter
+	std::vector<unsigned char> m_stale; // Set when the attributes must be pushed whatever they are
+	std::vector<int> m_changed; // Result of Collect
+	int m_count; // Emitters in use or removed, the length of the attribute arrays in use
+};
@@ -0,0 +1,154 @@
+#include "Fft.h"
+#define _USE_MATH_DEFINES
+#include <math.h>
+
+//Precalculates the twiddle factors and the bit reversal table for the size
+CFft::CFft(int size)
+{
+	m_size = size;
+	m_half = size / 2;
+
+	int bits = 0;
+	while ((1 << bits) < m_half)
+		bits++;
+	m_bitReverse.resize(m_half);
+	for (int i = 0; i < m_half; i++)
+	{
+		int r = 0;
+		for (int b = 0; b < bits; b++)
+			r |= ((i >> b) & 1) << (bits - 1 - b);
+		m_bitReverse[i] = r;
+	}
+
+	m_cos.resize(m_half / 2 + 1);
+	m_sin.resize(m_half / 2 + 1);
+	for (int i = 0; i <= m_half / 2; i++)
+	{
+		m_cos[i] = (float)cos(2.0 * M_PI * i / m_half);
+		m_sin[i] = (float)sin(2.0 * M_PI * i / m_half);
+	}
+
+	m_splitCos.resize(m_half + 1);
+	m_splitSin.resize(m_half + 1);
+	for (int k = 0; k <= m_half; k++)
+	{
+		m_splitCos[k] = (float)cos(2.0 * M_PI * k / m_size);
+		m_splitSin[k] = (float)sin(2.0 * M_PI * k / m_size);
+	}
+
+	m_workRe.resize(m_half);
+	m_workIm.resize(m_half);
+}
+
+CFft::~CFft()
+{}
+
+/*
+	Iterative radix-2 FFT: the data is put in bit reversed order and then combined with butterflies,
+	doubling the size of the transforms at every stage
+*/
+void CFft::Complex(float *re, float *im, int sign)
+{
+	int n = m_half;
+	for (int i = 0; i < n; i++)
+	{
+		int j = m_bitReverse[i];
+		if (j > i)
+		{
+			float t = re[i]; re[i] = re[j]; re[j] = t;
+			t = im[i]; im[i] = im[j]; im[j] = t;
+		}
+	}
+
+	for (int len = 2; len <= n; len <<= 1)
+	{
+		int half = len >> 1;
+		int step = n / len;
+		for (int start = 0; start < n; start += len)
+		{
+			for (int k = 0; k < half; k++)
+			{
+				//Twiddle factor e^(sign * 2*pi*i * k / len)
+				float wr = m_cos[k * step];
+				float wi = sign * m_sin[k * step];
+				int a = start + k;
+				int b = a + half;
+				float tr = re[b] * wr - im[b] * wi;
+				float ti = re[b] * wi + im[b] * wr;
+				re[b] = re[a] - tr;
+				im[b] = im[a] - ti;
+				re[a] += tr;
+				im[a] += ti;
+			}
+		}
+	}
+}
+
+/*
+	The even samples are packed in the real parts and the odd samples in the imaginary parts of a half size FFT.
+	Its output Z is split into the spectra of the even (E) and odd (O) samples, then X[k] = E[k] + e^(-2*pi*i*k/N) O[k]
+*/
+void CFft::Forward(const float *in, float *re, float *im)
+{
+	float *zr = m_workRe.data();
+	float *zi = m_workIm.data();
+	for (int i = 0; i < m_half; i++)
+	{
+		zr[i] = in[2 * i];
+		zi[i] = in[2 * i + 1];
+	}
+
+	Complex(zr, zi, -1);
+
+	for (int k = 0; k <= m_half; k++)
+	{
+		int a = k % m_half;
+		int b = (m_half - k) % m_half;
+		//E[k] = (Z[k] + conj(Z[M-k])) / 2 and O[k] = (Z[k] - conj(Z[M-k])) / 2i
+		float er = 0.5f * (zr[a] + zr[b]);
+		float ei = 0.5f * (zi[a] - zi[b]);
+		float or_ = 0.5f * (zi[a] + zi[b]);
+		float oi = -0.5f * (zr[a] - zr[b]);
+		float wr = m_splitCos[k];
+		float wi = -m_splitSin[k];
+		re[k] = er + or_ * wr - oi * wi;
+		im[k] = ei + or_ * wi + oi * wr;
+	}
+}
+
+/*
+	Undoes the split: E[k] = (X[k] + conj(X[M-k])) / 2 and O[k] = (X[k] - conj(X[M-k])) e^(2*pi*i*k/N) / 2,
+	then the half size inverse FFT of E + iO gives the even samples in the real parts and the odd ones in the imaginary parts
+*/
+void CFft::Inverse(const float *re, const float *im, float *out)
+{
+	float *zr = m_workRe.data();
+	float *zi = m_workIm.data();
+	for (int k = 0; k < m_half; k++)
+	{
+		int b = m_half - k;
+		float er = 0.5f * (re[k] + re[b]);
+		float ei = 0.5f * (im[k] - im[b]);
+		float dr = 0.5f * (re[k] - re[b]);
+		float di = 0.5f * (im[k] + im[b]);
+		float wr = m_splitCos[k];
+		float wi = m_splitSin[k];
+		float or_ = dr * wr - di * wi;
+		float oi = dr * wi + di * wr;
+		zr[k] = er - oi;
+		zi[k] = ei + or_;
+	}
+
+	Complex(zr, zi, 1);
+
+	float scale = 1.0f / m_half;
+	for (int i = 0; i < m_half; i++)
+	{
+		out[2 * i] = zr[i] * scale;
+		out[2 * i + 1] = zi[i] * scale;
+	}
+}
+
+//Getters of the class attributes
+int CFft::getSize() { return m_size; }
+int CFft::getBins() { return m_half + 1; }
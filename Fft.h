@@ -0,0 +1,31 @@
+#pragma once
+#include <vector>
+
+// Real FFT of a power of two size.
+// The spectrum has size / 2 + 1 bins and is kept in split form (real parts and imaginary parts in separate arrays),
+// which is the layout the convolvers multiply-accumulate on.
+class CFft
+{
+public:
+	CFft(int size); //Precalculates the twiddle factors and the bit reversal table for the size
+	~CFft(); //Destructor
+
+	//Transforms size real samples into size / 2 + 1 complex bins
+	void Forward(const float *in, float *re, float *im);
+	//Transforms size / 2 + 1 complex bins back into size real samples, scaled so Inverse(Forward(x)) = x
+	void Inverse(const float *re, const float *im, float *out);
+	//Getters of the class attributes
+	int getSize();
+	int getBins();
+
+private:
+	//In place complex FFT of half the size. sign is -1 for the forward transform and +1 for the inverse one
+	void Complex(float *re, float *im, int sign);
+
+	int m_size; // The number of real samples
+	int m_half; // The size of the complex FFT the real one is calculated with
+	std::vector<int> m_bitReverse; // Index permutation of the complex FFT
+	std::vector<float> m_cos, m_sin; // Twiddle factors of the complex FFT
+	std::vector<float> m_splitCos, m_splitSin; // Twiddle factors that split the complex FFT into the real one
+	std::vector<float> m_workRe, m_workIm; // The half size complex data
+};
@@ -0,0 +1,216 @@
+#include "FftConvolver.h"
+#include <cstring>
+#include <algorithm>
+
+//Precalculates the partition spectra of every filter of a bank
+CFftConvolver::CFftConvolver(const CMorphBank &filters, int blockSize)
+	: m_fft(2 * blockSize)
+{
+	Init(filters.getLength(), blockSize, 0);
+	SetFilters(filters);
+}
+
+//Precalculates the partition spectra of a single filter, which are used as they are
+CFftConvolver::CFftConvolver(const std::vector<float> &fir, int blockSize, int delayBlocks)
+	: m_fft(2 * blockSize)
+{
+	Init((int)fir.size(), blockSize, delayBlocks);
+	Transform(fir.data(), (int)fir.size(), m_mix.data());
+	m_mixValid = true;
+}
+
+//Sets the sizes and allocates the spectra
+void CFftConvolver::Init(int taps, int blockSize, int delayBlocks)
+{
+	m_taps = taps;
+	m_block = blockSize;
+	m_bins = m_fft.getBins();
+	m_partitions = (m_taps + m_block - 1) / m_block;
+	if (m_partitions < 1)
+		m_partitions = 1;
+	m_delay = delayBlocks;
+	m_slots = m_partitions + m_delay;
+
+	m_mix.assign(2 * m_partitions * m_bins, 0.0f);
+	m_mixBlend = false;
+	m_mixValid = false;
+	m_accRe.resize(m_bins);
+	m_accIm.resize(m_bins);
+	m_time.resize(2 * m_block);
+	m_fill = 0;
+	m_fdlPos = 0;
+}
+
+//Each partition is zero padded to twice the block size before the FFT
+void CFftConvolver::Transform(const float *fir, int taps, float *spectrum)
+{
+	float *re = spectrum;
+	float *im = spectrum + m_partitions * m_bins;
+	std::vector<float> segment(2 * m_block);
+	for (int p = 0; p < m_partitions; p++)
+	{
+		std::fill(segment.begin(), segment.end(), 0.0f);
+		for (int i = 0; i < m_block && p * m_block + i < taps; i++)
+			segment[i] = fir[p * m_block + i];
+		m_fft.Forward(segment.data(), &re[p * m_bins], &im[p * m_bins]);
+	}
+}
+
+CFftConvolver::~CFftConvolver()
+{}
+
+/*
+	The FFT is linear, so interpolating the spectra gives the spectrum of the interpolated filter:
+	b_filt_mix = (1-mix_ratio) * b_filt1 + mix_ratio * b_filt2
+*/
+void CFftConvolver::Mix(const float *controls, bool blend)
+{
+	if (m_bank.getCount() == 0)
+		return;
+
+	int dimensions = m_bank.getDimensions();
+	if (m_mixValid && blend == m_mixBlend && memcmp(controls, m_mixControls, dimensions * sizeof(float)) == 0)
+		return;
+
+	m_bank.Blend(controls, blend, m_mix.data());
+	memcpy(m_mixControls, controls, dimensions * sizeof(float));
+	m_mixBlend = blend;
+	m_mixValid = true;
+}
+
+//Replaces the filters of the bank with ones of the same length
+void CFftConvolver::SetFilters(const CMorphBank &filters)
+{
+	m_bank.Init(filters, 2 * m_partitions * m_bins);
+	for (int k = 0; k < m_bank.getCount(); k++)
+		Transform(filters.getEntry(k), filters.getLength(), m_bank.getEntry(k));
+	m_mixValid = false; //Forces the spectra to be calculated on the next block
+}
+
+/*
+	Samples are collected until a block is full, then the whole block is filtered at once.
+	Meanwhile the output is read from the previously filtered block, which delays it by one block
+*/
+void CFftConvolver::Process(const float *const *in, float *const *out, unsigned int frames, int channels)
+{
+	AddChannels(channels);
+
+	unsigned int done = 0;
+	while (done < frames)
+	{
+		unsigned int n = m_block - m_fill;
+		if (n > frames - done)
+			n = frames - done;
+
+		for (int c = 0; c < channels; c++)
+		{
+			channel_t &chan = m_channels[c];
+			memcpy(&chan.input[m_block + m_fill], in[c] + done, n * sizeof(float));
+			memcpy(out[c] + done, &chan.output[m_fill], n * sizeof(float));
+		}
+
+		m_fill += n;
+		done += n;
+
+		if (m_fill == m_block)
+		{
+			for (int c = 0; c < channels; c++)
+				ProcessBlock(m_channels[c]);
+			m_fdlPos = (m_fdlPos + 1) % m_slots;
+			m_fill = 0;
+		}
+	}
+}
+
+//Filters exactly one block of planar samples straight away
+void CFftConvolver::ProcessAligned(const float *const *in, float *const *out, int channels)
+{
+	AddChannels(channels);
+
+	for (int c = 0; c < channels; c++)
+	{
+		channel_t &chan = m_channels[c];
+		memcpy(&chan.input[m_block], in[c], m_block * sizeof(float));
+		ProcessBlock(chan);
+		memcpy(out[c], chan.output.data(), m_block * sizeof(float));
+	}
+	m_fdlPos = (m_fdlPos + 1) % m_slots;
+}
+
+//Creates the state of the channels that haven't been seen yet
+void CFftConvolver::AddChannels(int channels)
+{
+	while ((int)m_channels.size() < channels)
+	{
+		channel_t chan;
+		chan.input.assign(2 * m_block, 0.0f);
+		chan.output.assign(m_block, 0.0f);
+		chan.fdlRe.assign(m_slots * m_bins, 0.0f);
+		chan.fdlIm.assign(m_slots * m_bins, 0.0f);
+		m_channels.push_back(chan);
+	}
+}
+
+/*
+	Overlap-save: the FFT of the last two blocks goes into the delay line, the delay line is multiplied with the
+	partition spectra (partition p with the input of p + delay blocks ago) and the second half of the inverse FFT is the
+	filtered block. The first half is wrapped around by the circular convolution and discarded.
+*/
+void CFftConvolver::ProcessBlock(channel_t &chan)
+{
+	float *xRe = &chan.fdlRe[m_fdlPos * m_bins];
+	float *xIm = &chan.fdlIm[m_fdlPos * m_bins];
+	m_fft.Forward(chan.input.data(), xRe, xIm);
+
+	float *accRe = m_accRe.data();
+	float *accIm = m_accIm.data();
+	memset(accRe, 0, m_bins * sizeof(float));
+	memset(accIm, 0, m_bins * sizeof(float));
+
+	for (int p = 0; p < m_partitions; p++)
+	{
+		int slot = m_fdlPos - p - m_delay;
+		if (slot < 0)
+			slot += m_slots;
+		const float *aRe = &chan.fdlRe[slot * m_bins];
+		const float *aIm = &chan.fdlIm[slot * m_bins];
+		const float *hRe = &m_mix[p * m_bins];
+		const float *hIm = &m_mix[(m_partitions + p) * m_bins];
+		for (int k = 0; k < m_bins; k++)
+		{
+			accRe[k] += aRe[k] * hRe[k] - aIm[k] * hIm[k];
+			accIm[k] += aRe[k] * hIm[k] + aIm[k] * hRe[k];
+		}
+	}
+
+	m_fft.Inverse(accRe, accIm, m_time.data());
+	memcpy(chan.output.data(), &m_time[m_block], m_block * sizeof(float));
+
+	//The block just filled becomes the previous block
+	memmove(chan.input.data(), &chan.input[m_block], m_block * sizeof(float));
+}
+
+//Creates the state of up to channels channels
+void CFftConvolver::Prepare(int channels)
+{
+	AddChannels(channels);
+}
+
+//Clears the history of every channel
+void CFftConvolver::Reset()
+{
+	for (unsigned int c = 0; c < m_channels.size(); c++)
+	{
+		std::fill(m_channels[c].input.begin(), m_channels[c].input.end(), 0.0f);
+		std::fill(m_channels[c].output.begin(), m_channels[c].output.end(), 0.0f);
+		std::fill(m_channels[c].fdlRe.begin(), m_channels[c].fdlRe.end(), 0.0f);
+		std::fill(m_channels[c].fdlIm.begin(), m_channels[c].fdlIm.end(), 0.0f);
+	}
+	m_fill = 0;
+	m_fdlPos = 0;
+}
+
+//Getters of the class attributes
+int CFftConvolver::getTaps() { return m_taps; }
+int CFftConvolver::getBlockSize() { return m_block; }
+int CFftConvolver::getLatency() { return m_block * (1 + m_delay); }
@@ -0,0 +1,71 @@
+#pragma once
+#include <vector>
+#include "Fft.h"
+#include "MorphBank.h"
+
+// Uniformly partitioned overlap-save convolver for long FIR filters.
+// The filters are cut into partitions of one block; the spectrum of every input block is kept in a frequency domain
+// delay line and multiplied with the partition spectra, so the cost per sample barely grows with the filter length.
+// Like CFirFilter it morphs between the filters of a bank, here by mixing their spectra. The output is delayed by one block,
+// plus delayBlocks more when the filter is a later segment of a longer response (see CConvolutionReverb).
+class CFftConvolver
+{
+public:
+	CFftConvolver(const CMorphBank &filters, int blockSize); //Precalculates the partition spectra of every filter of a bank
+	CFftConvolver(const std::vector<float> &fir, int blockSize, int delayBlocks); //Precalculates the partition spectra of a single filter
+	~CFftConvolver(); //Destructor
+
+	//Blends the spectra of the filters around the controls, one per dimension of the bank. They are only recalculated
+	//when the controls change
+	void Mix(const float *controls, bool blend);
+	//Replaces the filters of the bank with ones of the same length
+	void SetFilters(const CMorphBank &filters);
+	//Filters a block of planar samples of any length: in[c] and out[c] hold the frames of channel c. They can be the same buffers
+	void Process(const float *const *in, float *const *out, unsigned int frames, int channels);
+	//Filters exactly one block of planar samples straight away, for callers that collect the blocks themselves.
+	//The output is not delayed by the block Process buffers, so it must not be mixed with calls to Process
+	void ProcessAligned(const float *const *in, float *const *out, int channels);
+	//Creates the state of up to channels channels, so Process doesn't allocate
+	void Prepare(int channels);
+	//Clears the history of every channel
+	void Reset();
+	//Getters of the class attributes
+	int getTaps();
+	int getBlockSize();
+	int getLatency();
+
+private:
+	// The state of one channel
+	typedef struct
+	{
+		std::vector<float> input; // The previous block followed by the block being filled
+		std::vector<float> output; // The last filtered block, read while the next one is filled
+		std::vector<float> fdlRe, fdlIm; // Spectra of the last partitions input blocks
+	} channel_t;
+
+	//Calculates the partition spectra of a filter
+	void Init(int taps, int blockSize, int delayBlocks);
+	void Transform(const float *fir, int taps, float *spectrum);
+	//Creates the state of the channels that haven't been seen yet
+	void AddChannels(int channels);
+	//Filters the block of a channel that has just been filled
+	void ProcessBlock(channel_t &chan);
+
+	CFft m_fft; // FFT of twice the block size
+	int m_taps; // The length of the filters
+	int m_block; // The block size, also the partition size
+	int m_bins; // Bins of each spectrum
+	int m_partitions; // Number of partitions of the filters
+	int m_delay; // Extra blocks of delay
+	int m_slots; // Spectra kept in the delay lines: the partitions plus the extra delay
+	CMorphBank m_bank; // Partition spectra of every filter of the bank, the real parts followed by the imaginary ones. Empty for a single filter
+	std::vector<float> m_mix; // Partition spectra of the active filter, laid out like the entries of the bank
+	std::vector<channel_t> m_channels;
+	std::vector<float> m_accRe, m_accIm; // Spectrum of the block being filtered
+	std::vector<float> m_time; // Time domain result of the block being filtered
+	int m_fill; // Samples in the block being filled
+	int m_fdlPos; // Position of the newest spectrum in the delay lines
+	float m_mixControls[CMorphBank::MAX_DIMENSIONS]; // The controls the active spectra were calculated with
+	bool m_mixBlend; // Whether the active spectra were blended
+	bool m_mixValid; // False until the active spectra have been calculated from the current bank
+};
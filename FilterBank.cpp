@@ -0,0 +1,164 @@
+#include "FilterBank.h"
+#include <cstring>
+
+CFilterBank::CFilterBank()
+{
+	m_blend = true;
+	m_sampleRate = 44100.0f;
+	m_sectionError = 0.0f;
+}
+
+CFilterBank::~CFilterBank()
+{}
+
+//Designs a grid of filters spanning the controls
+bool CFilterBank::Build(int taps, const std::vector<band_spec_t> &corners, float fs, const std::vector<int> &sizes)
+{
+	int dimensions = (int)sizes.size();
+	if (dimensions < 1 || dimensions > CMorphBank::MAX_DIMENSIONS || (int)corners.size() != (1 << dimensions))
+		return false;
+
+	CMorphBank bank;
+	if (!Design(taps, corners, fs, sizes, bank))
+		return false;
+	m_bank = bank;
+	m_sampleRate = fs;
+
+	//Longer filters are designed again at the length the sections can follow for the fit
+	if (m_bank.getLength() > CIirFilter::FIT_TAPS && Design(CIirFilter::FIT_TAPS, corners, fs, sizes, bank))
+		FitSections(bank);
+	else
+		FitSections(m_bank);
+	return true;
+}
+
+//Designs the entries of a grid of filters into bank
+bool CFilterBank::Design(int taps, const std::vector<band_spec_t> &corners, float fs, const std::vector<int> &sizes, CMorphBank &bank)
+{
+	int dimensions = (int)sizes.size();
+
+	bool interpolateSpec = true;
+	for (unsigned int c = 1; c < corners.size(); c++)
+		if (corners[c].bands.size() != corners[0].bands.size() || corners[c].weights.size() != corners[0].weights.size())
+			interpolateSpec = false;
+
+	//The corner designs, only needed when the specifications can't be interpolated
+	std::vector< std::vector<float> > cornerFirs;
+	if (!interpolateSpec)
+	{
+		for (unsigned int c = 0; c < corners.size(); c++)
+		{
+			cornerFirs.push_back(CFirDesign::Firls(taps, corners[c], fs));
+			if (cornerFirs[c].empty())
+				return false;
+		}
+		taps = (int)cornerFirs[0].size();
+	}
+
+	bank.Init(sizes, taps | 1); //Firls rounds even lengths up
+	const std::vector<int> &grid = bank.getSizes();
+
+	for (int k = 0; k < bank.getCount(); k++)
+	{
+		//Weight of every corner at the position of the entry
+		std::vector<float> weights(corners.size(), 1.0f);
+		int rest = k;
+		for (int d = 0; d < dimensions; d++)
+		{
+			float t = grid[d] > 1 ? (float)(rest % grid[d]) / (grid[d] - 1) : 0.0f;
+			rest /= grid[d];
+			for (unsigned int c = 0; c < corners.size(); c++)
+				weights[c] *= ((c >> d) & 1) ? t : 1 - t;
+		}
+
+		std::vector<float> fir;
+		if (interpolateSpec)
+		{
+			band_spec_t spec = corners[0];
+			for (unsigned int i = 0; i < spec.bands.size(); i++)
+			{
+				spec.bands[i] = 0.0f;
+				spec.desired[i] = 0.0f;
+				for (unsigned int c = 0; c < corners.size(); c++)
+				{
+					spec.bands[i] += weights[c] * corners[c].bands[i];
+					spec.desired[i] += weights[c] * corners[c].desired[i];
+				}
+			}
+			for (unsigned int i = 0; i < spec.weights.size(); i++)
+			{
+				spec.weights[i] = 0.0f;
+				for (unsigned int c = 0; c < corners.size(); c++)
+					spec.weights[i] += weights[c] * corners[c].weights[i];
+			}
+
+			fir = CFirDesign::Firls(taps, spec, fs);
+			if (fir.empty())
+				return false;
+		}
+		else
+		{
+			//b_filt_mix = (1-mix_ratio) * b_filt1 + mix_ratio * b_filt2, along every control
+			fir.assign(taps, 0.0f);
+			for (unsigned int c = 0; c < corners.size(); c++)
+				for (int i = 0; i < taps; i++)
+					fir[i] += weights[c] * cornerFirs[c][i];
+		}
+
+		memcpy(bank.getEntry(k), fir.data(), bank.getLength() * sizeof(float));
+	}
+	return true;
+}
+
+//Designs size filters along a single control
+bool CFilterBank::Build(int taps, const band_spec_t &spec0, const band_spec_t &spec1, float fs, int size)
+{
+	std::vector<band_spec_t> corners;
+	corners.push_back(spec0);
+	corners.push_back(spec1);
+	return Build(taps, corners, fs, std::vector<int>(1, size < 2 ? 2 : size));
+}
+
+//Uses two fixed filters
+void CFilterBank::Build(const std::vector<float> &fir1, const std::vector<float> &fir2, float fs)
+{
+	int taps = (int)(fir1.size() > fir2.size() ? fir1.size() : fir2.size());
+	m_bank.Init(std::vector<int>(1, 2), taps);
+	memcpy(m_bank.getEntry(0), fir1.data(), fir1.size() * sizeof(float));
+	memcpy(m_bank.getEntry(1), fir2.data(), fir2.size() * sizeof(float));
+	m_sampleRate = fs;
+	FitSections(m_bank);
+}
+
+/*
+	Every entry starts from the fit of the one before it along the first control, or of the one below it along the
+	next control at the start of a row, so the sections of neighbouring entries correspond and blend smoothly
+*/
+void CFilterBank::FitSections(const CMorphBank &target)
+{
+	m_sections.Init(target, CIirFilter::SECTIONS * CIirFilter::PARAMETERS);
+	m_sectionError = 0.0f;
+	int row = target.getSize(0);
+	//Stops at the first entry the sections cannot follow, as the whole bank is rejected then
+	for (int k = 0; k < target.getCount() && m_sectionError <= CIirFilter::TOLERANCE_DB; k++)
+	{
+		const float *start = k == 0 ? NULL : m_sections.getEntry(k % row != 0 ? k - 1 : k - row);
+		float error = CIirFilter::Fit(target.getEntry(k), target.getLength(), m_sampleRate, start, m_sections.getEntry(k));
+		if (error > m_sectionError)
+			m_sectionError = error;
+	}
+
+	if (m_sectionError > CIirFilter::TOLERANCE_DB)
+		m_sections = CMorphBank();
+}
+
+void CFilterBank::SetBlend(bool blend) { m_blend = blend; }
+
+//Getters of the class attributes
+const CMorphBank &CFilterBank::getBank() const { return m_bank; }
+const CMorphBank &CFilterBank::getSections() const { return m_sections; }
+float CFilterBank::getSectionError() const { return m_sectionError; }
+float CFilterBank::getSampleRate() const { return m_sampleRate; }
+bool CFilterBank::getBlend() const { return m_blend; }
+int CFilterBank::getDimensions() const { return m_bank.getDimensions(); }
+int CFilterBank::getTaps() const { return m_bank.getLength(); }
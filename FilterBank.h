@@ -0,0 +1,52 @@
+#pragma once
+#include <vector>
+#include "FirDesign.h"
+#include "MorphBank.h"
+#include "IirFilter.h"
+
+// Table of precomputed filters spanning one or more controls from 0 to 1.
+// Built once at startup, so the DSP only has to look up (and optionally blend) the nearest entries.
+// Every entry is also fitted with the sections of the IIR engine, so switching engines costs nothing either. Filters
+// longer than CIirFilter::FIT_TAPS have sharper edges than the sections can follow, so the sections are fitted to the
+// same specifications designed at that length. When they still can't follow them within CIirFilter::TOLERANCE_DB, the
+// IIR mode falls back to the FIR filters.
+class CFilterBank
+{
+public:
+	CFilterBank(); //Constructor
+	~CFilterBank(); //Destructor
+
+	//Designs a grid of filters of the given length, sizes[d] entries along control d. corners holds the 2^dimensions
+	//specifications at the corners of the grid, corner c being at the end of control d when bit d of c is set. Each
+	//entry is designed from the corners interpolated to its position, so the band edges and gains move smoothly. If
+	//the corners have different numbers of bands, the coefficients of the corner designs are interpolated instead
+	bool Build(int taps, const std::vector<band_spec_t> &corners, float fs, const std::vector<int> &sizes);
+	//Designs size filters along a single control, from spec0 to spec1
+	bool Build(int taps, const band_spec_t &spec0, const band_spec_t &spec1, float fs, int size);
+	//Uses two fixed filters, the original two-filter interpolation
+	void Build(const std::vector<float> &fir1, const std::vector<float> &fir2, float fs);
+	//Blend between the nearest entries (true), or use the nearest one (false)
+	void SetBlend(bool blend);
+
+	//Getters of the class attributes
+	const CMorphBank &getBank() const;
+	const CMorphBank &getSections() const;
+	float getSectionError() const;
+	float getSampleRate() const;
+	bool getBlend() const;
+	int getDimensions() const;
+	int getTaps() const;
+
+private:
+	//Designs the entries of a grid of filters into bank
+	static bool Design(int taps, const std::vector<band_spec_t> &corners, float fs, const std::vector<int> &sizes, CMorphBank &bank);
+	//Fits the IIR sections of every entry to the matching entry of target, a bank with the same grid. The sections are
+	//left empty if they don't fit the filters closely enough
+	void FitSections(const CMorphBank &target);
+
+	CMorphBank m_bank; // The entries of the table, contiguous and aligned
+	CMorphBank m_sections; // The IIR section parameters of every entry, empty if the fit was rejected
+	float m_sectionError; // Largest RMS error in dB of the fits so far of the IIR sections to an entry
+	float m_sampleRate; // The sample rate the filters were designed for
+	bool m_blend; // Whether the DSP blends the nearest entries
+};
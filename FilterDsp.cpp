@@ -0,0 +1,184 @@
+#include "FilterDsp.h"
+#include <cstring>
+
+//Creates the filter with the bank the DSP starts with
+CFilterDsp::CFilterDsp(const CFilterBank &bank, FilterMode mode)
+	: m_pending(), m_bank(bank)
+{
+	m_filter = new CDynamicFilter(bank, mode);
+	engine_t engine = { 0, m_filter };
+	m_engines.push_back(engine);
+	m_pending.version = 0;
+	m_pending.filter = m_filter;
+	m_mode = mode;
+	m_prepareFrames = 0;
+	m_prepareChannels = 0;
+	m_version = 0;
+	m_active.store(0, std::memory_order_relaxed);
+	m_reset.store(false, std::memory_order_relaxed);
+	Publish();
+}
+
+//Deletes every engine. No block is being read any more
+CFilterDsp::~CFilterDsp()
+{
+	for (size_t i = 0; i < m_engines.size(); i++)
+		delete m_engines[i].filter;
+}
+
+/*
+	Takes the newest controls published by the game thread, once for the whole block, then looks up the bank entries
+	around them and applies the blended filter to the block. The filter keeps the history of each channel between blocks.
+	The block is de-interleaved first so the filter reads and writes every channel contiguously, and only the channels of
+	the smaller layout are filtered: a downmix happens before the filter and an upmix after it.
+	A new engine is only switched to; the old one is left for the game thread to delete
+*/
+void CFilterDsp::Read(const float *in, float *out, unsigned int length, int inChannels, int outChannels)
+{
+	if (m_params.Update())
+	{
+		const filter_params_t &params = m_params.Read();
+		if (params.version != m_version)
+		{
+			m_filter = params.filter;
+			m_version = params.version;
+			m_active.store(m_version, std::memory_order_release);
+		}
+	}
+	if (m_reset.load(std::memory_order_relaxed) && m_reset.exchange(false, std::memory_order_acquire))
+		m_filter->Reset();
+
+	m_mixer.SetLayout(inChannels, outChannels);
+	m_mixer.Deinterleave(in, length);
+	m_filter->Process(m_mixer.getPlanar(), m_mixer.getPlanar(), length, m_mixer.getChannels(), m_params.Read().controls);
+	m_mixer.Interleave(out, length);
+}
+
+//Clears the history of the filter before the next block
+void CFilterDsp::Reset()
+{
+	m_reset.store(true, std::memory_order_release);
+}
+
+/*
+	A block of silence of the largest size and layout makes every engine, delay line and planar channel grow to it.
+	Nothing shrinks afterwards, and the silence leaves no history behind
+*/
+void CFilterDsp::Prepare(unsigned int frames, int channels)
+{
+	m_prepareFrames = frames;
+	m_prepareChannels = channels;
+	std::vector<float> silence((size_t)frames * channels, 0.0f);
+	Read(silence.data(), silence.data(), frames, channels, channels);
+	m_filter->Reset();
+}
+
+/*
+	The engines built for a new bank or mode are deleted and the first one, already prepared, is handed back to the
+	mixer side directly as no block is being read. Copying the bank back reuses the storage of the one it replaces
+	whenever that is as large
+*/
+void CFilterDsp::Restart(const CFilterBank &bank, FilterMode mode)
+{
+	if (m_pending.version != 0)
+	{
+		for (size_t i = 1; i < m_engines.size(); i++)
+			delete m_engines[i].filter;
+		m_engines.resize(1);
+		m_filter = m_engines[0].filter;
+		m_version = 0;
+		m_active.store(0, std::memory_order_relaxed);
+		m_pending.version = 0;
+		m_pending.filter = m_filter;
+		m_bank = bank;
+		m_mode = mode;
+	}
+
+	memset(m_pending.controls, 0, sizeof(m_pending.controls));
+	Publish();
+	m_filter->Reset();
+	m_reset.store(false, std::memory_order_relaxed);
+}
+
+/*
+	The engine is built from the game thread copies of the bank and the mode, and prepared for the largest block before
+	the mixer thread can see it. An engine published but replaced before the mixer thread read it is never used, and is
+	deleted with the older ones
+*/
+void CFilterDsp::Build()
+{
+	CDynamicFilter *filter = new CDynamicFilter(m_bank, m_mode);
+	if (m_prepareFrames > 0)
+		filter->Prepare(m_prepareFrames, m_prepareChannels);
+	engine_t engine = { m_pending.version + 1, filter };
+	m_engines.push_back(engine);
+	m_pending.version = engine.version;
+	m_pending.filter = filter;
+	Publish();
+}
+
+//Copies the game thread controls into a free slot of the triple buffer and publishes it
+void CFilterDsp::Publish()
+{
+	Collect();
+	filter_params_t &slot = m_params.Write();
+	memcpy(slot.controls, m_pending.controls, sizeof(slot.controls));
+	slot.version = m_pending.version;
+	slot.filter = m_pending.filter;
+	m_params.Publish();
+}
+
+/*
+	The versions the mixer thread reads only grow until Restart, so once it uses an engine it never goes back to an
+	older one. Nothing is deleted until the mixer thread has switched to a newer engine, and the first engine stays
+*/
+void CFilterDsp::Collect()
+{
+	unsigned int active = m_active.load(std::memory_order_acquire);
+	size_t old = 1;
+	while (old < m_engines.size() && m_engines[old].version < active)
+		delete m_engines[old++].filter;
+	if (old > 1)
+		m_engines.erase(m_engines.begin() + 1, m_engines.begin() + old);
+}
+
+//Changes one of the controls
+bool CFilterDsp::SetControl(int index, float value)
+{
+	if (index < 0 || index >= CONTROLS)
+		return false;
+	m_pending.controls[index] = value;
+	Publish();
+	return true;
+}
+
+//Switches the engine of the filter
+bool CFilterDsp::SetMode(int mode)
+{
+	if (mode < FILTER_MODE_FIR || mode > FILTER_MODE_MULTIRATE)
+		return false;
+	if (mode != m_mode)
+	{
+		m_mode = (FilterMode)mode;
+		Build();
+	}
+	return true;
+}
+
+//Replaces the filter bank
+void CFilterDsp::SetBank(const CFilterBank &bank)
+{
+	m_bank = bank;
+	Build();
+}
+
+//The last value set
+float CFilterDsp::getControl(int index)
+{
+	return index >= 0 && index < CONTROLS ? m_pending.controls[index] : 0.0f;
+}
+
+//The engine and the length of the filter in use
+const char *CFilterDsp::getEngineName() { return m_filter->getEngineName(); }
+int CFilterDsp::getTaps() { return m_filter->getTaps(); }
+CDspProfiler &CFilterDsp::getProfiler() { return m_profiler; }
@@ -0,0 +1,78 @@
+#pragma once
+#include <atomic>
+#include <vector>
+#include "DynamicFilter.h"
+#include "TripleBuffer.h"
+#include "ChannelMixer.h"
+#include "DspProfiler.h"
+
+// The state of a dynamic filter DSP, attached to the plugindata of its FMOD_DSP_STATE.
+// It doesn't depend on FMOD: the DSP callbacks of CAudio forward to it, and the offline tools drive it the same way.
+// The setters run on the game thread and Read on the mixer thread; the controls travel between them through a triple
+// buffer, so neither thread ever waits for the other. A new bank or mode is built into a new engine by the game thread,
+// which hands it over through the triple buffer and deletes the old one once the mixer thread has moved on from it: the
+// mixer thread never designs, allocates or frees anything.
+class CFilterDsp
+{
+public:
+	static const int CONTROLS = 2; // The external control and the depth control
+
+	CFilterDsp(const CFilterBank &bank, FilterMode mode); //Creates the filter with the bank the DSP starts with
+	~CFilterDsp(); //Destructor
+
+	//Mixer thread: filters one block of interleaved samples with the newest controls. The output can have another
+	//speaker layout than the input, in which case the block is also downmixed or upmixed
+	void Read(const float *in, float *out, unsigned int length, int inChannels, int outChannels);
+	//Any thread: clears the history of the filter before the next block, e.g. when the channel of the DSP restarts
+	void Reset();
+	//Grows every buffer of the filter for blocks of up to frames frames of channels channels, so Read doesn't allocate
+	//later. The engines built for a new bank or mode are prepared the same way. Called before the DSP is used
+	void Prepare(unsigned int frames, int channels);
+	//Puts the state back as it was created, with the controls at 0 and no history, when no block is being read. The
+	//engine it was created with is kept for this, so a state whose bank or mode were replaced goes back to it without
+	//building anything. bank and mode are the ones the state was created with
+	void Restart(const CFilterBank &bank, FilterMode mode);
+
+	//Game thread: each setter hands the whole set of controls to the mixer thread. They return false for an invalid value.
+	//A new mode or bank builds a new engine, which starts without history
+	bool SetControl(int index, float value);
+	bool SetMode(int mode);
+	void SetBank(const CFilterBank &bank);
+	//Game thread: the last value set
+	float getControl(int index);
+	//Mixer thread: the engine and the length of the filter in use
+	const char *getEngineName();
+	int getTaps();
+	//The CPU time accounting of the read callback
+	CDspProfiler &getProfiler();
+
+private:
+	// An engine built by the game thread
+	typedef struct
+	{
+		unsigned int version;
+		CDynamicFilter *filter;
+	} engine_t;
+
+	//Builds and prepares the engine of the bank and the mode, and publishes it as the next version
+	void Build();
+	//Copies the game thread controls into a free slot of the triple buffer and publishes it
+	void Publish();
+	//Deletes the engines older than the one the mixer thread uses, except the one the state was created with
+	void Collect();
+
+	CDynamicFilter *m_filter; // Only touched by the mixer thread
+	CChannelMixer m_mixer; // Planar copy of the block the filter runs on, only touched by the mixer thread
+	CDspProfiler m_profiler; // Written by the mixer thread, read by the game thread
+	CTripleBuffer<filter_params_t> m_params; // Controls handed from the game thread to the mixer thread
+	filter_params_t m_pending; // Game thread copy of the controls, published on every change
+	CFilterBank m_bank; // Game thread copy of the bank the engines are built from
+	FilterMode m_mode; // Game thread copy of the mode the engines are built for
+	std::vector<engine_t> m_engines; // The first engine, then the ones built and not deleted yet, oldest first. Only
+	                                 // touched by the game thread
+	unsigned int m_prepareFrames; // Block the new engines are prepared for, 0 until Prepare is called
+	int m_prepareChannels;
+	unsigned int m_version; // Version of the engine the filter is, only touched by the mixer thread
+	std::atomic<unsigned int> m_active; // Version of the engine the mixer thread uses, the older ones can be deleted
+	std::atomic<bool> m_reset; // Set by Reset, cleared by the mixer thread when it clears the history
+};
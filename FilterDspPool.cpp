@@ -0,0 +1,96 @@
+#include "FilterDspPool.h"
+#include <cstddef>
+#include <new>
+
+//Creates an empty pool, filled by Init
+CFilterDspPool::CFilterDspPool()
+{
+	for (int i = 0; i < CAPACITY; i++)
+		m_next[i].store(-1, std::memory_order_relaxed);
+	m_head.store(0xFFFFFFFFull, std::memory_order_relaxed);
+	m_free.store(0, std::memory_order_relaxed);
+	m_count = 0;
+	m_bank = NULL;
+	m_mode = FILTER_MODE_FIR;
+}
+
+//Destroys the states. Their DSPs must have been released already
+CFilterDspPool::~CFilterDspPool()
+{
+	for (int i = 0; i < m_count; i++)
+		((CFilterDsp *)m_slots[i].storage)->~CFilterDsp();
+}
+
+//Creates every state with the bank and the engine the DSPs start with, and sizes their buffers
+bool CFilterDspPool::Init(const CFilterBank &bank, FilterMode mode, unsigned int maxFrames, int maxChannels)
+{
+	if (m_count > 0)
+		return false;
+
+	m_bank = &bank;
+	m_mode = mode;
+	for (int i = CAPACITY - 1; i >= 0; i--)
+	{
+		CFilterDsp *dsp = new (m_slots[i].storage) CFilterDsp(bank, mode);
+		dsp->Prepare(maxFrames, maxChannels);
+		m_count++;
+		Push(i);
+	}
+
+	return true;
+}
+
+//Pushes a slot on the free list
+void CFilterDspPool::Push(int index)
+{
+	unsigned long long head = m_head.load(std::memory_order_relaxed);
+	unsigned long long top;
+	do
+	{
+		m_next[index].store((int)(unsigned int)head, std::memory_order_relaxed);
+		top = (head & 0xFFFFFFFF00000000ull) + 0x100000000ull + (unsigned int)index;
+	} while (!m_head.compare_exchange_weak(head, top, std::memory_order_release, std::memory_order_relaxed));
+	m_free.fetch_add(1, std::memory_order_relaxed);
+}
+
+/*
+	Pops the top free slot. The version in the high bits of the head changes on every push and pop, so a slot popped
+	and pushed back by another thread between the load and the exchange makes the exchange fail instead of corrupting
+	the list
+*/
+CFilterDsp *CFilterDspPool::Acquire()
+{
+	unsigned long long head = m_head.load(std::memory_order_acquire);
+	unsigned long long top;
+	int index;
+	do
+	{
+		index = (int)(unsigned int)head;
+		if (index < 0)
+			return NULL;
+		int next = m_next[index].load(std::memory_order_relaxed);
+		top = (head & 0xFFFFFFFF00000000ull) + 0x100000000ull + (unsigned int)next;
+	} while (!m_head.compare_exchange_weak(head, top, std::memory_order_acquire, std::memory_order_acquire));
+	m_free.fetch_sub(1, std::memory_order_relaxed);
+
+	return (CFilterDsp *)m_slots[index].storage;
+}
+
+/*
+	Restarts the state and gives it back. A state whose bank or engine were changed goes back to the engine it was
+	created with, so the next DSP that takes it starts prepared for the mode the pool was filled for
+*/
+void CFilterDspPool::Release(CFilterDsp *dsp)
+{
+	if (dsp == NULL)
+		return;
+	int index = (int)(((slot_t *)dsp) - m_slots);
+	if (index < 0 || index >= m_count)
+		return;
+
+	dsp->Restart(*m_bank, m_mode);
+	Push(index);
+}
+
+//Getters of the class attributes
+int CFilterDspPool::getFree() { return m_free.load(std::memory_order_relaxed); }
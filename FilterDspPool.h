@@ -0,0 +1,47 @@
+#pragma once
+#include <atomic>
+#include "FilterDsp.h"
+
+// A fixed number of dynamic filter DSP states, created once before any DSP is, so the create and release callbacks of
+// the DSPs only take a state from the pool and give it back. Every state has already filtered a block of the largest
+// size the mixer uses, so its history, planar and coefficient buffers are allocated up front and the mixer thread
+// doesn't allocate on the first block either.
+// The states are cache line aligned, so two DSPs filtered on different threads never share a line. The free list is a
+// lock-free stack, as FMOD may create and release DSPs from another thread than the game thread.
+class CFilterDspPool
+{
+public:
+	static const int CAPACITY = 32; // One per FMOD channel the system is initialised with
+	static const int CACHE_LINE = 64;
+
+	CFilterDspPool(); //Creates an empty pool, filled by Init
+	~CFilterDspPool(); //Destroys the states
+
+	//Creates every state with the bank and the engine the DSPs start with, and sizes their buffers for blocks of up
+	//to maxFrames frames of maxChannels channels. Returns false if the pool had already been filled
+	bool Init(const CFilterBank &bank, FilterMode mode, unsigned int maxFrames, int maxChannels);
+	//Takes a free state, NULL when they are all in use
+	CFilterDsp *Acquire();
+	//Gives a state back once its DSP is released. The state is restarted for the next DSP that takes it
+	void Release(CFilterDsp *dsp);
+	//Getters of the class attributes
+	int getFree(); //The number of states not in use
+
+private:
+	//Storage of a state, aligned to a cache line
+	typedef struct alignas(CACHE_LINE)
+	{
+		unsigned char storage[sizeof(CFilterDsp)];
+	} slot_t;
+
+	//Pushes a slot on the free list
+	void Push(int index);
+
+	slot_t m_slots[CAPACITY];
+	std::atomic<int> m_next[CAPACITY]; // Next free slot after each free slot, -1 for the last one
+	std::atomic<unsigned long long> m_head; // Top free slot in the low 32 bits (-1 when empty), and a version against ABA
+	std::atomic<int> m_free; // Number of free slots
+	int m_count; // Number of states created by Init
+	const CFilterBank *m_bank; // Bank and engine the states are restarted with
+	FilterMode m_mode;
+};
@@ -0,0 +1,159 @@
+#include "FirDesign.h"
+#define _USE_MATH_DEFINES
+#include <math.h>
+
+std::map< std::vector<float>, std::vector<float> > CFirDesign::m_cache;
+std::mutex CFirDesign::m_cacheMutex;
+
+//sin(pi x) / (pi x), as numpy.sinc
+static double Sinc(double x)
+{
+	if (x == 0.0)
+		return 1.0;
+	return sin(M_PI * x) / (M_PI * x);
+}
+
+/*
+	Same derivation as SciPy's firls. With M = (taps - 1) / 2 the filter is h = [a_M .. a_1, 2 a_0, a_1 .. a_M]
+	and a solves Q a = b, where Q(k, n) = q(k - n) + q(k + n) and, with f normalised so 1 is the Nyquist frequency
+	and a weight W and linear desired response D(f) = m f + c over each band:
+		q(n) = sum over bands of W [f sinc(n f)] from f1 to f2
+		b(n) = sum over bands of W [f D(f) sinc(n f) + m cos(pi n f) / (pi n)^2] from f1 to f2 (b(0) = W [m f^2 / 2 + c f])
+*/
+std::vector<float> CFirDesign::Firls(int taps, const band_spec_t &spec, float fs)
+{
+	if (taps % 2 == 0)
+		taps++;
+
+	int edges = (int)spec.bands.size();
+	if (edges < 2 || edges % 2 != 0 || (int)spec.desired.size() != edges || fs <= 0.0f)
+		return std::vector<float>();
+	int numBands = edges / 2;
+	if (!spec.weights.empty() && (int)spec.weights.size() != numBands)
+		return std::vector<float>();
+
+	//Looks the design up in the cache
+	std::vector<float> key;
+	key.push_back((float)taps);
+	key.push_back(fs);
+	key.insert(key.end(), spec.bands.begin(), spec.bands.end());
+	key.insert(key.end(), spec.desired.begin(), spec.desired.end());
+	key.insert(key.end(), spec.weights.begin(), spec.weights.end());
+	{
+		std::lock_guard<std::mutex> lock(m_cacheMutex);
+		std::map< std::vector<float>, std::vector<float> >::iterator cached = m_cache.find(key);
+		if (cached != m_cache.end())
+			return cached->second;
+	}
+
+	//The design runs unlocked. Two threads asking for the same filter both design it and store the same result
+	int M = (taps - 1) / 2;
+	double nyq = 0.5 * fs;
+
+	std::vector<double> q(2 * M + 1, 0.0);
+	std::vector<double> b(M + 1, 0.0);
+	for (int band = 0; band < numBands; band++)
+	{
+		double f1 = spec.bands[2 * band] / nyq;
+		double f2 = spec.bands[2 * band + 1] / nyq;
+		if (f1 < 0.0 || f2 > 1.0 + 1e-6 || f2 < f1)
+			return std::vector<float>();
+		if (f2 > 1.0)
+			f2 = 1.0; //Interpolated specifications can land a rounding error past Nyquist
+		double w = spec.weights.empty() ? 1.0 : spec.weights[band];
+		double d1 = spec.desired[2 * band];
+		double d2 = spec.desired[2 * band + 1];
+		double m = f2 > f1 ? (d2 - d1) / (f2 - f1) : 0.0;
+		double c = d1 - f1 * m;
+
+		for (int n = 0; n <= 2 * M; n++)
+			q[n] += w * (f2 * Sinc(f2 * n) - f1 * Sinc(f1 * n));
+
+		for (int n = 0; n <= M; n++)
+		{
+			double v2 = f2 * (m * f2 + c) * Sinc(f2 * n);
+			double v1 = f1 * (m * f1 + c) * Sinc(f1 * n);
+			if (n == 0)
+			{
+				v2 -= m * f2 * f2 / 2.0;
+				v1 -= m * f1 * f1 / 2.0;
+			}
+			else
+			{
+				v2 += m * cos(n * M_PI * f2) / ((M_PI * n) * (M_PI * n));
+				v1 += m * cos(n * M_PI * f1) / ((M_PI * n) * (M_PI * n));
+			}
+			b[n] += w * (v2 - v1);
+		}
+	}
+
+	//Toeplitz plus Hankel matrix
+	std::vector<double> Q((M + 1) * (M + 1));
+	for (int k = 0; k <= M; k++)
+		for (int n = 0; n <= M; n++)
+			Q[k * (M + 1) + n] = q[k > n ? k - n : n - k] + q[k + n];
+
+	if (!Solve(Q, b, M + 1))
+		return std::vector<float>();
+
+	std::vector<float> h(taps);
+	h[M] = (float)(2.0 * b[0]);
+	for (int n = 1; n <= M; n++)
+	{
+		h[M - n] = (float)b[n];
+		h[M + n] = (float)b[n];
+	}
+
+	std::lock_guard<std::mutex> lock(m_cacheMutex);
+	m_cache[key] = h;
+	return h;
+}
+
+//Empties the cache of designs
+void CFirDesign::ClearCache()
+{
+	std::lock_guard<std::mutex> lock(m_cacheMutex);
+	m_cache.clear();
+}
+
+//Solves Q a = b by Gaussian elimination with partial pivoting. The solution is left in b
+bool CFirDesign::Solve(std::vector<double> &Q, std::vector<double> &b, int n)
+{
+	for (int col = 0; col < n; col++)
+	{
+		int pivot = col;
+		for (int row = col + 1; row < n; row++)
+			if (fabs(Q[row * n + col]) > fabs(Q[pivot * n + col]))
+				pivot = row;
+		if (fabs(Q[pivot * n + col]) < 1e-300)
+			return false;
+
+		if (pivot != col)
+		{
+			for (int k = 0; k < n; k++)
+			{
+				double t = Q[col * n + k]; Q[col * n + k] = Q[pivot * n + k]; Q[pivot * n + k] = t;
+			}
+			double t = b[col]; b[col] = b[pivot]; b[pivot] = t;
+		}
+
+		for (int row = col + 1; row < n; row++)
+		{
+			double factor = Q[row * n + col] / Q[col * n + col];
+			if (factor == 0.0)
+				continue;
+			for (int k = col; k < n; k++)
+				Q[row * n + k] -= factor * Q[col * n + k];
+			b[row] -= factor * b[col];
+		}
+	}
+
+	for (int row = n - 1; row >= 0; row--)
+	{
+		double sum = b[row];
+		for (int k = row + 1; k < n; k++)
+			sum -= Q[row * n + k] * b[k];
+		b[row] = sum / Q[row * n + row];
+	}
+	return true;
+}
@@ -0,0 +1,33 @@
+#pragma once
+#include <vector>
+#include <map>
+#include <mutex>
+
+// Band specification of a least squares FIR design, as passed to SciPy's signal.firls:
+// pairs of band edges in Hz and the desired gain at each edge, optionally one weight per band
+typedef struct
+{
+	std::vector<float> bands;
+	std::vector<float> desired;
+	std::vector<float> weights;
+} band_spec_t;
+
+// In-process equivalent of signal.firls, so the filters no longer have to be designed offline.
+// Designs are cached, so asking for the same filter again costs a lookup. The cache is locked, so banks can be designed
+// from any thread.
+class CFirDesign
+{
+public:
+	//Designs a linear phase FIR filter minimising the weighted squared error to the desired response.
+	//taps must be odd (even lengths are rounded up). Returns an empty vector if the specification is invalid
+	static std::vector<float> Firls(int taps, const band_spec_t &spec, float fs);
+	//Empties the cache of designs
+	static void ClearCache();
+	//Solves Q a = b by Gaussian elimination with partial pivoting, leaving a in b. Returns false if Q is singular
+	static bool Solve(std::vector<double> &Q, std::vector<double> &b, int n);
+
+private:
+
+	static std::map< std::vector<float>, std::vector<float> > m_cache; // Designs, keyed by their parameters
+	static std::mutex m_cacheMutex; // Guards m_cache
+};
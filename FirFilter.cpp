@@ -0,0 +1,82 @@
+﻿#include "FirFilter.h"
+#include "FirKernels.h"
+#include <cstring>
+
+//Initialises the filter with the number of taps of the static filters
+CFirFilter::CFirFilter(int taps)
+{
+	m_taps = taps;
+	m_coefficients.assign(taps, 0.0f);
+	m_mixFir1 = NULL;
+	m_mixFir2 = NULL;
+	m_mix = -1.0f; //Forces the coefficients to be calculated on the first block
+}
+
+CFirFilter::~CFirFilter()
+{}
+
+/*
+	Interpolates the two static filters.
+	Definition taken from lab 7: b_filt_mix = (1-mix_ratio) * b_filt1 + mix_ratio * b_filt2
+*/
+void CFirFilter::Mix(const std::vector<float> &fir1, const std::vector<float> &fir2, float mix)
+{
+	if (mix == m_mix && fir1.data() == m_mixFir1 && fir2.data() == m_mixFir2)
+		return;
+
+	//Saved in reverse order so the kernels read the delay line forwards
+	for (int i = 0; i < m_taps; i++)
+		m_coefficients[m_taps - 1 - i] = (1 - mix) * fir1[i] + mix * fir2[i];
+	m_mixFir1 = fir1.data();
+	m_mixFir2 = fir2.data();
+	m_mix = mix;
+}
+
+//Uses a single filter as the active coefficients
+void CFirFilter::SetCoefficients(const std::vector<float> &fir)
+{
+	for (int i = 0; i < m_taps; i++)
+		m_coefficients[m_taps - 1 - i] = i < (int)fir.size() ? fir[i] : 0.0f;
+	m_mix = -1.0f;
+}
+
+/*
+	Filters a block of planar samples by convolution.
+	Definition taken from the lecture 4 slides: f(x[n]) = ∑i=0 x[n−i]b[i]
+	Each channel is copied to its mirrored delay line, whose newest taps - 1 + frames samples are one contiguous window
+	the kernel reads x[n-i] from, so neither the copy nor the history wraps around. The kernel writes the channel's output directly
+*/
+void CFirFilter::Process(const float *const *in, float *const *out, unsigned int frames, int channels)
+{
+	int history = m_taps - 1;
+	Prepare(frames, channels);
+	FirKernelFunc kernel = CFirKernels::Get();
+
+	for (int chan = 0; chan < channels; chan++)
+	{
+		CRingBuffer<float> &line = m_delayLines[chan];
+		line.Write(in[chan], frames);
+
+		kernel(line.Window(history + frames), m_coefficients.data(), m_taps, out[chan], frames);
+	}
+}
+
+//Creates the delay lines of the channels that haven't been seen yet and grows the others for longer blocks
+void CFirFilter::Prepare(unsigned int frames, int channels)
+{
+	int history = m_taps - 1;
+	while ((int)m_delayLines.size() < channels)
+		m_delayLines.push_back(CRingBuffer<float>(history + frames));
+	for (int chan = 0; chan < channels; chan++)
+		m_delayLines[chan].Reserve(history + frames);
+}
+
+//Clears the history of every channel
+void CFirFilter::Reset()
+{
+	for (unsigned int i = 0; i < m_delayLines.size(); i++)
+		m_delayLines[i].Clear();
+}
+
+//Getters of the class attributes
+int CFirFilter::getTaps() { return m_taps; }
@@ -0,0 +1,32 @@
+#pragma once
+#include <vector>
+#include "CircBuffer.h"
+
+// A streaming FIR filter. Each channel keeps its own delay line, so the convolution
+// carries on from one block to the next instead of restarting at zero.
+class CFirFilter
+{
+public:
+	CFirFilter(int taps); //Initialises the filter with the number of taps of the static filters
+	~CFirFilter(); //Destructor
+
+	//Interpolates two static filters into the active coefficients. They are only recalculated when the mix changes
+	void Mix(const std::vector<float> &fir1, const std::vector<float> &fir2, float mix);
+	//Uses a single filter as the active coefficients
+	void SetCoefficients(const std::vector<float> &fir);
+	//Creates the delay lines of up to channels channels, long enough for blocks of up to frames frames
+	void Prepare(unsigned int frames, int channels);
+	//Filters a block of planar samples: in[c] and out[c] hold the frames of channel c. They can be the same buffers
+	void Process(const float *const *in, float *const *out, unsigned int frames, int channels);
+	//Clears the history of every channel
+	void Reset();
+	//Getters of the class attributes
+	int getTaps();
+
+private:
+	std::vector<float> m_coefficients; // The active coefficients, in reverse order as the kernels expect them
+	std::vector< CRingBuffer<float> > m_delayLines; // Per channel, mirrored so the last taps - 1 inputs and the block are contiguous
+	const float *m_mixFir1, *m_mixFir2; // The filters the active coefficients were calculated from
+	float m_mix; // The mix the active coefficients were calculated with
+	int m_taps; // The length of the filter
+};
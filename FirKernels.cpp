@@ -0,0 +1,239 @@
+#include "FirKernels.h"
+
+#if defined(_M_X64) || defined(_M_IX86) || defined(__x86_64__) || defined(__i386__)
+#define FIR_X86
+#include <immintrin.h>
+#ifdef _MSC_VER
+#include <intrin.h>
+#else
+#include <cpuid.h>
+#endif
+#endif
+
+//The scalar kernel is used until Select is called
+FirKernelFunc CFirKernels::m_kernel = CFirKernels::Scalar;
+FirIsa CFirKernels::m_isa = FIR_ISA_SCALAR;
+
+#ifdef FIR_X86
+//Reads the cpuid registers of a leaf
+static void CpuId(int regs[4], int leaf, int subleaf)
+{
+#ifdef _MSC_VER
+	__cpuidex(regs, leaf, subleaf);
+#else
+	unsigned int a, b, c, d;
+	__cpuid_count(leaf, subleaf, a, b, c, d);
+	regs[0] = (int)a; regs[1] = (int)b; regs[2] = (int)c; regs[3] = (int)d;
+#endif
+}
+
+//Reads the register state the OS saves on a context switch
+static unsigned long long XGetBv()
+{
+#ifdef _MSC_VER
+	return _xgetbv(0);
+#else
+	unsigned int a, d;
+	__asm__ volatile("xgetbv" : "=a"(a), "=d"(d) : "c"(0));
+	return ((unsigned long long)d << 32) | a;
+#endif
+}
+#endif
+
+//Returns the best instruction set supported by the CPU and the OS
+FirIsa CFirKernels::DetectIsa()
+{
+#ifdef FIR_X86
+	int regs[4];
+	CpuId(regs, 0, 0);
+	int maxLeaf = regs[0];
+
+	CpuId(regs, 1, 0);
+	bool sse2 = (regs[3] & (1 << 26)) != 0;
+	bool osxsave = (regs[2] & (1 << 27)) != 0;
+	bool avx = (regs[2] & (1 << 28)) != 0;
+	bool fma = (regs[2] & (1 << 12)) != 0;
+	if (!sse2)
+		return FIR_ISA_SCALAR;
+	if (!osxsave || !avx || !fma || maxLeaf < 7)
+		return FIR_ISA_SSE2;
+
+	//The OS has to save the AVX registers (and the AVX-512 ones) for the kernels to be usable
+	unsigned long long xcr0 = XGetBv();
+	if ((xcr0 & 0x6) != 0x6)
+		return FIR_ISA_SSE2;
+
+	CpuId(regs, 7, 0);
+	bool avx2 = (regs[1] & (1 << 5)) != 0;
+	bool avx512f = (regs[1] & (1 << 16)) != 0;
+	if (!avx2)
+		return FIR_ISA_SSE2;
+	if (avx512f && (xcr0 & 0xE6) == 0xE6)
+		return FIR_ISA_AVX512;
+	return FIR_ISA_AVX2;
+#else
+	return FIR_ISA_SCALAR;
+#endif
+}
+
+//Picks the kernel for the host CPU
+void CFirKernels::Select()
+{
+	Select(DetectIsa());
+}
+
+//Forces a kernel
+void CFirKernels::Select(FirIsa isa)
+{
+	m_isa = isa;
+	switch (isa)
+	{
+	case FIR_ISA_SSE2: m_kernel = SSE2; break;
+	case FIR_ISA_AVX2: m_kernel = AVX2; break;
+	case FIR_ISA_AVX512: m_kernel = AVX512; break;
+	default: m_kernel = Scalar; m_isa = FIR_ISA_SCALAR; break;
+	}
+}
+
+//Getters of the class attributes
+FirKernelFunc CFirKernels::Get() { return m_kernel; }
+FirIsa CFirKernels::getIsa() { return m_isa; }
+
+const char *CFirKernels::getName()
+{
+	switch (m_isa)
+	{
+	case FIR_ISA_SSE2: return "SSE2";
+	case FIR_ISA_AVX2: return "AVX2";
+	case FIR_ISA_AVX512: return "AVX-512";
+	default: return "Scalar";
+	}
+}
+
+/*
+	Reference kernel.
+	Definition taken from the lecture 4 slides: f(x[n]) = sum(i) x[n-i]b[i], with the coefficients reversed so x is read forwards
+*/
+void CFirKernels::Scalar(const float *x, const float *h, int taps, float *y, unsigned int frames)
+{
+	for (unsigned int n = 0; n < frames; n++)
+	{
+		float acc = 0.0f;
+		for (int j = 0; j < taps; j++)
+			acc += x[n + j] * h[j];
+		y[n] = acc;
+	}
+}
+
+/*
+	The vector kernels calculate several consecutive outputs at once: each coefficient is broadcast and multiplied
+	by the input starting at its offset. Four accumulators are used so the additions don't wait on each other.
+	Whatever is left at the end of the block goes through the scalar kernel.
+*/
+FIR_TARGET("sse2")
+void CFirKernels::SSE2(const float *x, const float *h, int taps, float *y, unsigned int frames)
+{
+#ifdef FIR_X86
+	unsigned int n = 0;
+	for (; n + 16 <= frames; n += 16)
+	{
+		__m128 acc0 = _mm_setzero_ps(), acc1 = _mm_setzero_ps(), acc2 = _mm_setzero_ps(), acc3 = _mm_setzero_ps();
+		for (int j = 0; j < taps; j++)
+		{
+			__m128 c = _mm_set1_ps(h[j]);
+			const float *p = x + n + j;
+			acc0 = _mm_add_ps(acc0, _mm_mul_ps(c, _mm_loadu_ps(p)));
+			acc1 = _mm_add_ps(acc1, _mm_mul_ps(c, _mm_loadu_ps(p + 4)));
+			acc2 = _mm_add_ps(acc2, _mm_mul_ps(c, _mm_loadu_ps(p + 8)));
+			acc3 = _mm_add_ps(acc3, _mm_mul_ps(c, _mm_loadu_ps(p + 12)));
+		}
+		_mm_storeu_ps(y + n, acc0);
+		_mm_storeu_ps(y + n + 4, acc1);
+		_mm_storeu_ps(y + n + 8, acc2);
+		_mm_storeu_ps(y + n + 12, acc3);
+	}
+	for (; n + 4 <= frames; n += 4)
+	{
+		__m128 acc = _mm_setzero_ps();
+		for (int j = 0; j < taps; j++)
+			acc = _mm_add_ps(acc, _mm_mul_ps(_mm_set1_ps(h[j]), _mm_loadu_ps(x + n + j)));
+		_mm_storeu_ps(y + n, acc);
+	}
+	Scalar(x + n, h, taps, y + n, frames - n);
+#else
+	Scalar(x, h, taps, y, frames);
+#endif
+}
+
+FIR_TARGET("avx2,fma")
+void CFirKernels::AVX2(const float *x, const float *h, int taps, float *y, unsigned int frames)
+{
+#ifdef FIR_X86
+	unsigned int n = 0;
+	for (; n + 32 <= frames; n += 32)
+	{
+		__m256 acc0 = _mm256_setzero_ps(), acc1 = _mm256_setzero_ps(), acc2 = _mm256_setzero_ps(), acc3 = _mm256_setzero_ps();
+		for (int j = 0; j < taps; j++)
+		{
+			__m256 c = _mm256_set1_ps(h[j]);
+			const float *p = x + n + j;
+			acc0 = _mm256_fmadd_ps(c, _mm256_loadu_ps(p), acc0);
+			acc1 = _mm256_fmadd_ps(c, _mm256_loadu_ps(p + 8), acc1);
+			acc2 = _mm256_fmadd_ps(c, _mm256_loadu_ps(p + 16), acc2);
+			acc3 = _mm256_fmadd_ps(c, _mm256_loadu_ps(p + 24), acc3);
+		}
+		_mm256_storeu_ps(y + n, acc0);
+		_mm256_storeu_ps(y + n + 8, acc1);
+		_mm256_storeu_ps(y + n + 16, acc2);
+		_mm256_storeu_ps(y + n + 24, acc3);
+	}
+	for (; n + 8 <= frames; n += 8)
+	{
+		__m256 acc = _mm256_setzero_ps();
+		for (int j = 0; j < taps; j++)
+			acc = _mm256_fmadd_ps(_mm256_set1_ps(h[j]), _mm256_loadu_ps(x + n + j), acc);
+		_mm256_storeu_ps(y + n, acc);
+	}
+	//Avoids the AVX to SSE transition penalty in the code that runs after the kernel
+	_mm256_zeroupper();
+	Scalar(x + n, h, taps, y + n, frames - n);
+#else
+	Scalar(x, h, taps, y, frames);
+#endif
+}
+
+FIR_TARGET("avx512f")
+void CFirKernels::AVX512(const float *x, const float *h, int taps, float *y, unsigned int frames)
+{
+#ifdef FIR_X86
+	unsigned int n = 0;
+	for (; n + 64 <= frames; n += 64)
+	{
+		__m512 acc0 = _mm512_setzero_ps(), acc1 = _mm512_setzero_ps(), acc2 = _mm512_setzero_ps(), acc3 = _mm512_setzero_ps();
+		for (int j = 0; j < taps; j++)
+		{
+			__m512 c = _mm512_set1_ps(h[j]);
+			const float *p = x + n + j;
+			acc0 = _mm512_fmadd_ps(c, _mm512_loadu_ps(p), acc0);
+			acc1 = _mm512_fmadd_ps(c, _mm512_loadu_ps(p + 16), acc1);
+			acc2 = _mm512_fmadd_ps(c, _mm512_loadu_ps(p + 32), acc2);
+			acc3 = _mm512_fmadd_ps(c, _mm512_loadu_ps(p + 48), acc3);
+		}
+		_mm512_storeu_ps(y + n, acc0);
+		_mm512_storeu_ps(y + n + 16, acc1);
+		_mm512_storeu_ps(y + n + 32, acc2);
+		_mm512_storeu_ps(y + n + 48, acc3);
+	}
+	for (; n + 16 <= frames; n += 16)
+	{
+		__m512 acc = _mm512_setzero_ps();
+		for (int j = 0; j < taps; j++)
+			acc = _mm512_fmadd_ps(_mm512_set1_ps(h[j]), _mm512_loadu_ps(x + n + j), acc);
+		_mm512_storeu_ps(y + n, acc);
+	}
+	_mm256_zeroupper();
+	Scalar(x + n, h, taps, y + n, frames - n);
+#else
+	Scalar(x, h, taps, y, frames);
+#endif
+}
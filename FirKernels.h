@@ -0,0 +1,44 @@
+#pragma once
+
+// Multiply-accumulate kernel used by the FIR filters.
+// Calculates frames outputs: y[n] = sum(j = 0..taps-1) x[n+j] * h[j]
+// x holds taps - 1 history samples followed by the frames new samples, and h holds the coefficients in reverse order
+typedef void (*FirKernelFunc)(const float *x, const float *h, int taps, float *y, unsigned int frames);
+
+// MSVC lets any function use the intrinsics, GCC and Clang need to be told which functions use them
+#if !defined(_MSC_VER) && (defined(__x86_64__) || defined(__i386__))
+#define FIR_TARGET(isa) __attribute__((target(isa)))
+#else
+#define FIR_TARGET(isa)
+#endif
+
+// The instruction sets the FIR kernels have been written for
+enum FirIsa
+{
+	FIR_ISA_SCALAR,
+	FIR_ISA_SSE2,
+	FIR_ISA_AVX2,
+	FIR_ISA_AVX512
+};
+
+// Runtime dispatch of the FIR kernels: the fastest kernel the host CPU supports is picked once
+class CFirKernels
+{
+public:
+	static FirIsa DetectIsa(); //Returns the best instruction set supported by the CPU and the OS
+	static void Select(); //Picks the kernel for the host CPU. Called once from CAudio::Initialise
+	static void Select(FirIsa isa); //Forces a kernel, e.g. the scalar one when checking the others against it
+	static FirKernelFunc Get(); //Returns the selected kernel
+	static FirIsa getIsa();
+	static const char *getName();
+
+	//Kernels. The scalar one is the reference the others are checked against
+	static void Scalar(const float *x, const float *h, int taps, float *y, unsigned int frames);
+	static void SSE2(const float *x, const float *h, int taps, float *y, unsigned int frames);
+	static void AVX2(const float *x, const float *h, int taps, float *y, unsigned int frames);
+	static void AVX512(const float *x, const float *h, int taps, float *y, unsigned int frames);
+
+private:
+	static FirKernelFunc m_kernel; // The selected kernel
+	static FirIsa m_isa; // The instruction set of the selected kernel
+};
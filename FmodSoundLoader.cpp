@@ -0,0 +1,73 @@
+#include "FmodSoundLoader.h"
+#include "FmodStreamSource.h"
+#include "WavFile.h"
+
+CFmodSoundLoader::CFmodSoundLoader()
+{
+	m_system = NULL;
+}
+
+CFmodSoundLoader::~CFmodSoundLoader()
+{}
+
+void CFmodSoundLoader::SetSystem(FMOD::System *system)
+{
+	m_system = system;
+}
+
+/*
+	Decodes the whole file to floats and encodes it. The floats are freed once the sample is encoded, as they are about
+	four times its size and outside the budget of the bank. Samples of more channels than a voice plays are rejected
+*/
+void *CFmodSoundLoader::CreateSound(const CMappedFile &file, size_t &bytes)
+{
+	int channels, sampleRate;
+	unsigned int frames;
+	std::vector<float> pcm; // The decoded file
+	wav_format_t format;
+	if (CWavFile::Parse(file.getData(), file.getSize(), format))
+	{
+		channels = format.channels;
+		sampleRate = format.sampleRate;
+		if (channels > CAdpcmSample::MAX_CHANNELS)
+			return NULL;
+		frames = (unsigned int)(format.bytes / format.channels / (format.bits / 8));
+		pcm.resize((size_t)frames * channels);
+		CWavFile::Convert(format, format.data, pcm.data(), pcm.size());
+	}
+	else
+	{
+		CFmodStreamSource source;
+		if (!m_system || !source.OpenMemory(m_system, file.getData(), file.getSize()))
+			return NULL;
+		channels = source.getChannels();
+		sampleRate = source.getSampleRate();
+		if (channels < 1 || channels > CAdpcmSample::MAX_CHANNELS)
+			return NULL;
+		frames = 0;
+		const unsigned int chunk = 4096;
+		unsigned int decoded;
+		do
+		{
+			pcm.resize((size_t)(frames + chunk) * channels);
+			decoded = source.Decode(&pcm[(size_t)frames * channels], chunk);
+			frames += decoded;
+		} while (decoded == chunk);
+	}
+
+	CAdpcmSample *sample = new CAdpcmSample();
+	sample->Encode(pcm.data(), channels, sampleRate, frames);
+	bytes = sample->getBytes();
+	return sample;
+}
+
+void CFmodSoundLoader::ReleaseSound(void *sound)
+{
+	delete (CAdpcmSample *)sound;
+}
+
+//The samples are encoded copies
+bool CFmodSoundLoader::PlaysFromFile()
+{
+	return false;
+}
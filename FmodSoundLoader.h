@@ -0,0 +1,24 @@
+#pragma once
+#include "./include/fmod_studio/fmod.hpp"
+#include "SoundBank.h"
+#include "AdpcmSample.h"
+
+// Creates the looping samples of the sound bank as CAdpcmSample, about a quarter of the size of their PCM. A WAVE file
+// is converted straight out of its mapping; anything else is decoded by FMOD's codecs first. The file isn't needed once
+// the sample has been encoded.
+class CFmodSoundLoader : public CSoundLoader
+{
+public:
+	CFmodSoundLoader(); //Constructor
+	~CFmodSoundLoader(); //Destructor
+
+	//Sets the system that decodes the files that aren't WAVE, before the first one is loaded
+	void SetSystem(FMOD::System *system);
+
+	void *CreateSound(const CMappedFile &file, size_t &bytes);
+	void ReleaseSound(void *sound);
+	bool PlaysFromFile();
+
+private:
+	FMOD::System *m_system;
+};
@@ -0,0 +1,90 @@
+#include "FmodStreamSource.h"
+#include <cstring>
+
+CFmodStreamSource::CFmodStreamSource()
+{
+	m_sound = NULL;
+	m_format.channels = 0;
+	m_format.sampleRate = 0;
+	m_format.bits = 0;
+	m_format.ieee = false;
+	m_format.data = NULL;
+	m_format.bytes = 0;
+	m_frames = 0;
+}
+
+CFmodStreamSource::~CFmodStreamSource()
+{
+	if (m_sound)
+		m_sound->release();
+}
+
+/*
+	Opens the file for readData. FMOD's 8 bit samples are signed, unlike the ones of a WAVE file, so they aren't taken;
+	its codecs decode to 16 bit or float anyway
+*/
+bool CFmodStreamSource::Open(FMOD::System *system, const char *nameOrData, FMOD_MODE mode, FMOD_CREATESOUNDEXINFO *exinfo)
+{
+	if (system->createSound(nameOrData, mode | FMOD_OPENONLY | FMOD_ACCURATETIME, exinfo, &m_sound) != FMOD_OK)
+		return false;
+
+	FMOD_SOUND_FORMAT format;
+	float frequency;
+	if (m_sound->getFormat(NULL, &format, &m_format.channels, &m_format.bits) != FMOD_OK ||
+		m_sound->getDefaults(&frequency, NULL) != FMOD_OK ||
+		m_sound->getLength(&m_frames, FMOD_TIMEUNIT_PCM) != FMOD_OK ||
+		(format != FMOD_SOUND_FORMAT_PCM16 && format != FMOD_SOUND_FORMAT_PCM24 && format != FMOD_SOUND_FORMAT_PCM32 && format != FMOD_SOUND_FORMAT_PCMFLOAT) ||
+		m_format.channels < 1)
+	{
+		m_sound->release();
+		m_sound = NULL;
+		return false;
+	}
+	m_format.sampleRate = (int)frequency;
+	m_format.ieee = format == FMOD_SOUND_FORMAT_PCMFLOAT;
+	return true;
+}
+
+//Opens a file by name
+bool CFmodStreamSource::Open(FMOD::System *system, const char *filename)
+{
+	return Open(system, filename, FMOD_DEFAULT, 0);
+}
+
+//Opens the bytes of a file, whose length FMOD is given
+bool CFmodStreamSource::OpenMemory(FMOD::System *system, const unsigned char *data, size_t size)
+{
+	FMOD_CREATESOUNDEXINFO exinfo;
+	memset(&exinfo, 0, sizeof(exinfo));
+	exinfo.cbsize = sizeof(exinfo);
+	exinfo.length = (unsigned int)size;
+	return Open(system, (const char *)data, FMOD_OPENMEMORY, &exinfo);
+}
+
+//Reads the next frames from the codec and converts them. The buffer only grows on the prefetch thread
+unsigned int CFmodStreamSource::Decode(float *out, unsigned int frames)
+{
+	unsigned int frameBytes = m_format.channels * (m_format.bits / 8);
+	if (m_bytes.size() < (size_t)frames * frameBytes)
+		m_bytes.resize((size_t)frames * frameBytes);
+
+	unsigned int read = 0;
+	FMOD_RESULT result = m_sound->readData(m_bytes.data(), frames * frameBytes, &read);
+	if (result != FMOD_OK && result != FMOD_ERR_FILE_EOF)
+		return 0;
+
+	frames = read / frameBytes;
+	CWavFile::Convert(m_format, m_bytes.data(), out, (size_t)frames * m_format.channels);
+	return frames;
+}
+
+//Seeks the codec back to the first frame
+bool CFmodStreamSource::Rewind()
+{
+	return m_sound && m_sound->seekData(0) == FMOD_OK;
+}
+
+//Getters of the source format
+int CFmodStreamSource::getChannels() { return m_format.channels; }
+int CFmodStreamSource::getSampleRate() { return m_format.sampleRate; }
+unsigned int CFmodStreamSource::getFrames() { return m_frames; }
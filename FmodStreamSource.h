@@ -0,0 +1,33 @@
+#pragma once
+#include <vector>
+#include "./include/fmod_studio/fmod.hpp"
+#include "StreamSource.h"
+
+// A compressed file (MP3, Ogg Vorbis...) decoded by FMOD's codecs on the prefetch thread. The sound is only opened, not
+// played: its samples are read with readData, so FMOD never decodes it on its own stream thread.
+class CFmodStreamSource : public CStreamSource
+{
+public:
+	CFmodStreamSource(); //Constructor
+	~CFmodStreamSource(); //Releases the sound
+
+	//Opens a file with one of FMOD's codecs. Returns false if it can't be opened or decodes to 8 bit samples
+	bool Open(FMOD::System *system, const char *filename);
+	//Opens the bytes of a file in memory, which FMOD copies
+	bool OpenMemory(FMOD::System *system, const unsigned char *data, size_t size);
+
+	unsigned int Decode(float *out, unsigned int frames);
+	bool Rewind();
+	int getChannels();
+	int getSampleRate();
+	unsigned int getFrames();
+
+private:
+	//Opens a file or its bytes, with the mode and extra information FMOD needs for them
+	bool Open(FMOD::System *system, const char *nameOrData, FMOD_MODE mode, FMOD_CREATESOUNDEXINFO *exinfo);
+
+	FMOD::Sound *m_sound;
+	wav_format_t m_format; // Format of the decoded samples, converted like the ones of a WAVE file
+	unsigned int m_frames;
+	std::vector<unsigned char> m_bytes; // Samples read from FMOD before they are converted
+};
@@ -62,6 +62,9 @@ Game::Game()
 
 	m_dt = 0.0;
 	m_framesPerSecond = 0;
+	m_musicDspLoad = dsp_load_t();
+	m_submarineDspLoad = dsp_load_t();
+	m_soundBankStats = sound_bank_stats_t();
 	m_frameCount = 0;
 	m_elapsedTime = 0.0f;
 	m_currentDistance = 0.0f;
@@ -72,6 +75,8 @@ Game::Game()
 	m_submarinePosition = glm::vec3(0.0f, 0.0f, 0.0f);
 	m_submarineOrientation = glm::mat4(1.0f);
 	m_submarineVel = 0.0001f;
+	m_binaural = true;
+	m_ambisonic = false;
 }
 
 // Destructor
@@ -88,9 +93,9 @@ Game::~Game()
 	delete m_pSphere;
 	delete m_pModule;
 	delete m_pSubmarine;
-	delete m_pAudio;
 	delete m_pSoundSource;
 	delete m_pSubmarineSoundSource;
+	delete m_pAudio;
 
 	if (m_pShaderPrograms != NULL) {
 		for (unsigned int i = 0; i < m_pShaderPrograms->size(); i++)
@@ -122,8 +127,8 @@ void Game::Initialise()
 	m_pModule = new COpenAssetImportMesh;
 	m_pSubmarine = new COpenAssetImportMesh;
 	m_pAudio = new CAudio;
-	m_pSoundSource = new CSoundSource;
-	m_pSubmarineSoundSource = new CSoundSource;
+	m_pSoundSource = new CSoundSource(*m_pAudio);
+	m_pSubmarineSoundSource = new CSoundSource(*m_pAudio);
 
 	RECT dimensions = m_gameWindow.GetDimensions();
 
@@ -411,15 +416,13 @@ void Game::Update()
 	glm::vec3 B = glm::normalize(glm::cross(N, T));
 	//Sets submarine orientation
 	m_submarineOrientation = glm::mat4(glm::mat3(T, B, N));
-	//Sets position and velocity vectors for the submarine sound source
+	//Sets position and velocity vectors for the submarine sound source. The velocity is the derivative of the position,
+	//in units per millisecond, which the Doppler shift of the audio depends on
 	m_pSubmarineSoundSource->SetPosition(m_submarinePosition);
-	m_pSubmarineSoundSource->SetVelocity(glm::vec3(m_t, 0, m_t));
-
-	//Updates the module sound source 
-	m_pSoundSource->Update(m_dt);
+	m_pSubmarineSoundSource->SetVelocity(r * m_submarineVel * (-sin(m_t) * x + cos(m_t) * z));
 
-	//Updates the audio object
-	m_pAudio->Update(m_filterControl, m_pSoundSource, m_pSubmarineSoundSource, m_submarineVel, m_pCamera);
+	//Updates the audio object, which moves the sound sources with their velocity
+	m_pAudio->Update(m_dt, m_filterControl, m_pSubmarineSoundSource, m_submarineVel, m_pCamera);
 }
 
 
@@ -445,6 +448,13 @@ void Game::DisplayFrameRate()
 
 		// Reset the frames per second
 		m_frameCount = 0;
+
+		// The DSP loads are taken over the same second
+		if (m_pAudio)
+		{
+			m_pAudio->GetDspLoads(m_musicDspLoad, m_submarineDspLoad);
+			m_soundBankStats = m_pAudio->GetSoundBankStats();
+		}
     }
 
 	if (m_framesPerSecond > 0) {
@@ -455,6 +465,13 @@ void Game::DisplayFrameRate()
 		fontProgram->SetUniform("matrices.projMatrix", m_pCamera->GetOrthographicProjectionMatrix());
 		fontProgram->SetUniform("vColour", glm::vec4(1.0f, 1.0f, 1.0f, 1.0f));
 		m_pFtFont->Render(20, height - 20, 20, "FPS: %d", m_framesPerSecond);
+
+		// Load of each DSP in percent of its real-time budget, the 99th percentile block and the blocks over budget
+		m_pFtFont->Render(20, height - 40, 20, "Music DSP: %.2f%% p99 %.2f%% overruns %u", m_musicDspLoad.load, m_musicDspLoad.p99, m_musicDspLoad.overruns);
+		m_pFtFont->Render(20, height - 60, 20, "Submarine DSP: %.2f%% p99 %.2f%% overruns %u", m_submarineDspLoad.load, m_submarineDspLoad.p99, m_submarineDspLoad.overruns);
+
+		// Resident memory of the sound bank against its budget, and how often a sound had to be read again
+		m_pFtFont->Render(20, height - 80, 20, "Sound bank: %u/%u KB hits %u misses %u evictions %u", (unsigned int)(m_soundBankStats.bytesResident >> 10), (unsigned int)(m_soundBankStats.budget >> 10), m_soundBankStats.hits, m_soundBankStats.misses, m_soundBankStats.evictions);
 	}
 }
 
@@ -561,10 +578,10 @@ LRESULT Game::ProcessEvents(HWND window,UINT message, WPARAM w_param, LPARAM l_p
 			m_pAudio->PlayMusicStream();
 			break;
 		case '2': //Plays the sound od the module - Task 2a Part 1
-			m_pAudio->PlaySoundSource();
+			m_pAudio->PlaySoundSource(m_pSoundSource);
 			break;
 		case '3': //Plays the sound od the submarine - Task 2a Part 2
-			m_pAudio->PlayObjectSound();
+			m_pAudio->PlayObjectSound(m_pSubmarineSoundSource);
 			break;
 		//Controls for moving the module
 		case 'Y':
@@ -604,6 +621,16 @@ LRESULT Game::ProcessEvents(HWND window,UINT message, WPARAM w_param, LPARAM l_p
 				m_submarineVel = m_submarineVel + 0.0001;
 			}
 			break;
+		//Switches the 3D sounds between the HRTF DSPs, for headphones, and FMOD's panner, for speakers
+		case VK_F5:
+			m_binaural = !m_binaural;
+			m_pAudio->SetBinaural(m_binaural);
+			break;
+		//Switches the 3D sounds between the ambisonic bus and placing every sound on its own
+		case VK_F6:
+			m_ambisonic = !m_ambisonic;
+			m_pAudio->SetAmbisonic(m_ambisonic);
+			break;
 		case VK_RIGHT:
 			m_cameraRotation = m_cameraRotation + m_dt * 0.01f;
 			break;
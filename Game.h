@@ -2,6 +2,8 @@
 
 #include "Common.h"
 #include "GameWindow.h"
+#include "DspProfiler.h"
+#include "SoundBank.h"
 
 // Classes used in game.  For a new class, declare it here and provide a pointer to an object of this class below.  Then, in Game.cpp, 
 // include the header.  In the Game constructor, set the pointer to NULL and in Game::Initialise, create a new object.  Don't forget to 
@@ -46,6 +48,9 @@ private:
 	// Some other member variables
 	double m_dt;
 	int m_framesPerSecond;
+	dsp_load_t m_musicDspLoad; // CPU load of the music DSP over the last second
+	dsp_load_t m_submarineDspLoad; // CPU load of the submarine DSP over the last second
+	sound_bank_stats_t m_soundBankStats; // Counters of the sound bank, taken every second
 	bool m_appActive;
 	float m_currentDistance;
 	float m_cameraSpeed;
@@ -53,6 +58,8 @@ private:
 	float m_filterControl;
 	float m_t;  
 	float m_submarineVel;
+	bool m_binaural; // The 3D sounds are placed with the HRTF DSPs rather than FMOD's panner
+	bool m_ambisonic; // The 3D sounds are mixed into the ambisonic bus rather than placed one by one
 	glm::vec3 m_submarinePosition;  
 	glm::mat4 m_submarineOrientation;
 
@@ -0,0 +1,330 @@
+#include "HrirSet.h"
+#include "WavFile.h"
+#include "Fft.h"
+#include "FirDesign.h"
+#include <cstdio>
+#include <algorithm>
+#define _USE_MATH_DEFINES
+#include <math.h>
+
+// Spherical head model
+static const double HEAD_RADIUS = 0.0875; // Metres
+static const double SPEED_OF_SOUND = 343.0; // Metres per second, in the air the set stands for
+static const double MODEL_LENGTH = 0.003; // Seconds of the modelled responses
+
+// Low pass filter of the responses resampled to a lower rate
+static const int ANTI_ALIAS_TAPS = 63;
+static const float ANTI_ALIAS_PASSBAND = 0.8f; // Part of the new Nyquist band it passes
+
+CHrirSet::CHrirSet()
+{
+	m_taps = 0;
+	m_sampleRate = 0;
+	m_block = 0;
+	m_partitions = 0;
+	m_bins = 0;
+}
+
+CHrirSet::~CHrirSet()
+{}
+
+//Unit vector of a direction: x to the right, y up and z to the front
+static void DirectionVector(double azimuth, double elevation, double *v)
+{
+	double a = azimuth * M_PI / 180.0, e = elevation * M_PI / 180.0;
+	v[0] = sin(a) * cos(e);
+	v[1] = sin(e);
+	v[2] = cos(a) * cos(e);
+}
+
+//Azimuth and elevation of grid point (a, e)
+static double GridAzimuth(int a) { return 360.0 * a / (CHrirSet::AZIMUTHS - 1); }
+static double GridElevation(int e) { return -90.0 + 180.0 * e / (CHrirSet::ELEVATIONS - 1); }
+
+//Maps a direction to the controls of the grids, the azimuth first
+void CHrirSet::Controls(float azimuth, float elevation, float *controls)
+{
+	azimuth = fmodf(azimuth, 360.0f);
+	if (azimuth < 0.0f)
+		azimuth += 360.0f;
+	controls[0] = azimuth / 360.0f;
+	controls[1] = (elevation + 90.0f) / 180.0f;
+}
+
+/*
+	The responses of the file are cut at MAX_TAPS and resampled to the mixer rate with linear interpolation. Each output
+	tap stands for step input taps, so the taps are scaled by step to keep the gain. Going down in rate, the responses
+	are low pass filtered first, so what lies above the new Nyquist frequency doesn't fold back. The filter is symmetric
+	and centred on each tap, so it doesn't move the delays between the ears
+*/
+bool CHrirSet::Load(const char *wavFilename, const char *directionsFilename, int sampleRate)
+{
+	CWavFile wav;
+	if (!wav.Load(wavFilename) || wav.getChannels() != 2)
+		return false;
+
+	FILE *file = fopen(directionsFilename, "r");
+	if (!file)
+		return false;
+	std::vector<float> azimuths, elevations;
+	float azimuth, elevation;
+	while (fscanf(file, "%f %f", &azimuth, &elevation) == 2)
+	{
+		azimuths.push_back(azimuth);
+		elevations.push_back(elevation);
+	}
+	fclose(file);
+
+	int count = (int)azimuths.size();
+	if (count == 0 || wav.getFrames() % count != 0)
+		return false;
+	int fileTaps = (int)(wav.getFrames() / count);
+	double step = (double)wav.getSampleRate() / sampleRate;
+	int taps = (int)ceil(fileTaps / step);
+	if (taps > MAX_TAPS)
+		taps = MAX_TAPS;
+	if (taps < 1)
+		return false;
+
+	std::vector<float> samples = wav.getSamples();
+	if (step > 1.0)
+	{
+		float fileRate = (float)wav.getSampleRate();
+		float nyquist = 0.5f * sampleRate;
+		band_spec_t spec;
+		spec.bands = { 0.0f, ANTI_ALIAS_PASSBAND * nyquist, nyquist, 0.5f * fileRate };
+		spec.desired = { 1.0f, 1.0f, 0.0f, 0.0f };
+		std::vector<float> lowpass = CFirDesign::Firls(ANTI_ALIAS_TAPS, spec, fileRate);
+		int half = (int)lowpass.size() / 2;
+
+		const std::vector<float> &measured = wav.getSamples();
+		for (int d = 0; d < count; d++)
+		{
+			const float *in = &measured[(size_t)d * fileTaps * 2];
+			float *out = &samples[(size_t)d * fileTaps * 2];
+			for (int i = 0; i < fileTaps; i++)
+			{
+				for (int ear = 0; ear < 2; ear++)
+				{
+					float sum = 0.0f;
+					for (int j = std::max(0, i + half - fileTaps + 1); j < (int)lowpass.size() && i + half - j >= 0; j++)
+						sum += lowpass[j] * in[(i + half - j) * 2 + ear];
+					out[i * 2 + ear] = sum;
+				}
+			}
+		}
+	}
+
+	std::vector<float> responses((size_t)count * taps * 2);
+	for (int d = 0; d < count; d++)
+	{
+		const float *in = &samples[(size_t)d * fileTaps * 2];
+		float *out = &responses[(size_t)d * taps * 2];
+		for (int n = 0; n < taps; n++)
+		{
+			double position = n * step;
+			int i = (int)position;
+			float mix = (float)(position - i);
+			for (int ear = 0; ear < 2; ear++)
+			{
+				float a = i < fileTaps ? in[i * 2 + ear] : 0.0f;
+				float b = i + 1 < fileTaps ? in[(i + 1) * 2 + ear] : 0.0f;
+				out[n * 2 + ear] = (float)((a + mix * (b - a)) * step);
+			}
+		}
+	}
+
+	m_taps = taps;
+	m_sampleRate = sampleRate;
+	Resample(azimuths, elevations, responses);
+	return true;
+}
+
+/*
+	Each grid point blends the three measured directions nearest to it, weighted by the inverse of their angle to it, or
+	takes the measured one it sits on. Measured sets are dense enough that the blended delays stay close to each other
+*/
+void CHrirSet::Resample(const std::vector<float> &azimuths, const std::vector<float> &elevations, const std::vector<float> &responses)
+{
+	int count = (int)azimuths.size();
+	std::vector<double> vectors(count * 3);
+	for (int d = 0; d < count; d++)
+		DirectionVector(azimuths[d], elevations[d], &vectors[d * 3]);
+
+	std::vector<int> sizes{ AZIMUTHS, ELEVATIONS };
+	m_responses.Init(sizes, 2 * m_taps);
+	m_block = 0;
+	for (int e = 0; e < ELEVATIONS; e++)
+	{
+		for (int a = 0; a < AZIMUTHS; a++)
+		{
+			double grid[3];
+			DirectionVector(GridAzimuth(a), GridElevation(e), grid);
+
+			//The three largest cosines, the nearest first
+			int nearest[3] = { -1, -1, -1 };
+			double cosines[3] = { -2.0, -2.0, -2.0 };
+			for (int d = 0; d < count; d++)
+			{
+				const double *v = &vectors[d * 3];
+				double cosine = grid[0] * v[0] + grid[1] * v[1] + grid[2] * v[2];
+				for (int k = 0; k < 3; k++)
+				{
+					if (cosine > cosines[k])
+					{
+						for (int j = 2; j > k; j--)
+						{
+							cosines[j] = cosines[j - 1];
+							nearest[j] = nearest[j - 1];
+						}
+						cosines[k] = cosine;
+						nearest[k] = d;
+						break;
+					}
+				}
+			}
+
+			double weights[3] = { 0.0, 0.0, 0.0 };
+			double total = 0.0;
+			for (int k = 0; k < 3 && nearest[k] >= 0; k++)
+			{
+				double angle = acos(std::min(1.0, std::max(-1.0, cosines[k])));
+				if (angle < 1e-4)
+				{
+					weights[0] = weights[1] = weights[2] = 0.0;
+					weights[k] = total = 1.0;
+					break;
+				}
+				weights[k] = 1.0 / angle;
+				total += weights[k];
+			}
+
+			float *entry = m_responses.getEntry(e * AZIMUTHS + a);
+			for (int k = 0; k < 3; k++)
+			{
+				if (weights[k] == 0.0)
+					continue;
+				float weight = (float)(weights[k] / total);
+				const float *response = &responses[(size_t)nearest[k] * m_taps * 2];
+				for (int n = 0; n < m_taps; n++)
+				{
+					entry[n] += weight * response[n * 2];
+					entry[m_taps + n] += weight * response[n * 2 + 1];
+				}
+			}
+		}
+	}
+}
+
+/*
+	Every ear hears the sound with the delay of Woodworth's formula, the path around the sphere to the ear, and through
+	the head shadow filter of Brown and Duda, a shelf that cuts the high frequencies by up to 20 dB behind the head.
+	A reflection off the pinna, whose delay grows as the sound comes from lower, notches the spectrum with the elevation.
+	The fractional delays are windowed sincs and the shelf is the bilinear transform of its analog one-pole one-zero form
+*/
+void CHrirSet::Generate(int sampleRate)
+{
+	m_sampleRate = sampleRate;
+	m_taps = (int)ceil(MODEL_LENGTH * sampleRate);
+	if (m_taps > MAX_TAPS)
+		m_taps = MAX_TAPS;
+
+	std::vector<int> sizes{ AZIMUTHS, ELEVATIONS };
+	m_responses.Init(sizes, 2 * m_taps);
+	m_block = 0;
+
+	double headDelay = HEAD_RADIUS / SPEED_OF_SOUND;
+	double w0 = SPEED_OF_SOUND / HEAD_RADIUS;
+	double k = sampleRate / w0; //2 fs / (2 w0) of the bilinear transform
+	std::vector<double> impulse(m_taps);
+	for (int e = 0; e < ELEVATIONS; e++)
+	{
+		for (int a = 0; a < AZIMUTHS; a++)
+		{
+			double source[3];
+			DirectionVector(GridAzimuth(a), GridElevation(e), source);
+			float *entry = m_responses.getEntry(e * AZIMUTHS + a);
+
+			for (int ear = 0; ear < 2; ear++)
+			{
+				//Angle between the source and the ear, at -90 or 90 degrees azimuth
+				double side = ear == 0 ? -1.0 : 1.0;
+				double theta = acos(std::min(1.0, std::max(-1.0, side * source[0])));
+				double delay = headDelay + (theta < M_PI / 2 ? -headDelay * cos(theta) : headDelay * (theta - M_PI / 2));
+				double pinna = 0.0001 + 0.0001 * (1.0 - source[1]);
+
+				//Direct sound and the inverted pinna reflection, as band limited impulses
+				std::fill(impulse.begin(), impulse.end(), 0.0);
+				double arrivals[2] = { (delay + 0.0002) * sampleRate, (delay + 0.0002 + pinna) * sampleRate };
+				double gains[2] = { 1.0, -0.3 };
+				for (int r = 0; r < 2; r++)
+				{
+					for (int n = (int)arrivals[r] - 8; n <= (int)arrivals[r] + 8; n++)
+					{
+						if (n < 0 || n >= m_taps)
+							continue;
+						double x = n - arrivals[r];
+						double sinc = fabs(x) < 1e-9 ? 1.0 : sin(M_PI * x) / (M_PI * x);
+						double window = 0.5 + 0.5 * cos(M_PI * x / 9.0);
+						impulse[n] += gains[r] * sinc * window;
+					}
+				}
+
+				//Head shadow: alpha is 2 (+6 dB) facing the ear and 0.1 (-20 dB) at 150 degrees from it
+				double alpha = 1.05 + 0.95 * cos(theta * 180.0 / 150.0);
+				double b0 = (1.0 + alpha * k) / (1.0 + k);
+				double b1 = (1.0 - alpha * k) / (1.0 + k);
+				double a1 = (1.0 - k) / (1.0 + k);
+				double x1 = 0.0, y1 = 0.0;
+				float *h = entry + ear * m_taps;
+				for (int n = 0; n < m_taps; n++)
+				{
+					double y = b0 * impulse[n] + b1 * x1 - a1 * y1;
+					x1 = impulse[n];
+					y1 = y;
+					h[n] = (float)y;
+				}
+			}
+		}
+	}
+}
+
+//Each ear of each grid point is cut into partitions that are zero padded to twice the block size before the FFT
+void CHrirSet::Transform(int blockSize)
+{
+	m_block = blockSize;
+	m_partitions = (m_taps + m_block - 1) / m_block;
+	if (m_partitions < 1)
+		m_partitions = 1;
+	CFft fft(2 * m_block);
+	m_bins = fft.getBins();
+	int spectrum = m_partitions * m_bins;
+	m_spectra.Init(m_responses, 4 * spectrum);
+
+	std::vector<float> segment(2 * m_block);
+	for (int i = 0; i < m_responses.getCount(); i++)
+	{
+		for (int ear = 0; ear < 2; ear++)
+		{
+			const float *h = m_responses.getEntry(i) + ear * m_taps;
+			float *re = m_spectra.getEntry(i) + ear * 2 * spectrum;
+			float *im = re + spectrum;
+			for (int p = 0; p < m_partitions; p++)
+			{
+				std::fill(segment.begin(), segment.end(), 0.0f);
+				for (int n = 0; n < m_block && p * m_block + n < m_taps; n++)
+					segment[n] = h[p * m_block + n];
+				fft.Forward(segment.data(), &re[p * m_bins], &im[p * m_bins]);
+			}
+		}
+	}
+}
+
+//Getters of the class attributes
+const CMorphBank &CHrirSet::getResponses() const { return m_responses; }
+const CMorphBank &CHrirSet::getSpectra() const { return m_spectra; }
+int CHrirSet::getTaps() const { return m_taps; }
+int CHrirSet::getSampleRate() const { return m_sampleRate; }
+int CHrirSet::getBlockSize() const { return m_block; }
+int CHrirSet::getPartitions() const { return m_partitions; }
+int CHrirSet::getBins() const { return m_bins; }
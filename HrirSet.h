@@ -0,0 +1,55 @@
+#pragma once
+#include <vector>
+#include "MorphBank.h"
+
+// A set of head related impulse responses (HRIRs): the responses of the left and right ears to a sound from each direction.
+// The measured directions are resampled onto a regular azimuth x elevation grid, so a direction is looked up like the
+// controls of a filter bank and the four grid points around it are blended. The grid is also transformed once into the
+// partition spectra of CHrtfFilter, which every binaural voice shares.
+// Azimuths are in degrees clockwise from the front (90 is the right ear), elevations in degrees up from the horizon.
+class CHrirSet
+{
+public:
+	static const int AZIMUTHS = 73; // Every 5 degrees, with 360 repeating 0 so the interpolation wraps around
+	static const int ELEVATIONS = 13; // Every 15 degrees from -90 to 90
+	static const int MAX_TAPS = 512; // Longer responses are cut
+
+	CHrirSet(); //Constructor
+	~CHrirSet(); //Destructor
+
+	//Reads a set measured at any directions: a stereo WAV file with the responses one after the other, all of the same
+	//length, and a text file with the azimuth and elevation of each response on a line. The responses are resampled to
+	//sampleRate. Returns false if a file can't be read or they don't match
+	bool Load(const char *wavFilename, const char *directionsFilename, int sampleRate);
+	//Creates a set from a spherical head model, for when no measured set is available
+	void Generate(int sampleRate);
+	//Transforms every grid point into spectra of partitions of blockSize taps
+	void Transform(int blockSize);
+
+	//Maps a direction to the controls of the grids, the azimuth first
+	static void Controls(float azimuth, float elevation, float *controls);
+
+	//The grid of responses: each entry holds the left ear taps followed by the right ear taps
+	const CMorphBank &getResponses() const;
+	//The grid of partition spectra: each entry holds the real and then the imaginary parts of the left ear, then the
+	//same for the right ear. Each of the four is getPartitions() spectra of getBins() bins one after the other
+	const CMorphBank &getSpectra() const;
+	//Getters of the class attributes
+	int getTaps() const;
+	int getSampleRate() const;
+	int getBlockSize() const;
+	int getPartitions() const;
+	int getBins() const;
+
+private:
+	//Fills the grid from responses measured at the given directions, taps per ear, left and right interleaved
+	void Resample(const std::vector<float> &azimuths, const std::vector<float> &elevations, const std::vector<float> &responses);
+
+	CMorphBank m_responses;
+	CMorphBank m_spectra;
+	int m_taps;
+	int m_sampleRate;
+	int m_block; // Partition size of the spectra, 0 until Transform is called
+	int m_partitions;
+	int m_bins;
+};
@@ -0,0 +1,90 @@
+#include "HrtfDsp.h"
+#include <cstring>
+
+//Creates the filter with the spectra of a transformed set. The voice starts in front of the listener
+CHrtfDsp::CHrtfDsp(const CHrirSet &set)
+	: m_filter(set)
+{
+	hrtf_direction_t &direction = m_direction.Write();
+	direction.azimuth = 0.0f;
+	direction.elevation = 0.0f;
+	m_direction.Publish();
+	m_direction.Update();
+	m_reset.store(false, std::memory_order_relaxed);
+}
+
+CHrtfDsp::~CHrtfDsp()
+{}
+
+/*
+	Takes the newest direction once for the whole block. The filter crossfades between directions itself
+*/
+void CHrtfDsp::Read(const float *in, float *out, unsigned int length, int inChannels, int outChannels)
+{
+	m_direction.Update();
+	const hrtf_direction_t &direction = m_direction.Read();
+	if (m_reset.load(std::memory_order_relaxed) && m_reset.exchange(false, std::memory_order_acquire))
+		m_filter.Reset();
+
+	if (m_mono.size() < length)
+		Prepare(length);
+
+	float *mono = m_mono.data();
+	if (inChannels == 1)
+	{
+		memcpy(mono, in, length * sizeof(float));
+	}
+	else
+	{
+		float scale = 1.0f / inChannels;
+		for (unsigned int n = 0; n < length; n++)
+		{
+			float sum = 0.0f;
+			for (int c = 0; c < inChannels; c++)
+				sum += in[n * inChannels + c];
+			mono[n] = sum * scale;
+		}
+	}
+
+	float *left = m_left.data();
+	float *right = m_right.data();
+	m_filter.Process(mono, left, right, length, direction.azimuth, direction.elevation);
+
+	if (outChannels == 1)
+	{
+		for (unsigned int n = 0; n < length; n++)
+			out[n] = 0.5f * (left[n] + right[n]);
+	}
+	else
+	{
+		memset(out, 0, (size_t)length * outChannels * sizeof(float));
+		for (unsigned int n = 0; n < length; n++)
+		{
+			out[n * outChannels] = left[n];
+			out[n * outChannels + 1] = right[n];
+		}
+	}
+}
+
+//Clears the history of the filter before the next block
+void CHrtfDsp::Reset()
+{
+	m_reset.store(true, std::memory_order_release);
+}
+
+//Grows the buffers for blocks of up to frames frames
+void CHrtfDsp::Prepare(unsigned int frames)
+{
+	if (m_mono.size() >= frames)
+		return;
+	m_mono.resize(frames);
+	m_left.resize(frames);
+	m_right.resize(frames);
+}
+
+//Hands a new direction to the mixer thread
+void CHrtfDsp::SetDirection(const hrtf_direction_t &direction)
+{
+	m_direction.Write() = direction;
+	m_direction.Publish();
+}
@@ -0,0 +1,38 @@
+#pragma once
+#include <atomic>
+#include <vector>
+#include "HrtfFilter.h"
+#include "TripleBuffer.h"
+
+// Where the listener hears the voice of an HRTF DSP from
+typedef struct
+{
+	float azimuth; // Degrees clockwise from the front of the listener
+	float elevation; // Degrees up from the horizon of the listener
+} hrtf_direction_t;
+
+// The state of an HRTF DSP, attached to the plugindata of its FMOD_DSP_STATE. Like CFilterDsp it doesn't depend on FMOD.
+// The game thread sets the direction of the voice and the mixer thread picks it up through a triple buffer, so neither
+// waits for the other. The input is mixed down to mono and the binaural pair goes to the first two output channels.
+class CHrtfDsp
+{
+public:
+	CHrtfDsp(const CHrirSet &set); //Creates the filter with the spectra of a transformed set
+	~CHrtfDsp(); //Destructor
+
+	//Mixer thread: filters one block of interleaved samples for the newest direction
+	void Read(const float *in, float *out, unsigned int length, int inChannels, int outChannels);
+	//Any thread: clears the history of the filter before the next block, e.g. when the DSP moves to another channel
+	void Reset();
+	//Grows the buffers for blocks of up to frames frames, so Read doesn't allocate later. Called before the DSP is used
+	void Prepare(unsigned int frames);
+
+	//Game thread: hands a new direction to the mixer thread
+	void SetDirection(const hrtf_direction_t &direction);
+
+private:
+	CHrtfFilter m_filter; // Only touched by the mixer thread
+	CTripleBuffer<hrtf_direction_t> m_direction; // Direction handed from the game thread to the mixer thread
+	std::vector<float> m_mono, m_left, m_right; // One block of the input and of each ear
+	std::atomic<bool> m_reset; // Set by Reset, cleared by the mixer thread when it clears the history
+};
@@ -0,0 +1,215 @@
+#include "HrtfFilter.h"
+#include "FirKernels.h"
+#include <cstring>
+#include <algorithm>
+#include <math.h>
+
+#if defined(_M_X64) || defined(_M_IX86) || defined(__x86_64__) || defined(__i386__)
+#define FIR_X86
+#include <immintrin.h>
+#endif
+
+// Smallest move of a control, about half a degree, that blends new spectra
+static const float CONTROL_STEP = 0.5f / 360.0f;
+
+//Reference multiply-accumulate
+static void SpectrumScalar(const float *xRe, const float *xIm, const float *hRe, const float *hIm, float *accRe, float *accIm, int bins)
+{
+	for (int k = 0; k < bins; k++)
+	{
+		accRe[k] += xRe[k] * hRe[k] - xIm[k] * hIm[k];
+		accIm[k] += xRe[k] * hIm[k] + xIm[k] * hRe[k];
+	}
+}
+
+/*
+	The split layout needs no shuffles: a vector of real parts and a vector of imaginary parts are multiplied by the
+	matching vectors of the filter. The bins left over at the end (the block size is a power of two, so one) go through
+	the scalar kernel
+*/
+FIR_TARGET("sse2")
+static void SpectrumSSE2(const float *xRe, const float *xIm, const float *hRe, const float *hIm, float *accRe, float *accIm, int bins)
+{
+	int k = 0;
+#ifdef FIR_X86
+	for (; k + 4 <= bins; k += 4)
+	{
+		__m128 ar = _mm_loadu_ps(xRe + k), ai = _mm_loadu_ps(xIm + k);
+		__m128 br = _mm_loadu_ps(hRe + k), bi = _mm_loadu_ps(hIm + k);
+		__m128 re = _mm_sub_ps(_mm_mul_ps(ar, br), _mm_mul_ps(ai, bi));
+		__m128 im = _mm_add_ps(_mm_mul_ps(ar, bi), _mm_mul_ps(ai, br));
+		_mm_storeu_ps(accRe + k, _mm_add_ps(_mm_loadu_ps(accRe + k), re));
+		_mm_storeu_ps(accIm + k, _mm_add_ps(_mm_loadu_ps(accIm + k), im));
+	}
+#endif
+	SpectrumScalar(xRe + k, xIm + k, hRe + k, hIm + k, accRe + k, accIm + k, bins - k);
+}
+
+FIR_TARGET("avx2,fma")
+static void SpectrumAVX2(const float *xRe, const float *xIm, const float *hRe, const float *hIm, float *accRe, float *accIm, int bins)
+{
+	int k = 0;
+#ifdef FIR_X86
+	for (; k + 8 <= bins; k += 8)
+	{
+		__m256 ar = _mm256_loadu_ps(xRe + k), ai = _mm256_loadu_ps(xIm + k);
+		__m256 br = _mm256_loadu_ps(hRe + k), bi = _mm256_loadu_ps(hIm + k);
+		__m256 re = _mm256_fmadd_ps(ar, br, _mm256_loadu_ps(accRe + k));
+		__m256 im = _mm256_fmadd_ps(ar, bi, _mm256_loadu_ps(accIm + k));
+		_mm256_storeu_ps(accRe + k, _mm256_fnmadd_ps(ai, bi, re));
+		_mm256_storeu_ps(accIm + k, _mm256_fmadd_ps(ai, br, im));
+	}
+	//Avoids the AVX to SSE transition penalty in the code that runs after the kernel
+	_mm256_zeroupper();
+#endif
+	SpectrumScalar(xRe + k, xIm + k, hRe + k, hIm + k, accRe + k, accIm + k, bins - k);
+}
+
+//Allocates the delay line for the partitions of the set and picks the kernel of the FIR filters' instruction set
+CHrtfFilter::CHrtfFilter(const CHrirSet &set)
+	: m_set(set), m_fft(2 * set.getBlockSize())
+{
+	m_kernel = SelectKernel();
+	m_block = set.getBlockSize();
+	m_bins = set.getBins();
+	m_partitions = set.getPartitions();
+	m_input.assign(2 * m_block, 0.0f);
+	m_left.assign(m_block, 0.0f);
+	m_right.assign(m_block, 0.0f);
+	m_fadeLeft.assign(m_block, 0.0f);
+	m_fadeRight.assign(m_block, 0.0f);
+	m_fdlRe.assign(m_partitions * m_bins, 0.0f);
+	m_fdlIm.assign(m_partitions * m_bins, 0.0f);
+	m_current.assign(set.getSpectra().getLength(), 0.0f);
+	m_previous.assign(set.getSpectra().getLength(), 0.0f);
+	m_accRe.resize(m_bins);
+	m_accIm.resize(m_bins);
+	m_time.resize(2 * m_block);
+	m_fill = 0;
+	m_fdlPos = 0;
+	m_controls[0] = m_controls[1] = 0.0f;
+	m_valid = false;
+}
+
+CHrtfFilter::~CHrtfFilter()
+{}
+
+/*
+	Samples are collected until a block is full, then the whole block is filtered at once.
+	Meanwhile the output is read from the previously filtered block, which delays it by one block
+*/
+void CHrtfFilter::Process(const float *in, float *left, float *right, unsigned int frames, float azimuth, float elevation)
+{
+	float controls[2];
+	CHrirSet::Controls(azimuth, elevation, controls);
+
+	unsigned int done = 0;
+	while (done < frames)
+	{
+		unsigned int n = m_block - m_fill;
+		if (n > frames - done)
+			n = frames - done;
+
+		memcpy(&m_input[m_block + m_fill], in + done, n * sizeof(float));
+		memcpy(left + done, &m_left[m_fill], n * sizeof(float));
+		memcpy(right + done, &m_right[m_fill], n * sizeof(float));
+
+		m_fill += n;
+		done += n;
+
+		if (m_fill == m_block)
+		{
+			ProcessBlock(controls);
+			m_fill = 0;
+		}
+	}
+}
+
+/*
+	Overlap-save as in CFftConvolver: the FFT of the last two blocks goes into the delay line once and both ears multiply
+	it with their partition spectra. When the direction moved, the spectra of the old direction are kept and the block
+	fades linearly from their output to the output of the new ones
+*/
+void CHrtfFilter::ProcessBlock(const float *controls)
+{
+	m_fft.Forward(m_input.data(), &m_fdlRe[m_fdlPos * m_bins], &m_fdlIm[m_fdlPos * m_bins]);
+
+	bool moved = !m_valid || fabsf(controls[0] - m_controls[0]) >= CONTROL_STEP || fabsf(controls[1] - m_controls[1]) >= CONTROL_STEP;
+	bool fade = moved && m_valid;
+	if (moved)
+	{
+		m_current.swap(m_previous);
+		m_set.getSpectra().Blend(controls, true, m_current.data());
+		m_controls[0] = controls[0];
+		m_controls[1] = controls[1];
+		m_valid = true;
+	}
+
+	Render(m_current.data(), m_left.data(), m_right.data());
+	if (fade)
+	{
+		Render(m_previous.data(), m_fadeLeft.data(), m_fadeRight.data());
+		float step = 1.0f / m_block;
+		for (int n = 0; n < m_block; n++)
+		{
+			float mix = (n + 1) * step;
+			m_left[n] = m_fadeLeft[n] + mix * (m_left[n] - m_fadeLeft[n]);
+			m_right[n] = m_fadeRight[n] + mix * (m_right[n] - m_fadeRight[n]);
+		}
+	}
+
+	//The block just filled becomes the previous block
+	memmove(m_input.data(), &m_input[m_block], m_block * sizeof(float));
+	m_fdlPos = (m_fdlPos + 1) % m_partitions;
+}
+
+//Partition p of each ear is multiplied with the input of p blocks ago, and the second half of the inverse FFT is kept
+void CHrtfFilter::Render(const float *spectra, float *left, float *right)
+{
+	int spectrum = m_partitions * m_bins;
+	float *outputs[2] = { left, right };
+	for (int ear = 0; ear < 2; ear++)
+	{
+		const float *hRe = spectra + ear * 2 * spectrum;
+		const float *hIm = hRe + spectrum;
+		memset(m_accRe.data(), 0, m_bins * sizeof(float));
+		memset(m_accIm.data(), 0, m_bins * sizeof(float));
+		for (int p = 0; p < m_partitions; p++)
+		{
+			int slot = m_fdlPos - p;
+			if (slot < 0)
+				slot += m_partitions;
+			m_kernel(&m_fdlRe[slot * m_bins], &m_fdlIm[slot * m_bins], hRe + p * m_bins, hIm + p * m_bins, m_accRe.data(), m_accIm.data(), m_bins);
+		}
+		m_fft.Inverse(m_accRe.data(), m_accIm.data(), m_time.data());
+		memcpy(outputs[ear], &m_time[m_block], m_block * sizeof(float));
+	}
+}
+
+//Clears the history. The next block blends its spectra without a crossfade
+void CHrtfFilter::Reset()
+{
+	std::fill(m_input.begin(), m_input.end(), 0.0f);
+	std::fill(m_left.begin(), m_left.end(), 0.0f);
+	std::fill(m_right.begin(), m_right.end(), 0.0f);
+	std::fill(m_fdlRe.begin(), m_fdlRe.end(), 0.0f);
+	std::fill(m_fdlIm.begin(), m_fdlIm.end(), 0.0f);
+	m_fill = 0;
+	m_fdlPos = 0;
+	m_valid = false;
+}
+
+//Returns the multiply-accumulate for the instruction set of the FIR filters
+SpectrumKernelFunc CHrtfFilter::SelectKernel()
+{
+	switch (CFirKernels::getIsa())
+	{
+	case FIR_ISA_SSE2: return SpectrumSSE2;
+	case FIR_ISA_AVX2:
+	case FIR_ISA_AVX512: return SpectrumAVX2;
+	default: return SpectrumScalar;
+	}
+}
+
+//Getters of the class attributes
+int CHrtfFilter::getLatency() { return m_block; }
@@ -0,0 +1,52 @@
+#pragma once
+#include <vector>
+#include "Fft.h"
+#include "HrirSet.h"
+
+// Multiply-accumulate of split complex spectra: acc += x * h over bins bins
+typedef void (*SpectrumKernelFunc)(const float *xRe, const float *xIm, const float *hRe, const float *hIm, float *accRe, float *accIm, int bins);
+
+// The binaural filter of one voice: a mono signal convolved with the left and right ear responses of its direction.
+// It is a uniformly partitioned overlap-save convolver like CFftConvolver, but the spectrum of each input block is shared
+// by both ears and the partition spectra are blended from the grid of a CHrirSet every voice shares. When the direction
+// moves, the block is filtered with both the old and the new spectra and crossfaded. The delay line holds the spectra of
+// the input, so both filters see the whole history and the crossfade is between two exact outputs.
+// The output is delayed by one block of the set.
+class CHrtfFilter
+{
+public:
+	CHrtfFilter(const CHrirSet &set); //Allocates the delay line for the partitions of the set, which must be transformed
+	~CHrtfFilter(); //Destructor
+
+	//Filters frames samples of a mono signal into both ears, for a source at the given direction in degrees. The direction
+	//is picked up at the start of every block of the set
+	void Process(const float *in, float *left, float *right, unsigned int frames, float azimuth, float elevation);
+	//Clears the history
+	void Reset();
+	//Returns the multiply-accumulate for the instruction set of the FIR filters
+	static SpectrumKernelFunc SelectKernel();
+	//Getters of the class attributes
+	int getLatency();
+
+private:
+	//Filters the block that has just been filled, crossfading to the spectra of controls if they moved
+	void ProcessBlock(const float *controls);
+	//Convolves the delay line with a set of blended partition spectra into a block of both ears
+	void Render(const float *spectra, float *left, float *right);
+
+	const CHrirSet &m_set;
+	CFft m_fft; // FFT of twice the block size
+	SpectrumKernelFunc m_kernel; // Multiply-accumulate for the instruction set of the CPU
+	int m_block, m_bins, m_partitions;
+	std::vector<float> m_input; // The previous block followed by the block being filled
+	std::vector<float> m_left, m_right; // The last filtered block, read while the next one is filled
+	std::vector<float> m_fadeLeft, m_fadeRight; // The last block filtered with the previous direction
+	std::vector<float> m_fdlRe, m_fdlIm; // Spectra of the last partitions input blocks
+	std::vector<float> m_current, m_previous; // Blended spectra of the direction and of the one before it
+	std::vector<float> m_accRe, m_accIm; // Spectrum of the block being filtered
+	std::vector<float> m_time; // Time domain result of the block being filtered
+	int m_fill; // Samples in the block being filled
+	int m_fdlPos; // Position of the newest spectrum in the delay line
+	float m_controls[2]; // The grid controls the current spectra were blended for
+	bool m_valid; // False until the first block has blended its spectra
+};
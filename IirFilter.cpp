@@ -0,0 +1,418 @@
+#include "IirFilter.h"
+#include "FirDesign.h"
+#include <cmath>
+#include <cstring>
+#include <algorithm>
+
+#if defined(_M_X64) || defined(__SSE2__) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#define IIR_SSE
+#include <emmintrin.h>
+#endif
+
+#ifndef M_PI
+#define M_PI 3.14159265358979323846
+#endif
+
+const float CIirFilter::MIN_GAIN_DB = -48.0f;
+const float CIirFilter::MAX_GAIN_DB = 24.0f;
+const float CIirFilter::MIN_FREQUENCY = 20.0f;
+const float CIirFilter::MIN_Q = 0.1f;
+const float CIirFilter::MAX_Q = 20.0f;
+const float CIirFilter::TOLERANCE_DB = 3.0f;
+
+//Takes the bank of section parameters
+CIirFilter::CIirFilter(const CMorphBank &sections, float sampleRate)
+{
+	m_sampleRate = sampleRate;
+	memset(m_reached, 0, sizeof(m_reached));
+	m_started = false;
+	m_blended.assign(SECTIONS * PARAMETERS, 0.0f);
+	SetSections(sections);
+}
+
+CIirFilter::~CIirFilter()
+{}
+
+//Replaces the bank of section parameters
+void CIirFilter::SetSections(const CMorphBank &sections)
+{
+	m_sections = sections;
+}
+
+/*
+	Each section is the bell H(s) = (s^2 + k A^2 s + 1) / (s^2 + k s + 1), k = 1 / (Q A), at the prewarped frequency
+	w = W / g, with W = tan(pi f / fs) and g = tan(pi f0 / fs). The gain at the centre is A^2 = P. With a = w / Q and
+	re = 1 - w^2 its response is 10 log10((re^2 + P a^2) / (re^2 + a^2 / P)) dB, which the derivatives are taken of.
+	The cascade adds the responses of its sections in dB
+*/
+void CIirFilter::Response(const double *sections, const double *W, float sampleRate, double *response, double *jacobian)
+{
+	const double dB = 10.0 / log(10.0);
+	const int columns = SECTIONS * PARAMETERS;
+	std::fill(response, response + FIT_POINTS, 0.0);
+	for (int s = 0; s < SECTIONS; s++)
+	{
+		const double *section = sections + s * PARAMETERS;
+		double P = pow(10.0, section[0] / 20.0);
+		double f0 = pow(2.0, section[1]);
+		double Q = pow(2.0, section[2]);
+		double g = tan(M_PI * f0 / sampleRate);
+		//Change of w with log2 of the centre frequency, divided by w
+		double dwdu = -(1.0 + g * g) / g * M_PI / sampleRate * f0 * log(2.0);
+		for (int i = 0; i < FIT_POINTS; i++)
+		{
+			double w = W[i] / g;
+			double a = w / Q;
+			double re = 1.0 - w * w;
+			double num = re * re + P * a * a;
+			double den = re * re + a * a / P;
+			response[i] += dB * log(num / den);
+			if (jacobian)
+			{
+				double *row = jacobian + i * columns + s * PARAMETERS;
+				row[0] = 0.5 * (P * a * a / num + a * a / (P * den));
+				row[1] = dB * ((-4.0 * w * re + 2.0 * P * a / Q) / num - (-4.0 * w * re + 2.0 * a / (P * Q)) / den) * w * dwdu;
+				row[2] = -2.0 * dB * log(2.0) * (P * a * a / num - a * a / (P * den));
+			}
+		}
+	}
+}
+
+//Keeps the parameters of a section within their ranges
+void CIirFilter::Limit(double *section, float sampleRate)
+{
+	section[0] = std::min((double)MAX_GAIN_DB, std::max((double)MIN_GAIN_DB, section[0]));
+	section[1] = std::min(log2(0.45 * sampleRate), std::max(log2((double)MIN_FREQUENCY), section[1]));
+	section[2] = std::min(log2((double)MAX_Q), std::max(log2((double)MIN_Q), section[2]));
+}
+
+/*
+	The error at a frequency is the difference of the responses in dB. Where the FIR filter is below MIN_GAIN_DB only a
+	response above it counts, as the sections can't and needn't follow a stopband any deeper. Each iteration solves the
+	damped normal equations (J'J + lambda diag(J'J)) d = J'r, and lambda shrinks while the steps lower the error
+*/
+double CIirFilter::Solve(double *sections, int count, const double *W, const double *target, float sampleRate, int iterations)
+{
+	const int columns = SECTIONS * PARAMETERS;
+	int n = count * PARAMETERS;
+	std::vector<double> response(FIT_POINTS), jacobian(FIT_POINTS * columns), residual(FIT_POINTS);
+	std::vector<double> JtJ(n * n), Jtr(n), M, d;
+	std::vector<double> trial(columns);
+
+	//Squared error of a set of sections, with the residual and the Jacobian of the error when asked for
+	auto error = [&](const double *x, bool derivatives)
+	{
+		Response(x, W, sampleRate, response.data(), derivatives ? jacobian.data() : NULL);
+		double cost = 0.0;
+		for (int i = 0; i < FIT_POINTS; i++)
+		{
+			bool floor = target[i] <= MIN_GAIN_DB;
+			residual[i] = floor ? std::max(response[i] - MIN_GAIN_DB, 0.0) : response[i] - target[i];
+			if (derivatives && floor && residual[i] == 0.0)
+				std::fill(&jacobian[i * columns], &jacobian[i * columns] + columns, 0.0);
+			cost += residual[i] * residual[i];
+		}
+		return cost;
+	};
+
+	double lambda = 1e-2;
+	double cost = error(sections, true);
+	for (int iteration = 0; iteration < iterations; iteration++)
+	{
+		std::fill(JtJ.begin(), JtJ.end(), 0.0);
+		std::fill(Jtr.begin(), Jtr.end(), 0.0);
+		for (int i = 0; i < FIT_POINTS; i++)
+		{
+			const double *row = &jacobian[i * columns];
+			for (int a = 0; a < n; a++)
+			{
+				for (int b = a; b < n; b++)
+					JtJ[a * n + b] += row[a] * row[b];
+				Jtr[a] += row[a] * residual[i];
+			}
+		}
+		for (int a = 0; a < n; a++)
+			for (int b = 0; b < a; b++)
+				JtJ[a * n + b] = JtJ[b * n + a];
+
+		bool improved = false;
+		for (int attempt = 0; attempt < 8 && !improved; attempt++)
+		{
+			M = JtJ;
+			d = Jtr;
+			for (int a = 0; a < n; a++)
+				M[a * n + a] += lambda * JtJ[a * n + a] + 1e-9;
+			if (!CFirDesign::Solve(M, d, n))
+			{
+				lambda *= 4.0;
+				continue;
+			}
+			std::copy(sections, sections + columns, trial.begin());
+			for (int s = 0; s < count; s++)
+			{
+				for (int p = 0; p < PARAMETERS; p++)
+					trial[s * PARAMETERS + p] -= d[s * PARAMETERS + p];
+				Limit(&trial[s * PARAMETERS], sampleRate);
+			}
+			double trialCost = error(trial.data(), false);
+			if (trialCost < cost)
+			{
+				bool converged = trialCost > cost * (1.0 - 1e-3);
+				std::copy(trial.begin(), trial.end(), sections);
+				cost = error(sections, true);
+				lambda *= 0.3;
+				if (converged)
+					return cost;
+				improved = true;
+			}
+			else
+				lambda *= 4.0;
+		}
+		if (!improved)
+			break;
+	}
+	return cost;
+}
+
+/*
+	The target is the magnitude of the FIR filter at FIT_POINTS frequencies from MIN_FREQUENCY to 0.45 fs. Without a
+	neighbouring fit to start from, the sections are placed one at a time where the error of the ones already placed is
+	largest, which is refitted after each. Starting from the neighbour keeps every section moving smoothly across the
+	bank, so the blended sections between two entries stay close to both
+*/
+float CIirFilter::Fit(const float *fir, int taps, float sampleRate, const float *start, float *sections)
+{
+	const int columns = SECTIONS * PARAMETERS;
+	double W[FIT_POINTS], frequencies[FIT_POINTS], target[FIT_POINTS];
+	for (int i = 0; i < FIT_POINTS; i++)
+	{
+		frequencies[i] = MIN_FREQUENCY * pow(0.45 * sampleRate / MIN_FREQUENCY, (double)i / (FIT_POINTS - 1));
+		W[i] = tan(M_PI * frequencies[i] / sampleRate);
+
+		//e^(-j phase n) is rotated one tap at a time
+		double re = 0.0, im = 0.0, c = 1.0, s = 0.0;
+		double stepC = cos(2.0 * M_PI * frequencies[i] / sampleRate), stepS = -sin(2.0 * M_PI * frequencies[i] / sampleRate);
+		for (int j = 0; j < taps; j++)
+		{
+			re += fir[j] * c;
+			im += fir[j] * s;
+			double t = c * stepC - s * stepS;
+			s = c * stepS + s * stepC;
+			c = t;
+		}
+		double magnitude = sqrt(re * re + im * im);
+		target[i] = magnitude > 1e-9 ? 20.0 * log10(magnitude) : MIN_GAIN_DB;
+		target[i] = std::min((double)MAX_GAIN_DB, std::max((double)MIN_GAIN_DB, target[i]));
+	}
+
+	double x[columns];
+	double cost;
+	if (start)
+	{
+		for (int p = 0; p < columns; p++)
+			x[p] = start[p];
+		cost = Solve(x, SECTIONS, W, target, sampleRate, 40);
+	}
+	else
+	{
+		for (int s = 0; s < SECTIONS; s++)
+		{
+			x[s * PARAMETERS] = 0.0;
+			x[s * PARAMETERS + 1] = log2(1000.0);
+			x[s * PARAMETERS + 2] = 0.0;
+		}
+		double response[FIT_POINTS];
+		for (int s = 0; s < SECTIONS; s++)
+		{
+			Response(x, W, sampleRate, response, NULL);
+			int worst = 0;
+			double worstError = 0.0;
+			for (int i = 0; i < FIT_POINTS; i++)
+			{
+				double error = target[i] <= MIN_GAIN_DB ? std::max(response[i] - MIN_GAIN_DB, 0.0) : response[i] - target[i];
+				if (fabs(error) > fabs(worstError))
+				{
+					worst = i;
+					worstError = error;
+				}
+			}
+			x[s * PARAMETERS] = -worstError;
+			x[s * PARAMETERS + 1] = log2(frequencies[worst]);
+			Limit(&x[s * PARAMETERS], sampleRate);
+			Solve(x, s + 1, W, target, sampleRate, 20);
+		}
+		cost = Solve(x, SECTIONS, W, target, sampleRate, 40);
+	}
+
+	for (int p = 0; p < columns; p++)
+		sections[p] = (float)x[p];
+	return (float)sqrt(cost / FIT_POINTS);
+}
+
+//Calculates the prewarped frequency g, the damping k and the mix m1 of every section from their parameters
+void CIirFilter::Coefficients(const float *sections, float *g, float *k, float *m1)
+{
+	for (int s = 0; s < SECTIONS; s++)
+	{
+		const float *section = sections + s * PARAMETERS;
+		float A = powf(10.0f, section[0] / 40.0f);
+		float f = std::min(exp2f(section[1]), 0.45f * m_sampleRate);
+		g[s] = (float)tan(M_PI * f / m_sampleRate);
+		k[s] = 1.0f / (exp2f(section[2]) * A);
+		m1[s] = k[s] * (A * A - 1.0f);
+	}
+}
+
+/*
+	g, k and the mix m1 of each section are interpolated linearly from the start to the end of the block, and the
+	feedback coefficient a1 = 1 / (1 + g (g + k)) is calculated from them on every sample. Every value in between is
+	then a section with a positive frequency and damping, and any of those is a stable state variable filter; m1 only
+	mixes its outputs. The cascade therefore stays stable however fast the controls move
+*/
+void CIirFilter::Process(const float *const *in, float *const *out, unsigned int frames, int channels, const float *controls, bool blend)
+{
+	if (frames == 0)
+		return;
+
+	m_sections.Blend(controls, blend, m_blended.data());
+	if (!m_started)
+	{
+		memcpy(m_reached, m_blended.data(), sizeof(m_reached));
+		m_started = true;
+	}
+
+	float g1[SECTIONS], k1[SECTIONS], m11[SECTIONS];
+	Coefficients(m_reached, m_g, m_k, m_m1);
+	Coefficients(m_blended.data(), g1, k1, m11);
+	memcpy(m_reached, m_blended.data(), sizeof(m_reached));
+
+	for (int s = 0; s < SECTIONS; s++)
+	{
+		m_gStep[s] = (g1[s] - m_g[s]) / frames;
+		m_kStep[s] = (k1[s] - m_k[s]) / frames;
+		m_m1Step[s] = (m11[s] - m_m1[s]) / frames;
+	}
+
+	//Creates the state of the channels that haven't been seen yet
+	int groups = (channels + 3) / 4;
+	if ((int)m_state.size() < groups * SECTIONS * 2 * 4)
+		m_state.resize(groups * SECTIONS * 2 * 4, 0.0f);
+
+	for (int group = 0; group < groups; group++)
+	{
+		int first = group * 4;
+		int lanes = channels - first < 4 ? channels - first : 4;
+		ProcessGroup(in + first, out + first, frames, lanes, &m_state[group * SECTIONS * 2 * 4]);
+	}
+}
+
+/*
+	Simper's trapezoidal state variable filter, as a bell: y = x + m1 * band, with a2 = g a1 and a3 = g a2. The four
+	lanes are four channels, so every section runs once per frame for all of them. The state stays in registers for the
+	whole block
+*/
+void CIirFilter::ProcessGroup(const float *const *in, float *const *out, unsigned int frames, int lanes, float *state)
+{
+	float g[SECTIONS], k[SECTIONS], m1[SECTIONS];
+	memcpy(g, m_g, sizeof(g));
+	memcpy(k, m_k, sizeof(k));
+	memcpy(m1, m_m1, sizeof(m1));
+
+#ifdef IIR_SSE
+	//The unused lanes read silence and write to a spare buffer, so the loop has no per lane branches
+	if (lanes < 4)
+	{
+		if (m_spare.size() < 2 * frames)
+			m_spare.resize(2 * frames);
+		std::fill(m_spare.begin(), m_spare.begin() + frames, 0.0f);
+	}
+	const float *src[4];
+	float *dst[4];
+	for (int c = 0; c < 4; c++)
+	{
+		src[c] = c < lanes ? in[c] : m_spare.data();
+		dst[c] = c < lanes ? out[c] : m_spare.data() + frames;
+	}
+
+	__m128 ic1[SECTIONS], ic2[SECTIONS];
+	for (int s = 0; s < SECTIONS; s++)
+	{
+		ic1[s] = _mm_loadu_ps(&state[s * 8]);
+		ic2[s] = _mm_loadu_ps(&state[s * 8 + 4]);
+	}
+
+	for (unsigned int n = 0; n < frames; n++)
+	{
+		__m128 v0 = _mm_set_ps(src[3][n], src[2][n], src[1][n], src[0][n]);
+
+		for (int s = 0; s < SECTIONS; s++)
+		{
+			g[s] += m_gStep[s];
+			k[s] += m_kStep[s];
+			m1[s] += m_m1Step[s];
+			float a1 = 1.0f / (1.0f + g[s] * (g[s] + k[s]));
+			float a2 = g[s] * a1;
+			__m128 A1 = _mm_set1_ps(a1);
+			__m128 A2 = _mm_set1_ps(a2);
+			__m128 A3 = _mm_set1_ps(g[s] * a2);
+
+			__m128 v3 = _mm_sub_ps(v0, ic2[s]);
+			__m128 v1 = _mm_add_ps(_mm_mul_ps(A1, ic1[s]), _mm_mul_ps(A2, v3));
+			__m128 v2 = _mm_add_ps(ic2[s], _mm_add_ps(_mm_mul_ps(A2, ic1[s]), _mm_mul_ps(A3, v3)));
+			ic1[s] = _mm_sub_ps(_mm_add_ps(v1, v1), ic1[s]);
+			ic2[s] = _mm_sub_ps(_mm_add_ps(v2, v2), ic2[s]);
+
+			v0 = _mm_add_ps(v0, _mm_mul_ps(_mm_set1_ps(m1[s]), v1));
+		}
+
+		float frame[4];
+		_mm_storeu_ps(frame, v0);
+		dst[0][n] = frame[0];
+		dst[1][n] = frame[1];
+		dst[2][n] = frame[2];
+		dst[3][n] = frame[3];
+	}
+
+	for (int s = 0; s < SECTIONS; s++)
+	{
+		_mm_storeu_ps(&state[s * 8], ic1[s]);
+		_mm_storeu_ps(&state[s * 8 + 4], ic2[s]);
+	}
+#else
+	float a1[SECTIONS];
+	for (unsigned int n = 0; n < frames; n++)
+	{
+		for (int s = 0; s < SECTIONS; s++)
+		{
+			g[s] += m_gStep[s];
+			k[s] += m_kStep[s];
+			m1[s] += m_m1Step[s];
+			a1[s] = 1.0f / (1.0f + g[s] * (g[s] + k[s]));
+		}
+		for (int c = 0; c < lanes; c++)
+		{
+			float v0 = in[c][n];
+			for (int s = 0; s < SECTIONS; s++)
+			{
+				float a2 = g[s] * a1[s];
+				float a3 = g[s] * a2;
+				float &ic1 = state[s * 8 + c];
+				float &ic2 = state[s * 8 + 4 + c];
+				float v3 = v0 - ic2;
+				float v1 = a1[s] * ic1 + a2 * v3;
+				float v2 = ic2 + a2 * ic1 + a3 * v3;
+				ic1 = 2.0f * v1 - ic1;
+				ic2 = 2.0f * v2 - ic2;
+				v0 += m1[s] * v1;
+			}
+			out[c][n] = v0;
+		}
+	}
+#endif
+}
+
+//Clears the state of every channel
+void CIirFilter::Reset()
+{
+	std::fill(m_state.begin(), m_state.end(), 0.0f);
+}
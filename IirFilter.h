@@ -0,0 +1,63 @@
+#pragma once
+#include <vector>
+#include "MorphBank.h"
+
+// Alternative engine of the dynamic filter: a cascade of peaking sections fitted to the magnitude response of each FIR
+// filter of a bank, at a fraction of the multiply-adds per sample of a long FIR filter.
+// The sections are topology-preserving state variable filters. The centre frequency, Q and gain of every section are
+// fitted to each entry of the bank, and blended with the controls like the FIR coefficients. They are ramped sample by
+// sample across each block, which keeps the cascade stable and free of zipper noise while the controls change. Up to
+// four channels are filtered at once with SSE.
+class CIirFilter
+{
+public:
+	static const int SECTIONS = 12; // Number of second order sections
+	static const int PARAMETERS = 3; // Gain in dB, log2 of the centre frequency in Hz and log2 of the Q of each section
+	static const float MIN_GAIN_DB; // Range of the fitted gains
+	static const float MAX_GAIN_DB;
+	static const float MIN_FREQUENCY; // Range of the fitted centre frequencies in Hz, the top one is 0.45 fs
+	static const float MIN_Q; // Range of the fitted Q
+	static const float MAX_Q;
+	static const int FIT_POINTS = 160; // Frequencies the fit compares the responses at, spaced logarithmically
+	static const int FIT_TAPS = 23; // Longest FIR filter the sections are fitted to, the sharpest response they follow on every build
+	static const float TOLERANCE_DB; // Largest RMS error of a fit the engine can be used with
+
+	CIirFilter(const CMorphBank &sections, float sampleRate); //Takes the bank of section parameters
+	~CIirFilter(); //Destructor
+
+	//Fits the parameters of the sections (PARAMETERS floats each) to the magnitude response of a FIR filter, starting
+	//from the sections fitted to a neighbouring entry, or from none when start is NULL. Returns the RMS error in dB
+	static float Fit(const float *fir, int taps, float sampleRate, const float *start, float *sections);
+
+	//Filters a block of planar samples with the sections blended from the bank entries around the controls.
+	//in[c] and out[c] hold the frames of channel c. They can be the same buffers
+	void Process(const float *const *in, float *const *out, unsigned int frames, int channels, const float *controls, bool blend);
+	//Replaces the bank of section parameters. The state is kept, so the response glides to the new sections
+	void SetSections(const CMorphBank &sections);
+	//Clears the state of every channel
+	void Reset();
+
+private:
+	//Response in dB of the cascade at the prewarped frequencies W of the fit, with its derivatives by every parameter
+	//when jacobian isn't NULL
+	static void Response(const double *sections, const double *W, float sampleRate, double *response, double *jacobian);
+	//Levenberg-Marquardt iterations on the first count sections, from their current parameters. Returns the squared error
+	static double Solve(double *sections, int count, const double *W, const double *target, float sampleRate, int iterations);
+	//Keeps the parameters of a section within their ranges
+	static void Limit(double *section, float sampleRate);
+	//Calculates the prewarped frequency g, the damping k and the mix m1 of every section from their parameters
+	void Coefficients(const float *sections, float *g, float *k, float *m1);
+	//Runs the cascade over the frames of a group of up to four channels
+	void ProcessGroup(const float *const *in, float *const *out, unsigned int frames, int lanes, float *state);
+
+	CMorphBank m_sections; // Parameters of the sections for every entry of the bank
+	float m_sampleRate;
+	float m_reached[SECTIONS * PARAMETERS]; // The parameters reached at the end of the last block
+	bool m_started; // False until the first block sets the parameters without a ramp
+	std::vector<float> m_blended; // The parameters blended for the current block
+	float m_g[SECTIONS], m_gStep[SECTIONS]; // Prewarped frequency of each section at the start of the block and its change per sample
+	float m_k[SECTIONS], m_kStep[SECTIONS]; // Damping of each section at the start of the block and its change per sample
+	float m_m1[SECTIONS], m_m1Step[SECTIONS]; // Mix of each section at the start of the block and its change per sample
+	std::vector<float> m_state; // Two state variables per section for each group of four channels
+	std::vector<float> m_spare; // Input and output of the unused lanes of the last group
+};
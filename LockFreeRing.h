@@ -0,0 +1,79 @@
+#pragma once
+#include <atomic>
+#include <vector>
+
+// Lock-free ring buffer between one producer thread and one consumer thread, with a power of two capacity.
+// Each side only moves its own counter, so neither ever waits for the other: the producer writes as many items as
+// there is room for and the consumer reads as many as are ready. The counters wrap at 2^32, which the capacity divides.
+template <typename T>
+class CLockFreeRing
+{
+public:
+	CLockFreeRing(unsigned int capacity = 1) { Init(capacity); }
+
+	//Allocates the buffer for at least capacity items and empties it. Neither thread may be using the ring
+	void Init(unsigned int capacity)
+	{
+		unsigned int size = 1;
+		while (size < capacity)
+			size <<= 1;
+		m_data.assign(size, T());
+		m_mask = size - 1;
+		m_head.store(0, std::memory_order_relaxed);
+		m_tail.store(0, std::memory_order_relaxed);
+	}
+
+	//Producer: adds up to count items. Returns the number added, less than count if the ring is full
+	unsigned int Write(const T *items, unsigned int count)
+	{
+		unsigned int tail = m_tail.load(std::memory_order_relaxed);
+		unsigned int head = m_head.load(std::memory_order_acquire);
+		unsigned int room = m_mask + 1 - (tail - head);
+		if (count > room)
+			count = room;
+
+		//Two runs without masking: up to the end of the buffer, then from its start
+		unsigned int start = tail & m_mask;
+		unsigned int first = count < m_mask + 1 - start ? count : m_mask + 1 - start;
+		T *data = m_data.data();
+		for (unsigned int n = 0; n < first; n++)
+			data[start + n] = items[n];
+		for (unsigned int n = first; n < count; n++)
+			data[n - first] = items[n];
+
+		m_tail.store(tail + count, std::memory_order_release);
+		return count;
+	}
+
+	//Consumer: takes up to count items. Returns the number taken, less than count if not enough are ready
+	unsigned int Read(T *items, unsigned int count)
+	{
+		unsigned int head = m_head.load(std::memory_order_relaxed);
+		unsigned int tail = m_tail.load(std::memory_order_acquire);
+		unsigned int ready = tail - head;
+		if (count > ready)
+			count = ready;
+
+		unsigned int start = head & m_mask;
+		unsigned int first = count < m_mask + 1 - start ? count : m_mask + 1 - start;
+		const T *data = m_data.data();
+		for (unsigned int n = 0; n < first; n++)
+			items[n] = data[start + n];
+		for (unsigned int n = first; n < count; n++)
+			items[n] = data[n - first];
+
+		m_head.store(head + count, std::memory_order_release);
+		return count;
+	}
+
+	//Either thread: the items ready to be read, and the room left for writing. The other thread can only make them grow
+	unsigned int getReadable() const { return m_tail.load(std::memory_order_acquire) - m_head.load(std::memory_order_acquire); }
+	unsigned int getWritable() const { return m_mask + 1 - getReadable(); }
+	unsigned int getCapacity() const { return m_mask + 1; }
+
+private:
+	std::vector<T> m_data;
+	unsigned int m_mask; // Capacity - 1
+	std::atomic<unsigned int> m_head; // Items read so far, only moved by the consumer
+	std::atomic<unsigned int> m_tail; // Items written so far, only moved by the producer
+};
@@ -0,0 +1,117 @@
+#include "MappedFile.h"
+
+#ifdef _WIN32
+#include <windows.h>
+#else
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+CMappedFile::CMappedFile()
+{
+	m_data = NULL;
+	m_size = 0;
+	m_file = NULL;
+	m_mapping = NULL;
+}
+
+CMappedFile::~CMappedFile()
+{
+	Close();
+}
+
+//Maps a whole file read-only
+bool CMappedFile::Open(const char *filename)
+{
+	Close();
+#ifdef _WIN32
+	HANDLE file = CreateFileA(filename, GENERIC_READ, FILE_SHARE_READ, NULL, OPEN_EXISTING, FILE_FLAG_SEQUENTIAL_SCAN, NULL);
+	if (file == INVALID_HANDLE_VALUE)
+		return false;
+	LARGE_INTEGER size;
+	if (!GetFileSizeEx(file, &size) || size.QuadPart == 0)
+	{
+		CloseHandle(file);
+		return false;
+	}
+	HANDLE mapping = CreateFileMappingA(file, NULL, PAGE_READONLY, 0, 0, NULL);
+	void *data = mapping ? MapViewOfFile(mapping, FILE_MAP_READ, 0, 0, 0) : NULL;
+	if (!data)
+	{
+		if (mapping)
+			CloseHandle(mapping);
+		CloseHandle(file);
+		return false;
+	}
+	m_file = file;
+	m_mapping = mapping;
+	m_size = (size_t)size.QuadPart;
+#else
+	int fd = open(filename, O_RDONLY);
+	if (fd < 0)
+		return false;
+	struct stat info;
+	if (fstat(fd, &info) != 0 || info.st_size == 0)
+	{
+		close(fd);
+		return false;
+	}
+	void *data = mmap(NULL, (size_t)info.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+	close(fd); //The mapping keeps the file open
+	if (data == MAP_FAILED)
+		return false;
+	m_size = (size_t)info.st_size;
+#endif
+	m_data = (const unsigned char *)data;
+	return true;
+}
+
+//Unmaps the file
+void CMappedFile::Close()
+{
+	if (!m_data)
+		return;
+#ifdef _WIN32
+	UnmapViewOfFile(m_data);
+	CloseHandle((HANDLE)m_mapping);
+	CloseHandle((HANDLE)m_file);
+#else
+	munmap((void *)m_data, m_size);
+#endif
+	m_data = NULL;
+	m_size = 0;
+	m_file = NULL;
+	m_mapping = NULL;
+}
+
+/*
+	Asks the OS to read a range ahead. The range is widened to whole pages and clipped to the file. Where the OS has no
+	such call (Windows before 8) it does nothing, and the pages are read when they are touched
+*/
+void CMappedFile::Prefetch(size_t offset, size_t bytes) const
+{
+	if (!m_data || offset >= m_size)
+		return;
+	if (bytes > m_size - offset)
+		bytes = m_size - offset;
+
+	const size_t page = 4096;
+	size_t start = offset / page * page;
+	bytes += offset - start;
+#ifdef _WIN32
+#if _WIN32_WINNT >= 0x0602
+	WIN32_MEMORY_RANGE_ENTRY range;
+	range.VirtualAddress = (PVOID)(m_data + start);
+	range.NumberOfBytes = bytes;
+	PrefetchVirtualMemory(GetCurrentProcess(), 1, &range, 0);
+#endif
+#else
+	madvise((void *)(m_data + start), bytes, MADV_WILLNEED);
+#endif
+}
+
+//Getters of the class attributes
+const unsigned char *CMappedFile::getData() const { return m_data; }
+size_t CMappedFile::getSize() const { return m_size; }
@@ -0,0 +1,32 @@
+#pragma once
+#include <cstddef>
+
+// A file mapped read-only into memory, so its bytes are read in place instead of being copied into a buffer first.
+// The pages are read from the disk the first time they are touched; Prefetch asks the OS to read a range ahead, so the
+// thread that touches it later doesn't stall on the disk.
+class CMappedFile
+{
+public:
+	CMappedFile(); //Constructor
+	~CMappedFile(); //Unmaps the file
+
+	//Maps a whole file. Returns false if it can't be opened or is empty
+	bool Open(const char *filename);
+	//Unmaps the file. The pointers into it become invalid
+	void Close();
+	//Starts reading bytes bytes from offset into memory and returns without waiting for them
+	void Prefetch(size_t offset, size_t bytes) const;
+
+	//Getters of the class attributes
+	const unsigned char *getData() const;
+	size_t getSize() const;
+
+private:
+	CMappedFile(const CMappedFile &); // Not copyable, the mapping has a single owner
+	CMappedFile &operator=(const CMappedFile &);
+
+	const unsigned char *m_data; // The mapped bytes, NULL when no file is open
+	size_t m_size;
+	void *m_file; // File and mapping handles on Windows
+	void *m_mapping;
+};
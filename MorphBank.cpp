@@ -0,0 +1,187 @@
+#include "MorphBank.h"
+#include <cstring>
+#include <cstdint>
+
+CMorphBank::CMorphBank()
+{
+	m_count = 0;
+	m_length = 0;
+	m_stride = 0;
+}
+
+//The copied storage may be aligned differently, so the entries are copied from aligned position to aligned position
+CMorphBank::CMorphBank(const CMorphBank &other)
+{
+	m_count = 0;
+	m_length = 0;
+	m_stride = 0;
+	*this = other;
+}
+
+CMorphBank &CMorphBank::operator=(const CMorphBank &other)
+{
+	if (this != &other && other.m_count == 0)
+	{
+		//An empty bank stays empty
+		m_storage.clear();
+		m_sizes.clear();
+		m_count = 0;
+		m_length = 0;
+		m_stride = 0;
+	}
+	else if (this != &other)
+	{
+		Init(other.m_sizes, other.m_length);
+		memcpy(Data(), other.Data(), m_count * m_stride * sizeof(float));
+	}
+	return *this;
+}
+
+CMorphBank::~CMorphBank()
+{}
+
+//Lays out the grid and zeroes the entries
+void CMorphBank::Init(const std::vector<int> &sizes, int length)
+{
+	m_sizes = sizes;
+	if (m_sizes.empty())
+		m_sizes.push_back(1);
+	if ((int)m_sizes.size() > MAX_DIMENSIONS)
+		m_sizes.resize(MAX_DIMENSIONS);
+
+	m_count = 1;
+	for (unsigned int d = 0; d < m_sizes.size(); d++)
+	{
+		if (m_sizes[d] < 1)
+			m_sizes[d] = 1;
+		m_count *= m_sizes[d];
+	}
+	m_length = length;
+	m_stride = (length + ALIGNMENT - 1) / ALIGNMENT * ALIGNMENT;
+	m_storage.assign(m_count * m_stride + ALIGNMENT, 0.0f);
+}
+
+//Lays out a grid with the same sizes as another one
+void CMorphBank::Init(const CMorphBank &layout, int length)
+{
+	Init(layout.m_sizes, length);
+}
+
+//The entry below the control and the fractional part, or the nearest entry when blending is off
+void CMorphBank::Locate(float control, int size, bool blend, int &index, float &mix) const
+{
+	int last = size - 1;
+	if (last == 0)
+	{
+		index = 0;
+		mix = 0.0f;
+		return;
+	}
+	if (control < 0.0f)
+		control = 0.0f;
+	if (control > 1.0f)
+		control = 1.0f;
+
+	float position = control * last;
+	index = (int)position;
+	mix = position - index;
+	if (!blend)
+		mix = mix < 0.5f ? 0.0f : 1.0f;
+	if (index >= last)
+	{
+		index = last - 1;
+		mix = 1.0f;
+	}
+}
+
+/*
+	Multilinear interpolation: each of the 2^dimensions corners of the cell around the controls is weighted by the
+	product of (1 - mix) or mix along every dimension. Corners with no weight are skipped, so a control sitting on an
+	entry costs nothing, and the remaining ones are summed in one pass over the coefficients
+*/
+void CMorphBank::Blend(const float *controls, bool blend, float *out) const
+{
+	const float *corners[1 << MAX_DIMENSIONS];
+	float weights[1 << MAX_DIMENSIONS];
+	int used = 0;
+
+	int dimensions = (int)m_sizes.size();
+	int index[MAX_DIMENSIONS];
+	float mix[MAX_DIMENSIONS];
+	for (int d = 0; d < dimensions; d++)
+		Locate(controls[d], m_sizes[d], blend, index[d], mix[d]);
+
+	for (int c = 0; c < (1 << dimensions); c++)
+	{
+		float weight = 1.0f;
+		int entry = 0;
+		int step = 1;
+		for (int d = 0; d < dimensions; d++)
+		{
+			bool upper = (c >> d) & 1;
+			weight *= upper ? mix[d] : 1.0f - mix[d];
+			entry += (index[d] + (upper ? 1 : 0)) * step;
+			step *= m_sizes[d];
+		}
+		if (weight == 0.0f)
+			continue;
+		corners[used] = getEntry(entry);
+		weights[used] = weight;
+		used++;
+	}
+
+	int n = m_length;
+	if (used == 1)
+	{
+		memcpy(out, corners[0], n * sizeof(float));
+	}
+	else if (used == 2)
+	{
+		const float *a = corners[0], *b = corners[1];
+		float wa = weights[0], wb = weights[1];
+		for (int i = 0; i < n; i++)
+			out[i] = wa * a[i] + wb * b[i];
+	}
+	else if (used == 4)
+	{
+		const float *a = corners[0], *b = corners[1], *c = corners[2], *d = corners[3];
+		float wa = weights[0], wb = weights[1], wc = weights[2], wd = weights[3];
+		for (int i = 0; i < n; i++)
+			out[i] = wa * a[i] + wb * b[i] + wc * c[i] + wd * d[i];
+	}
+	else
+	{
+		memset(out, 0, n * sizeof(float));
+		for (int k = 0; k < used; k++)
+		{
+			const float *a = corners[k];
+			float wa = weights[k];
+			for (int i = 0; i < n; i++)
+				out[i] += wa * a[i];
+		}
+	}
+}
+
+//First aligned float of the storage
+float *CMorphBank::Data()
+{
+	uintptr_t address = (uintptr_t)m_storage.data();
+	uintptr_t mask = ALIGNMENT * sizeof(float) - 1;
+	return (float *)((address + mask) & ~mask);
+}
+
+const float *CMorphBank::Data() const
+{
+	return const_cast<CMorphBank *>(this)->Data();
+}
+
+//Entry at a flat index
+float *CMorphBank::getEntry(int index) { return Data() + index * m_stride; }
+const float *CMorphBank::getEntry(int index) const { return Data() + index * m_stride; }
+
+//Getters of the class attributes
+int CMorphBank::getDimensions() const { return (int)m_sizes.size(); }
+int CMorphBank::getSize(int dimension) const { return m_sizes[dimension]; }
+const std::vector<int> &CMorphBank::getSizes() const { return m_sizes; }
+int CMorphBank::getCount() const { return m_count; }
+int CMorphBank::getLength() const { return m_length; }
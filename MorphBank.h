@@ -0,0 +1,49 @@
+#pragma once
+#include <vector>
+
+// Grid of filters indexed by up to MAX_DIMENSIONS controls in [0, 1], e.g. the speed and the depth of the submarine.
+// The entries are stored one after the other in a single aligned block, dimension 0 varying fastest, and each one is
+// padded to a multiple of ALIGNMENT floats. The neighbours of any point are then at fixed strides from each other and
+// blending the two (one control) or four (two controls) nearest entries is a single pass over the coefficients.
+class CMorphBank
+{
+public:
+	static const int MAX_DIMENSIONS = 4;
+	static const int ALIGNMENT = 8; // Every entry starts on a 32 byte boundary
+
+	CMorphBank(); //Constructor
+	CMorphBank(const CMorphBank &other); //Copies the entries to the aligned position of the new storage
+	CMorphBank &operator=(const CMorphBank &other);
+	~CMorphBank(); //Destructor
+
+	//Lays out a grid with sizes[d] entries along dimension d. Every entry is length floats long and zeroed
+	void Init(const std::vector<int> &sizes, int length);
+	//Lays out a grid with the same sizes as another one, with entries of a different length
+	void Init(const CMorphBank &layout, int length);
+	//Blends the entries around the controls (one per dimension) into out, which holds length floats.
+	//With blend false the nearest entry is copied instead
+	void Blend(const float *controls, bool blend, float *out) const;
+
+	//Entry at a flat index, dimension 0 varying fastest
+	float *getEntry(int index);
+	const float *getEntry(int index) const;
+	//Getters of the class attributes
+	int getDimensions() const;
+	int getSize(int dimension) const;
+	const std::vector<int> &getSizes() const;
+	int getCount() const;
+	int getLength() const;
+
+private:
+	//Maps a control to the entry below it along a dimension and the mix with the next one
+	void Locate(float control, int size, bool blend, int &index, float &mix) const;
+	//First aligned float of the storage
+	float *Data();
+	const float *Data() const;
+
+	std::vector<float> m_storage; // The entries, over-allocated so the first one can be aligned
+	std::vector<int> m_sizes; // Entries along each dimension
+	int m_count; // Number of entries
+	int m_length; // Floats of each entry
+	int m_stride; // Distance between consecutive entries, the length rounded up to the alignment
+};
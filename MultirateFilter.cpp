@@ -0,0 +1,227 @@
+#include "MultirateFilter.h"
+#include "FirDesign.h"
+#include <cmath>
+#include <cstring>
+#include <algorithm>
+
+#ifndef M_PI
+#define M_PI 3.14159265358979323846
+#endif
+
+const float CMultirateFilter::PASSBAND_DB = -40.0f;
+const float CMultirateFilter::PASSBAND_FRACTION = 0.8f;
+
+/*
+	The anti-aliasing filter passes PASSBAND_FRACTION of the decimated Nyquist band and stops above it. Entry k of the low
+	rate bank is factor * h[n * factor]: h is band limited to the decimated band, so this has the same response at the
+	low rate
+*/
+CMultirateFilter::CMultirateFilter(const CMorphBank &bank, float sampleRate, int factor)
+{
+	m_factor = factor < 1 ? 1 : factor;
+	m_phase = 0;
+	m_filter = NULL;
+
+	float nyquist = 0.5f * sampleRate / m_factor;
+	band_spec_t spec;
+	spec.bands = { 0.0f, PASSBAND_FRACTION * nyquist, nyquist, 0.5f * sampleRate };
+	spec.desired = { 1.0f, 1.0f, 0.0f, 0.0f };
+	m_antiAlias = CFirDesign::Firls(PHASE_TAPS * m_factor + 1, spec, sampleRate);
+	if (m_antiAlias.empty())
+		m_antiAlias.assign(1, 1.0f);
+
+	SetFilters(bank);
+}
+
+CMultirateFilter::~CMultirateFilter()
+{
+	delete m_filter;
+}
+
+//Picks the largest decimation factor whose band still holds the passband of every filter of a bank
+int CMultirateFilter::ChooseFactor(const CMorphBank &bank, float sampleRate)
+{
+	const int points = 256;
+	float highest = 0.0f;
+	std::vector<double> magnitude(points);
+
+	for (int k = 0; k < bank.getCount(); k++)
+	{
+		const float *h = bank.getEntry(k);
+		double peak = 0.0;
+		for (int p = 0; p < points; p++)
+		{
+			double w = M_PI * p / (points - 1);
+			double re = 0.0, im = 0.0;
+			for (int i = 0; i < bank.getLength(); i++)
+			{
+				re += h[i] * cos(w * i);
+				im -= h[i] * sin(w * i);
+			}
+			magnitude[p] = sqrt(re * re + im * im);
+			peak = std::max(peak, magnitude[p]);
+		}
+
+		//The passband ends at the highest frequency still within PASSBAND_DB of the peak
+		double threshold = peak * pow(10.0, PASSBAND_DB / 20.0);
+		for (int p = points - 1; p >= 0; p--)
+		{
+			if (magnitude[p] >= threshold)
+			{
+				highest = std::max(highest, 0.5f * sampleRate * p / (points - 1));
+				break;
+			}
+		}
+	}
+
+	int factor = 1;
+	while (factor < MAX_FACTOR && highest <= PASSBAND_FRACTION * 0.5f * sampleRate / (factor + 1))
+		factor++;
+
+	//Per input sample the decimator and the interpolator cost about PHASE_TAPS taps each and the low rate filter
+	//taps / factor^2. Short filters are cheaper at the full rate, so they keep it unless decimating halves the work
+	int taps = bank.getLength();
+	if (factor > 1 && 2 * PHASE_TAPS + taps / (factor * factor) > taps / 2)
+		factor = 1;
+	return factor;
+}
+
+//Replaces the filter bank
+void CMultirateFilter::SetFilters(const CMorphBank &bank)
+{
+	int taps = (bank.getLength() + m_factor - 1) / m_factor;
+	m_bank.Init(bank, taps);
+	for (int k = 0; k < bank.getCount(); k++)
+	{
+		const float *h = bank.getEntry(k);
+		float *low = m_bank.getEntry(k);
+		for (int i = 0; i < taps; i++)
+			low[i] = m_factor * h[i * m_factor];
+	}
+
+	if (!m_filter || m_filter->getTaps() != taps)
+	{
+		delete m_filter;
+		m_filter = new CFirFilter(taps);
+	}
+	m_coefficients.assign(taps, 0.0f);
+	m_valid = false; //Forces the filter to be blended on the next block
+}
+
+//Creates the state of the channels that haven't been seen yet
+void CMultirateFilter::AddChannels(int channels)
+{
+	while ((int)m_channels.size() < channels)
+	{
+		channel_t chan;
+		chan.input.Init((int)m_antiAlias.size() - 1, true);
+		chan.low.Init(PHASE_TAPS + 1, true);
+		m_channels.push_back(chan);
+	}
+}
+
+/*
+	Every factor input samples, the one at phase 0 produces a low rate sample:
+	d[m] = sum(j) g[j] x[m * factor - j]
+	After the low rate filter, output n = m * factor + r is made from the filtered samples up to m by phase r of g:
+	y[n] = factor * sum(k) g[k * factor + r] f[m - k]
+*/
+void CMultirateFilter::Process(const float *const *in, float *const *out, unsigned int frames, int channels, const float *controls, bool blend)
+{
+	AddChannels(channels);
+
+	//The bank entries are blended once for the whole block, and only when the controls change
+	int dimensions = m_bank.getDimensions();
+	if (!m_valid || memcmp(controls, m_controls, dimensions * sizeof(float)) != 0)
+	{
+		m_bank.Blend(controls, blend, m_coefficients.data());
+		m_filter->SetCoefficients(m_coefficients);
+		memcpy(m_controls, controls, dimensions * sizeof(float));
+		m_valid = true;
+	}
+
+	int taps = (int)m_antiAlias.size();
+	int history = taps - 1;
+	int lowHistory = PHASE_TAPS + 1;
+
+	//Number of low rate samples the block produces
+	unsigned int count = m_phase == 0 ? (frames + m_factor - 1) / m_factor : (frames + m_phase - 1) / m_factor;
+	m_blocks.resize(channels);
+	for (int c = 0; c < channels; c++)
+	{
+		if (m_channels[c].block.size() < count)
+			m_channels[c].block.resize(count);
+		m_blocks[c] = m_channels[c].block.data();
+	}
+
+	//Decimation
+	for (int c = 0; c < channels; c++)
+	{
+		CRingBuffer<float> &input = m_channels[c].input;
+		input.Reserve(history + frames);
+		input.Write(in[c], frames);
+		const float *window = input.Window(history + frames);
+
+		float *decimated = m_blocks[c];
+		unsigned int m = 0;
+		int phase = m_phase;
+		for (unsigned int i = 0; i < frames; i++)
+		{
+			if (phase == 0)
+			{
+				const float *x = window + history + i;
+				float d = 0.0f;
+				for (int j = 0; j < taps; j++)
+					d += m_antiAlias[j] * x[-j];
+				decimated[m] = d;
+				m++;
+			}
+			phase = phase + 1 == m_factor ? 0 : phase + 1;
+		}
+	}
+
+	//Filtering at the low rate
+	if (count > 0)
+		m_filter->Process(m_blocks.data(), m_blocks.data(), count, channels);
+
+	//Interpolation
+	for (int c = 0; c < channels; c++)
+	{
+		CRingBuffer<float> &lowLine = m_channels[c].low;
+		lowLine.Reserve(lowHistory + count);
+		lowLine.Write(m_blocks[c], count);
+		const float *low = lowLine.Window(lowHistory + count);
+
+		int newest = lowHistory - 1; //Position of the latest low rate sample
+		int phase = m_phase;
+		for (unsigned int i = 0; i < frames; i++)
+		{
+			if (phase == 0)
+				newest++;
+
+			float y = 0.0f;
+			for (int k = 0; k * m_factor + phase < taps; k++)
+				y += m_antiAlias[k * m_factor + phase] * low[newest - k];
+			out[c][i] = m_factor * y;
+
+			phase = phase + 1 == m_factor ? 0 : phase + 1;
+		}
+	}
+
+	m_phase = (int)((m_phase + frames) % m_factor);
+}
+
+//Clears the history of every channel
+void CMultirateFilter::Reset()
+{
+	for (unsigned int c = 0; c < m_channels.size(); c++)
+	{
+		m_channels[c].input.Clear();
+		m_channels[c].low.Clear();
+	}
+	m_filter->Reset();
+	m_phase = 0;
+}
+
+//Getters of the class attributes
+int CMultirateFilter::getFactor() { return m_factor; }
@@ -0,0 +1,58 @@
+#pragma once
+#include <vector>
+#include "MorphBank.h"
+#include "FirFilter.h"
+#include "CircBuffer.h"
+
+// Multirate engine of the dynamic filter for filters that keep only low frequencies.
+// The input is decimated by a polyphase anti-aliasing filter, filtered at the lower rate by the bank decimated to it and
+// interpolated back by the polyphase images of the same anti-aliasing filter. Only the phases that produce output are
+// calculated, so the work per sample drops by about the decimation factor for long filters.
+class CMultirateFilter
+{
+public:
+	static const int MAX_FACTOR = 8; // Largest decimation factor
+	static const int PHASE_TAPS = 16; // Taps of each phase of the anti-aliasing filter
+	static const float PASSBAND_DB; // Level below the peak response that ends the passband of a filter
+	static const float PASSBAND_FRACTION; // Part of the decimated Nyquist band the passband may fill
+
+	CMultirateFilter(const CMorphBank &bank, float sampleRate, int factor); //Decimates the bank and designs the anti-aliasing filter
+	~CMultirateFilter(); //Destructor
+
+	//Picks the largest decimation factor whose band still holds the passband of every filter of a bank.
+	//1 if none, or if the filters are too short for decimating to save work
+	static int ChooseFactor(const CMorphBank &bank, float sampleRate);
+
+	//Filters a block of planar samples with the filter blended from the bank entries around the controls.
+	//in[c] and out[c] hold the frames of channel c. They can be the same buffers
+	void Process(const float *const *in, float *const *out, unsigned int frames, int channels, const float *controls, bool blend);
+	//Replaces the filter bank with one of the same length and decimation factor
+	void SetFilters(const CMorphBank &bank);
+	//Clears the history of every channel
+	void Reset();
+	//Getters of the class attributes
+	int getFactor();
+
+private:
+	// The state of one channel
+	typedef struct
+	{
+		CRingBuffer<float> input; // The last input samples followed by the current block, for the decimator
+		CRingBuffer<float> low; // The last filtered low rate samples followed by the new ones, for the interpolator
+		std::vector<float> block; // The low rate samples of the current block, decimated then filtered in place
+	} channel_t;
+
+	//Creates the state of the channels that haven't been seen yet
+	void AddChannels(int channels);
+
+	int m_factor; // Decimation factor
+	std::vector<float> m_antiAlias; // Anti-aliasing filter, PHASE_TAPS * factor + 1 taps
+	CMorphBank m_bank; // The filter bank decimated to the low rate
+	CFirFilter *m_filter; // Filter of the low rate samples
+	std::vector<float> m_coefficients; // The blended low rate filter
+	float m_controls[CMorphBank::MAX_DIMENSIONS]; // The controls the blended filter was calculated with
+	bool m_valid; // False until the blended filter has been calculated from the current bank
+	std::vector<channel_t> m_channels;
+	std::vector<float *> m_blocks; // The low rate block of every channel, for the low rate filter
+	int m_phase; // Position of the next input sample within its group of factor samples
+};
@@ -0,0 +1,151 @@
+#include "PropagationModel.h"
+#include <math.h>
+
+#if defined(_M_X64) || defined(__x86_64__) || defined(__SSE2__) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#define PROPAGATION_SSE2
+#include <emmintrin.h>
+#endif
+
+//Thorp's high frequency term of sea water is 2.75e-4 dB/km/kHz^2. It is a thousand times stronger here, so emitters a
+//hundred units away are heard as if they were kilometres away: about 10 kHz at 100 units and 3 kHz at 1000 units
+const propagation_medium_t CPropagationModel::WATER = { 1.482f, 2.75e-4f };
+const propagation_medium_t CPropagationModel::AIR = { 0.343f, 1.6e-3f };
+const float CPropagationModel::MAX_CUTOFF = 22000.0f;
+
+// Attenuation at the cutoff, in dB
+static const float CUTOFF_DB = 3.0f;
+// The Doppler shift is clamped to an octave either way, and the speeds towards each other to half the speed of sound
+static const float MIN_PITCH = 0.5f;
+static const float MAX_PITCH = 2.0f;
+static const float MAX_SPEED = 0.5f;
+
+//Starts in water with a min distance of 1
+CPropagationModel::CPropagationModel()
+{
+	m_minDistance = 1.0f;
+	SetMedium(WATER, 1.0f);
+}
+
+CPropagationModel::~CPropagationModel()
+{}
+
+//Allocates the results for capacity emitters
+void CPropagationModel::Reserve(int capacity)
+{
+	if ((int)m_gains.size() >= capacity)
+		return;
+	m_gains.resize(capacity);
+	m_cutoffs.resize(capacity);
+	m_pitches.resize(capacity);
+}
+
+//Sets the medium and the Doppler scale
+void CPropagationModel::SetMedium(const propagation_medium_t &medium, float dopplerScale)
+{
+	m_medium = medium;
+	m_dopplerScale = dopplerScale;
+	//Squared cutoff times the distance, in Hz^2 units. Without absorption it is large enough to always give MAX_CUTOFF
+	m_cutoffScale = medium.absorption > 0.0f ? CUTOFF_DB * 1e6f / medium.absorption : 1e30f;
+}
+
+//Sets the distance up to which an emitter is heard at full volume and unfiltered
+void CPropagationModel::SetMinDistance(float minDistance)
+{
+	m_minDistance = minDistance > 0.0f ? minDistance : 1.0f;
+}
+
+/*
+	The distance d is clamped to the min distance, which gives the inverse rolloff min / d without a branch and keeps the
+	direction to the listener defined. The absorption at f kHz over d units is absorption * f^2 * d dB, so the cutoff where
+	it reaches CUTOFF_DB is sqrt(CUTOFF_DB / (absorption * d)) kHz. The Doppler ratio is (c + vl) / (c - vs), with vs the
+	speed of the emitter towards the listener and vl the speed of the listener towards the emitter
+*/
+void CPropagationModel::Update(const CEmitterTable &emitters, const float *listener, const float *listenerVelocity)
+{
+	int count = emitters.getRange();
+	if (count > (int)m_gains.size())
+		Reserve(count);
+
+	int first = 0;
+#ifdef PROPAGATION_SSE2
+	const float *x = emitters.getX(), *y = emitters.getY(), *z = emitters.getZ();
+	const float *vx = emitters.getVX(), *vy = emitters.getVY(), *vz = emitters.getVZ();
+	float *gains = m_gains.data(), *cutoffs = m_cutoffs.data(), *pitches = m_pitches.data();
+
+	float c = m_medium.speedOfSound;
+	__m128 lx = _mm_set1_ps(listener[0]), ly = _mm_set1_ps(listener[1]), lz = _mm_set1_ps(listener[2]);
+	__m128 lvx = _mm_set1_ps(listenerVelocity[0] * m_dopplerScale);
+	__m128 lvy = _mm_set1_ps(listenerVelocity[1] * m_dopplerScale);
+	__m128 lvz = _mm_set1_ps(listenerVelocity[2] * m_dopplerScale);
+	__m128 minDistance = _mm_set1_ps(m_minDistance);
+	__m128 minDistance2 = _mm_set1_ps(m_minDistance * m_minDistance);
+	__m128 cutoffScale = _mm_set1_ps(m_cutoffScale);
+	__m128 maxCutoff = _mm_set1_ps(MAX_CUTOFF);
+	__m128 speed = _mm_set1_ps(c);
+	__m128 maxSpeed = _mm_set1_ps(MAX_SPEED * c);
+	__m128 minSpeed = _mm_set1_ps(-MAX_SPEED * c);
+	__m128 doppler = _mm_set1_ps(m_dopplerScale);
+	__m128 minPitch = _mm_set1_ps(MIN_PITCH), maxPitch = _mm_set1_ps(MAX_PITCH);
+	for (; first + 4 <= count; first += 4)
+	{
+		__m128 dx = _mm_sub_ps(_mm_loadu_ps(x + first), lx);
+		__m128 dy = _mm_sub_ps(_mm_loadu_ps(y + first), ly);
+		__m128 dz = _mm_sub_ps(_mm_loadu_ps(z + first), lz);
+		__m128 d2 = _mm_add_ps(_mm_add_ps(_mm_mul_ps(dx, dx), _mm_mul_ps(dy, dy)), _mm_mul_ps(dz, dz));
+		__m128 d = _mm_sqrt_ps(_mm_max_ps(d2, minDistance2));
+		__m128 inverse = _mm_div_ps(_mm_set1_ps(1.0f), d);
+
+		_mm_storeu_ps(gains + first, _mm_mul_ps(minDistance, inverse));
+		_mm_storeu_ps(cutoffs + first, _mm_min_ps(maxCutoff, _mm_sqrt_ps(_mm_mul_ps(cutoffScale, inverse))));
+
+		//The offset points from the listener to the emitter
+		__m128 sx = _mm_mul_ps(_mm_loadu_ps(vx + first), doppler);
+		__m128 sy = _mm_mul_ps(_mm_loadu_ps(vy + first), doppler);
+		__m128 sz = _mm_mul_ps(_mm_loadu_ps(vz + first), doppler);
+		__m128 away = _mm_add_ps(_mm_add_ps(_mm_mul_ps(sx, dx), _mm_mul_ps(sy, dy)), _mm_mul_ps(sz, dz));
+		__m128 towards = _mm_add_ps(_mm_add_ps(_mm_mul_ps(lvx, dx), _mm_mul_ps(lvy, dy)), _mm_mul_ps(lvz, dz));
+		__m128 vs = _mm_min_ps(maxSpeed, _mm_sub_ps(_mm_setzero_ps(), _mm_mul_ps(away, inverse)));
+		__m128 vl = _mm_max_ps(minSpeed, _mm_mul_ps(towards, inverse));
+		__m128 pitch = _mm_div_ps(_mm_add_ps(speed, vl), _mm_sub_ps(speed, vs));
+		_mm_storeu_ps(pitches + first, _mm_min_ps(maxPitch, _mm_max_ps(minPitch, pitch)));
+	}
+#endif
+	UpdateScalar(emitters, listener, listenerVelocity, first, count);
+}
+
+//The same calculation one emitter at a time, for the emitters left over and for CPUs without SSE2
+void CPropagationModel::UpdateScalar(const CEmitterTable &emitters, const float *listener, const float *listenerVelocity, int first, int last)
+{
+	const float *x = emitters.getX(), *y = emitters.getY(), *z = emitters.getZ();
+	const float *vx = emitters.getVX(), *vy = emitters.getVY(), *vz = emitters.getVZ();
+	float c = m_medium.speedOfSound;
+	float lvx = listenerVelocity[0] * m_dopplerScale;
+	float lvy = listenerVelocity[1] * m_dopplerScale;
+	float lvz = listenerVelocity[2] * m_dopplerScale;
+
+	for (int i = first; i < last; i++)
+	{
+		float dx = x[i] - listener[0], dy = y[i] - listener[1], dz = z[i] - listener[2];
+		float d2 = dx * dx + dy * dy + dz * dz;
+		float d = sqrtf(d2 > m_minDistance * m_minDistance ? d2 : m_minDistance * m_minDistance);
+		float inverse = 1.0f / d;
+
+		m_gains[i] = m_minDistance * inverse;
+		float cutoff = sqrtf(m_cutoffScale * inverse);
+		m_cutoffs[i] = cutoff < MAX_CUTOFF ? cutoff : MAX_CUTOFF;
+
+		float vs = -(vx[i] * dx + vy[i] * dy + vz[i] * dz) * m_dopplerScale * inverse;
+		float vl = (lvx * dx + lvy * dy + lvz * dz) * inverse;
+		if (vs > MAX_SPEED * c)
+			vs = MAX_SPEED * c;
+		if (vl < -MAX_SPEED * c)
+			vl = -MAX_SPEED * c;
+		float pitch = (c + vl) / (c - vs);
+		m_pitches[i] = pitch < MIN_PITCH ? MIN_PITCH : (pitch > MAX_PITCH ? MAX_PITCH : pitch);
+	}
+}
+
+//Getters of the class attributes
+const float *CPropagationModel::getGains() const { return m_gains.data(); }
+const float *CPropagationModel::getCutoffs() const { return m_cutoffs.data(); }
+const float *CPropagationModel::getPitches() const { return m_pitches.data(); }
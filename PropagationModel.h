@@ -0,0 +1,50 @@
+#pragma once
+#include <vector>
+#include "EmitterTable.h"
+
+// The medium the sound travels through. Distances are in world units and velocities in units per millisecond, the
+// ones of the emitter table
+typedef struct
+{
+	float speedOfSound; // Units per millisecond
+	float absorption; // dB per unit per kHz^2: the high frequency absorption grows with the square of the frequency
+} propagation_medium_t;
+
+// How each emitter is heard from the listener: its distance attenuation, the cutoff of the low pass the absorption of
+// the medium amounts to, and its Doppler pitch ratio. They are calculated for every emitter of the table in one pass over
+// its position and velocity arrays, four emitters at a time with SSE2, and the audio system applies them to the voices
+// as their volume, a low pass filter and their pitch, instead of leaving it to FMOD's 3D engine.
+class CPropagationModel
+{
+public:
+	static const propagation_medium_t WATER; // Sea water, with the absorption scaled up to the distances of the game
+	static const propagation_medium_t AIR; // Air at 20 degrees and 50% humidity
+	static const float MAX_CUTOFF; // Cutoff of an emitter the absorption doesn't filter, in Hz
+
+	CPropagationModel(); //Starts in water with a min distance of 1
+	~CPropagationModel(); //Destructor
+
+	//Allocates the results for capacity emitters, so Update doesn't allocate
+	void Reserve(int capacity);
+	//Sets the medium and how much the speeds of the emitters and of the listener shift their pitch (1 is the physical shift)
+	void SetMedium(const propagation_medium_t &medium, float dopplerScale);
+	//Sets the distance up to which an emitter is heard at full volume and unfiltered
+	void SetMinDistance(float minDistance);
+	//Calculates the results of every emitter of the table for the listener position and velocity (x, y and z)
+	void Update(const CEmitterTable &emitters, const float *listener, const float *listenerVelocity);
+
+	//The results of each emitter, valid until the next Update
+	const float *getGains() const; // Inverse distance rolloff, 1 up to the min distance
+	const float *getCutoffs() const; // Hz, up to MAX_CUTOFF
+	const float *getPitches() const; // Frequency ratio, between 0.5 and 2
+
+private:
+	//Calculates the results of emitters first to last - 1 one at a time
+	void UpdateScalar(const CEmitterTable &emitters, const float *listener, const float *listenerVelocity, int first, int last);
+
+	propagation_medium_t m_medium;
+	float m_dopplerScale;
+	float m_minDistance;
+	float m_cutoffScale; // The squared cutoff in Hz times the distance
+	std::vector<float> m_gains, m_cutoffs, m_pitches;
+};
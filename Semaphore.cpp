@@ -0,0 +1,53 @@
+#include "Semaphore.h"
+
+#ifdef _WIN32
+#include <windows.h>
+#else
+#include <semaphore.h>
+#include <cerrno>
+#endif
+
+//Creates the semaphore with a count of 0
+CSemaphore::CSemaphore()
+{
+#ifdef _WIN32
+	m_semaphore = CreateSemaphoreA(NULL, 0, 0x7fffffff, NULL);
+#else
+	sem_t *semaphore = new sem_t;
+	sem_init(semaphore, 0, 0);
+	m_semaphore = semaphore;
+#endif
+}
+
+CSemaphore::~CSemaphore()
+{
+#ifdef _WIN32
+	CloseHandle((HANDLE)m_semaphore);
+#else
+	sem_destroy((sem_t *)m_semaphore);
+	delete (sem_t *)m_semaphore;
+#endif
+}
+
+//Adds one to the count. Both ReleaseSemaphore and sem_post return straight away
+void CSemaphore::Post()
+{
+#ifdef _WIN32
+	ReleaseSemaphore((HANDLE)m_semaphore, 1, NULL);
+#else
+	sem_post((sem_t *)m_semaphore);
+#endif
+}
+
+//Waits until the count is above 0 and takes one from it. A wait interrupted by a signal is started again
+void CSemaphore::Wait()
+{
+#ifdef _WIN32
+	WaitForSingleObject((HANDLE)m_semaphore, INFINITE);
+#else
+	int result;
+	do
+		result = sem_wait((sem_t *)m_semaphore);
+	while (result != 0 && errno == EINTR);
+#endif
+}
@@ -0,0 +1,21 @@
+#pragma once
+
+// A counting semaphore, for waking a worker thread from the mixer thread. Post never blocks or waits for a lock, unlike
+// notifying a condition variable, whose mutex the worker may be holding.
+class CSemaphore
+{
+public:
+	CSemaphore(); //Creates the semaphore with a count of 0
+	~CSemaphore(); //Destroys it. No thread may be waiting
+
+	//Adds one to the count, waking a thread waiting for it. Never blocks
+	void Post();
+	//Waits until the count is above 0 and takes one from it
+	void Wait();
+
+private:
+	CSemaphore(const CSemaphore &); // Not copyable, the semaphore has a single owner
+	CSemaphore &operator=(const CSemaphore &);
+
+	void *m_semaphore; // HANDLE on Windows, sem_t elsewhere
+};
@@ -0,0 +1,407 @@
+#include "SoundBank.h"
+#include <cctype>
+#include <cstring>
+
+CSoundBank::CSoundBank(CSoundLoader &loader, size_t budget)
+	: m_loader(loader)
+{
+	m_clock = 0;
+	m_budget = budget;
+	m_resident = 0;
+	m_hits = 0;
+	m_misses = 0;
+	m_evictions = 0;
+	m_quit = false;
+	m_thread = std::thread(&CSoundBank::Loader, this);
+}
+
+//The loader thread finishes first, and the sounds it read that Update never took are released with the others
+CSoundBank::~CSoundBank()
+{
+	{
+		std::lock_guard<std::mutex> lock(m_mutex);
+		m_quit = true;
+	}
+	m_wake.notify_one();
+	m_thread.join();
+
+	for (unsigned int r = 0; r < m_reloaded.size(); r++)
+	{
+		if (m_reloaded[r].sound)
+			m_loader.ReleaseSound(m_reloaded[r].sound);
+		delete m_reloaded[r].file;
+	}
+	for (unsigned int h = 0; h < m_sounds.size(); h++)
+		if (m_sounds[h].sound)
+			Unload(m_sounds[h]);
+}
+
+/*
+	Looks the path up first, so a sound asked for again under the same path doesn't even map its file. A new path is
+	mapped and hashed, and only loaded if no sound has the same contents. Equal hashes are only taken as the same file
+	once the bytes compare equal. A known sound that was unloaded is read again, which counts as a miss
+*/
+int CSoundBank::Load(const char *path)
+{
+	std::string key = PathKey(path);
+	std::unordered_map<std::string, int>::iterator known = m_paths.find(key);
+	if (known != m_paths.end())
+	{
+		sound_entry_t &entry = m_sounds[known->second];
+		if (entry.sound)
+			m_hits++;
+		else if (Read(entry))
+			m_misses++;
+		else
+			return -1;
+		entry.refs++;
+		entry.lastPlayed = ++m_clock;
+		Trim();
+		return known->second;
+	}
+
+	CMappedFile *file = new CMappedFile();
+	if (!file->Open(path))
+	{
+		delete file;
+		return -1;
+	}
+	unsigned long long hash = Hash(file->getData(), file->getSize());
+	std::unordered_map<unsigned long long, int>::iterator same = m_hashes.find(hash);
+	if (same != m_hashes.end() && SameContents(m_sounds[same->second], *file))
+	{
+		delete file;
+		int handle = same->second;
+		sound_entry_t &entry = m_sounds[handle];
+		if (entry.sound)
+			m_hits++;
+		else if (Read(entry))
+			m_misses++;
+		else
+			return -1;
+		entry.refs++;
+		entry.lastPlayed = ++m_clock;
+		m_paths[key] = handle;
+		Trim();
+		return handle;
+	}
+
+	sound_entry_t entry;
+	entry.path = path;
+	entry.hash = hash;
+	entry.size = file->getSize();
+	{
+		std::lock_guard<std::mutex> lock(m_createMutex);
+		entry.sound = m_loader.CreateSound(*file, entry.bytes);
+	}
+	if (!entry.sound || !m_loader.PlaysFromFile())
+	{
+		delete file;
+		file = NULL;
+	}
+	if (!entry.sound)
+		return -1;
+	entry.file = file;
+	m_misses++;
+	m_resident += entry.bytes;
+	entry.refs = 1;
+	entry.playing = 0;
+	entry.lastPlayed = ++m_clock;
+	entry.loading = false;
+
+	//The lists Play and Update fill are sized for a request of every sound, so playing doesn't allocate
+	int handle;
+	{
+		std::lock_guard<std::mutex> lock(m_mutex);
+		if (m_free.empty())
+		{
+			handle = (int)m_sounds.size();
+			entry.generation = 0;
+			m_sounds.push_back(entry);
+		}
+		else
+		{
+			handle = m_free.back();
+			m_free.pop_back();
+			entry.generation = m_sounds[handle].generation;
+			m_sounds[handle] = entry;
+		}
+		m_requests.reserve(m_sounds.size());
+		m_reloaded.reserve(m_sounds.size());
+	}
+	m_taken.reserve(m_sounds.size());
+	m_ready.reserve(m_sounds.size());
+	m_paths[key] = handle;
+	m_hashes.insert(std::make_pair(hash, handle));
+	Trim();
+	return handle;
+}
+
+//The last handle frees the slot and forgets every path of the sound, and its hash unless another sound holds it
+void CSoundBank::Release(int handle)
+{
+	if (handle < 0 || handle >= (int)m_sounds.size() || m_sounds[handle].refs == 0)
+		return;
+	sound_entry_t &entry = m_sounds[handle];
+	if (--entry.refs > 0)
+		return;
+
+	if (entry.sound)
+		Unload(entry);
+	for (std::unordered_map<std::string, int>::iterator it = m_paths.begin(); it != m_paths.end();)
+		it = it->second == handle ? m_paths.erase(it) : ++it;
+	std::unordered_map<unsigned long long, int>::iterator same = m_hashes.find(entry.hash);
+	if (same != m_hashes.end() && same->second == handle)
+		m_hashes.erase(same);
+	{
+		std::lock_guard<std::mutex> lock(m_mutex);
+		entry.path.clear();
+		entry.generation++;
+	}
+	entry.loading = false;
+	m_free.push_back(handle);
+}
+
+//An evicted sound is asked for once, and counts one miss however many times it is played before it is back
+void *CSoundBank::Play(int handle)
+{
+	if (handle < 0 || handle >= (int)m_sounds.size() || m_sounds[handle].refs == 0)
+		return NULL;
+	sound_entry_t &entry = m_sounds[handle];
+	if (!entry.sound)
+	{
+		if (!entry.loading)
+		{
+			Request(handle);
+			m_misses++;
+		}
+		return NULL;
+	}
+
+	m_hits++;
+	entry.playing++;
+	entry.lastPlayed = ++m_clock;
+	Trim();
+	return entry.sound;
+}
+
+/*
+	The reloaded sounds are swapped out of the lock, so the loader thread isn't held while they are taken. A read for a
+	slot released since, or a sound Load has read again meanwhile, is dropped. The handle of the second is still listed,
+	as voices may be waiting for it. The budget is enforced by the next Play or Load, so a sound just taken back can't
+	be unloaded before it is played
+*/
+const std::vector<int> &CSoundBank::Update()
+{
+	m_ready.clear();
+	{
+		std::lock_guard<std::mutex> lock(m_mutex);
+		m_taken.swap(m_reloaded);
+	}
+
+	for (unsigned int r = 0; r < m_taken.size(); r++)
+	{
+		reload_t &reload = m_taken[r];
+		sound_entry_t &entry = m_sounds[reload.handle];
+		bool wanted = entry.refs > 0 && entry.generation == reload.generation && entry.loading;
+		if (wanted)
+			entry.loading = false;
+		if (wanted && reload.sound && !entry.sound)
+		{
+			entry.sound = reload.sound;
+			entry.file = reload.file;
+			entry.bytes = reload.bytes;
+			entry.lastPlayed = ++m_clock;
+			m_resident += entry.bytes;
+			m_ready.push_back(reload.handle);
+		}
+		else
+		{
+			if (wanted && entry.sound)
+				m_ready.push_back(reload.handle);
+			if (reload.sound)
+			{
+				m_loader.ReleaseSound(reload.sound);
+				delete reload.file;
+			}
+		}
+	}
+	m_taken.clear();
+
+	return m_ready;
+}
+
+void CSoundBank::Stop(int handle)
+{
+	if (handle >= 0 && handle < (int)m_sounds.size() && m_sounds[handle].playing > 0)
+		m_sounds[handle].playing--;
+}
+
+void CSoundBank::SetBudget(size_t bytes)
+{
+	m_budget = bytes;
+	Trim();
+}
+
+//Maps the file the sound was first loaded from and creates the sound again
+bool CSoundBank::Read(sound_entry_t &entry)
+{
+	if (!Create(entry.path.c_str(), entry.sound, entry.file, entry.bytes))
+		return false;
+	m_resident += entry.bytes;
+	return true;
+}
+
+//Maps a file and creates its sound, keeping the file only if the sound plays from it
+bool CSoundBank::Create(const char *path, void *&sound, CMappedFile *&file, size_t &bytes)
+{
+	sound = NULL;
+	file = new CMappedFile();
+	if (file->Open(path))
+	{
+		std::lock_guard<std::mutex> lock(m_createMutex);
+		sound = m_loader.CreateSound(*file, bytes);
+	}
+	if (!sound || !m_loader.PlaysFromFile())
+	{
+		delete file;
+		file = NULL;
+	}
+	return sound != NULL;
+}
+
+//The slot is marked so it is asked for once. The lists were sized by Load, so this doesn't allocate
+void CSoundBank::Request(int handle)
+{
+	sound_entry_t &entry = m_sounds[handle];
+	entry.loading = true;
+	reload_t reload = { handle, entry.generation, NULL, NULL, 0 };
+	{
+		std::lock_guard<std::mutex> lock(m_mutex);
+		m_requests.push_back(reload);
+	}
+	m_wake.notify_one();
+}
+
+/*
+	Reads one requested sound at a time. The path is copied under the lock, as Load may grow the slots meanwhile, and
+	the file is mapped and decoded without it. A slot released since the request has no path and is reported as failed
+*/
+void CSoundBank::Loader()
+{
+	std::unique_lock<std::mutex> lock(m_mutex);
+	while (true)
+	{
+		m_wake.wait(lock, [this] { return m_quit || !m_requests.empty(); });
+		if (m_quit)
+			return;
+
+		reload_t reload = m_requests.front();
+		m_requests.erase(m_requests.begin());
+		const sound_entry_t &entry = m_sounds[reload.handle];
+		std::string path = entry.generation == reload.generation ? entry.path : std::string();
+		lock.unlock();
+		if (path.empty() || !Create(path.c_str(), reload.sound, reload.file, reload.bytes))
+		{
+			reload.sound = NULL;
+			reload.file = NULL;
+		}
+		lock.lock();
+		m_reloaded.push_back(reload);
+	}
+}
+
+/*
+	A sound that plays from its file still has it mapped, otherwise the file it was loaded from is mapped again. A file
+	that can't be read any more isn't the same
+*/
+bool CSoundBank::SameContents(const sound_entry_t &entry, const CMappedFile &file)
+{
+	if (entry.size != file.getSize())
+		return false;
+	if (entry.file)
+		return memcmp(entry.file->getData(), file.getData(), file.getSize()) == 0;
+
+	CMappedFile original;
+	return original.Open(entry.path.c_str()) && original.getSize() == file.getSize() &&
+		memcmp(original.getData(), file.getData(), file.getSize()) == 0;
+}
+
+//The sound goes before the file it may play from
+void CSoundBank::Unload(sound_entry_t &entry)
+{
+	m_loader.ReleaseSound(entry.sound);
+	delete entry.file;
+	entry.sound = NULL;
+	entry.file = NULL;
+	m_resident -= entry.bytes;
+}
+
+/*
+	A bank holds tens or hundreds of sounds, so the least recently played one is found by a scan instead of keeping a
+	list in order on every play. Playing sounds are never unloaded, so the bank can stay over the budget while they play
+*/
+void CSoundBank::Trim()
+{
+	while (m_resident > m_budget)
+	{
+		int oldest = -1;
+		for (int h = 0; h < (int)m_sounds.size(); h++)
+		{
+			const sound_entry_t &entry = m_sounds[h];
+			if (entry.sound && entry.playing == 0 && (oldest < 0 || entry.lastPlayed < m_sounds[oldest].lastPlayed))
+				oldest = h;
+		}
+		if (oldest < 0)
+			return;
+		Unload(m_sounds[oldest]);
+		m_evictions++;
+	}
+}
+
+//Lower case with forward slashes
+std::string CSoundBank::PathKey(const char *path)
+{
+	std::string key(path);
+	for (unsigned int i = 0; i < key.size(); i++)
+		key[i] = key[i] == '\\' ? '/' : (char)tolower((unsigned char)key[i]);
+	return key;
+}
+
+//64 bit FNV-1a
+unsigned long long CSoundBank::Hash(const unsigned char *data, size_t size)
+{
+	unsigned long long hash = 14695981039346656037ULL;
+	for (size_t i = 0; i < size; i++)
+	{
+		hash ^= data[i];
+		hash *= 1099511628211ULL;
+	}
+	return hash;
+}
+
+//Getters of the class attributes
+sound_bank_stats_t CSoundBank::getStats() const
+{
+	sound_bank_stats_t stats;
+	stats.hits = m_hits;
+	stats.misses = m_misses;
+	stats.evictions = m_evictions;
+	stats.bytesResident = m_resident;
+	stats.budget = m_budget;
+	stats.sounds = 0;
+	stats.residentSounds = 0;
+	for (unsigned int h = 0; h < m_sounds.size(); h++)
+	{
+		if (m_sounds[h].refs > 0)
+			stats.sounds++;
+		if (m_sounds[h].sound)
+			stats.residentSounds++;
+	}
+	return stats;
+}
+
+bool CSoundBank::isLoading(int handle) const
+{
+	return handle >= 0 && handle < (int)m_sounds.size() && m_sounds[handle].loading;
+}
@@ -0,0 +1,134 @@
+#pragma once
+#include <string>
+#include <vector>
+#include <unordered_map>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include "MappedFile.h"
+
+// Creates and releases the sounds of a CSoundBank for the player that plays them (FMOD in the game)
+class CSoundLoader
+{
+public:
+	virtual ~CSoundLoader() {}
+
+	//Creates a sound from the bytes of a file. Sets bytes to the memory the sound keeps resident. Returns NULL if the
+	//file isn't a sound the player can play. Called from the game thread and from the loader thread of the bank, never
+	//from both at once
+	virtual void *CreateSound(const CMappedFile &file, size_t &bytes) = 0;
+	//Releases a sound. The bank never releases a sound that is playing
+	virtual void ReleaseSound(void *sound) = 0;
+	//Whether the sounds play from the bytes of their file, which then stay mapped until they are released
+	virtual bool PlaysFromFile() = 0;
+};
+
+// Counters of a CSoundBank. A lookup is a hit when the sound is resident, a miss when its file has to be read
+typedef struct
+{
+	unsigned int hits;
+	unsigned int misses;
+	unsigned int evictions; // Sounds unloaded to stay within the budget
+	size_t bytesResident; // Memory kept by the resident sounds
+	size_t budget;
+	int sounds; // Sounds with a handle held
+	int residentSounds;
+} sound_bank_stats_t;
+
+// The sounds of the game, loaded once however many times and under whatever paths they are asked for: a path that has
+// been loaded before gets the same handle, and so does a file with the same bytes as a loaded one. Handles
+// are reference counted. The resident sounds are kept within a memory budget by unloading the least recently played
+// ones that aren't playing; a handle stays valid when its sound is unloaded, and the sound is read again the next time
+// it is played. That read runs on a loader thread, so playing never maps or decodes a file on the game thread: Play
+// returns NULL until Update has taken the sound back. Only used from the game thread apart from the loader.
+class CSoundBank
+{
+public:
+	CSoundBank(CSoundLoader &loader, size_t budget); //Creates an empty bank
+	~CSoundBank(); //Unloads every sound
+
+	//Takes a handle to the sound of a file, loading it unless the bank already has it, or reading it again if it was
+	//unloaded. Returns -1 if it can't be loaded
+	int Load(const char *path);
+	//Gives a handle back. The sound is unloaded when the last one is
+	void Release(int handle);
+	//Returns the sound of a handle to start playing it. The sound can't be unloaded until Stop has been called as many
+	//times as Play. An unloaded sound is handed to the loader thread and NULL is returned until Update lists it
+	void *Play(int handle);
+	//Takes the sounds the loader thread has read again. Returns the handles that can be played now, valid until the
+	//next call
+	const std::vector<int> &Update();
+	//One of the voices playing the sound of a handle has stopped
+	void Stop(int handle);
+	//Changes the budget, unloading sounds if they don't fit in it any more
+	void SetBudget(size_t bytes);
+	//Getters of the class attributes
+	sound_bank_stats_t getStats() const;
+	bool isLoading(int handle) const; //Being read again by the loader thread
+
+private:
+	// A sound and where it comes from
+	typedef struct
+	{
+		std::string path; // Path the sound was first loaded from, read again after an eviction
+		unsigned long long hash; // Of the contents of the file
+		size_t size; // Of the file
+		CMappedFile *file; // The file while the sound is resident and plays from it, NULL otherwise
+		void *sound; // Created by the loader, NULL when not resident
+		size_t bytes; // Memory the sound keeps resident
+		int refs; // Handles held, 0 for a free slot
+		int playing; // Voices playing the sound
+		unsigned long long lastPlayed; // Play clock when the sound was last played or loaded
+		bool loading; // Being read again by the loader thread
+		unsigned int generation; // Counts the sounds the slot has held, so a read for a released one is dropped
+	} sound_entry_t;
+
+	// A sound read again by the loader thread
+	typedef struct
+	{
+		int handle;
+		unsigned int generation; // Of the slot when the read was asked for
+		void *sound; // NULL if the read failed
+		CMappedFile *file;
+		size_t bytes;
+	} reload_t;
+
+	//Maps a file and creates its sound. Returns false if either fails
+	bool Read(sound_entry_t &entry);
+	//Maps a file and creates its sound, keeping the file only if the sound plays from it. Returns false if either fails
+	bool Create(const char *path, void *&sound, CMappedFile *&file, size_t &bytes);
+	//Hands an unloaded sound to the loader thread
+	void Request(int handle);
+	//Reads the sounds asked for until the bank is destroyed
+	void Loader();
+	//Whether a mapped file has the same bytes as the file of a sound
+	bool SameContents(const sound_entry_t &entry, const CMappedFile &file);
+	//Releases a sound and its file
+	void Unload(sound_entry_t &entry);
+	//Unloads the least recently played sounds that aren't playing until the resident ones fit in the budget
+	void Trim();
+	//Key of a path: lower case with forward slashes, as paths on Windows are
+	static std::string PathKey(const char *path);
+	//FNV-1a hash of the bytes of a file
+	static unsigned long long Hash(const unsigned char *data, size_t size);
+
+	CSoundLoader &m_loader;
+	std::vector<sound_entry_t> m_sounds; // Indexed by handle
+	std::vector<int> m_free; // Handles of free slots
+	std::unordered_map<std::string, int> m_paths; // Handle of every path a sound has been loaded under
+	std::unordered_map<unsigned long long, int> m_hashes; // Handle of the first sound loaded with each hash
+	unsigned long long m_clock; // Counts plays and loads, for the least recently played order
+	size_t m_budget, m_resident;
+	unsigned int m_hits, m_misses, m_evictions;
+
+	std::vector<reload_t> m_requests; // Sounds for the loader thread to read, oldest first
+	std::vector<reload_t> m_reloaded; // Sounds the loader thread has read, for Update
+	std::vector<reload_t> m_taken; // The reloaded sounds Update works on, swapped with m_reloaded
+	std::vector<int> m_ready; // Result of Update
+	std::thread m_thread; // The loader thread
+	std::mutex m_mutex; // Protects the requests, the reloaded sounds, m_quit, and the growth of m_sounds and the paths and
+	                    // generations of its entries, which the loader thread reads
+	std::mutex m_createMutex; // Held while the loader creates a sound
+	std::condition_variable m_wake; // Wakes the loader thread for a request or to finish
+	bool m_quit; // Tells the loader thread to finish
+};
@@ -1,22 +1,32 @@
 #include "SoundSource.h"
+#include "Audio.h"
 
-CSoundSource::CSoundSource()
+CSoundSource::CSoundSource(CAudio &audio)
 {
-	//Initilises the attributes 
-	m_pos = glm::vec3(0.0f, 0.0f, 0.0f);
-	m_vel = glm::vec3(0.0f);
+	//Adds the emitter, at the origin and at rest
+	m_audio = &audio;
+	m_emitters = &audio.GetEmitters();
+	m_emitter = m_emitters->Add(0.0f, 0.0f, 0.0f);
 }
 
-CSoundSource::~CSoundSource(){}
-
-void CSoundSource::Update(float dt)
+CSoundSource::~CSoundSource()
 {
-	//Changes the position based on the velocity and the amount of time between frames
-	m_pos += m_vel * dt;
+	m_audio->RemoveEmitter(m_emitter);
 }
 
 //Getters and setters of the class attributes 
-void CSoundSource::SetPosition(glm::vec3 pos){ m_pos = pos; }
-glm::vec3 CSoundSource::GetPosition() const { return m_pos; }
-void CSoundSource::SetVelocity(glm::vec3 vel){ m_vel = vel; }
-glm::vec3 CSoundSource::GetVelocity() const{ return m_vel; }
+void CSoundSource::SetPosition(glm::vec3 pos){ m_emitters->SetPosition(m_emitter, pos.x, pos.y, pos.z); }
+glm::vec3 CSoundSource::GetPosition() const
+{
+	glm::vec3 pos;
+	m_emitters->getPosition(m_emitter, glm::value_ptr(pos));
+	return pos;
+}
+void CSoundSource::SetVelocity(glm::vec3 vel){ m_emitters->SetVelocity(m_emitter, vel.x, vel.y, vel.z); }
+glm::vec3 CSoundSource::GetVelocity() const
+{
+	glm::vec3 vel;
+	m_emitters->getVelocity(m_emitter, glm::value_ptr(vel));
+	return vel;
+}
+int CSoundSource::GetEmitter() const { return m_emitter; }
\ No newline at end of file
@@ -1,25 +1,29 @@
 #pragma once
 #include "Common.h"
+#include "EmitterTable.h"
 
-// Holds information useful for a 3d sound effect
+class CAudio;
+
+// Holds information useful for a 3d sound effect. The position and velocity live in the emitter table of the audio
+// system, where every emitter is moved at once and only the ones heard are pushed to FMOD. The audio system removes
+// the emitter, so a sound still playing from it stops and gives its channel back
 class CSoundSource
 {
 public:
 
-	CSoundSource(); //Constructor
-	~CSoundSource(); //Destructor
+	CSoundSource(CAudio &audio); //Constructor: adds an emitter at the origin to the table of the audio system
+	~CSoundSource(); //Destructor: stops the sound of the emitter and removes it
 
 	void SetPosition(glm::vec3 pos);	// Sets the position
 	glm::vec3 GetPosition() const;	// Returns the position
 	void SetVelocity(glm::vec3 vel);	// Sets the velocity
 	glm::vec3 GetVelocity() const;	// Returns the velocity 
-
-	// Updates the position based on velocity and the amount of time between frames
-	void Update(float dt);
+	int GetEmitter() const;	// Returns the index of the emitter in the table
 
 private:
 
-	glm::vec3 m_pos;	// Location vector in world coordinates
-	glm::vec3 m_vel;	// Velocity vector
+	CAudio *m_audio;	// The audio system playing the sounds of the emitter
+	CEmitterTable *m_emitters;	// The table holding the emitter
+	int m_emitter;	// Index of the emitter, whose position moves with its velocity every frame
 
 };
\ No newline at end of file
@@ -0,0 +1,68 @@
+#include "StreamSource.h"
+
+CWavStreamSource::CWavStreamSource()
+{
+	m_format.channels = 0;
+	m_format.sampleRate = 0;
+	m_format.bits = 0;
+	m_format.ieee = false;
+	m_format.data = NULL;
+	m_format.bytes = 0;
+	m_position = 0;
+	m_prefetched = 0;
+}
+
+CWavStreamSource::~CWavStreamSource()
+{}
+
+//Maps a file, reads its header and has the start of the samples read ahead
+bool CWavStreamSource::Open(const char *filename)
+{
+	if (!m_file.Open(filename) || !CWavFile::Parse(m_file.getData(), m_file.getSize(), m_format))
+	{
+		m_file.Close();
+		return false;
+	}
+	return Rewind();
+}
+
+/*
+	Converts the next frames out of the mapping. Whenever the decoder gets within half of READ_AHEAD of the bytes the OS
+	has been asked for, the next READ_AHEAD bytes are asked for
+*/
+unsigned int CWavStreamSource::Decode(float *out, unsigned int frames)
+{
+	size_t frameBytes = (size_t)m_format.channels * (m_format.bits / 8);
+	size_t left = (m_format.bytes - m_position) / frameBytes;
+	if (frames > left)
+		frames = (unsigned int)left;
+
+	size_t offset = m_format.data - m_file.getData();
+	size_t end = m_position + frames * frameBytes;
+	if (end + READ_AHEAD / 2 > m_prefetched && m_prefetched < m_format.bytes)
+	{
+		m_file.Prefetch(offset + m_prefetched, READ_AHEAD);
+		m_prefetched += READ_AHEAD;
+	}
+
+	CWavFile::Convert(m_format, m_format.data + m_position, out, (size_t)frames * m_format.channels);
+	m_position = end;
+	return frames;
+}
+
+//Goes back to the first frame and has it read ahead again
+bool CWavStreamSource::Rewind()
+{
+	if (!m_format.data)
+		return false;
+	m_position = 0;
+	m_prefetched = READ_AHEAD;
+	m_file.Prefetch(m_format.data - m_file.getData(), READ_AHEAD);
+	return true;
+}
+
+//Getters of the source format
+int CWavStreamSource::getChannels() { return m_format.channels; }
+int CWavStreamSource::getSampleRate() { return m_format.sampleRate; }
+unsigned int CWavStreamSource::getFrames() { return m_format.channels > 0 ? (unsigned int)(m_format.bytes / m_format.channels / (m_format.bits / 8)) : 0; }
+const wav_format_t &CWavStreamSource::getFormat() const { return m_format; }
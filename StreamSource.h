@@ -0,0 +1,50 @@
+#pragma once
+#include "MappedFile.h"
+#include "WavFile.h"
+
+// A decoder a CAudioStream pulls interleaved float samples from, on the prefetch thread. A source may take its time
+// (read the disk, decompress), as nothing waits for it but the ring of the stream.
+class CStreamSource
+{
+public:
+	virtual ~CStreamSource() {}
+
+	//Decodes up to frames frames into out. Returns the frames decoded, fewer than frames only at the end of the source
+	virtual unsigned int Decode(float *out, unsigned int frames) = 0;
+	//Goes back to the first frame. Returns false if the source can't
+	virtual bool Rewind() = 0;
+
+	//Getters of the source format. getFrames is 0 when the length isn't known
+	virtual int getChannels() = 0;
+	virtual int getSampleRate() = 0;
+	virtual unsigned int getFrames() = 0;
+};
+
+// A WAVE file read through a memory mapping: the samples are converted straight out of the mapped file, with no read
+// into an intermediate buffer, and the OS is asked to read the next part of the file ahead of the decoder.
+class CWavStreamSource : public CStreamSource
+{
+public:
+	static const unsigned int READ_AHEAD = 1 << 18; // Bytes the OS is asked to read ahead of the decoder
+
+	CWavStreamSource(); //Constructor
+	~CWavStreamSource(); //Destructor
+
+	//Maps a file and reads its header. Returns false if it can't be opened or isn't a supported WAVE file
+	bool Open(const char *filename);
+
+	unsigned int Decode(float *out, unsigned int frames);
+	bool Rewind();
+	int getChannels();
+	int getSampleRate();
+	unsigned int getFrames();
+
+	//The format of the file, whose data points into the mapping
+	const wav_format_t &getFormat() const;
+
+private:
+	CMappedFile m_file;
+	wav_format_t m_format;
+	size_t m_position; // Bytes of the data chunk decoded so far
+	size_t m_prefetched; // Bytes of the data chunk the OS has been asked to read
+};
@@ -0,0 +1,51 @@
+#pragma once
+#include <atomic>
+
+// Lock-free triple buffer between one producer thread and one consumer thread.
+// The producer fills the back slot and publishes it; the consumer picks up the newest published slot whenever it wants.
+// Neither side ever waits for the other, and the consumer always sees a complete snapshot, never a half written one.
+// A slot handed back to the producer holds an older snapshot, so the producer has to write the whole state every time.
+template <typename T>
+class CTripleBuffer
+{
+public:
+	CTripleBuffer()
+		: m_slots()
+	{
+		m_back = 0;
+		m_middle = 1;
+		m_front = 2;
+	}
+
+	//Producer: returns the slot to fill
+	T &Write() { return m_slots[m_back]; }
+
+	//Producer: makes the filled slot the newest snapshot
+	void Publish()
+	{
+		int old = m_middle.exchange(m_back | DIRTY, std::memory_order_acq_rel);
+		m_back = old & INDEX;
+	}
+
+	//Consumer: takes the newest snapshot if one has been published since the last call. Returns true if it changed
+	bool Update()
+	{
+		if ((m_middle.load(std::memory_order_relaxed) & DIRTY) == 0)
+			return false;
+		int old = m_middle.exchange(m_front, std::memory_order_acq_rel);
+		m_front = old & INDEX;
+		return true;
+	}
+
+	//Consumer: returns the snapshot taken by the last Update
+	const T &Read() const { return m_slots[m_front]; }
+
+private:
+	static const int INDEX = 3; // Bits of m_middle holding the slot index
+	static const int DIRTY = 4; // Set in m_middle when it holds a snapshot the consumer hasn't taken
+
+	T m_slots[3];
+	int m_back; // Slot owned by the producer
+	std::atomic<int> m_middle; // Slot in between, plus the DIRTY flag
+	int m_front; // Slot owned by the consumer
+};
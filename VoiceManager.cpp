@@ -0,0 +1,332 @@
+#include "VoiceManager.h"
+#include <algorithm>
+
+const float CVoiceManager::HYSTERESIS = 0.5f;
+const float CVoiceManager::MIN_SCORE = 0.001f;
+
+//Manages voices real voices for the emitters of the table
+CVoiceManager::CVoiceManager(CEmitterTable &emitters, int voices)
+{
+	m_emitters = &emitters;
+	m_voices = voices;
+	m_clock = 0.0;
+	m_minDistance = 1.0f;
+	m_cullDistance = 500.0f;
+	m_inverseCell = 2.0f / m_cullDistance;
+
+	m_voiceEmitter.assign(voices, -1);
+	for (int v = voices - 1; v >= 0; v--)
+		m_freeVoices.push_back(v);
+	m_head.assign(GRID_BUCKETS, -1);
+	m_candidates.reserve(voices);
+	m_stopped.reserve(voices);
+	m_stoppedVoices.reserve(voices);
+	m_started.reserve(voices);
+}
+
+CVoiceManager::~CVoiceManager()
+{}
+
+//Grows the arrays indexed by emitter to emitters emitters
+void CVoiceManager::Grow(int emitters)
+{
+	m_volume.resize(emitters, 0.0f);
+	m_weight2.resize(emitters, 0.0f);
+	m_startTime.resize(emitters, 0.0);
+	m_slot.resize(emitters, -1);
+	m_selected.resize(emitters, 0);
+	m_next.resize(emitters, -1);
+	m_previous.resize(emitters, -1);
+	m_bucket.resize(emitters, 0);
+	m_cells.resize(emitters, 0);
+}
+
+//Allocates room for emitters emitters
+void CVoiceManager::Reserve(int emitters)
+{
+	if (emitters > (int)m_slot.size())
+		Grow(emitters);
+	m_playing.reserve(emitters);
+	m_pendingStops.reserve(emitters);
+	m_pendingVoices.reserve(emitters);
+}
+
+/*
+	The cells are half the cull distance wide, so the listener's cell and the two around it on every axis cover the
+	sphere in which emitters are scored. The playing emitters are put in the cells of the new width, and their scores
+	follow the new minimum distance
+*/
+void CVoiceManager::SetDistances(float minDistance, float cullDistance)
+{
+	float scale = minDistance / m_minDistance;
+	m_minDistance = minDistance;
+	m_cullDistance = cullDistance;
+	m_inverseCell = 2.0f / cullDistance;
+	for (size_t i = 0; i < m_playing.size(); i++)
+	{
+		int e = m_playing[i];
+		m_weight2[e] *= scale * scale;
+		Unlink(e);
+		Link(e, BucketOf(e));
+	}
+}
+
+//Starts the sound of an emitter
+void CVoiceManager::Play(int emitter, float volume, float priority)
+{
+	if (emitter >= (int)m_slot.size())
+		Reserve(2 * (emitter + 1));
+	m_volume[emitter] = volume;
+	m_weight2[emitter] = (volume * priority * m_minDistance) * (volume * priority * m_minDistance);
+	m_startTime[emitter] = m_clock;
+	if (m_slot[emitter] < 0)
+	{
+		m_slot[emitter] = (int)m_playing.size();
+		m_playing.push_back(emitter);
+		Link(emitter, BucketOf(emitter));
+	}
+}
+
+//Stops the sound of an emitter
+void CVoiceManager::Stop(int emitter)
+{
+	if (emitter >= (int)m_slot.size() || m_slot[emitter] < 0)
+		return;
+
+	//The last playing emitter takes its place in the packed list
+	int slot = m_slot[emitter];
+	int moved = m_playing.back();
+	m_playing[slot] = moved;
+	m_slot[moved] = slot;
+	m_playing.pop_back();
+	m_slot[emitter] = -1;
+	Unlink(emitter);
+
+	int voice = m_emitters->getVoice(emitter);
+	if (voice != CEmitterTable::NO_VOICE)
+	{
+		m_pendingStops.push_back(emitter);
+		m_pendingVoices.push_back(voice);
+		Release(emitter);
+	}
+}
+
+/*
+	The table forgets the voice of a removed emitter, so the voice is handed back first. Otherwise it would stay bound to
+	the index, and the next emitter added there would start with it
+*/
+bool CVoiceManager::Remove(int emitter)
+{
+	if (m_emitters->isLive(emitter))
+		Stop(emitter);
+	return m_emitters->Remove(emitter);
+}
+
+//Hands the voice of an emitter back
+void CVoiceManager::Release(int emitter)
+{
+	int voice = m_emitters->getVoice(emitter);
+	m_voiceEmitter[voice] = -1;
+	m_freeVoices.push_back(voice);
+	m_emitters->SetVoice(emitter, CEmitterTable::NO_VOICE);
+}
+
+//Grid cell of a coordinate: rounded towards minus infinity, without a call to floorf
+inline int CVoiceManager::Cell(float coordinate) const
+{
+	float scaled = coordinate * m_inverseCell;
+	int cell = (int)scaled;
+	return cell - (scaled < (float)cell);
+}
+
+//Bucket of a grid cell: its coordinates modulo GRID_SIZE, side by side
+inline unsigned int CVoiceManager::Bucket(int cx, int cy, int cz)
+{
+	const unsigned int mask = GRID_SIZE - 1;
+	return ((unsigned int)cx & mask) | ((unsigned int)cy & mask) << 4 | ((unsigned int)cz & mask) << 8;
+}
+
+//Bucket of the cell of an emitter
+inline unsigned int CVoiceManager::BucketOf(int emitter) const
+{
+	return Bucket(Cell(m_emitters->getX()[emitter]), Cell(m_emitters->getY()[emitter]), Cell(m_emitters->getZ()[emitter]));
+}
+
+//Adds an emitter at the front of the list of a bucket
+void CVoiceManager::Link(int emitter, unsigned int bucket)
+{
+	int head = m_head[bucket];
+	m_next[emitter] = head;
+	m_previous[emitter] = -1;
+	if (head >= 0)
+		m_previous[head] = emitter;
+	m_head[bucket] = emitter;
+	m_bucket[emitter] = bucket;
+}
+
+//Takes an emitter out of the list of its bucket
+void CVoiceManager::Unlink(int emitter)
+{
+	int next = m_next[emitter];
+	int previous = m_previous[emitter];
+	if (previous >= 0)
+		m_next[previous] = next;
+	else
+		m_head[m_bucket[emitter]] = next;
+	if (next >= 0)
+		m_previous[next] = previous;
+}
+
+//A candidate is worse than another one when it scores less: the heap of the best ones keeps the worst on top
+static bool Better(const CVoiceManager::candidate_t &a, const CVoiceManager::candidate_t &b)
+{
+	return a.score > b.score;
+}
+
+/*
+	1. The emitters that moved to another cell are moved to the list of its bucket. Most don't, so it is one pass that
+	   only computes cells.
+	2. The buckets of the cells around the listener are scored. They are five different buckets on each axis, and the
+	   emitters of the cells GRID_SIZE cells away that share them are left out by the cull distance.
+	   The score is the inverse distance rolloff of FMOD (full volume up to the minimum distance, then min / distance)
+	   times the volume and the priority. Its square ranks the emitters the same without a square root.
+	   The best voices candidates are kept in a heap with the worst of them on top, so most emitters cost one comparison.
+	3. The voices change hands: first the real emitters that weren't picked lose theirs, then the picked virtual emitters
+	   take the free ones.
+*/
+void CVoiceManager::Update(float dt, const float *listener)
+{
+	m_clock += dt;
+	m_stopped.assign(m_pendingStops.begin(), m_pendingStops.end());
+	m_stoppedVoices.assign(m_pendingVoices.begin(), m_pendingVoices.end());
+	m_pendingStops.clear();
+	m_pendingVoices.clear();
+	m_started.clear();
+
+	//1. Grid: the buckets of all the emitters in one pass over the position arrays, then the moves of the playing ones
+	const float *x = m_emitters->getX(), *y = m_emitters->getY(), *z = m_emitters->getZ();
+	const int *voices = m_emitters->getVoices();
+	int range = m_emitters->getRange();
+	if ((int)m_slot.size() < range)
+		Grow(range);
+	unsigned int *cells = m_cells.data();
+	float inverseCell = m_inverseCell;
+	for (int e = 0; e < range; e++)
+	{
+		float sx = x[e] * inverseCell, sy = y[e] * inverseCell, sz = z[e] * inverseCell;
+		int cx = (int)sx, cy = (int)sy, cz = (int)sz;
+		cx -= sx < (float)cx;
+		cy -= sy < (float)cy;
+		cz -= sz < (float)cz;
+		cells[e] = Bucket(cx, cy, cz);
+	}
+	const unsigned int *buckets = m_bucket.data();
+	for (int e = 0; e < range; e++)
+	{
+		if (cells[e] != buckets[e] && m_slot[e] >= 0)
+		{
+			Unlink(e);
+			Link(e, cells[e]);
+		}
+	}
+
+	//2. Scores around the listener
+	m_candidates.clear();
+	float cull2 = m_cullDistance * m_cullDistance;
+	float min2 = m_minDistance * m_minDistance;
+	float hysteresis2 = (1.0f + HYSTERESIS) * (1.0f + HYSTERESIS);
+	float threshold2 = MIN_SCORE * MIN_SCORE;
+	int lx = Cell(listener[0]), ly = Cell(listener[1]), lz = Cell(listener[2]);
+	int cursors[SCAN_CELLS];
+	int lists = 0;
+	for (int cx = lx - 2; cx <= lx + 2; cx++)
+		for (int cy = ly - 2; cy <= ly + 2; cy++)
+			for (int cz = lz - 2; cz <= lz + 2; cz++)
+				if (m_head[Bucket(cx, cy, cz)] >= 0)
+					cursors[lists++] = m_head[Bucket(cx, cy, cz)];
+
+	//The lists are walked side by side, one emitter of each at a time, so the loads of their next emitters overlap
+	while (lists > 0)
+	{
+		for (int l = 0; l < lists; l++)
+		{
+			int e = cursors[l];
+			cursors[l] = m_next[e];
+
+			float dx = x[e] - listener[0], dy = y[e] - listener[1], dz = z[e] - listener[2];
+			float distance2 = dx * dx + dy * dy + dz * dz;
+			if (distance2 > cull2)
+				continue;
+			float score2 = m_weight2[e] / (distance2 > min2 ? distance2 : min2);
+			if (voices[e] != CEmitterTable::NO_VOICE)
+				score2 *= hysteresis2;
+			if (score2 < threshold2)
+				continue;
+			candidate_t candidate = { score2, e };
+			if ((int)m_candidates.size() < m_voices)
+			{
+				m_candidates.push_back(candidate);
+				std::push_heap(m_candidates.begin(), m_candidates.end(), Better);
+			}
+			else if (score2 > m_candidates.front().score)
+			{
+				std::pop_heap(m_candidates.begin(), m_candidates.end(), Better);
+				m_candidates.back() = candidate;
+				std::push_heap(m_candidates.begin(), m_candidates.end(), Better);
+			}
+		}
+
+		//The lists that ended are replaced by the last ones
+		for (int l = 0; l < lists; )
+		{
+			if (cursors[l] < 0)
+				cursors[l] = cursors[--lists];
+			else
+				l++;
+		}
+	}
+
+	//3. Voices
+	int chosen = (int)m_candidates.size();
+	for (int i = 0; i < chosen; i++)
+		m_selected[m_candidates[i].emitter] = 1;
+
+	for (int v = 0; v < m_voices; v++)
+	{
+		int e = m_voiceEmitter[v];
+		if (e >= 0 && !m_selected[e])
+		{
+			m_stopped.push_back(e);
+			m_stoppedVoices.push_back(v);
+			Release(e);
+		}
+	}
+	for (int i = 0; i < chosen; i++)
+	{
+		int e = m_candidates[i].emitter;
+		m_selected[e] = 0;
+		if (m_emitters->getVoice(e) == CEmitterTable::NO_VOICE)
+		{
+			int voice = m_freeVoices.back();
+			m_freeVoices.pop_back();
+			m_voiceEmitter[voice] = e;
+			m_emitters->SetVoice(e, voice);
+			m_started.push_back(e);
+		}
+	}
+}
+
+//Results of the last update
+const std::vector<int> &CVoiceManager::getStopped() { return m_stopped; }
+const std::vector<int> &CVoiceManager::getStoppedVoices() { return m_stoppedVoices; }
+const std::vector<int> &CVoiceManager::getStarted() { return m_started; }
+
+//Getters of the emitter attributes
+bool CVoiceManager::isPlaying(int emitter) const { return emitter < (int)m_slot.size() && m_slot[emitter] >= 0; }
+float CVoiceManager::getVolume(int emitter) const { return m_volume[emitter]; }
+double CVoiceManager::getPlayTime(int emitter) const { return m_clock - m_startTime[emitter]; }
+
+//Getters of the class attributes
+int CVoiceManager::getVoices() const { return m_voices; }
+int CVoiceManager::getPlaying() const { return (int)m_playing.size(); }
+int CVoiceManager::getReal() const { return m_voices - (int)m_freeVoices.size(); }
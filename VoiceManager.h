@@ -0,0 +1,102 @@
+#pragma once
+#include <vector>
+#include "EmitterTable.h"
+
+// Decides which of the playing emitters are heard through the real voices (FMOD channels) the mixer can afford.
+// Each playing emitter is scored by its estimated audibility, the inverse distance rolloff of FMOD times its volume and
+// priority, and the best ones get the voices. The others are virtual: they keep playing silently, as the time they
+// started is kept, and take a voice back at the right place in their sound when they become audible enough.
+// The playing emitters are kept in a spatial grid, and only the cells around the listener within the cull distance are
+// scored, so an emitter far away only costs the check of whether it changed cell. The grid wraps around: cells
+// GRID_SIZE cells apart share a bucket, which the cull distance sorts out as it is much shorter.
+// A real voice counts as HYSTERESIS louder than it is, so two emitters of about the same score don't swap every frame.
+class CVoiceManager
+{
+public:
+	static const float HYSTERESIS; // Bonus of the emitters that already have a voice
+	static const float MIN_SCORE; // Audibility below which an emitter isn't worth a voice
+	static const int GRID_SIZE = 16; // The grid wraps around every GRID_SIZE cells on each axis, a power of two
+	static const int GRID_BUCKETS = GRID_SIZE * GRID_SIZE * GRID_SIZE;
+	static const int SCAN_CELLS = 5 * 5 * 5; // The cells scored around the listener
+
+	//A playing emitter around the listener, with its squared score
+	typedef struct
+	{
+		float score;
+		int emitter;
+	} candidate_t;
+
+	CVoiceManager(CEmitterTable &emitters, int voices); //Manages voices real voices for the emitters of the table
+	~CVoiceManager(); //Destructor
+
+	//Allocates room for emitters emitters, so Update doesn't allocate
+	void Reserve(int emitters);
+	//Sets the distance up to which a sound is at full volume, as set in FMOD, and the one beyond which it is culled
+	void SetDistances(float minDistance, float cullDistance);
+
+	//Starts the sound of an emitter. It competes for a voice from the next update
+	void Play(int emitter, float volume, float priority);
+	//Stops the sound of an emitter. Its voice, if it has one, is freed on the next update
+	void Stop(int emitter);
+	//Stops the sound of an emitter and removes it from the emitter table, so its voice is free before the index is
+	//reused. Returns false if the emitter isn't in the table
+	bool Remove(int emitter);
+
+	//Advances the clock by dt milliseconds, scores the playing emitters around the listener and hands out the voices.
+	//The emitters that lost a voice and the ones that got one are listed by getStopped and getStarted
+	void Update(float dt, const float *listener);
+	const std::vector<int> &getStopped(); //Emitters whose voice was taken, with the voice in getStoppedVoices
+	const std::vector<int> &getStoppedVoices();
+	const std::vector<int> &getStarted(); //Emitters given a voice, which the emitter table binds them to
+
+	//Getters of the emitter attributes
+	bool isPlaying(int emitter) const;
+	float getVolume(int emitter) const;
+	double getPlayTime(int emitter) const; //Milliseconds since the sound of the emitter started
+	//Getters of the class attributes
+	int getVoices() const;
+	int getPlaying() const; //Emitters playing, real or virtual
+	int getReal() const; //Emitters with a voice
+
+private:
+	//Grows the arrays indexed by emitter to emitters emitters
+	void Grow(int emitters);
+	//Grid cell of a coordinate
+	int Cell(float coordinate) const;
+	//Bucket of a grid cell
+	static unsigned int Bucket(int cx, int cy, int cz);
+	//Bucket of the cell of an emitter
+	unsigned int BucketOf(int emitter) const;
+	//Adds an emitter to the list of a bucket, and takes it out of its list
+	void Link(int emitter, unsigned int bucket);
+	void Unlink(int emitter);
+	//Hands the voice of an emitter back
+	void Release(int emitter);
+
+	CEmitterTable *m_emitters;
+	int m_voices; // Real voices
+	float m_minDistance, m_cullDistance;
+	float m_inverseCell; // 1 over the width of the grid cells
+	double m_clock; // Milliseconds since the first update
+
+	//Per emitter
+	std::vector<float> m_volume;
+	std::vector<float> m_weight2; // Square of volume x priority x minimum distance: the squared score is it over the squared distance
+	std::vector<double> m_startTime; // Clock when the sound started
+	std::vector<int> m_slot; // Position of each playing emitter in m_playing, -1 when not playing
+	std::vector<unsigned char> m_selected; // Set for the emitters chosen in the current update
+
+	std::vector<int> m_playing; // Playing emitters, packed
+	std::vector<int> m_voiceEmitter; // Emitter of each voice, -1 when free
+	std::vector<int> m_freeVoices; // Voices no emitter uses
+
+	//Grid of the playing emitters: a doubly linked list per bucket
+	std::vector<int> m_head; // First emitter of each bucket, -1 when empty
+	std::vector<int> m_next, m_previous; // Neighbours of each emitter in the list of its bucket
+	std::vector<unsigned int> m_bucket; // Bucket of each playing emitter
+	std::vector<unsigned int> m_cells; // Bucket of the cell of every emitter in the current update
+
+	std::vector<candidate_t> m_candidates; // The best emitters of the current update, as a heap with the worst on top
+	std::vector<int> m_pendingStops, m_pendingVoices; // Emitters stopped since the last update, with their voice
+	std::vector<int> m_stopped, m_stoppedVoices, m_started; // Result of the last update
+};
@@ -0,0 +1,169 @@
+#include "WavFile.h"
+#include "MappedFile.h"
+#include <cstdio>
+#include <cstring>
+
+#ifdef _MSC_VER
+#pragma warning(disable:4996)
+#endif
+
+CWavFile::CWavFile()
+{
+	m_channels = 0;
+	m_sampleRate = 0;
+}
+
+CWavFile::~CWavFile()
+{}
+
+//Little endian readers of the header fields
+static unsigned int ReadU32(const unsigned char *p) { return p[0] | (p[1] << 8) | (p[2] << 16) | ((unsigned int)p[3] << 24); }
+static unsigned int ReadU16(const unsigned char *p) { return p[0] | (p[1] << 8); }
+
+//Reads a file mapped into memory, converting the samples straight out of the mapping
+bool CWavFile::Load(const char *filename)
+{
+	CMappedFile file;
+	wav_format_t format;
+	if (!file.Open(filename) || !Parse(file.getData(), file.getSize(), format))
+		return false;
+
+	m_channels = format.channels;
+	m_sampleRate = format.sampleRate;
+	m_samples.resize(format.bytes / (format.bits / 8));
+	Convert(format, format.data, m_samples.data(), m_samples.size());
+	return true;
+}
+
+//Reads the fmt and data chunks, skipping any other chunk
+bool CWavFile::Parse(const unsigned char *file, size_t size, wav_format_t &format)
+{
+	if (size < 12 || memcmp(file, "RIFF", 4) != 0 || memcmp(file + 8, "WAVE", 4) != 0)
+		return false;
+
+	int type = 0;
+	format.channels = 0;
+	format.sampleRate = 0;
+	format.bits = 0;
+	format.data = NULL;
+	format.bytes = 0;
+	size_t pos = 12;
+	while (pos + 8 <= size)
+	{
+		size_t length = ReadU32(file + pos + 4);
+		const unsigned char *chunk = file + pos + 8;
+		if (length > size - pos - 8)
+			length = size - pos - 8;
+
+		if (memcmp(file + pos, "fmt ", 4) == 0 && length >= 16)
+		{
+			type = ReadU16(chunk);
+			format.channels = ReadU16(chunk + 2);
+			format.sampleRate = ReadU32(chunk + 4);
+			format.bits = ReadU16(chunk + 14);
+			if (type == 0xFFFE && length >= 26)
+				type = ReadU16(chunk + 24); //WAVE_FORMAT_EXTENSIBLE, the format is in the sub format GUID
+		}
+		else if (memcmp(file + pos, "data", 4) == 0)
+		{
+			format.data = chunk;
+			format.bytes = length;
+		}
+		pos += 8 + length + (length & 1);
+	}
+
+	bool pcm = type == 1 && (format.bits == 8 || format.bits == 16 || format.bits == 24 || format.bits == 32);
+	format.ieee = type == 3 && format.bits == 32;
+	if (!format.data || format.channels < 1 || format.sampleRate < 1 || (!pcm && !format.ieee))
+		return false;
+
+	size_t frame = (size_t)format.channels * (format.bits / 8);
+	format.bytes = format.bytes / frame * frame;
+	return true;
+}
+
+//Converts samples to floats, one loop per format
+void CWavFile::Convert(const wav_format_t &format, const unsigned char *in, float *out, size_t count)
+{
+	if (format.ieee)
+		memcpy(out, in, count * sizeof(float)); //Little endian like every platform the game runs on
+	else if (format.bits == 8)
+		for (size_t i = 0; i < count; i++)
+			out[i] = (in[i] - 128) / 128.0f;
+	else if (format.bits == 16)
+		for (size_t i = 0; i < count; i++)
+			out[i] = (short)ReadU16(in + 2 * i) / 32768.0f;
+	else if (format.bits == 24)
+		for (size_t i = 0; i < count; i++)
+		{
+			const unsigned char *p = in + 3 * i; //Three bytes, as the last sample can end the mapped file
+			out[i] = ((int)((p[0] << 8) | (p[1] << 16) | ((unsigned int)p[2] << 24)) >> 8) / 8388608.0f;
+		}
+	else
+		for (size_t i = 0; i < count; i++)
+			out[i] = (int)ReadU32(in + 4 * i) / 2147483648.0f;
+}
+
+//Little endian writers of the header fields
+static void WriteU32(std::vector<unsigned char> &out, unsigned int v) { for (int i = 0; i < 4; i++) out.push_back((v >> (8 * i)) & 0xFF); }
+static void WriteU16(std::vector<unsigned char> &out, unsigned int v) { out.push_back(v & 0xFF); out.push_back((v >> 8) & 0xFF); }
+
+//Writes the samples, as 16 bit PCM or as 32 bit float
+bool CWavFile::Save(const char *filename, bool pcm16)
+{
+	int width = pcm16 ? 2 : 4;
+	unsigned int bytes = (unsigned int)(m_samples.size() * width);
+
+	std::vector<unsigned char> out;
+	out.insert(out.end(), { 'R', 'I', 'F', 'F' });
+	WriteU32(out, 36 + bytes);
+	out.insert(out.end(), { 'W', 'A', 'V', 'E', 'f', 'm', 't', ' ' });
+	WriteU32(out, 16);
+	WriteU16(out, pcm16 ? 1 : 3);
+	WriteU16(out, m_channels);
+	WriteU32(out, m_sampleRate);
+	WriteU32(out, m_sampleRate * m_channels * width);
+	WriteU16(out, m_channels * width);
+	WriteU16(out, 8 * width);
+	out.insert(out.end(), { 'd', 'a', 't', 'a' });
+	WriteU32(out, bytes);
+
+	for (size_t i = 0; i < m_samples.size(); i++)
+	{
+		float s = m_samples[i];
+		if (pcm16)
+		{
+			//Clipped and rounded to the nearest step
+			s = s > 1.0f ? 1.0f : (s < -1.0f ? -1.0f : s);
+			int v = (int)(s * 32767.0f + (s >= 0.0f ? 0.5f : -0.5f));
+			WriteU16(out, (unsigned int)(v & 0xFFFF));
+		}
+		else
+		{
+			unsigned int u;
+			memcpy(&u, &s, sizeof(float));
+			WriteU32(out, u);
+		}
+	}
+
+	FILE *file = fopen(filename, "wb");
+	if (!file)
+		return false;
+	bool ok = fwrite(out.data(), 1, out.size(), file) == out.size();
+	fclose(file);
+	return ok;
+}
+
+//Replaces the samples with a new interleaved block of silence
+void CWavFile::Create(int channels, int sampleRate, unsigned int frames)
+{
+	m_channels = channels;
+	m_sampleRate = sampleRate;
+	m_samples.assign((size_t)frames * channels, 0.0f);
+}
+
+//Getters of the class attributes
+std::vector<float> &CWavFile::getSamples() { return m_samples; }
+int CWavFile::getChannels() { return m_channels; }
+int CWavFile::getSampleRate() { return m_sampleRate; }
+unsigned int CWavFile::getFrames() { return m_channels > 0 ? (unsigned int)(m_samples.size() / m_channels) : 0; }
@@ -0,0 +1,46 @@
+#pragma once
+#include <vector>
+#include <cstddef>
+
+// Format of a RIFF WAVE file and where its samples are, found in the bytes of the file
+typedef struct
+{
+	int channels;
+	int sampleRate;
+	int bits; // Bits per sample
+	bool ieee; // 32 bit float samples instead of integer PCM
+	const unsigned char *data; // The data chunk, inside the bytes that were parsed
+	size_t bytes; // Size of the data chunk, cut to whole frames
+} wav_format_t;
+
+// A RIFF WAVE file held in memory as interleaved float samples.
+// Reads 8, 16, 24 and 32 bit PCM and 32 bit float files, and writes 16 bit PCM or 32 bit float ones.
+class CWavFile
+{
+public:
+	CWavFile(); //Constructor
+	~CWavFile(); //Destructor
+
+	//Reads a file. Returns false if it can't be opened or isn't a supported WAVE file
+	bool Load(const char *filename);
+	//Writes the samples, as 16 bit PCM or as 32 bit float
+	bool Save(const char *filename, bool pcm16);
+	//Replaces the samples with a new interleaved block
+	void Create(int channels, int sampleRate, unsigned int frames);
+
+	//Finds the format and the samples in the bytes of a file. Returns false if it isn't a supported WAVE file
+	static bool Parse(const unsigned char *file, size_t size, wav_format_t &format);
+	//Converts count samples of a format, starting at in, to floats in [-1, 1]
+	static void Convert(const wav_format_t &format, const unsigned char *in, float *out, size_t count);
+
+	//Getters of the class attributes
+	std::vector<float> &getSamples();
+	int getChannels();
+	int getSampleRate();
+	unsigned int getFrames();
+
+private:
+	std::vector<float> m_samples; // Interleaved samples in [-1, 1]
+	int m_channels;
+	int m_sampleRate;
+};
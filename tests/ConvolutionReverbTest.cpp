@@ -0,0 +1,122 @@
+// Checks the convolution reverb against a direct convolution with its impulse response, that the mixer thread doesn't
+// allocate once the reverb is prepared for its block size, and that blocks handed over faster than the background
+// thread calculates the tail are dropped and counted rather than waited for.
+//
+// Usage: ConvolutionReverbTest
+#include <cstdio>
+#include <cstdlib>
+#include <cmath>
+#include <new>
+#include <chrono>
+#include <thread>
+#include <vector>
+#include "../ConvolutionReverb.h"
+
+static const int SAMPLE_RATE = 44100;
+static const int LENGTH = 30000; // Reaches the tail segment, which starts at 16384
+static const unsigned int BLOCK = 512;
+static const double MIN_RATIO_DB = 100.0; // Signal to error ratio the paced reverb must reach
+
+//Allocations made by the calling thread, counted by the operator new of this test
+static thread_local unsigned long long allocations = 0;
+
+void *operator new(size_t size)
+{
+	allocations++;
+	void *p = malloc(size ? size : 1);
+	if (p == NULL)
+		throw std::bad_alloc();
+	return p;
+}
+
+void operator delete(void *p) noexcept
+{
+	free(p);
+}
+
+//The sized delete must free with malloc's free as well, or AddressSanitizer reports a mismatch
+void operator delete(void *p, size_t) noexcept
+{
+	free(p);
+}
+
+//Uniform random number in [-1, 1]
+static float Random()
+{
+	return 2.0f * rand() / RAND_MAX - 1.0f;
+}
+
+int main()
+{
+	int failures = 0;
+	srand(1);
+
+	std::vector< std::vector<float> > ir = CConvolutionReverb::GenerateUnderwaterIR(SAMPLE_RATE, 1.0f, 2);
+	for (unsigned int c = 0; c < ir.size(); c++)
+		ir[c].resize(LENGTH);
+	int frames = SAMPLE_RATE;
+	std::vector<float> in(2 * frames), out(2 * frames);
+	for (size_t i = 0; i < in.size(); i++)
+		in[i] = Random();
+
+	//Paced like the mixer, so the background thread always has the time of a tail block
+	{
+		CConvolutionReverb reverb(ir);
+		reverb.Prepare(BLOCK);
+		unsigned long long before = allocations;
+		for (int done = 0; done < frames; done += BLOCK)
+		{
+			unsigned int n = frames - done < (int)BLOCK ? frames - done : BLOCK;
+			reverb.Process(&in[2 * done], &out[2 * done], n, 2, 1.0f, 0.0f);
+			std::this_thread::sleep_for(std::chrono::milliseconds(1));
+		}
+		unsigned long long allocated = allocations - before;
+
+		double signal = 0.0, error = 0.0;
+		for (int c = 0; c < 2; c++)
+		{
+			for (int n = 0; n < frames; n++)
+			{
+				double reference = 0.0;
+				for (int k = 0; k < LENGTH && k <= n; k++)
+					reference += ir[c][k] * in[2 * (n - k) + c];
+				signal += reference * reference;
+				error += (out[2 * n + c] - reference) * (out[2 * n + c] - reference);
+			}
+		}
+		double ratio = 10.0 * log10(signal / error);
+		printf("Paced: %.1f dB signal to error, %u misses, %llu allocations\n", ratio, reverb.getMisses(), allocated);
+		if (ratio < MIN_RATIO_DB || reverb.getMisses() > 0 || allocated > 0)
+		{
+			printf("FAIL paced reverb\n");
+			failures++;
+		}
+	}
+
+	//Tail blocks handed over back to back: the background thread falls behind, and Process must still return
+	{
+		CConvolutionReverb reverb(ir);
+		reverb.Prepare(CConvolutionReverb::TAIL_BLOCK);
+		int blocks = 0;
+		for (int repeat = 0; repeat < 20; repeat++)
+		{
+			for (int done = 0; done + CConvolutionReverb::TAIL_BLOCK <= frames; done += CConvolutionReverb::TAIL_BLOCK)
+			{
+				reverb.Process(&in[2 * done], &out[2 * done], CConvolutionReverb::TAIL_BLOCK, 2, 1.0f, 0.0f);
+				blocks++;
+			}
+		}
+		bool finite = true;
+		for (size_t i = 0; i < out.size(); i++)
+			finite = finite && std::isfinite(out[i]);
+		printf("Unpaced: %d tail blocks, %u dropped\n", blocks, reverb.getMisses());
+		if (!finite)
+		{
+			printf("FAIL unpaced reverb\n");
+			failures++;
+		}
+	}
+
+	printf(failures ? "%d checks failed\n" : "The reverb matches the direct convolution\n", failures);
+	return failures ? 1 : 0;
+}
@@ -0,0 +1,80 @@
+// Checks every FIR kernel the CPU supports against the scalar reference kernel, across filter lengths and block lengths
+// that leave every remainder of the vector loops. The vector kernels add the products in another order (and fused, with FMA), so
+// the outputs are compared with a tolerance rather than bit for bit.
+//
+// Usage: FirKernelTest [tolerance]
+#include <cstdio>
+#include <cstdlib>
+#include <cmath>
+#include <vector>
+#include "../FirKernels.h"
+
+//Largest difference allowed from the scalar kernel. The coefficients are normalised so no output exceeds 1
+static const double DEFAULT_TOLERANCE = 1e-5;
+
+static const FirIsa ISAS[] = { FIR_ISA_SSE2, FIR_ISA_AVX2, FIR_ISA_AVX512 };
+static const char *ISA_NAMES[] = { "Scalar", "SSE2", "AVX2", "AVX-512" };
+static const int TAPS[] = { 1, 2, 3, 4, 5, 7, 8, 9, 15, 16, 17, 31, 32, 33, 63, 64, 65, 127, 256, 1024, 4096 };
+static const unsigned int LENGTHS[] = { 1, 3, 4, 5, 8, 15, 16, 17, 31, 32, 33, 63, 64, 65, 127, 256, 1000, 1024 };
+
+//Uniform random number in [-1, 1]
+static float Random()
+{
+	return 2.0f * rand() / RAND_MAX - 1.0f;
+}
+
+//Returns the largest difference of a kernel from the scalar one on a random filter and input
+static double Compare(FirKernelFunc kernel, int taps, unsigned int frames)
+{
+	std::vector<float> h(taps), x(taps - 1 + frames), y(frames), reference(frames);
+	double sum = 0.0;
+	for (int j = 0; j < taps; j++)
+	{
+		h[j] = Random();
+		sum += fabs(h[j]);
+	}
+	for (int j = 0; j < taps; j++)
+		h[j] = (float)(h[j] / sum);
+	for (size_t i = 0; i < x.size(); i++)
+		x[i] = Random();
+
+	CFirKernels::Scalar(x.data(), h.data(), taps, reference.data(), frames);
+	kernel(x.data(), h.data(), taps, y.data(), frames);
+	double error = 0.0;
+	for (unsigned int n = 0; n < frames; n++)
+		error = fmax(error, fabs((double)y[n] - reference[n]));
+	return error;
+}
+
+int main(int argc, char **argv)
+{
+	double tolerance = argc > 1 ? atof(argv[1]) : DEFAULT_TOLERANCE;
+	FirIsa best = CFirKernels::DetectIsa();
+	int failures = 0;
+	srand(1);
+
+	for (int i = 0; i < (int)(sizeof(ISAS) / sizeof(ISAS[0])) && ISAS[i] <= best; i++)
+	{
+		CFirKernels::Select(ISAS[i]);
+		double worst = 0.0;
+		for (int t = 0; t < (int)(sizeof(TAPS) / sizeof(TAPS[0])); t++)
+		{
+			for (int l = 0; l < (int)(sizeof(LENGTHS) / sizeof(LENGTHS[0])); l++)
+			{
+				double error = Compare(CFirKernels::Get(), TAPS[t], LENGTHS[l]);
+				worst = fmax(worst, error);
+				if (error > tolerance)
+				{
+					printf("FAIL %s kernel, %d taps, %u frames: error %.3g\n", ISA_NAMES[ISAS[i]], TAPS[t], LENGTHS[l], error);
+					failures++;
+				}
+			}
+		}
+		printf("%-8s largest error %.3g\n", ISA_NAMES[ISAS[i]], worst);
+	}
+
+	if (best == FIR_ISA_SCALAR)
+		printf("No vector kernel is supported by this CPU\n");
+	printf(failures ? "%d comparisons failed\n" : "All kernels match the scalar one\n", failures);
+	return failures ? 1 : 0;
+}
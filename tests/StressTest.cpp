@@ -0,0 +1,632 @@
+// Stress tests of the classes shared between threads: each case runs the threads that use a class in the game against
+// each other, in a loop, and checks the results. Build with -DSANITIZE=thread (or address) for the sanitizer to check
+// the accesses as well.
+//
+// Usage: StressTest case
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <cmath>
+#include <new>
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <random>
+#include <thread>
+#include <vector>
+#include "../FilterDsp.h"
+#include "../FilterDspPool.h"
+#include "../FirDesign.h"
+#include "../SoundBank.h"
+#include "../AudioStream.h"
+#include "../AdpcmSample.h"
+
+//Allocations made by the calling thread, counted by the operator new of this test
+static thread_local unsigned long long allocations = 0;
+
+void *operator new(size_t size)
+{
+	allocations++;
+	void *p = malloc(size ? size : 1);
+	if (p == NULL)
+		throw std::bad_alloc();
+	return p;
+}
+
+void operator delete(void *p) noexcept
+{
+	free(p);
+}
+
+//The sized delete must free with malloc's free as well, or AddressSanitizer reports a mismatch
+void operator delete(void *p, size_t) noexcept
+{
+	free(p);
+}
+
+//The specifications of the music bank, as in CAudio
+static const band_spec_t FIR1_SPEC{ { 0, 2000, 2600, 2900, 3500, 22050 }, { 0, 0, 1, 1, 0, 0 }, {} };
+static const band_spec_t FIR2_SPEC{ { 0, 100, 700, 1000, 1600, 22050 }, { 1, 0, 1, 0, 1, 0 }, {} };
+
+//Returns false and prints the check if it failed
+static bool Check(bool passed, const char *check)
+{
+	if (!passed)
+		printf("FAIL %s\n", check);
+	return passed;
+}
+
+/*
+	The game thread replaces the bank, the mode and the controls of a filter DSP while the mixer thread reads blocks.
+	The mixer thread must not allocate, and its output must stay finite
+*/
+static bool FilterDsp()
+{
+	CFilterBank shortBank, longBank;
+	shortBank.Build(16, FIR1_SPEC, FIR2_SPEC, 44100.0f, 8);
+	longBank.Build(255, FIR1_SPEC, FIR2_SPEC, 44100.0f, 8);
+	CFilterDsp dsp(shortBank, FILTER_MODE_FIR);
+	dsp.Prepare(512, 2);
+
+	std::atomic<bool> stop(false);
+	unsigned long long mixerAllocations = 0;
+	bool finite = true;
+	long blocks = 0;
+	std::thread mixer([&]
+	{
+		std::vector<float> in(1024, 0.1f), out(1024);
+		unsigned long long before = allocations;
+		while (!stop.load(std::memory_order_relaxed))
+		{
+			dsp.Read(in.data(), out.data(), 512, 2, 2);
+			for (int i = 0; i < 1024; i++)
+				finite = finite && std::isfinite(out[i]);
+			blocks++;
+		}
+		mixerAllocations = allocations - before;
+	});
+
+	for (int i = 0; i < 300; i++)
+	{
+		dsp.SetBank(i & 1 ? shortBank : longBank);
+		dsp.SetMode(i % 3);
+		dsp.SetControl(0, (i % 10) / 10.0f);
+	}
+	stop.store(true, std::memory_order_relaxed);
+	mixer.join();
+
+	printf("%ld blocks read while 300 banks and modes were set, %llu allocations on the mixer thread\n", blocks, mixerAllocations);
+	return Check(mixerAllocations == 0, "no allocation on the mixer thread") & Check(finite, "finite output");
+}
+
+//Renders the same blocks of a test signal with a filter DSP, at control 0
+static std::vector<float> Render(CFilterDsp &dsp, int blocks)
+{
+	std::vector<float> in(1024), out(1024 * blocks);
+	for (int b = 0; b < blocks; b++)
+	{
+		for (int i = 0; i < 1024; i++)
+			in[i] = sinf(0.05f * (b * 1024 + i)) + 0.5f * sinf(0.31f * (b * 1024 + i));
+		dsp.Read(in.data(), &out[b * 1024], 512, 2, 2);
+	}
+	return out;
+}
+
+/*
+	Four threads take states from the pool, replace their bank and mode, filter a few blocks with them and give them
+	back, as the create and release callbacks of DSPs on different threads would. Once every state is back, each one
+	must render the same as a state created fresh: no engine built for another bank or mode, no control and no history
+	may survive a release
+*/
+static bool FilterDspPool()
+{
+	CFilterBank shortBank, longBank;
+	shortBank.Build(16, FIR1_SPEC, FIR2_SPEC, 44100.0f, 8);
+	longBank.Build(255, FIR1_SPEC, FIR2_SPEC, 44100.0f, 8);
+	CFilterDspPool pool;
+	pool.Init(shortBank, FILTER_MODE_FIR, 512, 2);
+
+	CFilterDsp fresh(shortBank, FILTER_MODE_FIR);
+	fresh.Prepare(512, 2);
+	std::vector<float> expected = Render(fresh, 4);
+
+	const int rounds = 100;
+	std::atomic<int> empty(0);
+	std::atomic<bool> start(false);
+	std::vector<std::thread> threads;
+	for (int t = 0; t < 4; t++)
+	{
+		threads.push_back(std::thread([&, t]
+		{
+			while (!start.load(std::memory_order_acquire))
+				std::this_thread::yield();
+			for (int i = 0; i < rounds; i++)
+			{
+				CFilterDsp *dsp = pool.Acquire();
+				if (dsp == NULL)
+				{
+					empty++;
+					continue;
+				}
+				if ((i + t) % 4 != 0)
+					dsp->SetBank(longBank);
+				dsp->SetMode((i + t) % 3);
+				dsp->SetControl(0, 0.1f * (i % 10));
+				dsp->SetControl(1, 0.5f);
+				Render(*dsp, 2);
+				pool.Release(dsp);
+			}
+		}));
+	}
+	start.store(true, std::memory_order_release);
+	for (size_t t = 0; t < threads.size(); t++)
+		threads[t].join();
+
+	bool allFree = pool.getFree() == CFilterDspPool::CAPACITY;
+	int different = 0;
+	std::vector<CFilterDsp *> states;
+	while (CFilterDsp *dsp = pool.Acquire())
+	{
+		if (Render(*dsp, 4) != expected)
+			different++;
+		states.push_back(dsp);
+	}
+	for (size_t i = 0; i < states.size(); i++)
+		pool.Release(states[i]);
+
+	printf("%d states taken and released from 4 threads (%d times the pool was empty), %d of %d states render differently from a fresh one\n",
+		4 * rounds - empty.load(), empty.load(), different, (int)states.size());
+	return Check(allFree, "every state back in the pool") & Check(states.size() == CFilterDspPool::CAPACITY, "every state taken again") &
+		Check(different == 0, "released states render as fresh ones");
+}
+
+/*
+	Four threads design the same filters while one of them keeps clearing the cache of designs, so lookups, insertions
+	and clears of the same entries overlap. Every design must come out the same as when it is designed alone
+*/
+static bool FirDesign()
+{
+	const int designs = 50;
+	const int rounds = 200;
+	std::vector<band_spec_t> specs(designs);
+	std::vector< std::vector<float> > expected(designs);
+	for (int k = 0; k < designs; k++)
+	{
+		specs[k].bands = { 0.0f, 1000.0f + 20.0f * k, 2000.0f + 20.0f * k, 22050.0f };
+		specs[k].desired = { 1.0f, 1.0f, 0.0f, 0.0f };
+		expected[k] = CFirDesign::Firls(31, specs[k], 44100.0f);
+	}
+
+	std::atomic<int> mismatches(0);
+	std::atomic<bool> start(false);
+	std::vector<std::thread> threads;
+	for (int t = 0; t < 4; t++)
+	{
+		threads.push_back(std::thread([&, t]
+		{
+			while (!start.load(std::memory_order_acquire))
+				std::this_thread::yield();
+			for (int i = 0; i < rounds * designs; i++)
+			{
+				int k = (i * (t + 1)) % designs;
+				if (CFirDesign::Firls(31, specs[k], 44100.0f) != expected[k])
+					mismatches++;
+				if (t == 0 && i % 25 == 0)
+					CFirDesign::ClearCache();
+			}
+		}));
+	}
+	start.store(true, std::memory_order_release);
+	for (size_t t = 0; t < threads.size(); t++)
+		threads[t].join();
+
+	printf("%d designs from 4 threads, %d different from the design alone\n", 4 * rounds * designs, mismatches.load());
+	return Check(mismatches == 0, "the same designs from every thread");
+}
+
+// Sounds of the sound bank cases: a copy of the bytes of their file, counted so none is leaked
+class CTestSoundLoader : public CSoundLoader
+{
+public:
+	CTestSoundLoader() : m_live(0) {}
+
+	void *CreateSound(const CMappedFile &file, size_t &bytes)
+	{
+		bytes = file.getSize();
+		m_live++;
+		return new std::vector<unsigned char>(file.getData(), file.getData() + file.getSize());
+	}
+	void ReleaseSound(void *sound)
+	{
+		delete (std::vector<unsigned char> *)sound;
+		m_live--;
+	}
+	bool PlaysFromFile() { return false; }
+	int getLive() const { return m_live.load(); }
+
+private:
+	std::atomic<int> m_live; // Sounds created and not released yet
+};
+
+//Writes sound files of size bytes with different contents and returns their paths
+static std::vector<std::string> WriteSounds(int count, size_t size)
+{
+	std::vector<std::string> paths;
+	for (int k = 0; k < count; k++)
+	{
+		char path[64];
+		snprintf(path, sizeof(path), "stress_sound_%d.bin", k);
+		FILE *file = fopen(path, "wb");
+		if (file == NULL)
+			return std::vector<std::string>();
+		for (size_t i = 0; i < size; i++)
+			fputc((int)((i * (k + 1) + k) & 0xFF), file);
+		fclose(file);
+		paths.push_back(path);
+	}
+	return paths;
+}
+
+//Whether a sound holds the bytes of a file written by WriteSounds
+static bool SoundOf(void *sound, const std::string &path)
+{
+	FILE *file = fopen(path.c_str(), "rb");
+	if (file == NULL)
+		return false;
+	std::vector<unsigned char> bytes;
+	for (int c = fgetc(file); c != EOF; c = fgetc(file))
+		bytes.push_back((unsigned char)c);
+	fclose(file);
+	return *(std::vector<unsigned char> *)sound == bytes;
+}
+
+//Calls Update until it lists a handle, for up to a second
+static bool WaitReady(CSoundBank &bank, int handle)
+{
+	for (int i = 0; i < 1000; i++)
+	{
+		const std::vector<int> &ready = bank.Update();
+		for (size_t r = 0; r < ready.size(); r++)
+			if (ready[r] == handle)
+				return true;
+		std::this_thread::sleep_for(std::chrono::milliseconds(1));
+	}
+	return false;
+}
+
+/*
+	A voice plays an evicted sound, which is handed to the loader thread, and Load reads the same sound again on the
+	game thread before Update takes the read. Update drops the second copy, but must still list the handle for the voice
+	waiting for it
+*/
+static bool SoundBankReload()
+{
+	std::vector<std::string> paths = WriteSounds(2, 4096);
+	if (!Check(paths.size() == 2, "sound files written"))
+		return false;
+	CTestSoundLoader loader;
+	bool passed;
+	{
+		CSoundBank bank(loader, 4096);
+		int first = bank.Load(paths[0].c_str());
+		int second = bank.Load(paths[1].c_str()); //Evicts the first
+		passed = Check(first >= 0 && second >= 0 && bank.Play(first) == NULL && bank.isLoading(first), "an evicted sound handed to the loader");
+
+		int again = bank.Load(paths[0].c_str());
+		bool listed = WaitReady(bank, first);
+		void *sound = bank.Play(first);
+		printf("Evicted sound read again by Load while its reload was pending: %s by Update\n", listed ? "listed" : "never listed");
+		passed &= Check(again == first, "the same handle from Load");
+		passed &= Check(listed, "the handle listed by Update");
+		passed &= Check(sound != NULL && SoundOf(sound, paths[0]), "the sound playable once listed");
+		bank.Stop(first);
+		bank.Release(again);
+		bank.Release(first);
+		bank.Release(second);
+	}
+	passed &= Check(loader.getLive() == 0, "the duplicate sound released");
+	for (size_t k = 0; k < paths.size(); k++)
+		remove(paths[k].c_str());
+	return passed;
+}
+
+/*
+	The game thread loads, plays, stops and releases eight sounds in a random order against a budget of three, so sounds
+	are evicted and handed to the loader thread all the time. Every sound played must hold the bytes of its file, every
+	voice waiting for a sound must get it, and no sound may be leaked
+*/
+static bool SoundBank()
+{
+	const int sounds = 8;
+	const size_t size = 4096;
+	std::vector<std::string> paths = WriteSounds(sounds, size);
+	if (!Check(paths.size() == sounds, "sound files written"))
+		return false;
+
+	CTestSoundLoader loader;
+	std::vector<int> handles(sounds, -1), refs(sounds, 0);
+	std::vector<bool> waiting(sounds, false);
+	std::vector<int> playing; // A sound per voice playing
+	int plays = 0, wrong = 0, stranded = 0;
+	sound_bank_stats_t stats;
+	{
+		CSoundBank bank(loader, 3 * size);
+		std::minstd_rand random(1);
+
+		//Starts a voice on a sound, or leaves it waiting
+		auto play = [&](int k)
+		{
+			void *sound = bank.Play(handles[k]);
+			waiting[k] = sound == NULL;
+			if (sound)
+			{
+				plays++;
+				wrong += !SoundOf(sound, paths[k]);
+				playing.push_back(k);
+			}
+		};
+		//Starts the voices waiting for the sounds the loader has read
+		auto update = [&]()
+		{
+			const std::vector<int> &ready = bank.Update();
+			for (size_t r = 0; r < ready.size(); r++)
+				for (int k = 0; k < sounds; k++)
+					if (handles[k] == ready[r] && waiting[k])
+						play(k);
+		};
+
+		for (int i = 0; i < 20000; i++)
+		{
+			int k = (int)(random() % sounds);
+			bool voices = std::find(playing.begin(), playing.end(), k) != playing.end();
+			switch (random() % 5)
+			{
+			case 0:
+				handles[k] = bank.Load(paths[k].c_str());
+				refs[k]++;
+				break;
+			case 1:
+				//The last handle of a sound is only given back once its voices have stopped
+				if (refs[k] > 1 || (refs[k] == 1 && !voices))
+				{
+					bank.Release(handles[k]);
+					if (--refs[k] == 0)
+					{
+						handles[k] = -1;
+						waiting[k] = false;
+					}
+				}
+				break;
+			case 2:
+				if (refs[k] > 0)
+					play(k);
+				break;
+			case 3:
+				if (!playing.empty())
+				{
+					size_t v = random() % playing.size();
+					bank.Stop(handles[playing[v]]);
+					playing[v] = playing.back();
+					playing.pop_back();
+				}
+				break;
+			default:
+				update();
+				break;
+			}
+			if (i % 64 == 0)
+				std::this_thread::yield();
+		}
+
+		//Every voice still waiting must get its sound
+		for (size_t v = 0; v < playing.size(); v++)
+			bank.Stop(handles[playing[v]]);
+		playing.clear();
+		for (int i = 0; i < 2000 && std::find(waiting.begin(), waiting.end(), true) != waiting.end(); i++)
+		{
+			update();
+			std::this_thread::sleep_for(std::chrono::milliseconds(1));
+		}
+		stranded = (int)std::count(waiting.begin(), waiting.end(), true);
+		for (size_t v = 0; v < playing.size(); v++)
+			bank.Stop(handles[playing[v]]);
+
+		bank.SetBudget(3 * size);
+		stats = bank.getStats();
+		for (int k = 0; k < sounds; k++)
+			for (; refs[k] > 0; refs[k]--)
+				bank.Release(handles[k]);
+	}
+	for (size_t k = 0; k < paths.size(); k++)
+		remove(paths[k].c_str());
+
+	printf("%d sounds played, %u misses, %u evictions, %d played with the wrong bytes, %d voices never given their sound, %d sounds leaked\n",
+		plays, stats.misses, stats.evictions, wrong, stranded, loader.getLive());
+	return Check(stats.evictions > 0, "sounds evicted") & Check(wrong == 0, "every sound played with the bytes of its file") &
+		Check(stranded == 0, "every waiting voice given its sound") & Check(stats.bytesResident <= stats.budget, "the budget kept once the voices stop") &
+		Check(loader.getLive() == 0, "no sound leaked");
+}
+
+// A looping stereo source whose frame n holds n on the left and -n on the right, decoded as slowly as a disk may be
+class CRampSource : public CStreamSource
+{
+public:
+	CRampSource(unsigned int frames, int delayMs) : m_frames(frames), m_delayMs(delayMs), m_position(0) {}
+
+	unsigned int Decode(float *out, unsigned int frames)
+	{
+		std::this_thread::sleep_for(std::chrono::milliseconds(m_delayMs));
+		unsigned int n = frames < m_frames - m_position ? frames : m_frames - m_position;
+		for (unsigned int i = 0; i < n; i++)
+		{
+			out[i * 2] = (float)(m_position + i);
+			out[i * 2 + 1] = -(float)(m_position + i);
+		}
+		m_position += n;
+		return n;
+	}
+	bool Rewind() { m_position = 0; return true; }
+	int getChannels() { return 2; }
+	int getSampleRate() { return 44100; }
+	unsigned int getFrames() { return m_frames; }
+
+private:
+	unsigned int m_frames;
+	int m_delayMs;
+	unsigned int m_position;
+};
+
+/*
+	The game thread adds streams to the prefetcher while the mixer thread reads them, then removes them. The last source
+	decodes slowly, and removing the others must not wait for it. Every frame read must follow the one before it
+*/
+static bool Prefetcher()
+{
+	const int rounds = 20;
+	const int streams = 4;
+	const unsigned int frames = 10000;
+	const int slowMs = 50;
+	CStreamPrefetcher prefetcher;
+	long wrong = 0, read = 0;
+	double slowestRemove = 0.0;
+
+	for (int r = 0; r < rounds; r++)
+	{
+		std::vector<CAudioStream *> list;
+		for (int s = 0; s < streams; s++)
+		{
+			list.push_back(new CAudioStream(new CRampSource(frames, s == streams - 1 ? slowMs : 0), true, 8192));
+			prefetcher.Add(list[s], 1024);
+		}
+
+		std::atomic<bool> stop(false);
+		std::thread mixer([&]
+		{
+			std::vector<unsigned int> next(streams, 0);
+			std::vector<float> out(2 * 256);
+			while (!stop.load(std::memory_order_relaxed))
+			{
+				for (int s = 0; s < streams; s++)
+				{
+					unsigned int n = list[s]->Read(out.data(), 256);
+					for (unsigned int i = 0; i < n; i++)
+					{
+						wrong += out[i * 2] != (float)next[s] || out[i * 2 + 1] != -(float)next[s];
+						next[s] = next[s] + 1 == frames ? 0 : next[s] + 1;
+					}
+					read += n;
+				}
+				std::this_thread::sleep_for(std::chrono::milliseconds(1));
+			}
+		});
+		std::this_thread::sleep_for(std::chrono::milliseconds(60));
+		stop.store(true, std::memory_order_relaxed);
+		mixer.join();
+
+		//The fast streams go first, most likely while the slow one is being filled
+		for (int s = 0; s < streams; s++)
+		{
+			std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+			prefetcher.Remove(list[s]);
+			double ms = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+			if (s < streams - 1 && ms > slowestRemove)
+				slowestRemove = ms;
+			delete list[s];
+		}
+	}
+
+	printf("%ld frames read from %d rounds of %d streams, %ld out of order, slowest removal of a fast stream %.3f ms\n",
+		read, rounds, streams, wrong, slowestRemove);
+	return Check(read > 0, "frames read") & Check(wrong == 0, "every frame in order") &
+		Check(slowestRemove < slowMs / 2, "removing a stream doesn't wait for the fill of another");
+}
+
+/*
+	The game thread points a voice at samples of 1 to 8 channels, and at silence, while the audio thread reads it in
+	stereo. Each sample holds a different constant, so every frame read must be silence or the constant of one sample in
+	both channels, within the error of the codec. Start runs in the per-frame update, so it must not allocate, whatever the channels of the sample
+*/
+static bool AdpcmVoice()
+{
+	const int channels[] = { 1, 2, 6, 8 };
+	const int samples = (int)(sizeof(channels) / sizeof(channels[0]));
+	const unsigned int frames = 3000;
+	std::vector<CAdpcmSample> sample(samples);
+	std::vector<float> level(samples);
+	for (int k = 0; k < samples; k++)
+	{
+		level[k] = 0.1f * (k + 1);
+		std::vector<float> pcm((size_t)frames * channels[k], level[k]);
+		sample[k].Encode(pcm.data(), channels[k], 44100, frames);
+	}
+
+	CAdpcmVoice voice;
+	std::atomic<bool> stop(false);
+	long wrong = 0, blocks = 0;
+	std::thread audio([&]
+	{
+		std::vector<float> out(2 * 512);
+		while (!stop.load(std::memory_order_relaxed))
+		{
+			voice.Read(out.data(), 512, 2);
+			for (int n = 0; n < 512; n++)
+			{
+				bool known = out[n * 2] == 0.0f && out[n * 2 + 1] == 0.0f;
+				for (int k = 0; k < samples && !known; k++)
+					known = fabsf(out[n * 2] - level[k]) < 0.02f && fabsf(out[n * 2 + 1] - level[k]) < 0.02f;
+				wrong += !known;
+			}
+			blocks++;
+		}
+	});
+
+	unsigned long long before = allocations;
+	for (int i = 0; i < 20000; i++)
+	{
+		int k = i % (samples + 1);
+		voice.Start(k < samples ? &sample[k] : NULL, (unsigned int)i * 7);
+		if (i % 16 == 0)
+			std::this_thread::yield();
+	}
+	unsigned long long startAllocations = allocations - before;
+	stop.store(true, std::memory_order_relaxed);
+	audio.join();
+
+	printf("20000 samples of 1 to 8 channels started while %ld blocks were read, %ld frames wrong, %llu allocations by Start\n",
+		blocks, wrong, startAllocations);
+	return Check(wrong == 0, "every frame silent or from one sample") & Check(startAllocations == 0, "no allocation in Start");
+}
+
+// A case and the function that runs it
+typedef struct
+{
+	const char *name;
+	bool (*run)();
+} stress_case_t;
+
+static const stress_case_t CASES[] =
+{
+	{ "filterdsp", FilterDsp },
+	{ "filterdsppool", FilterDspPool },
+	{ "adpcmvoice", AdpcmVoice },
+	{ "firdesign", FirDesign },
+	{ "prefetcher", Prefetcher },
+	{ "soundbank", SoundBank },
+	{ "soundbankreload", SoundBankReload },
+};
+
+int main(int argc, char **argv)
+{
+	bool found = false;
+	for (size_t i = 0; i < sizeof(CASES) / sizeof(CASES[0]); i++)
+	{
+		if (argc > 1 && strcmp(argv[1], CASES[i].name) != 0)
+			continue;
+		found = true;
+		if (!CASES[i].run())
+			return 1;
+	}
+	if (!found)
+		printf("No case is called %s\n", argv[1]);
+	return found ? 0 : 1;
+}
@@ -0,0 +1,94 @@
+// Checks that removing a playing emitter gives its voice back: emitters around the listener are removed while they
+// play, with or without a voice, and added again at the same index, as the sound sources of a level come and go. The
+// voices must stay shared between the emitters playing, with none lost or bound to two emitters.
+//
+// Usage: VoiceManagerTest
+#include <cstdio>
+#include <vector>
+#include "../EmitterTable.h"
+#include "../VoiceManager.h"
+
+static const int VOICES = 4;
+static const int EMITTERS = 8;
+static const int ROUNDS = 1000;
+
+//Returns false and prints the check if it failed
+static bool Check(bool passed, const char *check)
+{
+	if (!passed)
+		printf("FAIL %s\n", check);
+	return passed;
+}
+
+//Checks that every voice is used by one playing emitter at most, and counts the emitters that have one
+static bool Consistent(const CEmitterTable &emitters, const CVoiceManager &voices, int *real)
+{
+	std::vector<int> users(VOICES, 0);
+	*real = 0;
+	for (int e = 0; e < emitters.getRange(); e++)
+	{
+		int voice = emitters.isLive(e) ? emitters.getVoice(e) : CEmitterTable::NO_VOICE;
+		if (voice == CEmitterTable::NO_VOICE)
+			continue;
+		if (voice < 0 || voice >= VOICES || !voices.isPlaying(e))
+			return false;
+		users[voice]++;
+		(*real)++;
+	}
+	for (int v = 0; v < VOICES; v++)
+		if (users[v] > 1)
+			return false;
+	return *real == voices.getReal();
+}
+
+int main()
+{
+	CEmitterTable emitters;
+	emitters.Reserve(EMITTERS);
+	CVoiceManager voices(emitters, VOICES);
+	voices.Reserve(EMITTERS);
+	voices.SetDistances(1.0f, 500.0f);
+	const float listener[3] = { 0.0f, 0.0f, 0.0f };
+
+	//Twice as many emitters as voices, all audible
+	for (int i = 0; i < EMITTERS; i++)
+	{
+		emitters.Add(10.0f * (i + 1), 0.0f, 0.0f);
+		voices.Play(i, 1.0f, 1.0f);
+	}
+	voices.Update(16.0f, listener);
+	int real = 0;
+	bool passed = Check(Consistent(emitters, voices, &real) && real == VOICES, "every voice used before the removals");
+
+	int reused = 0, inconsistent = 0, lost = 0;
+	for (int r = 0; r < ROUNDS; r++)
+	{
+		//Removes a real emitter most rounds and a virtual one the others, and adds one back where it was
+		int emitter = r % EMITTERS;
+		float position[3];
+		emitters.getPosition(emitter, position);
+		voices.Remove(emitter);
+		int added = emitters.Add(position[0], position[1], position[2]);
+		reused += added == emitter;
+		voices.Play(added, 1.0f, 1.0f);
+		voices.Update(16.0f, listener);
+
+		if (!Consistent(emitters, voices, &real))
+			inconsistent++;
+		else if (real != VOICES)
+			lost++;
+	}
+
+	//Once every emitter is removed, every voice is free again
+	for (int i = 0; i < EMITTERS; i++)
+		voices.Remove(i);
+	voices.Update(16.0f, listener);
+
+	printf("%d playing emitters removed and added again (%d at the same index), %d updates with voices bound wrongly, %d with voices lost\n",
+		ROUNDS, reused, inconsistent, lost);
+	passed &= Check(reused == ROUNDS, "the index of the removed emitter reused");
+	passed &= Check(inconsistent == 0, "every voice used by one playing emitter at most");
+	passed &= Check(lost == 0, "the free voice count unchanged by the removals");
+	passed &= Check(voices.getReal() == 0 && voices.getPlaying() == 0 && emitters.getActive() == 0, "every voice free once the emitters are removed");
+	return passed ? 0 : 1;
+}
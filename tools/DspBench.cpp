@@ -0,0 +1,501 @@
+// Microbenchmark of the dynamic filter DSP. Drives the read callback of the "Control FIR filter" DSP through a stand-in
+// for FMOD_DSP_STATE, sweeping block lengths, channel counts, filter lengths and engines, and reports the cost per
+// sample, the cycles per tap and the real-time factor. The JSON output can be kept and compared between releases.
+//
+// Usage: DspBench [options]
+//   --lengths a,b,...      Block lengths in frames (64,256,1024,4096)
+//   --channels a,b,...     Channel counts (1,2,6,8)
+//   --taps a,b,...         Filter lengths (3,16,64,256,1024,4096)
+//   --modes a,b,...        Engines: fir, iir, multirate (fir,iir,multirate)
+//   --kernels              Also run the direct form FIR engine with every FIR kernel the CPU supports
+//   --hrtf voices          Also run that many HRTF DSPs at once, with their directions moving every block (0)
+//   --ambisonic voices     Also run that many voices through the ambisonic bus and its binaural decoder (0)
+//   --adpcm voices         Also decode that many stereo ADPCM samples at once, as the voices of the 3D sounds do (0)
+//   --rate hz              Sample rate (48000)
+//   --min-time ms          Time each configuration runs for (50)
+//   --json file            Write the results as JSON, "-" for the standard output
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <cmath>
+#include <chrono>
+#include <string>
+#include <vector>
+#include "../FilterDsp.h"
+#include "../FirKernels.h"
+#include "../HrtfDsp.h"
+#include "../AmbisonicDsp.h"
+#include "../AdpcmSample.h"
+
+#if defined(_MSC_VER) && (defined(_M_X64) || defined(_M_IX86))
+#include <intrin.h>
+#define BENCH_RDTSC
+#elif defined(__x86_64__) || defined(__i386__)
+#include <x86intrin.h>
+#define BENCH_RDTSC
+#endif
+
+#ifndef M_PI
+#define M_PI 3.14159265358979323846
+#endif
+
+// Stand-in for FMOD_DSP_STATE: the DSP callbacks only use its plugindata
+typedef struct
+{
+	void *instance;
+	void *plugindata;
+} bench_dsp_state_t;
+
+//The read callback of the dynamic filter DSP, as CAudio::DSPCallback
+static int BenchDSPCallback(bench_dsp_state_t *dsp_state, float *inbuffer, float *outbuffer, unsigned int length, int inchannels, int *outchannels)
+{
+	CFilterDsp *thisdsp = (CFilterDsp *)dsp_state->plugindata;
+	thisdsp->Read(inbuffer, outbuffer, length, inchannels, *outchannels);
+	return 0;
+}
+
+// The result of one configuration
+typedef struct
+{
+	std::string mode; // Requested mode, the engine it ran on can differ
+	std::string engine;
+	std::string kernel;
+	int taps;
+	int channels;
+	int length;
+	double nsPerSample;
+	double cyclesPerTap; // Negative when the time stamp counter isn't available
+	double realtimeFactor;
+} bench_result_t;
+
+//Time stamp counter, in reference cycles
+static unsigned long long Cycles()
+{
+#ifdef BENCH_RDTSC
+	return __rdtsc();
+#else
+	return 0;
+#endif
+}
+
+//Parses a comma separated list of numbers
+static std::vector<int> ParseList(const char *text)
+{
+	std::vector<int> values;
+	while (*text)
+	{
+		values.push_back(atoi(text));
+		const char *comma = strchr(text, ',');
+		if (!comma)
+			break;
+		text = comma + 1;
+	}
+	return values;
+}
+
+//Hann windowed sinc low pass filter
+static std::vector<float> LowPass(int taps, float cutoff, float fs)
+{
+	std::vector<float> h(taps);
+	double fc = cutoff / fs;
+	for (int i = 0; i < taps; i++)
+	{
+		double x = i - (taps - 1) / 2.0;
+		double sinc = x == 0.0 ? 2.0 * fc : sin(2.0 * M_PI * fc * x) / (M_PI * x);
+		double window = taps > 1 ? 0.5 - 0.5 * cos(2.0 * M_PI * i / (taps - 1)) : 1.0;
+		h[i] = (float)(sinc * window);
+	}
+	return h;
+}
+
+//Runs one configuration for at least minTime seconds
+static bench_result_t Run(const CFilterBank &bank, FilterMode mode, int channels, int length, float fs, double minTime)
+{
+	CFilterDsp *dsp = new CFilterDsp(bank, FILTER_MODE_FIR);
+	dsp->SetMode(mode);
+	bench_dsp_state_t state;
+	state.instance = NULL;
+	state.plugindata = dsp;
+
+	std::vector<float> in((size_t)length * channels), out((size_t)length * channels);
+	for (size_t i = 0; i < in.size(); i++)
+		in[i] = (float)rand() / RAND_MAX - 0.5f;
+
+	//The control moves every block, as it does in the game
+	int outchannels = channels;
+	for (int warmup = 0; warmup < 4; warmup++)
+		BenchDSPCallback(&state, in.data(), out.data(), length, channels, &outchannels);
+
+	CDynamicFilter probe(bank, mode);
+	static const char *modeNames[] = { "fir", "iir", "multirate" };
+	bench_result_t result;
+	result.mode = modeNames[mode];
+	result.engine = probe.getEngineName();
+	result.kernel = result.engine == "direct" ? CFirKernels::getName() : "";
+
+	long long blocks = 0;
+	double elapsed = 0.0;
+	unsigned long long cycles = 0;
+	std::chrono::high_resolution_clock::time_point start = std::chrono::high_resolution_clock::now();
+	unsigned long long startCycles = Cycles();
+	while (elapsed < minTime || blocks < 8)
+	{
+		dsp->SetControl(0, (float)(blocks % 100) / 99.0f);
+		BenchDSPCallback(&state, in.data(), out.data(), length, channels, &outchannels);
+		blocks++;
+		elapsed = std::chrono::duration<double>(std::chrono::high_resolution_clock::now() - start).count();
+	}
+	cycles = Cycles() - startCycles;
+
+	double samples = (double)blocks * length * channels;
+	result.taps = bank.getTaps();
+	result.channels = channels;
+	result.length = length;
+	result.nsPerSample = elapsed * 1e9 / samples;
+	result.cyclesPerTap = cycles > 0 ? cycles / samples / result.taps : -1.0;
+	result.realtimeFactor = blocks * length / fs / elapsed;
+
+	delete dsp;
+	return result;
+}
+
+// The result of the HRTF DSPs or of the ambisonic bus
+typedef struct
+{
+	int voices;
+	int length;
+	double nsPerSample; // Per voice
+	double load; // Percent of one core all the voices take
+} hrtf_result_t;
+
+/*
+	The voices share a set modelled at the sample rate, as when the game has no measured one. Every voice turns by a
+	few degrees per block, so every block is crossfaded, the worst case
+*/
+static hrtf_result_t RunHrtf(int voices, int length, float fs, double minTime)
+{
+	CHrirSet set;
+	set.Generate((int)fs);
+	set.Transform(128);
+	std::vector<CHrtfDsp *> dsps(voices);
+	for (int v = 0; v < voices; v++)
+	{
+		dsps[v] = new CHrtfDsp(set);
+		dsps[v]->Prepare(length);
+	}
+
+	std::vector<float> in(length), out((size_t)length * 2);
+	for (int i = 0; i < length; i++)
+		in[i] = (float)rand() / RAND_MAX - 0.5f;
+
+	long long blocks = 0;
+	double elapsed = 0.0;
+	std::chrono::high_resolution_clock::time_point start = std::chrono::high_resolution_clock::now();
+	while (elapsed < minTime || blocks < 8)
+	{
+		for (int v = 0; v < voices; v++)
+		{
+			hrtf_direction_t direction = { (float)(blocks * 3 + v * 10), (float)((blocks + v) % 90 - 45) };
+			dsps[v]->SetDirection(direction);
+			dsps[v]->Read(in.data(), out.data(), length, 1, 2);
+		}
+		blocks++;
+		elapsed = std::chrono::duration<double>(std::chrono::high_resolution_clock::now() - start).count();
+	}
+
+	hrtf_result_t result;
+	result.voices = voices;
+	result.length = length;
+	result.nsPerSample = elapsed * 1e9 / ((double)blocks * length * voices);
+	result.load = 100.0 * elapsed / (blocks * length / fs);
+	for (int v = 0; v < voices; v++)
+		delete dsps[v];
+	return result;
+}
+
+/*
+	Every voice is encoded by its own encoder DSP and summed into the bus, which FMOD does in the game, and the bus is
+	decoded once for the ears. The voices move every block, so every block ramps the gains and rotates the bus
+*/
+static hrtf_result_t RunAmbisonic(int voices, int length, float fs, double minTime)
+{
+	const int channels = CAmbisonicEncoder::CHANNELS;
+	CHrirSet set;
+	set.Generate((int)fs);
+	set.Transform(128);
+	std::vector<CAmbisonicEncoderDsp *> encoders(voices);
+	for (int v = 0; v < voices; v++)
+		encoders[v] = new CAmbisonicEncoderDsp();
+	CAmbisonicDecoderDsp decoder(set);
+	decoder.Prepare(length);
+
+	std::vector<float> in(length), encoded((size_t)length * channels), bus((size_t)length * channels), out((size_t)length * 2);
+	for (int i = 0; i < length; i++)
+		in[i] = (float)rand() / RAND_MAX - 0.5f;
+
+	long long blocks = 0;
+	double elapsed = 0.0;
+	std::chrono::high_resolution_clock::time_point start = std::chrono::high_resolution_clock::now();
+	while (elapsed < minTime || blocks < 8)
+	{
+		std::fill(bus.begin(), bus.end(), 0.0f);
+		for (int v = 0; v < voices; v++)
+		{
+			float angle = (blocks * 3 + v * 10) * 3.14159265f / 180.0f;
+			ambisonic_gains_t gains;
+			CAmbisonicEncoder::Encode(cosf(angle), sinf(angle), 0.0f, gains.gains);
+			encoders[v]->SetGains(gains);
+			encoders[v]->Read(in.data(), encoded.data(), length, 1);
+			for (size_t i = 0; i < bus.size(); i++)
+				bus[i] += encoded[i];
+		}
+		float axes[9] = { cosf(blocks * 0.01f), sinf(blocks * 0.01f), 0.0f, -sinf(blocks * 0.01f), cosf(blocks * 0.01f), 0.0f, 0.0f, 0.0f, 1.0f };
+		ambisonic_rotation_t rotation;
+		CAmbisonicEncoder::Rotation(axes, rotation.matrix);
+		decoder.SetRotation(rotation);
+		decoder.Read(bus.data(), out.data(), length, channels, 2);
+		blocks++;
+		elapsed = std::chrono::duration<double>(std::chrono::high_resolution_clock::now() - start).count();
+	}
+
+	hrtf_result_t result;
+	result.voices = voices;
+	result.length = length;
+	result.nsPerSample = elapsed * 1e9 / ((double)blocks * length * voices);
+	result.load = 100.0 * elapsed / (blocks * length / fs);
+	for (int v = 0; v < voices; v++)
+		delete encoders[v];
+	return result;
+}
+
+/*
+	Every voice plays its own ten second stereo sample, a tone over noise, from its own frame, so the voices don't share
+	the blocks in the cache. Reports per sample of each channel
+*/
+static hrtf_result_t RunAdpcm(int voices, int length, float fs, double minTime, double &ratio)
+{
+	const int channels = 2;
+	unsigned int frames = (unsigned int)(fs * 10.0f);
+	std::vector<float> pcm((size_t)frames * channels);
+	for (unsigned int i = 0; i < frames; i++)
+		for (int c = 0; c < channels; c++)
+			pcm[(size_t)i * channels + c] = 0.4f * sinf(2.0f * 3.14159265f * (220.0f + 110.0f * c) * i / fs) + 0.1f * ((float)rand() / RAND_MAX - 0.5f);
+	std::vector<CAdpcmSample *> samples(voices);
+	std::vector<CAdpcmVoice *> decoders(voices);
+	for (int v = 0; v < voices; v++)
+	{
+		samples[v] = new CAdpcmSample();
+		samples[v]->Encode(pcm.data(), channels, (int)fs, frames);
+		decoders[v] = new CAdpcmVoice();
+		decoders[v]->Start(samples[v], (unsigned int)((unsigned long long)frames * v / voices));
+	}
+	ratio = (double)frames * channels * sizeof(short) / samples[0]->getBytes();
+
+	std::vector<float> out((size_t)length * channels);
+	long long blocks = 0;
+	double elapsed = 0.0;
+	std::chrono::high_resolution_clock::time_point start = std::chrono::high_resolution_clock::now();
+	while (elapsed < minTime || blocks < 8)
+	{
+		for (int v = 0; v < voices; v++)
+			decoders[v]->Read(out.data(), length, channels);
+		blocks++;
+		elapsed = std::chrono::duration<double>(std::chrono::high_resolution_clock::now() - start).count();
+	}
+
+	hrtf_result_t result;
+	result.voices = voices;
+	result.length = length;
+	result.nsPerSample = elapsed * 1e9 / ((double)blocks * length * channels * voices);
+	result.load = 100.0 * elapsed / (blocks * length / fs);
+	for (int v = 0; v < voices; v++)
+	{
+		delete decoders[v];
+		delete samples[v];
+	}
+	return result;
+}
+
+//Writes the results of the HRTF DSPs or of the ambisonic bus as a JSON array
+static void WriteJsonVoices(FILE *file, const char *name, const std::vector<hrtf_result_t> &voices)
+{
+	if (voices.empty())
+		return;
+	fprintf(file, "  \"%s\": [\n", name);
+	for (unsigned int i = 0; i < voices.size(); i++)
+		fprintf(file, "    { \"voices\": %d, \"length\": %d, \"ns_per_sample\": %.4f, \"load\": %.3f }%s\n", voices[i].voices, voices[i].length,
+			voices[i].nsPerSample, voices[i].load, i + 1 < voices.size() ? "," : "");
+	fprintf(file, "  ],\n");
+}
+
+//Writes the results as JSON
+static void WriteJson(FILE *file, const std::vector<bench_result_t> &results, const std::vector<hrtf_result_t> &hrtf, const std::vector<hrtf_result_t> &ambisonic,
+	const std::vector<hrtf_result_t> &adpcm, float fs)
+{
+	fprintf(file, "{\n  \"sample_rate\": %.0f,\n  \"kernel\": \"%s\",\n", fs, CFirKernels::getName());
+	WriteJsonVoices(file, "hrtf", hrtf);
+	WriteJsonVoices(file, "ambisonic", ambisonic);
+	WriteJsonVoices(file, "adpcm", adpcm);
+	fprintf(file, "  \"results\": [\n");
+	for (unsigned int i = 0; i < results.size(); i++)
+	{
+		const bench_result_t &r = results[i];
+		fprintf(file, "    { \"mode\": \"%s\", \"engine\": \"%s\", \"kernel\": \"%s\", \"taps\": %d, \"channels\": %d, \"length\": %d, "
+			"\"ns_per_sample\": %.4f, \"cycles_per_tap\": ", r.mode.c_str(), r.engine.c_str(), r.kernel.c_str(), r.taps, r.channels, r.length, r.nsPerSample);
+		if (r.cyclesPerTap >= 0.0)
+			fprintf(file, "%.4f", r.cyclesPerTap);
+		else
+			fprintf(file, "null");
+		fprintf(file, ", \"realtime_factor\": %.2f }%s\n", r.realtimeFactor, i + 1 < results.size() ? "," : "");
+	}
+	fprintf(file, "  ]\n}\n");
+}
+
+int main(int argc, char **argv)
+{
+	std::vector<int> lengths = { 64, 256, 1024, 4096 };
+	std::vector<int> channelCounts = { 1, 2, 6, 8 };
+	std::vector<int> tapCounts = { 3, 16, 64, 256, 1024, 4096 };
+	std::vector<FilterMode> modes = { FILTER_MODE_FIR, FILTER_MODE_IIR, FILTER_MODE_MULTIRATE };
+	bool allKernels = false;
+	int hrtfVoices = 0;
+	int ambisonicVoices = 0;
+	int adpcmVoices = 0;
+	float fs = 48000.0f;
+	double minTime = 0.05;
+	const char *jsonFile = NULL;
+
+	for (int i = 1; i < argc; i++)
+	{
+		bool value = i + 1 < argc;
+		if (!strcmp(argv[i], "--lengths") && value)
+			lengths = ParseList(argv[++i]);
+		else if (!strcmp(argv[i], "--channels") && value)
+			channelCounts = ParseList(argv[++i]);
+		else if (!strcmp(argv[i], "--taps") && value)
+			tapCounts = ParseList(argv[++i]);
+		else if (!strcmp(argv[i], "--modes") && value)
+		{
+			modes.clear();
+			std::string list = argv[++i];
+			if (list.find("fir") != std::string::npos)
+				modes.push_back(FILTER_MODE_FIR);
+			if (list.find("iir") != std::string::npos)
+				modes.push_back(FILTER_MODE_IIR);
+			if (list.find("multirate") != std::string::npos)
+				modes.push_back(FILTER_MODE_MULTIRATE);
+		}
+		else if (!strcmp(argv[i], "--kernels"))
+			allKernels = true;
+		else if (!strcmp(argv[i], "--hrtf") && value)
+			hrtfVoices = atoi(argv[++i]);
+		else if (!strcmp(argv[i], "--ambisonic") && value)
+			ambisonicVoices = atoi(argv[++i]);
+		else if (!strcmp(argv[i], "--adpcm") && value)
+			adpcmVoices = atoi(argv[++i]);
+		else if (!strcmp(argv[i], "--rate") && value)
+			fs = (float)atof(argv[++i]);
+		else if (!strcmp(argv[i], "--min-time") && value)
+			minTime = atof(argv[++i]) / 1000.0;
+		else if (!strcmp(argv[i], "--json") && value)
+			jsonFile = argv[++i];
+		else
+		{
+			fprintf(stderr, "Unknown option %s\n", argv[i]);
+			return 2;
+		}
+	}
+
+	CFirKernels::Select();
+	FirIsa best = CFirKernels::getIsa();
+	std::vector<bench_result_t> results;
+
+	//The table goes to the standard error when the JSON takes the standard output
+	FILE *table = jsonFile && strcmp(jsonFile, "-") == 0 ? stderr : stdout;
+	fprintf(table, "%-10s %-10s %-8s %6s %4s %6s %12s %12s %12s\n", "mode", "engine", "kernel", "taps", "ch", "length", "ns/sample", "cycles/tap", "x realtime");
+	for (unsigned int t = 0; t < tapCounts.size(); t++)
+	{
+		//Two low pass filters the external control morphs between
+		CFilterBank bank;
+		bank.Build(LowPass(tapCounts[t], 3000.0f, fs), LowPass(tapCounts[t], 1000.0f, fs), fs);
+
+		for (unsigned int m = 0; m < modes.size(); m++)
+		{
+			for (unsigned int c = 0; c < channelCounts.size(); c++)
+			{
+				for (unsigned int l = 0; l < lengths.size(); l++)
+				{
+					//The direct form engine is run with each kernel when asked to, the others with the best one
+					int lastIsa = allKernels && modes[m] == FILTER_MODE_FIR ? (int)best : (int)FIR_ISA_SCALAR;
+					for (int isa = lastIsa; isa >= 0; isa--)
+					{
+						CFirKernels::Select(allKernels && modes[m] == FILTER_MODE_FIR ? (FirIsa)isa : best);
+						bench_result_t r = Run(bank, modes[m], channelCounts[c], lengths[l], fs, minTime);
+						CFirKernels::Select(best);
+						if (r.engine != "direct" && isa != lastIsa)
+							break; //Only the direct form engine uses the kernels
+						results.push_back(r);
+						fprintf(table, "%-10s %-10s %-8s %6d %4d %6d %12.3f %12.4f %12.1f\n", r.mode.c_str(), r.engine.c_str(), r.kernel.c_str(), r.taps, r.channels,
+							r.length, r.nsPerSample, r.cyclesPerTap, r.realtimeFactor);
+					}
+				}
+			}
+		}
+	}
+
+	//The HRTF DSPs of every voice together, in percent of one core
+	std::vector<hrtf_result_t> hrtfResults;
+	if (hrtfVoices > 0)
+	{
+		fprintf(table, "\n%-6s %6s %12s %12s\n", "voices", "length", "ns/sample", "load %");
+		for (unsigned int l = 0; l < lengths.size(); l++)
+		{
+			hrtf_result_t r = RunHrtf(hrtfVoices, lengths[l], fs, minTime);
+			hrtfResults.push_back(r);
+			fprintf(table, "%-6d %6d %12.3f %12.2f\n", r.voices, r.length, r.nsPerSample, r.load);
+		}
+	}
+
+	//The encoders of every voice and the decoder of the ambisonic bus together, in percent of one core
+	std::vector<hrtf_result_t> ambisonicResults;
+	if (ambisonicVoices > 0)
+	{
+		fprintf(table, "\n%-6s %6s %12s %12s (ambisonic)\n", "voices", "length", "ns/sample", "load %");
+		for (unsigned int l = 0; l < lengths.size(); l++)
+		{
+			hrtf_result_t r = RunAmbisonic(ambisonicVoices, lengths[l], fs, minTime);
+			ambisonicResults.push_back(r);
+			fprintf(table, "%-6d %6d %12.3f %12.2f\n", r.voices, r.length, r.nsPerSample, r.load);
+		}
+	}
+
+	//The decoders of every voice together, in percent of one core
+	std::vector<hrtf_result_t> adpcmResults;
+	if (adpcmVoices > 0)
+	{
+		double ratio = 0.0;
+		fprintf(table, "\n%-6s %6s %12s %12s (adpcm)\n", "voices", "length", "ns/sample", "load %");
+		for (unsigned int l = 0; l < lengths.size(); l++)
+		{
+			hrtf_result_t r = RunAdpcm(adpcmVoices, lengths[l], fs, minTime, ratio);
+			adpcmResults.push_back(r);
+			fprintf(table, "%-6d %6d %12.3f %12.2f\n", r.voices, r.length, r.nsPerSample, r.load);
+		}
+		fprintf(table, "%.2f times smaller than 16 bit PCM\n", ratio);
+	}
+
+	if (jsonFile)
+	{
+		FILE *file = strcmp(jsonFile, "-") == 0 ? stdout : fopen(jsonFile, "w");
+		if (!file)
+		{
+			fprintf(stderr, "Can't write %s\n", jsonFile);
+			return 1;
+		}
+		WriteJson(file, results, hrtfResults, ambisonicResults, adpcmResults, fs);
+		if (file != stdout)
+			fclose(file);
+	}
+
+	return 0;
+}
@@ -0,0 +1,265 @@
+// Offline renderer of the dynamic filter: reads a WAV file, filters it with the same filter bank as the game while a
+// scripted external control moves, and writes the result. Runs without FMOD or a window, so the DSP can be profiled
+// and checked on any machine.
+//
+// Usage: DspRender input.wav output.wav [options]
+//   --mode fir|iir|multirate   Engine of the dynamic filter (fir)
+//   --taps n                   Length of the designed filters (511)
+//   --bank n                   Filters spanning the external control (16)
+//   --block n                  Frames per block, like the FMOD DSP buffer (1024)
+//   --control c                Constant external control (0)
+//   --curve file               External control curve: lines of "seconds control [depth]", interpolated linearly
+//   --depth d                  Constant depth control, which adds the deep specifications as a second dimension
+//   --channels n               Channels of the output, downmixed or upmixed from the input (as the input)
+//   --pcm16                    Write 16 bit PCM instead of 32 bit float
+//   --compare golden.wav       Compare the output with a reference rendering and fail if it differs
+//   --tolerance dB             Signal to error ratio the comparison must reach (90)
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <cmath>
+#include <chrono>
+#include <vector>
+#include "../WavFile.h"
+#include "../FilterDsp.h"
+#include "../FirKernels.h"
+
+//The specifications of the static filters, as in CAudio
+static const band_spec_t FIR1_SPEC{ { 0, 2000, 2600, 2900, 3500, 22050 }, { 0, 0, 1, 1, 0, 0 }, {} };
+static const band_spec_t FIR2_SPEC{ { 0, 100, 700, 1000, 1600, 22050 }, { 1, 0, 1, 0, 1, 0 }, {} };
+static const band_spec_t FIR1_DEEP_SPEC{ { 0, 1000, 1300, 1450, 1750, 22050 }, { 0, 0, 1, 1, 0, 0 }, {} };
+static const band_spec_t FIR2_DEEP_SPEC{ { 0, 50, 350, 500, 800, 22050 }, { 1, 0, 1, 0, 1, 0 }, {} };
+
+// A point of the control curve
+typedef struct
+{
+	double time;
+	float control;
+	float depth;
+} curve_point_t;
+
+//Reads the control curve. Returns false if the file can't be read
+static bool LoadCurve(const char *filename, std::vector<curve_point_t> &curve)
+{
+	FILE *file = fopen(filename, "r");
+	if (!file)
+		return false;
+
+	char line[256];
+	while (fgets(line, sizeof(line), file))
+	{
+		curve_point_t point;
+		point.depth = 0.0f;
+		int n = sscanf(line, "%lf %f %f", &point.time, &point.control, &point.depth);
+		if (n >= 2)
+			curve.push_back(point);
+	}
+	fclose(file);
+	return !curve.empty();
+}
+
+//Interpolates the control curve at a time
+static void SampleCurve(const std::vector<curve_point_t> &curve, double time, float *controls)
+{
+	if (time <= curve.front().time)
+	{
+		controls[0] = curve.front().control;
+		controls[1] = curve.front().depth;
+		return;
+	}
+	for (unsigned int i = 1; i < curve.size(); i++)
+	{
+		if (time < curve[i].time)
+		{
+			const curve_point_t &a = curve[i - 1], &b = curve[i];
+			float t = (float)((time - a.time) / (b.time - a.time));
+			controls[0] = a.control + t * (b.control - a.control);
+			controls[1] = a.depth + t * (b.depth - a.depth);
+			return;
+		}
+	}
+	controls[0] = curve.back().control;
+	controls[1] = curve.back().depth;
+}
+
+//Signal to error ratio of the output against a reference, in dB
+static double Compare(CWavFile &output, CWavFile &golden, double &maxError)
+{
+	std::vector<float> &a = output.getSamples();
+	std::vector<float> &b = golden.getSamples();
+	double signal = 0.0, error = 0.0;
+	maxError = 0.0;
+	for (size_t i = 0; i < a.size(); i++)
+	{
+		double e = a[i] - b[i];
+		signal += (double)b[i] * b[i];
+		error += e * e;
+		if (fabs(e) > maxError)
+			maxError = fabs(e);
+	}
+	if (error == 0.0)
+		return INFINITY;
+	return 10.0 * log10((signal > 0.0 ? signal : 1e-30) / error);
+}
+
+int main(int argc, char **argv)
+{
+	if (argc < 3)
+	{
+		fprintf(stderr, "Usage: %s input.wav output.wav [--mode fir|iir|multirate] [--taps n] [--bank n] [--block n]\n"
+			"       [--control c] [--curve file] [--depth d] [--channels n] [--pcm16] [--compare golden.wav] [--tolerance dB]\n", argv[0]);
+		return 2;
+	}
+
+	FilterMode mode = FILTER_MODE_FIR;
+	int taps = 511, bankSize = 16, block = 1024, outChannels = 0;
+	float controls[CMorphBank::MAX_DIMENSIONS] = { 0.0f, 0.0f, 0.0f, 0.0f };
+	bool depth = false, pcm16 = false;
+	const char *curveFile = NULL, *goldenFile = NULL;
+	double tolerance = 90.0;
+
+	for (int i = 3; i < argc; i++)
+	{
+		bool value = i + 1 < argc;
+		if (!strcmp(argv[i], "--mode") && value)
+		{
+			const char *m = argv[++i];
+			mode = !strcmp(m, "iir") ? FILTER_MODE_IIR : (!strcmp(m, "multirate") ? FILTER_MODE_MULTIRATE : FILTER_MODE_FIR);
+		}
+		else if (!strcmp(argv[i], "--taps") && value)
+			taps = atoi(argv[++i]);
+		else if (!strcmp(argv[i], "--bank") && value)
+			bankSize = atoi(argv[++i]);
+		else if (!strcmp(argv[i], "--block") && value)
+			block = atoi(argv[++i]);
+		else if (!strcmp(argv[i], "--control") && value)
+			controls[0] = (float)atof(argv[++i]);
+		else if (!strcmp(argv[i], "--curve") && value)
+			curveFile = argv[++i];
+		else if (!strcmp(argv[i], "--depth") && value)
+		{
+			controls[1] = (float)atof(argv[++i]);
+			depth = true;
+		}
+		else if (!strcmp(argv[i], "--channels") && value)
+			outChannels = atoi(argv[++i]);
+		else if (!strcmp(argv[i], "--pcm16"))
+			pcm16 = true;
+		else if (!strcmp(argv[i], "--compare") && value)
+			goldenFile = argv[++i];
+		else if (!strcmp(argv[i], "--tolerance") && value)
+			tolerance = atof(argv[++i]);
+		else
+		{
+			fprintf(stderr, "Unknown option %s\n", argv[i]);
+			return 2;
+		}
+	}
+	if (block < 1)
+		block = 1;
+
+	CWavFile input;
+	if (!input.Load(argv[1]))
+	{
+		fprintf(stderr, "Can't read %s\n", argv[1]);
+		return 1;
+	}
+
+	std::vector<curve_point_t> curve;
+	if (curveFile && !LoadCurve(curveFile, curve))
+	{
+		fprintf(stderr, "Can't read the control curve %s\n", curveFile);
+		return 1;
+	}
+	for (unsigned int i = 0; i < curve.size(); i++)
+		depth = depth || curve[i].depth != 0.0f;
+
+	CFirKernels::Select();
+
+	//The same bank as the game: the music bank, or the submarine speed x depth bank
+	CFilterBank bank;
+	float fs = (float)input.getSampleRate();
+	bool built;
+	if (depth)
+	{
+		std::vector<band_spec_t> corners{ FIR1_SPEC, FIR2_SPEC, FIR1_DEEP_SPEC, FIR2_DEEP_SPEC };
+		built = bank.Build(taps, corners, fs, std::vector<int>{ bankSize, bankSize / 2 > 1 ? bankSize / 2 : 2 });
+	}
+	else
+		built = bank.Build(taps, FIR1_SPEC, FIR2_SPEC, fs, bankSize);
+	if (!built)
+	{
+		fprintf(stderr, "The filter design failed\n");
+		return 1;
+	}
+	if (mode == FILTER_MODE_IIR)
+		printf("IIR sections %s, fit error %.2f dB\n", bank.getSections().getCount() > 0 ? "used" : "rejected", bank.getSectionError());
+
+	//Driven like the DSP: the controls are set and the block is read
+	CFilterDsp filter(bank, mode);
+	filter.getProfiler().SetSampleRate(input.getSampleRate());
+	int inChannels = input.getChannels();
+	int channels = outChannels > 0 ? outChannels : inChannels;
+	unsigned int frames = input.getFrames();
+	CWavFile output;
+	output.Create(channels, input.getSampleRate(), frames);
+	const float *in = input.getSamples().data();
+	float *out = output.getSamples().data();
+
+	//Only the filtering is timed, the control curve is sampled outside of it
+	double seconds = 0.0;
+	for (unsigned int done = 0; done < frames; done += block)
+	{
+		unsigned int n = frames - done < (unsigned int)block ? frames - done : block;
+		if (!curve.empty())
+			SampleCurve(curve, (double)done / fs, controls);
+
+		for (int c = 0; c < CFilterDsp::CONTROLS; c++)
+			filter.SetControl(c, controls[c]);
+		std::chrono::high_resolution_clock::time_point start = std::chrono::high_resolution_clock::now();
+		unsigned long long ticks = CDspProfiler::Now();
+		filter.Read(in + (size_t)done * inChannels, out + (size_t)done * channels, n, inChannels, channels);
+		filter.getProfiler().Record(ticks, n);
+		seconds += std::chrono::duration<double>(std::chrono::high_resolution_clock::now() - start).count();
+	}
+
+	if (!output.Save(argv[2], pcm16))
+	{
+		fprintf(stderr, "Can't write %s\n", argv[2]);
+		return 1;
+	}
+
+	double samples = (double)frames * channels;
+	printf("%s kernel, %d taps, %s engine: %u frames x %d channels in %.3f ms\n", CFirKernels::getName(), filter.getTaps(),
+		filter.getEngineName(), frames, channels, seconds * 1000.0);
+	printf("%.0f samples/second, %.1fx real time\n", seconds > 0.0 ? samples / seconds : 0.0,
+		seconds > 0.0 ? frames / fs / seconds : 0.0);
+	dsp_load_t load = filter.getProfiler().Snapshot();
+	printf("DSP load %.2f%%, p99 block %.2f%%, %u of %u blocks over budget\n", load.load, load.p99, load.overruns, load.blocks);
+
+	//Regression check against a reference rendering
+	if (goldenFile)
+	{
+		CWavFile golden;
+		if (!golden.Load(goldenFile))
+		{
+			fprintf(stderr, "Can't read %s\n", goldenFile);
+			return 1;
+		}
+		if (golden.getChannels() != channels || golden.getFrames() != frames)
+		{
+			fprintf(stderr, "FAIL: %s has a different layout\n", goldenFile);
+			return 1;
+		}
+		//The reference is compared with what was written, so 16 bit renderings compare equal to themselves
+		CWavFile written;
+		written.Load(argv[2]);
+		double maxError;
+		double ser = Compare(written, golden, maxError);
+		printf("%s: %.1f dB signal to error, max error %g\n", ser >= tolerance ? "PASS" : "FAIL", ser, maxError);
+		if (ser < tolerance)
+			return 1;
+	}
+
+	return 0;
+}